@@ -20,6 +20,23 @@ do NOT check to make sure they have been initialized.
 	#define FFT(a,n) if(!fftInit(roundtol(LOG2(n)))) ffts(a,roundtol(LOG2(n)),1);else printf("fft error\n");
 *******************************************************************/
 
+typedef enum {
+	FFT_BACKEND_FFTLIB,	/* the radix 2/4 fftlib, always available */
+	FFT_BACKEND_FFTW	/* planned FFTW transforms, if built with ASF_FFTW */
+} fft_backend_t;
+
+int fftSetBackend(fft_backend_t backend);
+/* select the backend that does the transforms below (the default is FFTW */
+/* if it is built in, or whatever the ASF_FFT_BACKEND environment variable */
+/* says, "fftlib" or "fftw") */
+/* returns 0 on success, 1 if the backend isn't built in */
+
+fft_backend_t fftGetBackend(void);
+/* the backend in use */
+
+const char *fftBackendName(fft_backend_t backend);
+/* "fftlib" or "fftw" */
+
 int fftInit(int M);
 /* malloc and init cosine and bit reversed tables for a given size fft, ifft, rfft, rifft*/
 /* INPUTS */
@@ -28,7 +45,7 @@ int fftInit(int M);
 /* private cosine and bit reversed tables	*/
 
 void fftFree(void);
-/* release storage for all private cosine and bit reversed tables*/
+/* release storage for all private cosine and bit reversed tables, and FFTW plans*/
 
 void ffts(float *data, int M, int Rows);
 /* Compute in-place complex fft on the rows of the input array	*/
@@ -111,6 +111,15 @@ void rifft2d(float *data, int M2, int M);
 /* OUTPUTS */
 /* *data = output data array	*/
 
+void rfft2d_r(float *data, int M2, int M, float *work);
+void rifft2d_r(float *data, int M2, int M, float *work);
+/* Same as rfft2d and rifft2d, but use the caller's storage for columns */
+/* instead of the private storage, so that separate threads can transform */
+/* at once.  fft2dInit must still be called for the sizes, before any */
+/* threads are started, to set up the cosine and bit reversed tables */
+/* INPUTS */
+/* *work = storage for 4 columns, at least 4*2*pow(2,M2) floats */
+
 void rspect2dprod(float *data1, float *data2, float *outdata, int N2, int N1);
 /* When multiplying a pair of 2d spectra from rfft2d care must be taken to multiply the*/
 /* four real values seperately from the complex ones. This routine does it correctly.*/
@@ -60,6 +60,8 @@ void give_usage(char *name)
     "   -debug dbg_flg  1     Debug: for options enter -debug 0\n"
     "   -log logfile       NO    Allows output to be written to a log file\n"
     "   -quiet     NO    Suppresses the output to the essential\n"
+    "   -threads count  1     Number of threads to process each patch with\n"
+    "                         (0 uses one thread per processor)\n"
     "   -power     NO    Creates a power image\n"
     "   -sigma     NO    Creates a sigma image\n"
     "   -gamma     NO    Creates a gamma image\n"
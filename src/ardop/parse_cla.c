@@ -92,6 +92,7 @@ int parse_cla(int argc,char *argv[], struct INPUT_ARDOP_PARAMS *g)
             g->iflag    = intParm(atoi(GET_ARG(1)));
             if (*(g->iflag)==0) return debug_help; }
         else if (strmatch(key,"-quiet")) {quietflag = 1;}
+        else if (strmatch(key,"-threads")) {CHK_ARG_ASP(1); ardop_set_thread_count(atoi(GET_ARG(1)));}
         else if (strmatch(key,"-power")) {g->pwrFlag=intParm(1);}
         else if (strmatch(key,"-sigma")) {g->sigmaFlag=intParm(1); cal_check=1;}
         else if (strmatch(key,"-gamma")) {g->gammaFlag=intParm(1); cal_check=1;}
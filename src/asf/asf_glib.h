@@ -20,4 +20,86 @@
 
 #endif
 
+/* Thread support that works with both old (pre 2.32) and new glib.  */
+
+#include <glib.h>
+#ifndef win32
+#include <unistd.h>
+#endif
+
+/* Must be called before any of the below, in case glib is old.  */
+static inline void asf_thread_init(void)
+{
+#if ! GLIB_CHECK_VERSION (2, 32, 0)
+  if (!g_thread_supported ()) g_thread_init (NULL);
+#endif
+}
+
+static inline GMutex *asf_mutex_new(void)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  GMutex *mutex = g_new (GMutex, 1);
+  g_mutex_init (mutex);
+  return mutex;
+#else
+  return g_mutex_new ();
+#endif
+}
+
+static inline void asf_mutex_free(GMutex *mutex)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  g_mutex_clear (mutex);
+  g_free (mutex);
+#else
+  g_mutex_free (mutex);
+#endif
+}
+
+static inline GCond *asf_cond_new(void)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  GCond *cond = g_new (GCond, 1);
+  g_cond_init (cond);
+  return cond;
+#else
+  return g_cond_new ();
+#endif
+}
+
+static inline void asf_cond_free(GCond *cond)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  g_cond_clear (cond);
+  g_free (cond);
+#else
+  g_cond_free (cond);
+#endif
+}
+
+/* Start a joinable thread, returns NULL on failure.  */
+static inline GThread *asf_thread_new(const char *name, GThreadFunc func,
+                                      gpointer data)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  return g_thread_try_new (name, func, data, NULL);
+#else
+  (void) name;
+  return g_thread_create (func, data, TRUE, NULL);
+#endif
+}
+
+/* Number of processors available, for picking a default thread count.  */
+static inline int asf_processor_count(void)
+{
+#if GLIB_CHECK_VERSION (2, 36, 0)
+  return (int) g_get_num_processors ();
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int) n : 1;
+#else
+  return 1;
+#endif
+}
+
 #endif
@@ -1,7 +1,9 @@
 #define ASF_NAME_STRING "asf_calibrate"
 
 #define ASF_USAGE_STRING \
-"   "ASF_NAME_STRING" [-db] [-wh_scale] -sigma | -gamma | -beta <input file> <output file>\n"
+"   "ASF_NAME_STRING" [-db] [-wh_scale]\n"\
+"                 [-multilook <azimuth looks> <range looks>]\n"\
+"                 -sigma | -gamma | -beta <input file> <output file>\n"
 
 #define ASF_DESCRIPTION_STRING \
 "   This program applies the radiometric calibration parameter to an\n"\
@@ -26,7 +28,10 @@
 "                 at Woods Hole.\n\n"\
 "                 cal DN [byte] = (cal DN + 31) / 0.15 + 1\n\n"\
 "                 In this scheme the DN of zero is reserved for the no data\n"\
-"                 value.\n"
+"                 value.\n"\
+"   -multilook    Average the calibrated power over the given number of\n"\
+"                 azimuth and range looks, in the same pass over the data\n"\
+"                 and before the conversion into dB.\n"
 
 #include <asf.h>
 #include <asf_meta.h>
@@ -93,6 +98,7 @@ main (int argc, char *argv[])
   int NUM_ARGS = 3;
   int dbFlag = FALSE;
   int wh_scaleFlag = FALSE;
+  int azimuth_looks = 1, range_looks = 1;
   radiometry_t radiometry=r_AMP;
   char *inFile, *outFile, *radio;
 
@@ -115,6 +121,11 @@ main (int argc, char *argv[])
     else if (strmatches(key,"-wh_scale","--wh_scale",NULL)) {
       wh_scaleFlag = TRUE;
     }
+    else if (strmatches(key,"-multilook","--multilook",NULL)) {
+      CHECK_ARG(2);
+      azimuth_looks = atoi(GET_ARG(2));
+      range_looks = atoi(GET_ARG(1));
+    }
     else if (strmatches(key,"-log","--log",NULL)) {
       CHECK_ARG(1);
       strcpy(logFile,GET_ARG(1));
@@ -164,7 +175,8 @@ main (int argc, char *argv[])
   else
     asfPrintError("Unknown radiometry (%s)\n", radio);
 
-  int fail = asf_calibrate(inFile, outFile, radiometry, wh_scaleFlag);
+  int fail = asf_calibrate_ext(inFile, outFile, radiometry, wh_scaleFlag,
+			       azimuth_looks, range_looks);
   int ok = !fail;
 
   asfPrintStatus(ok ? "Done.\n" : "Failed.\n");
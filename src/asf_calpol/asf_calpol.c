@@ -3,7 +3,7 @@
 #define ASF_USAGE_STRING \
 "   "ASF_NAME_STRING" [-log <logfile>] [-quiet] [-c <classification file>]\n"\
 "          [-pauli] [-sinclair] [-freeman] [-make-feasible-boundary <size>]\n"\
-"          <in_base_name> <out_base_name>\n"
+"          [-threads <count>] <in_base_name> <out_base_name>\n"
 
 #define ASF_DESCRIPTION_STRING \
 "     This program decomposes SLC quad-pol data into data required\n"\
@@ -67,6 +67,11 @@
 "          Outputs bands required to generate the Freeman/Durden\n"\
 "          decomposition.  Cannot be used with -c, -sinclair, or -pauli.\n"\
 "\n"\
+"     -threads <count>\n"\
+"          Number of threads to use for the decomposition.  The default is\n"\
+"          1, 0 uses one thread per processor.  The output is the same\n"\
+"          for any number of threads.\n"\
+"\n"\
 "     -make-feasible-boundary <size>\n"\
 "          This is an option generally used internally only.\n\n"\
 "          It generates a csv file with <size> points, containing the \n"\
@@ -173,6 +178,10 @@ main (int argc, char *argv[])
   int sinclair = extract_flag_options(&argc,&argv,"-sinclair","-s",NULL);
   int freeman = extract_flag_options(&argc,&argv,"-freeman","-f",NULL);
 
+  int thread_count = 1;
+  extract_int_options(&argc,&argv,&thread_count,"-threads","--threads",NULL);
+  polarimetry_set_thread_count(thread_count);
+
   int sz;
   int make_boundary_file =
     extract_int_options(&argc,&argv,&sz,"-make-feasible-boundary",NULL);
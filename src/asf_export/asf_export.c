@@ -12,6 +12,8 @@ following defines.
 "   "ASF_NAME_STRING" [-format <output_format>] [-byte <sample mapping option>]\n"\
 "              [-rgb <red> <green> <blue>] [-band <band_id | all>]\n"\
 "              [-lut <look up table file>] [-truecolor] [-falsecolor]\n"\
+"              [-tile <size>] [-compress <method>] [-overviews]\n"\
+"              [-threads <count>]\n"\
 "              [-log <log_file>] [-quiet] [-license] [-version] [-help]\n"\
 "              <in_base_name> <out_full_name>\n"
 
@@ -146,6 +148,22 @@ following defines.
 "        specified rather than a band_id, then export all available bands into\n"\
 "        individual files, one for each band.  Default is '-band all'.\n"\
 "        Cannot be chosen together with the -rgb option.\n"\
+"   -tile <size>\n"\
+"        TIFF and GeoTIFF only.  Writes the image in square tiles of <size>\n"\
+"        pixels (a multiple of 16, e.g. 256 or 512) instead of one row at a\n"\
+"        time.  Together with -overviews this produces a cloud optimized\n"\
+"        GeoTIFF.\n"\
+"   -compress <method>\n"\
+"        TIFF and GeoTIFF only.  Compression to use: lzw (the default),\n"\
+"        deflate, zstd or none.  Tiled deflate output is compressed on as\n"\
+"        many threads as -threads allows.\n"\
+"   -overviews\n"\
+"        TIFF and GeoTIFF only, requires -tile.  Adds reduced resolution\n"\
+"        copies of the image, each half the size of the one before, down to\n"\
+"        a single tile, for fast display of the zoomed out image.\n"\
+"   -threads <count>\n"\
+"        Number of threads to use when compressing tiles.  The default is\n"\
+"        1, 0 uses one thread per processor.\n"\
 "   -log <logFile>\n"\
 "        Output will be written to a specified log file.\n"\
 "   -quiet\n"\
@@ -314,6 +332,20 @@ main (int argc, char *argv[])
   get_asf_share_dir_with_argv0(argv[0]);
   handle_license_and_version_args(argc, argv, ASF_NAME_STRING);
 
+  // TIFF layout options
+  int tile_size = 0, thread_count = 1;
+  char compression[256];
+  strcpy(compression, "");
+  extract_int_options(&argc, &argv, &tile_size, "-tile", "--tile", NULL);
+  extract_string_options(&argc, &argv, compression, "-compress",
+                         "--compress", NULL);
+  int overviews = extract_flag_options(&argc, &argv, "-overviews",
+                                       "--overviews", NULL);
+  extract_int_options(&argc, &argv, &thread_count, "-threads", "--threads",
+                      NULL);
+  asf_export_set_tiff_options(tile_size, compression, overviews);
+  asf_export_set_thread_count(thread_count);
+
   formatFlag = checkForOption ("-format", argc, argv);
   logFlag = checkForOption ("-log", argc, argv);
   quietFlag = checkForOption ("-quiet", argc, argv);
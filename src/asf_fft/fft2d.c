@@ -250,7 +250,7 @@ else
 			if(M==0) ifft2d(data, M3, M2);
 }
 
-void rfft2d(float *data, int M2, int M){
+void rfft2d_r(float *data, int M2, int M, float *work){
 /* Compute 2D real fft and return results in-place	*/
 /* First performs real fft on rows using size from M to compute positive frequencies */
 /* then performs transform on columns using size from M2 to compute wavenumbers */
@@ -271,34 +271,34 @@ int i1;
 if((M2>0)&&(M>0)){
 	rffts(data, M, POW2(M2));
 	if (M==1){
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 	}
 	else if (M==2){
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		ffts(Array2d[M2], M2, 1);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		ffts(work, M2, 1);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
 	}
 	else{
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 3);
-		ffts(Array2d[M2], M2, 3);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 3);
+		ffts(work, M2, 3);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
 		for (i1=4; i1<POW2(M)/2; i1+=4){
-			cxpose(data + i1*2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 4);
-			ffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M)/2, work, POW2(M2), POW2(M2), 4);
+			ffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
 		}
 	}
 }
@@ -306,7 +306,13 @@ else
 	rffts(data, M2+M, 1);
 }
 
-void rifft2d(float *data, int M2, int M){
+void rfft2d(float *data, int M2, int M){
+/* Compute 2D real fft and return results in-place, using the private */
+/* column storage set up by fft2dInit; see rfft2d_r	*/
+rfft2d_r(data, M2, M, Array2d[M2]);
+}
+
+void rifft2d_r(float *data, int M2, int M, float *work){
 /* Compute 2D real ifft and return results in-place	*/
 /* The input must be in the order as outout from rfft2d */
 /* INPUTS */
@@ -318,34 +324,34 @@ void rifft2d(float *data, int M2, int M){
 int i1;
 if((M2>0)&&(M>0)){
 	if (M==1){
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2));
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2));
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 	}
 	else if (M==2){
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2)); 
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2));
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		iffts(Array2d[M2], M2, 1);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		iffts(work, M2, 1);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
 	}
 	else{
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2));
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2));
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 3);
-		iffts(Array2d[M2], M2, 3);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 3);
+		iffts(work, M2, 3);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
 		for (i1=4; i1<POW2(M)/2; i1+=4){
-			cxpose(data + i1*2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 4);
-			iffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M)/2, work, POW2(M2), POW2(M2), 4);
+			iffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
 		}
 	}
 	riffts(data, M, POW2(M2));
@@ -354,6 +360,12 @@ else
 	riffts(data, M2+M, 1);
 }
 
+void rifft2d(float *data, int M2, int M){
+/* Compute 2D real ifft and return results in-place, using the private */
+/* column storage set up by fft2dInit; see rifft2d_r	*/
+rifft2d_r(data, M2, M, Array2d[M2]);
+}
+
 void rspect2dprod(float *data1, float *data2, float *outdata, int N2, int N1){
 /* When multiplying a pair of 2d spectra from rfft2d care must be taken to multiply the*/
 /* four real values seperately from the complex ones. This routine does it correctly.*/
@@ -0,0 +1,150 @@
+// Test program useful for checking the speed of the FFT backends.
+//
+// Times in-place 1D complex transforms at the sizes ardop uses (one
+// azimuth or range line per cfft1d call) and 2D real transforms at the
+// chip sizes fftMatch uses, forward and back, with each backend built
+// into asf_fft.  Checks that the backends agree, and that a round trip
+// gives back the input.
+//
+// Usage: fft_speed [seconds_per_test]
+
+#include <math.h>
+#include <time.h>
+
+#include "asf.h"
+#include "fft.h"
+#include "fft2d.h"
+#include "fftlib.h"
+
+static double seconds_since(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void fill(float *data, size_t n)
+{
+  size_t ii;
+  srand(42);
+  for (ii = 0; ii < n; ii++)
+    data[ii] = (float)rand() / RAND_MAX - 0.5;
+}
+
+// Largest difference between a and b, relative to the largest value in a.
+static double max_rel_diff(const float *a, const float *b, size_t n)
+{
+  double max_a = 0, max_d = 0;
+  size_t ii;
+  for (ii = 0; ii < n; ii++) {
+    if (fabs(a[ii]) > max_a) max_a = fabs(a[ii]);
+    if (fabs(a[ii] - b[ii]) > max_d) max_d = fabs(a[ii] - b[ii]);
+  }
+  return max_a > 0 ? max_d / max_a : max_d;
+}
+
+// Microseconds per forward+inverse pair of 1D complex transforms of size
+// 2^M, leaving the forward transform of the test data in spectrum.
+static double time_1d(int M, float *data, float *spectrum, double budget)
+{
+  size_t n = 2 * (size_t)POW2(M);
+  int reps = 0;
+  clock_t start;
+
+  fftInit(M);
+  fill(data, n);
+  memcpy(spectrum, data, n * sizeof(float));
+  ffts(spectrum, M, 1);
+
+  start = clock();
+  do {
+    ffts(data, M, 1);
+    iffts(data, M, 1);
+    reps++;
+  } while (seconds_since(start) < budget);
+  return seconds_since(start) * 1e6 / reps;
+}
+
+// Same for 2D real transforms of size 2^M by 2^M.
+static double time_2d(int M, float *data, float *spectrum, double budget)
+{
+  size_t n = (size_t)POW2(M) * POW2(M);
+  int reps = 0;
+  clock_t start;
+
+  fft2dInit(M, M);
+  fill(data, n);
+  memcpy(spectrum, data, n * sizeof(float));
+  rfft2d(spectrum, M, M);
+
+  start = clock();
+  do {
+    rfft2d(data, M, M);
+    rifft2d(data, M, M);
+    reps++;
+  } while (seconds_since(start) < budget);
+  return seconds_since(start) * 1e6 / reps;
+}
+
+int main(int argc, char **argv)
+{
+  double budget = argc > 1 ? atof(argv[1]) : 1.0;
+  fft_backend_t backends[] = { FFT_BACKEND_FFTLIB, FFT_BACKEND_FFTW };
+  int sizes_1d[] = { 11, 12, 13, 14 };   // ardop range & azimuth lines
+  int sizes_2d[] = { 8, 9, 10, 11 };     // fftMatch chips
+  int n_backends = fftSetBackend(FFT_BACKEND_FFTW) == 0 ? 2 : 1;
+  size_t max_n = (size_t)POW2(11) * POW2(11);  // floats in the biggest test
+  float *data = MALLOC(max_n * sizeof(float));
+  float *check = MALLOC(max_n * sizeof(float));
+  float *spectra[2];
+  int bb, ii;
+
+  spectra[0] = MALLOC(max_n * sizeof(float));
+  spectra[1] = MALLOC(max_n * sizeof(float));
+  if (n_backends < 2)
+    printf("FFTW backend not built in, timing fftlib only.\n");
+
+  printf("%-18s", "transform");
+  for (bb = 0; bb < n_backends; bb++)
+    printf(" %10s us", fftBackendName(backends[bb]));
+  printf("  round trip err  backend diff\n");
+
+  for (ii = 0; ii < 4; ii++) {
+    int M = sizes_1d[ii];
+    size_t n = 2 * (size_t)POW2(M);
+    char name[32];
+    double err = 0;
+    sprintf(name, "1D complex %d", (int)POW2(M));
+    printf("%-18s", name);
+    for (bb = 0; bb < n_backends; bb++) {
+      fftSetBackend(backends[bb]);
+      printf(" %13.1f", time_1d(M, data, spectra[bb], budget));
+      fill(check, n);
+      err = fmax(err, max_rel_diff(check, data, n));
+    }
+    printf("  %14.2g  %12.2g\n", err, n_backends > 1 ?
+           max_rel_diff(spectra[0], spectra[1], n) : 0.0);
+  }
+
+  for (ii = 0; ii < 4; ii++) {
+    int M = sizes_2d[ii];
+    size_t n = (size_t)POW2(M) * POW2(M);
+    char name[32];
+    double err = 0;
+    sprintf(name, "2D real %dx%d", (int)POW2(M), (int)POW2(M));
+    printf("%-18s", name);
+    for (bb = 0; bb < n_backends; bb++) {
+      fftSetBackend(backends[bb]);
+      printf(" %13.1f", time_2d(M, data, spectra[bb], budget));
+      fill(check, n);
+      err = fmax(err, max_rel_diff(check, data, n));
+    }
+    printf("  %14.2g  %12.2g\n", err, n_backends > 1 ?
+           max_rel_diff(spectra[0], spectra[1], n) : 0.0);
+  }
+
+  fft2dFree();
+  FREE(spectra[0]);
+  FREE(spectra[1]);
+  FREE(check);
+  FREE(data);
+  return EXIT_SUCCESS;
+}
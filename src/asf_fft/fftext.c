@@ -8,6 +8,13 @@ tables.  Note that you can call fftinit repeatedly with the same size, the
 extra calls will be ignored. So, you could make a macro to call fftInit every
 time you call ffts. For example you could have someting like:
 #define FFT(a,n) if(!fftInit(roundtol(LOG2(n)))) ffts(a,roundtol(LOG2(n)),1); else printf("fft error\n");
+
+The transforms themselves are done by one of two backends: fftlib, or FFTW
+when asf_fft is built with ASF_FFTW defined.  FFTW plans are made the first
+time a transform of a given kind, size and row count is done, and kept until
+fftFree.  The backend defaults to FFTW when it is built in, and can be chosen
+with fftSetBackend or the ASF_FFT_BACKEND environment variable ("fftlib" or
+"fftw").  Results are the same either way, up to rounding.
 *******************************************************************/
 #include "asf.h"
 
@@ -15,10 +22,246 @@ time you call ffts. For example you could have someting like:
 #include "matlib.h"
 #include "fft.h"
 
+#ifdef ASF_FFTW
+#include <fftw3.h>
+#include <glib.h>
+#endif
+
 /* pointers to storage of Utbl's and  BRLow's*/
 float *UtblArray[8*sizeof(int)] = {0};
 short *BRLowArray[8*sizeof(int)/2]  = {0};
 
+#ifdef ASF_FFTW
+/* backend in use, or -1 until the first transform picks the default,*/
+/* which is done once only*/
+static int fftBackend = -1;
+static gsize fftBackendChosen = 0;
+#else
+/* fftlib is the only backend there is*/
+static int fftBackend = FFT_BACKEND_FFTLIB;
+#endif
+
+#ifdef ASF_FFTW
+
+enum fftw_kind {FFTW_KIND_C2C_FWD, FFTW_KIND_C2C_INV, FFTW_KIND_R2C, FFTW_KIND_C2R};
+
+/* cached FFTW plans, one per kind, size, row count and data alignment.*/
+/* The real transforms also keep the complex array they go through, which*/
+/* is lent to one caller at a time*/
+typedef struct fftw_plan_entry {
+	enum fftw_kind kind;
+	int M;
+	int Rows;
+	int aligned;
+	fftwf_plan plan;
+	fftwf_complex *scratch;
+	struct fftw_plan_entry *next;
+} fftw_plan_entry;
+
+static fftw_plan_entry *fftwPlans = NULL;
+G_LOCK_DEFINE_STATIC(fftwPlans);
+
+static fftwf_plan make_fftw_plan(enum fftw_kind kind, int M, int Rows, int aligned){
+/* make a plan on scratch arrays, FFTW_MEASURE overwrites them*/
+int N = POW2(M);
+unsigned flags = FFTW_MEASURE | (aligned ? 0 : FFTW_UNALIGNED);
+fftwf_complex *c = fftwf_malloc(sizeof(fftwf_complex)*(size_t)Rows*N);
+float *r = fftwf_malloc(sizeof(float)*(size_t)Rows*N);
+fftwf_plan plan = NULL;
+switch (kind){
+	case FFTW_KIND_C2C_FWD:
+	case FFTW_KIND_C2C_INV:
+		plan = fftwf_plan_many_dft(1, &N, Rows, c, NULL, 1, N, c, NULL, 1, N,
+			kind == FFTW_KIND_C2C_FWD ? FFTW_FORWARD : FFTW_BACKWARD, flags);
+		break;
+	case FFTW_KIND_R2C:
+		plan = fftwf_plan_many_dft_r2c(1, &N, Rows, r, NULL, 1, N,
+			c, NULL, 1, N/2+1, flags);
+		break;
+	case FFTW_KIND_C2R:
+		plan = fftwf_plan_many_dft_c2r(1, &N, Rows, c, NULL, 1, N/2+1,
+			r, NULL, 1, N, flags);
+		break;
+}
+fftwf_free(c);
+fftwf_free(r);
+return plan;
+}
+
+static fftw_plan_entry *get_fftw_plan(enum fftw_kind kind, int M, int Rows, const void *data){
+/* cached plan for the transform, made on first use, or NULL if FFTW*/
+/* can't make one.  Plans for 16 byte aligned data are kept apart from*/
+/* the rest, so FFTW can use SIMD for them*/
+int aligned = ((size_t)data % 16) == 0;
+fftw_plan_entry *e;
+fftwf_plan plan;
+
+G_LOCK(fftwPlans);
+for (e = fftwPlans; e; e = e->next)
+	if (e->kind == kind && e->M == M && e->Rows == Rows && e->aligned == aligned)
+		break;
+if (!e && (plan = make_fftw_plan(kind, M, Rows, aligned)) != NULL){
+	e = (fftw_plan_entry *) MALLOC(sizeof(fftw_plan_entry));
+	e->kind = kind;
+	e->M = M;
+	e->Rows = Rows;
+	e->aligned = aligned;
+	e->plan = plan;
+	e->scratch = NULL;
+	e->next = fftwPlans;
+	fftwPlans = e;
+}
+G_UNLOCK(fftwPlans);
+return e;
+}
+
+static fftwf_complex *take_fftw_scratch(fftw_plan_entry *e){
+/* complex array for a real transform with plan e.  The one kept with the*/
+/* plan if nobody else has it, otherwise a new one*/
+fftwf_complex *c;
+G_LOCK(fftwPlans);
+c = e->scratch;
+e->scratch = NULL;
+G_UNLOCK(fftwPlans);
+if (!c)
+	c = fftwf_malloc(sizeof(fftwf_complex)*(size_t)e->Rows*(POW2(e->M)/2+1));
+return c;
+}
+
+static void give_back_fftw_scratch(fftw_plan_entry *e, fftwf_complex *c){
+/* keep c with the plan for next time, unless it already has one*/
+G_LOCK(fftwPlans);
+if (!e->scratch){
+	e->scratch = c;
+	c = NULL;
+}
+G_UNLOCK(fftwPlans);
+if (c)
+	fftwf_free(c);
+}
+
+static void free_fftw_plans(void){
+fftw_plan_entry *e;
+G_LOCK(fftwPlans);
+while ((e = fftwPlans) != NULL){
+	fftwPlans = e->next;
+	fftwf_destroy_plan(e->plan);
+	if (e->scratch)
+		fftwf_free(e->scratch);
+	free(e);
+}
+G_UNLOCK(fftwPlans);
+}
+
+static int use_fftw(int M){
+/* fftlib is as good as anything for the tiny sizes*/
+return fftGetBackend() == FFT_BACKEND_FFTW && M > 1;
+}
+
+static int fftw_ffts(float *data, int M, int Rows, enum fftw_kind kind){
+/* in-place complex transform of the rows, scaled like fftlib's*/
+fftw_plan_entry *e = get_fftw_plan(kind, M, Rows, data);
+if (!e)
+	return 0;
+fftwf_execute_dft(e->plan, (fftwf_complex *)data, (fftwf_complex *)data);
+if (kind == FFTW_KIND_C2C_INV){
+	float scale = 1.0/POW2(M);
+	size_t i1, n = 2*(size_t)Rows*POW2(M);
+	for (i1=0; i1<n; i1++)
+		data[i1] *= scale;
+}
+return 1;
+}
+
+static int fftw_rffts(float *data, int M, int Rows){
+/* real transform of the rows, packed like fftlib's (see rffts)*/
+int N = POW2(M);
+int i1, k;
+fftw_plan_entry *e = get_fftw_plan(FFTW_KIND_R2C, M, Rows, data);
+fftwf_complex *c;
+if (!e)
+	return 0;
+c = take_fftw_scratch(e);
+fftwf_execute_dft_r2c(e->plan, data, c);
+for (i1=0; i1<Rows; i1++){
+	float *out = data + (size_t)i1*N;
+	fftwf_complex *in = c + (size_t)i1*(N/2+1);
+	out[0] = in[0][0];
+	out[1] = in[N/2][0];
+	for (k=1; k<N/2; k++){
+		out[2*k] = in[k][0];
+		out[2*k+1] = in[k][1];
+	}
+}
+give_back_fftw_scratch(e, c);
+return 1;
+}
+
+static int fftw_riffts(float *data, int M, int Rows){
+/* inverse of fftw_rffts, scaled like fftlib's*/
+int N = POW2(M);
+int i1, k;
+float scale = 1.0/N;
+size_t i2, n = (size_t)Rows*N;
+fftw_plan_entry *e = get_fftw_plan(FFTW_KIND_C2R, M, Rows, data);
+fftwf_complex *c;
+if (!e)
+	return 0;
+c = take_fftw_scratch(e);
+for (i1=0; i1<Rows; i1++){
+	float *in = data + (size_t)i1*N;
+	fftwf_complex *out = c + (size_t)i1*(N/2+1);
+	out[0][0] = in[0];
+	out[0][1] = 0.0;
+	out[N/2][0] = in[1];
+	out[N/2][1] = 0.0;
+	for (k=1; k<N/2; k++){
+		out[k][0] = in[2*k];
+		out[k][1] = in[2*k+1];
+	}
+}
+fftwf_execute_dft_c2r(e->plan, c, data);
+give_back_fftw_scratch(e, c);
+for (i2=0; i2<n; i2++)
+	data[i2] *= scale;
+return 1;
+}
+
+#endif
+
+int fftSetBackend(fft_backend_t backend){
+/* select the backend for all following transforms*/
+/* returns 0 on success, 1 if the backend isn't built in*/
+#ifndef ASF_FFTW
+if (backend == FFT_BACKEND_FFTW)
+	return 1;
+#endif
+fftBackend = backend;
+return 0;
+}
+
+fft_backend_t fftGetBackend(void){
+/* backend in use, picking the default on the first call unless*/
+/* fftSetBackend was called first*/
+#ifdef ASF_FFTW
+if (g_once_init_enter(&fftBackendChosen)){
+	if (fftBackend < 0){
+		const char *env = getenv("ASF_FFT_BACKEND");
+		if (env && strcmp(env, "fftlib") == 0)
+			fftBackend = FFT_BACKEND_FFTLIB;
+		else
+			fftBackend = FFT_BACKEND_FFTW;
+	}
+	g_once_init_leave(&fftBackendChosen, 1);
+}
+#endif
+return (fft_backend_t) fftBackend;
+}
+
+const char *fftBackendName(fft_backend_t backend){
+return backend == FFT_BACKEND_FFTW ? "fftw" : "fftlib";
+}
+
 int fftInit(int M){
 /* malloc and init cosine and bit reversed tables for a given size fft, ifft, rfft, rifft*/
 /* INPUTS */
@@ -54,7 +297,11 @@ return theError;
 
 void fftFree(){
 /* release storage for all private cosine and bit reversed tables*/
+/* and FFTW plans*/
 int i1;
+#ifdef ASF_FFTW
+free_fftw_plans();
+#endif
 for (i1=8*sizeof(int)/2-1; i1>=0; i1--){
 	if (BRLowArray[i1] != 0){
 		free(BRLowArray[i1]);
@@ -82,6 +329,10 @@ void ffts(float *data, int M, int Rows){
 /* Rows = number of rows in ioptr array (use 1 for Rows for a single fft)	*/
 /* OUTPUTS */
 /* *ioptr = output data array	*/
+#ifdef ASF_FFTW
+	if (use_fftw(M) && fftw_ffts(data, M, Rows, FFTW_KIND_C2C_FWD))
+		return;
+#endif
 	ffts1(data, M, Rows, UtblArray[M], BRLowArray[M/2]);
 }
 
@@ -93,6 +344,10 @@ void iffts(float *data, int M, int Rows){
 /* Rows = number of rows in ioptr array (use 1 for Rows for a single fft)	*/
 /* OUTPUTS */
 /* *ioptr = output data array	*/
+#ifdef ASF_FFTW
+	if (use_fftw(M) && fftw_ffts(data, M, Rows, FFTW_KIND_C2C_INV))
+		return;
+#endif
 	iffts1(data, M, Rows, UtblArray[M], BRLowArray[M/2]);
 }
 
@@ -109,6 +364,10 @@ void rffts(float *data, int M, int Rows){
 /* OUTPUTS */
 /* *ioptr = output data array	in the following order */
 /* Re(x[0]), Re(x[N/2]), Re(x[1]), Im(x[1]), Re(x[2]), Im(x[2]), ... Re(x[N/2-1]), Im(x[N/2-1]). */
+#ifdef ASF_FFTW
+	if (use_fftw(M) && fftw_rffts(data, M, Rows))
+		return;
+#endif
 	rffts1(data, M, Rows, UtblArray[M], BRLowArray[(M-1)/2]);
 }
 
@@ -122,6 +381,10 @@ void riffts(float *data, int M, int Rows){
 /* Rows = number of rows in ioptr array (use 1 for Rows for a single fft)	*/
 /* OUTPUTS */
 /* *ioptr = real output data array	*/
+#ifdef ASF_FFTW
+	if (use_fftw(M) && fftw_riffts(data, M, Rows))
+		return;
+#endif
 	riffts1(data, M, Rows, UtblArray[M], BRLowArray[(M-1)/2]);
 }
 
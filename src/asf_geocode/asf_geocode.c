@@ -26,8 +26,8 @@ trouble, and use edit_man_header. :)
 "             [-force] [-resample-method <method>] [-height <height>]\n"\
 "             [-datum <datum>] [-pixel-size <pixel size>] [-band <band_id | all>]\n"\
 "             [-log <file>] [-write-proj-file <file>] [-read-proj-file <file>]\n"\
-"             [-save-mapping] [-background <value>] [-quiet] [-license]\n"\
-"             [-version] [-help]\n"\
+"             [-save-mapping] [-background <value>] [-threads <count>]\n"\
+"             [-quiet] [-license] [-version] [-help]\n"\
 "             <in_base_name> <out_base_name>\n"\
 "\n"\
 "   Use the -help option for more projection parameter controls.\n"
@@ -58,6 +58,11 @@ trouble, and use edit_man_header. :)
 "          original file, the other the sample numbers.  Together, these\n"\
 "          define the mapping of pixels performed by the geocoding.\n"\
 "\n"\
+"     -threads <count>\n"\
+"          Number of threads to use when resampling.  The default is 1,\n"\
+"          0 uses one thread per processor.  The output is the same\n"\
+"          whatever the number of threads.\n"\
+"\n"\
 "     -log <log file>\n"\
 "          Output will be written to a specified log file.\n"\
 "\n"\
@@ -205,6 +210,10 @@ main (int argc, char **argv)
   }
   quietflag = detect_flag_options(argc, argv, "-quiet", "--quiet", NULL);
   save_map_flag = extract_flag_options(&argc, &argv, "-save-mapping", "--save_mapping", NULL);
+  int thread_count = 1;
+  extract_int_options(&argc, &argv, &thread_count, "-threads", "--threads",
+                      NULL);
+  asf_geocode_set_thread_count(thread_count);
 
   handle_license_and_version_args(argc, argv, ASF_NAME_STRING);
 
@@ -25,7 +25,8 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 
 #define ASF_USAGE_STRING \
 "   "ASF_NAME_STRING" [-create] [-input <inFile>] [-output <outFile>]\n"\
-"                [-tmpdir <dir>] [-log <logFile>] [-quiet] [-license]\n"\
+"                [-tmpdir <dir>] [-threads <count>] [-jobs <count>]\n"\
+"                [-native-byte-order] [-log <logFile>] [-quiet] [-license]\n"\
 "                [-version] [-help]\n"\
 "                <config_file>\n"
 
@@ -61,6 +62,21 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 "   -tmpdir <dir>\n"\
 "        Overwrite the temporary directory in a configuration file or\n"\
 "        defines the temporary directory for a settings file.\n"\
+"   -threads <count>\n"\
+"        Number of threads to use when SAR processing, geocoding and\n"\
+"        doing polarimetric decompositions. The default is 1, 0 uses one\n"\
+"        thread per processor.\n"\
+"   -jobs <count>\n"\
+"        Number of files of a batch to process at a time, overriding the\n"\
+"        'batch jobs' setting of the configuration file. 0 runs one per\n"\
+"        processor. Each concurrently processed file is logged to a file of\n"\
+"        its own in its temporary directory, and no more of them are started\n"\
+"        than fit in the 'batch memory' setting.\n"\
+"   -native-byte-order\n"\
+"        Write the geocoded intermediate files in the temporary directory\n"\
+"        in this machine's byte order instead of big endian, which saves\n"\
+"        swapping bytes when they are exported on little endian machines.\n"\
+"        The final products are not affected.\n"\
 "   -log <logFile>\n"\
 "        Set the name and location of the log file. Default behavior is to\n"\
 "        log to tmp<processIDnumber>.log\n"\
@@ -98,6 +114,9 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 #include "ceos.h"
 #include "asf_meta.h"
 #include "asf_convert.h"
+#include "asf_geocode.h"
+#include "ardop_defs.h"
+#include "asf_sar.h"
 #include "proj.h"
 #include "asf_contact.h"
 #include <unistd.h>
@@ -176,6 +195,21 @@ int main(int argc, char *argv[])
   // This is an undocumented option, for internal use (by the GUI)
   int save_dem = extract_flag_options(&argc, &argv, "-save-dem", "--save-dem", NULL);
 
+  int thread_count = 1;
+  extract_int_options(&argc, &argv, &thread_count, "-threads", "--threads",
+                      NULL);
+  asf_geocode_set_thread_count(thread_count);
+  ardop_set_thread_count(thread_count);
+  polarimetry_set_thread_count(thread_count);
+
+  int job_count = -1;
+  extract_int_options(&argc, &argv, &job_count, "-jobs", "--jobs", NULL);
+  asf_convert_set_batch_jobs(job_count);
+
+  if (extract_flag_options(&argc, &argv, "-native-byte-order",
+                           "--native-byte-order", NULL))
+    meta_set_output_byte_order(meta_native_byte_order());
+
   // Check which options were provided
   create_f = checkForOption("-create", argc, argv);
   log_f    = checkForOption("-log", argc, argv);
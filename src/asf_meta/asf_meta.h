@@ -36,6 +36,12 @@
 #include "uavsar.h"
 #include "seasat_slant_shift.h"
 
+/* Byte order of the samples in an ASF internal data file.  */
+typedef enum {
+  META_BIG_ENDIAN=0,
+  META_LITTLE_ENDIAN
+} byte_order_t;
+
 /* There are some different versions of the metadata files around.
    This token defines the current version, which this header is
    designed to correspond with.  */
@@ -208,6 +214,8 @@ typedef struct {
   double bit_error_rate;     /* Fraction of bits which are in error.       */
   int missing_lines;         /* Number of missing lines in data take       */
   float no_data;             /* Value indicating no data for this pixel    */
+  byte_order_t byte_order;   /* Byte order of the data file, normally big  */
+                             /* endian; see ioLine.c                       */
 } meta_general;
 
 
@@ -387,6 +395,7 @@ typedef struct {
   double std_deviation;         /* Standard deviation                    */
   double percent_valid;         // Percent of valid values
   double mask;                  /* Value ignored while taking statistics */
+  char   data_key[64];          // Data file these were taken from, if known
 } meta_stats;
 /********************************************************************
  * meta_statistics: statistical info about the image
@@ -759,6 +768,28 @@ int getLatLongMeta(const stateVector stVec,meta_parameters *meta,
                    double range,double doppler,double elev,
                    double *targLat, double *targLon, double *targRadius);
 
+/* Geolocation contexts: in meta_geo_context.c.
+   A context holds what is needed to geolocate many points of one image:
+   for slant and ground range images located with state vectors, the
+   orbit interpolation coefficients, which are set up once, so that the
+   range-doppler equations can be solved directly with Newton's method.
+   Other images are passed on to meta_get_latLon/meta_get_lineSamp.
+
+   The context is not changed by the calls below, so several threads may
+   share one (the metadata must not be changed while it is in use).  The
+   arrays are n points long; elev may be NULL for points on the ellipsoid.
+   Points that can't be located are set to MAGIC_UNSET_DOUBLE, and the
+   number of those is returned. */
+typedef struct meta_geo_context meta_geo_context;
+meta_geo_context *meta_geo_context_new(meta_parameters *meta);
+void meta_geo_context_free(meta_geo_context *ctx);
+int meta_get_latLon_arr(const meta_geo_context *ctx, int n,
+                        const double *yLine, const double *xSample,
+                        const double *elev, double *lat, double *lon);
+int meta_get_lineSamp_arr(const meta_geo_context *ctx, int n,
+                          const double *lat, const double *lon,
+                          const double *elev, double *yLine, double *xSample);
+
 /* quick code to get a bounding box for the metadata */
 void meta_get_bounding_box(meta_parameters *meta,
                            double *plat_min, double *plat_max,
@@ -851,8 +882,10 @@ double unpacked_deg(double angle);
 
 /******************************************************************************
  * ioLine: Grab any data type and fill a buffer of _type_ data.
- * Assumes that the datae file contains data in big endian order and
- * returns data in host byte order. Implemented in asf.a/ioLine.c */
+ * Assumes that the data file contains data in the byte order given by
+ * meta->general->byte_order (big endian, except for some intermediate
+ * files) and returns data in host byte order. Implemented in
+ * asf.a/ioLine.c */
 
 /* Size of line chunk to read or write.  */
 #define CHUNK_OF_LINES 32
@@ -912,6 +945,33 @@ int get_partial_float_lines(FILE *file, meta_parameters *meta,
           int sample_number, int num_samples_to_get,
           float *dest);
 
+/* Byte order of the host, and the byte order tools that support it use for
+ * new ASF internal files (big endian unless set otherwise). */
+byte_order_t meta_native_byte_order(void);
+void meta_set_output_byte_order(byte_order_t byte_order);
+byte_order_t meta_get_output_byte_order(void);
+
+/* Read-only access to an image file through a memory mapping when possible,
+ * see image_map_open() in ioLine.c.  The line reading functions work like
+ * the ones above. */
+typedef struct image_map image_map_t;
+image_map_t *image_map_open(const char *file_name);
+void image_map_close(image_map_t *map);
+int image_map_is_mapped(const image_map_t *map);
+const void *image_map_bytes(const image_map_t *map, long long offset,
+                            long long length);
+size_t image_map_read(image_map_t *map, long long offset, size_t length,
+                      void *dest);
+int image_map_get_data_lines(image_map_t *map, meta_parameters *meta,
+       int line_number, int num_lines_to_get,
+       int sample_number, int num_samples_to_get,
+       void *dest, int dest_data_type);
+int image_map_get_float_line(image_map_t *map, meta_parameters *meta,
+                             int line_number, float *dest);
+int image_map_get_float_lines(image_map_t *map, meta_parameters *meta,
+                              int line_number, int num_lines_to_get,
+                              float *dest);
+
 // Prototypes from meta_init_ceos.c
 char *get_polarization (const char *fName);
 double get_chirp_rate (const char *fName);
@@ -1016,6 +1076,36 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
 		 float inDn, char *bandExt, int dbFlag);
 float get_rad_cal_dn(meta_parameters *meta, int line, int sample, char *bandExt,
 		     float inDn, float radCorr);
+
+// Calibration plan: get_cal_dn() for whole lines.  Every calibration model
+// is linear in power, cal = gain*DN^2 + offset (gain*DN + offset for UAVSAR,
+// whose data already is power), with gain and offset depending on the
+// sample and the incidence angle only.  The plan keeps them for every
+// sample of a row every CAL_PLAN_LINES lines, interpolated in between, or
+// of just one row when they don't change along azimuth.
+#define CAL_PLAN_LINES 64
+typedef struct {
+  int sample_count;
+  int line_count;
+  int row_count;      // rows, CAL_PLAN_LINES lines apart (the last one on
+                      // the last line); 1 if the gain is range only
+  int power_input;    // TRUE if the data numbers are power, not amplitude
+  int db_flag;        // TRUE to return dB
+  float *gain;        // row_count x sample_count
+  float *offset;      // row_count x sample_count
+} cal_plan_t;
+// meta has the geometry and the output radiometry.  range_only takes the
+// incidence angles of the first line for all lines, as import does.
+cal_plan_t *cal_plan_new(meta_parameters *meta, char *bandExt, int db_flag);
+cal_plan_t *cal_plan_new_ext(meta_parameters *meta, char *bandExt,
+			     int db_flag, int range_only, int sample_count);
+void cal_plan_free(cal_plan_t *plan);
+// Calibrates the sample_count data numbers of a line; in and out may be
+// the same buffer.
+void cal_plan_apply(const cal_plan_t *plan, int line, const float *in,
+		    float *out);
+// Calibrates a single data number
+float cal_plan_value(const cal_plan_t *plan, int line, int sample, float inDn);
 float cal2amp(meta_parameters *meta, float incid, int sample, char *bandExt, 
 	      float calValue);
 quadratic_2d find_quadratic(const double *out, const double *x,
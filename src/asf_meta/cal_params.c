@@ -929,6 +929,169 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
   return calValue;
 }
 
+/*----------------------------------------------------------------------
+  Calibration plan:
+        get_cal_dn() for whole lines.  The gain and offset of every
+        sample are found once, with get_cal_dn() itself, on rows
+        CAL_PLAN_LINES lines apart, and interpolated along azimuth in
+        between.  Calibrating a line is then a multiply-add per sample.
+----------------------------------------------------------------------*/
+
+// Incidence angle from the 2D quadratic incid_init() fits for map
+// projected images (as quadratic_2_incidence_angle() in import_ceos.c)
+static float quadratic_incid(const float *q, float x, float y)
+{
+  return q[0] + q[1]*x + q[2]*y + q[3]*x*x + q[4]*x*y + q[5]*y*y +
+    q[6]*x*x*y + q[7]*x*y*y + q[8]*x*x*y*y + q[9]*x*x*x + q[10]*y*y*y;
+}
+
+static int cal_plan_row_line(const cal_plan_t *plan, int row)
+{
+  int line = row*CAL_PLAN_LINES;
+  return line < plan->line_count ? line : plan->line_count - 1;
+}
+
+cal_plan_t *cal_plan_new(meta_parameters *meta, char *bandExt, int db_flag)
+{
+  return cal_plan_new_ext(meta, bandExt, db_flag, FALSE,
+			  meta->general->sample_count);
+}
+
+cal_plan_t *cal_plan_new_ext(meta_parameters *meta, char *bandExt,
+			     int db_flag, int range_only, int sample_count)
+{
+  cal_plan_t *plan = (cal_plan_t *) MALLOC(sizeof(cal_plan_t));
+  int ns = sample_count;
+  float *q = NULL;
+  int ii, jj;
+
+  if (!meta->calibration)
+    asfPrintError("Can't calibrate without a calibration block!\n");
+
+  // Map projected images come with a fit of the incidence angles over
+  // the whole image
+  if (meta->sar && meta->sar->image_type == 'P' && meta->projection) {
+    q = incid_init(meta);
+    range_only = FALSE;
+  }
+
+  plan->sample_count = ns;
+  plan->line_count = meta->general->line_count;
+  plan->row_count =
+    (plan->line_count - 1 + CAL_PLAN_LINES - 1)/CAL_PLAN_LINES + 1;
+  if (range_only || plan->line_count <= 1)
+    plan->row_count = 1;
+  plan->power_input = meta->calibration->type == uavsar_cal;
+  plan->db_flag = db_flag;
+  plan->gain = (float *) MALLOC(sizeof(float)*plan->row_count*ns);
+  plan->offset = (float *) MALLOC(sizeof(float)*plan->row_count*ns);
+
+  for (ii=0; ii<plan->row_count; ii++) {
+    int line = cal_plan_row_line(plan, ii);
+    float *gain = plan->gain + ii*ns;
+    float *offset = plan->offset + ii*ns;
+    for (jj=0; jj<ns; jj++) {
+      float incid = 0.0;
+      if (q)
+	incid = quadratic_incid(q, line, jj);
+      else if (meta->sar)
+	incid = meta_incid(meta, line, jj);
+      offset[jj] = get_cal_dn(meta, incid, jj, 0.0, bandExt, FALSE);
+      gain[jj] = get_cal_dn(meta, incid, jj, 1.0, bandExt, FALSE) - offset[jj];
+    }
+  }
+  FREE(q);
+
+  // Most radiometries (and calibration schemes) don't depend on the
+  // incidence angle -- then one row does for the whole image
+  for (ii=1; ii<plan->row_count; ii++)
+    if (memcmp(plan->gain, plan->gain + ii*ns, sizeof(float)*ns) != 0 ||
+	memcmp(plan->offset, plan->offset + ii*ns, sizeof(float)*ns) != 0)
+      break;
+  if (ii == plan->row_count)
+    plan->row_count = 1;
+
+  return plan;
+}
+
+void cal_plan_free(cal_plan_t *plan)
+{
+  if (plan) {
+    FREE(plan->gain);
+    FREE(plan->offset);
+    FREE(plan);
+  }
+}
+
+// The row at or above the line, and how far the line is towards the next
+// row (0 if the row alone is to be used)
+static int cal_plan_row(const cal_plan_t *plan, int line, float *t)
+{
+  int row = line/CAL_PLAN_LINES;
+
+  if (line < 0)
+    row = 0;
+  if (row >= plan->row_count - 1) {
+    *t = 0.0;
+    return plan->row_count - 1;
+  }
+  int line0 = cal_plan_row_line(plan, row);
+  int line1 = cal_plan_row_line(plan, row + 1);
+  *t = line > line0 ? (float)(line - line0)/(float)(line1 - line0) : 0.0;
+  return row;
+}
+
+void cal_plan_apply(const cal_plan_t *plan, int line, const float *in,
+		    float *out)
+{
+  int ns = plan->sample_count;
+  int jj;
+  float t;
+  int row = cal_plan_row(plan, line, &t);
+  const float *g0 = plan->gain + row*ns, *o0 = plan->offset + row*ns;
+
+  if (t == 0.0) {
+    if (plan->power_input)
+      for (jj=0; jj<ns; jj++)
+	out[jj] = g0[jj]*in[jj] + o0[jj];
+    else
+      for (jj=0; jj<ns; jj++)
+	out[jj] = g0[jj]*in[jj]*in[jj] + o0[jj];
+  }
+  else {
+    const float *g1 = g0 + ns, *o1 = o0 + ns;
+    for (jj=0; jj<ns; jj++) {
+      float gain = g0[jj] + t*(g1[jj] - g0[jj]);
+      float offset = o0[jj] + t*(o1[jj] - o0[jj]);
+      float dn = plan->power_input ? in[jj] : in[jj]*in[jj];
+      out[jj] = gain*dn + offset;
+    }
+  }
+
+  if (plan->db_flag)
+    for (jj=0; jj<ns; jj++)
+      out[jj] = 10.0*log10(out[jj]);
+}
+
+float cal_plan_value(const cal_plan_t *plan, int line, int sample, float inDn)
+{
+  int ns = plan->sample_count;
+  float t;
+  int row = cal_plan_row(plan, line, &t);
+  int kk = row*ns + sample;
+  float gain = plan->gain[kk], offset = plan->offset[kk];
+  float dn = plan->power_input ? inDn : inDn*inDn;
+  float value;
+
+  if (t != 0.0) {
+    gain += t*(plan->gain[kk+ns] - gain);
+    offset += t*(plan->offset[kk+ns] - offset);
+  }
+  value = gain*dn + offset;
+
+  return plan->db_flag ? 10.0*log10(value) : value;
+}
+
 // Determine radiometrically correction amplitude value
 float get_rad_cal_dn(meta_parameters *meta, int line, int sample, char *bandExt,
 		     float inDn, float radCorr)
@@ -8,6 +8,23 @@ io_util:
 #include "asf_endian.h"
 #include "asf_complex.h"
 
+#include <stdint.h>
+#include <string.h>
+#ifndef win32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+/* An image file opened for reading with image_map_open().  When the file
+ * could be mapped, data points at the whole file and fp is NULL; otherwise
+ * data is NULL and reads go through fp as usual. */
+struct image_map {
+  FILE *fp;
+  const unsigned char *data;
+  long long size;
+};
+
 /*******************************************************************************
  * Return the number of bytes that a data_type is made of, kill program on
  * failure to figure the size of the data type. */
@@ -34,27 +51,311 @@ int data_type2sample_size(int data_type)
 
 
 /*******************************************************************************
- * Get x number of lines of data (any data type) and fill a pre-allocated array
- * with it. The data is assumed to be in big endian format and will be converted
- * to the native machine's format. The line_number argument is the zero-indexed
- * line number to get. The dest argument must be a pointer to existing memory.
- * Returns the amount of samples successfully read & converted. */
-int get_data_lines(FILE *file, meta_parameters *meta,
+ * Sample conversion kernels.
+ *
+ * Every (file type, buffer type) pair gets its own tight loop so that the
+ * compiler can unroll and vectorize the byteswap and the type conversion
+ * together, instead of branching on the data types for every sample.  Complex
+ * data is handled by converting its two components as two plain samples.
+ * The "_from_big" kernels byteswap the file sample before converting it, the
+ * "_to_big" kernels byteswap the converted sample; the "_lil" ones do the
+ * same for little endian files.  Swaps to or from the host's own byte order
+ * compile away. */
+
+typedef void (*sample_converter_t)(const void *in, void *out, size_t n);
+
+/* Size of the scratch area used to stream samples that need converting.  It
+ * lives on the stack so reads and writes never allocate, and is small enough
+ * to stay in cache while being converted. */
+#define IO_CHUNK_BYTES 65536
+
+static inline uint16_t bswap_u16(uint16_t x)
+{
+  return (uint16_t)((x >> 8) | (x << 8));
+}
+
+static inline uint32_t bswap_u32(uint32_t x)
+{
+  return ((x >> 24) & 0x000000ffU) | ((x >>  8) & 0x0000ff00U) |
+         ((x <<  8) & 0x00ff0000U) | ((x << 24) & 0xff000000U);
+}
+
+static inline uint64_t bswap_u64(uint64_t x)
+{
+  return ((uint64_t)bswap_u32((uint32_t)x) << 32) |
+         bswap_u32((uint32_t)(x >> 32));
+}
+
+static inline short int swap_int16(short int x)
+{
+  uint16_t u;
+  memcpy(&u, &x, sizeof(u));
+  u = bswap_u16(u);
+  memcpy(&x, &u, sizeof(u));
+  return x;
+}
+
+static inline int swap_int32(int x)
+{
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+  u = bswap_u32(u);
+  memcpy(&x, &u, sizeof(u));
+  return x;
+}
+
+static inline float swap_real32(float x)
+{
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+  u = bswap_u32(u);
+  memcpy(&x, &u, sizeof(u));
+  return x;
+}
+
+static inline double swap_real64(double x)
+{
+  uint64_t u;
+  memcpy(&u, &x, sizeof(u));
+  u = bswap_u64(u);
+  memcpy(&x, &u, sizeof(u));
+  return x;
+}
+
+/* Big endian <-> host and little endian <-> host conversion of one sample of
+ * each base type.  Swapping is symmetric, so these work in both directions. */
+static inline unsigned char big_byte(unsigned char x) { return x; }
+static inline unsigned char lil_byte(unsigned char x) { return x; }
+
+#if defined(ASF_LIL_ENDIAN)
+static inline short int big_int16(short int x) { return swap_int16(x); }
+static inline int big_int32(int x) { return swap_int32(x); }
+static inline short int lil_int16(short int x) { return x; }
+static inline int lil_int32(int x) { return x; }
+#else
+static inline short int big_int16(short int x) { return x; }
+static inline int big_int32(int x) { return x; }
+static inline short int lil_int16(short int x) { return swap_int16(x); }
+static inline int lil_int32(int x) { return swap_int32(x); }
+#endif
+
+#if defined(ASF_LIL_IEEE)
+static inline float big_real32(float x) { return swap_real32(x); }
+static inline double big_real64(double x) { return swap_real64(x); }
+static inline float lil_real32(float x) { return x; }
+static inline double lil_real64(double x) { return x; }
+#else
+static inline float big_real32(float x) { return x; }
+static inline double big_real64(double x) { return x; }
+static inline float lil_real32(float x) { return swap_real32(x); }
+static inline double lil_real64(double x) { return swap_real64(x); }
+#endif
+
+#define DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, DN, DT)                       \
+static void convert_##SN##_##DN##_from_##ORDER(const void *in, void *out,     \
+                                               size_t n)                      \
+{                                                                             \
+  const ST *src = (const ST *)in;                                             \
+  DT *dst = (DT *)out;                                                        \
+  size_t ii;                                                                  \
+  for (ii = 0; ii < n; ii++)                                                  \
+    dst[ii] = (DT)ORDER##_##SN(src[ii]);                                      \
+}                                                                             \
+static void convert_##SN##_##DN##_to_##ORDER(const void *in, void *out,       \
+                                             size_t n)                        \
+{                                                                             \
+  const ST *src = (const ST *)in;                                             \
+  DT *dst = (DT *)out;                                                        \
+  size_t ii;                                                                  \
+  for (ii = 0; ii < n; ii++)                                                  \
+    dst[ii] = ORDER##_##DN((DT)src[ii]);                                      \
+}
+
+#define DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, SN, ST)                          \
+  DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, byte, unsigned char)                \
+  DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, int16, short int)                   \
+  DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, int32, int)                         \
+  DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, real32, float)                      \
+  DEFINE_SAMPLE_CONVERTERS(ORDER, SN, ST, real64, double)
+
+#define DEFINE_BYTE_ORDER_CONVERTERS(ORDER)                                   \
+  DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, byte, unsigned char)                   \
+  DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, int16, short int)                      \
+  DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, int32, int)                            \
+  DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, real32, float)                         \
+  DEFINE_SAMPLE_CONVERTERS_FROM(ORDER, real64, double)
+
+DEFINE_BYTE_ORDER_CONVERTERS(big)
+DEFINE_BYTE_ORDER_CONVERTERS(lil)
+
+#define CONVERTER_ROW(SN, SUFFIX)                                             \
+  { convert_##SN##_byte##SUFFIX, convert_##SN##_int16##SUFFIX,                \
+    convert_##SN##_int32##SUFFIX, convert_##SN##_real32##SUFFIX,              \
+    convert_##SN##_real64##SUFFIX }
+
+#define CONVERTER_TABLE(SUFFIX)                                               \
+  { CONVERTER_ROW(byte, SUFFIX), CONVERTER_ROW(int16, SUFFIX),                \
+    CONVERTER_ROW(int32, SUFFIX), CONVERTER_ROW(real32, SUFFIX),              \
+    CONVERTER_ROW(real64, SUFFIX) }
+
+/* Indexed by [source base type][destination base type], see base_type(). */
+static const sample_converter_t convert_from_big[5][5] =
+  CONVERTER_TABLE(_from_big);
+static const sample_converter_t convert_to_big[5][5] =
+  CONVERTER_TABLE(_to_big);
+static const sample_converter_t convert_from_lil[5][5] =
+  CONVERTER_TABLE(_from_lil);
+static const sample_converter_t convert_to_lil[5][5] =
+  CONVERTER_TABLE(_to_lil);
+
+/* Zero-based index of the (component) type of a data type, so that
+ * ASF_BYTE and COMPLEX_BYTE are both 0, ..., REAL64 and COMPLEX_REAL64 4. */
+static int base_type(int data_type)
+{
+  if (data_type >= COMPLEX_BYTE)
+    return data_type - COMPLEX_BYTE;
+  return data_type - ASF_BYTE;
+}
+
+/* Number of plain values that make up one sample of the data type. */
+static int components_per_sample(int data_type)
+{
+  return data_type >= COMPLEX_BYTE ? 2 : 1;
+}
+
+/* Byte order of the host. */
+byte_order_t meta_native_byte_order(void)
+{
+#if defined(ASF_LIL_ENDIAN)
+  return META_LITTLE_ENDIAN;
+#else
+  return META_BIG_ENDIAN;
+#endif
+}
+
+static byte_order_t output_byte_order = META_BIG_ENDIAN;
+
+/* Byte order for new ASF internal files, used by tools that write files whose
+ * byte order doesn't matter to anyone but the next processing step (see
+ * asf_mapready -native-byte-order).  Every other file is big endian. */
+void meta_set_output_byte_order(byte_order_t byte_order)
+{
+  output_byte_order = byte_order;
+}
+
+byte_order_t meta_get_output_byte_order(void)
+{
+  return output_byte_order;
+}
+
+/* Neither byte order nor type changes, so samples can be copied as is. */
+static int is_plain_copy(meta_parameters *meta, int file_type, int buf_type)
+{
+  return base_type(file_type) == base_type(buf_type) &&
+         (base_type(file_type) == base_type(ASF_BYTE) ||
+          meta->general->byte_order == meta_native_byte_order());
+}
+
+/* Kernel converting samples of file_type in the data file described by meta
+ * to samples of buf_type, or NULL if they need no conversion. */
+static sample_converter_t file_to_buffer(meta_parameters *meta, int file_type,
+                                         int buf_type)
+{
+  if (is_plain_copy(meta, file_type, buf_type))
+    return NULL;
+  if (meta->general->byte_order == META_LITTLE_ENDIAN)
+    return convert_from_lil[base_type(file_type)][base_type(buf_type)];
+  return convert_from_big[base_type(file_type)][base_type(buf_type)];
+}
+
+/* Kernel converting samples of buf_type to samples of file_type in the data
+ * file described by meta, or NULL if they need no conversion. */
+static sample_converter_t buffer_to_file(meta_parameters *meta, int buf_type,
+                                         int file_type)
+{
+  if (is_plain_copy(meta, file_type, buf_type))
+    return NULL;
+  if (meta->general->byte_order == META_LITTLE_ENDIAN)
+    return convert_to_lil[base_type(buf_type)][base_type(file_type)];
+  return convert_to_big[base_type(buf_type)][base_type(file_type)];
+}
+
+/* Reads num_samples contiguous samples starting at the current file position
+ * and converts them into dest.  When no type conversion is needed the data is
+ * read straight into dest and byteswapped in place, if convert says it needs
+ * to be; otherwise it is streamed through a fixed size scratch area on the
+ * stack.  Returns the number of samples read. */
+static int read_converted_run(FILE *file, sample_converter_t convert,
+                              int same_type, size_t sample_size,
+                              size_t dest_sample_size, int components,
+                              size_t num_samples, void *dest)
+{
+  double chunk[IO_CHUNK_BYTES/sizeof(double)];
+  size_t chunk_samples = IO_CHUNK_BYTES / sample_size;
+  unsigned char *out = (unsigned char *)dest;
+  size_t samples_gotten = 0;
+
+  if (same_type) {
+    samples_gotten = ASF_FREAD(dest, sample_size, num_samples, file);
+    if (convert)
+      convert(dest, dest, samples_gotten*components);
+    return (int)samples_gotten;
+  }
+
+  while (samples_gotten < num_samples) {
+    size_t want = num_samples - samples_gotten;
+    size_t got;
+    if (want > chunk_samples)
+      want = chunk_samples;
+    got = ASF_FREAD(chunk, sample_size, want, file);
+    convert(chunk, out + samples_gotten*dest_sample_size, got*components);
+    samples_gotten += got;
+    if (got < want)
+      break;
+  }
+
+  return (int)samples_gotten;
+}
+
+/* Converts num_samples contiguous samples starting offset bytes into a mapped
+ * file into dest (copies them, if convert is NULL).  Samples past the end of
+ * the file are not read, as with fread().  Returns the number of samples
+ * converted. */
+static int read_mapped_run(const image_map_t *map, long long offset,
+                           sample_converter_t convert, size_t sample_size,
+                           int components, size_t num_samples, void *dest)
+{
+  long long available = map->size > offset ?
+      (map->size - offset) / (long long)sample_size : 0;
+  if ((long long)num_samples > available)
+    num_samples = (size_t)available;
+  if (convert)
+    convert(map->data + offset, dest, num_samples*components);
+  else
+    memcpy(dest, map->data + offset, num_samples*sample_size);
+  return (int)num_samples;
+}
+
+/* Reads & converts lines from either file or, when it is not NULL, the
+ * mapping map.  See get_data_lines(). */
+static int get_data_runs(FILE *file, const image_map_t *map,
+       meta_parameters *meta,
        int line_number, int num_lines_to_get,
        int sample_number, int num_samples_to_get,
        void *dest, int dest_data_type)
 {
-  int ii;               /* Sample index.  */
+  int ii;               /* Line index.  */
   int samples_gotten=0; /* Number of samples retrieved */
-  int line_samples_gotten;
   size_t sample_size;   /* Sample size in bytes.  */
-  void *temp_buffer;    /* Buffer for unconverted data.  */
+  size_t dest_sample_size; /* Size of a converted sample in bytes.  */
   int sample_count = meta->general->sample_count;
   int line_count = meta->general->line_count;
   int band_count = meta->general->band_count;
   int data_type    = meta->general->data_type;
   int num_lines_left = line_count * band_count - line_number;
   int num_samples_left = sample_count - sample_number;
+  int num_runs, samples_per_run;
+  sample_converter_t convert;
   long long offset;
 
   // Check whether data conversion is possible
@@ -82,156 +383,69 @@ int get_data_lines(FILE *file, meta_parameters *meta,
       "Only %d samples left in file. Exiting.\n",
       num_samples_to_get, num_samples_left);
 
-  /* Determine sample size.  */
+  /* Determine sample sizes and the conversion kernel.  */
   sample_size = data_type2sample_size(data_type);
+  dest_sample_size = data_type2sample_size(dest_data_type);
+  convert = file_to_buffer(meta, data_type, dest_data_type);
 
-  temp_buffer = MALLOC( sample_size * num_lines_to_get * num_samples_to_get);
-
+  /* Whole lines are contiguous in the file, so they can be read in one go. */
+  if (sample_number == 0 && num_samples_to_get == sample_count) {
+    num_runs = 1;
+    samples_per_run = num_lines_to_get * num_samples_to_get;
+  }
+  else {
+    num_runs = num_lines_to_get;
+    samples_per_run = num_samples_to_get;
+  }
 
-  // Scan to the beginning of the line sample.
-  for (ii=0; ii<num_lines_to_get; ii++) {
+  // Scan to the beginning of each run and read it.
+  for (ii=0; ii<num_runs; ii++) {
+    void *run_dest =
+        (unsigned char *)dest + (size_t)ii*samples_per_run*dest_sample_size;
     offset = (long long)sample_size *
         ((long long)sample_count * ((long long)line_number + (long long)ii) + (long long)sample_number);
     if (offset<0) {
         asfPrintError("File offset overflow error ...file is too large to read.\n"
-                      "offset = %ld (sample_size * (sample_count * (line_number + ii) + sample_number)\n"
+                      "offset = %lld (sample_size * (sample_count * (line_number + ii) + sample_number)\n"
                       "sample_size = %d\n"
                       "sample_count = %d\n"
                       "line_number = %d\n"
                       "ii = %d\n"
                       "sample_number = %d\n",
-                      offset, sample_size, sample_count, line_number, ii, sample_number);
+                      offset, (int)sample_size, sample_count, line_number, ii,
+                      sample_number);
+    }
+    if (map) {
+      samples_gotten += read_mapped_run(map, offset, convert, sample_size,
+          components_per_sample(data_type), samples_per_run, run_dest);
+      continue;
     }
     FSEEK64(file, offset, SEEK_SET);
-    line_samples_gotten = ASF_FREAD(temp_buffer+ii*num_samples_to_get*sample_size,
-        sample_size, num_samples_to_get, file);
-    samples_gotten += line_samples_gotten;
+    samples_gotten += read_converted_run(file, convert,
+        data_type == dest_data_type, sample_size, dest_sample_size,
+        components_per_sample(data_type), samples_per_run, run_dest);
   }
 
-  /* Fill in destination array.  */
-  switch (data_type) {
-    case REAL32:
-      for ( ii=0; ii<samples_gotten; ii++ ) {
-        ieee_big32(((float*)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case ASF_BYTE:((unsigned char*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case INTEGER16:((short int*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case INTEGER32:((int*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case REAL32:((float*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case REAL64:((double*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case COMPLEX_REAL32:
-      for ( ii=0; ii<samples_gotten*2; ii++ ) {
-        ieee_big32(((float*)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER32:((int*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case COMPLEX_REAL32:((float*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-         case COMPLEX_REAL64:((double*)dest)[ii] = ((float*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case ASF_BYTE:
-      for ( ii=0; ii<samples_gotten; ii++ ) {
-        switch (dest_data_type) {
-         case ASF_BYTE:((unsigned char*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case INTEGER16:((short int*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case INTEGER32:((int*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case REAL32:((float*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case REAL64:((double*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-        }
-      }
-     break;
-    case INTEGER16:
-      for ( ii=0; ii<samples_gotten; ii++ ) {
-        big16(((short int *)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case ASF_BYTE:((unsigned char*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case INTEGER16:((short int*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case INTEGER32:((int*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case REAL32:((float*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case REAL64:((double*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case INTEGER32:
-      for ( ii=0; ii<samples_gotten; ii++ ) {
-        big32(((int *)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case ASF_BYTE:((unsigned char*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case INTEGER16:((short int*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case INTEGER32:((int*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case REAL32:((float*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case REAL64:((double*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case REAL64:
-      for ( ii=0; ii<samples_gotten; ii++ ) {
-        ieee_big64(((double*)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case ASF_BYTE:((unsigned char*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case INTEGER16:((short int*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case INTEGER32:((int*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case REAL32:((float*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case REAL64:((double*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-        }
-      }
-    case COMPLEX_BYTE:
-      for ( ii=0; ii<samples_gotten*2; ii++ ) {
-        switch (dest_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER32:((int*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case COMPLEX_REAL32:((float*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-         case COMPLEX_REAL64:((double*)dest)[ii] = ((unsigned char*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case COMPLEX_INTEGER16:
-      for ( ii=0; ii<samples_gotten*2; ii++ ) {
-        big16(((short int *)temp_buffer)[ii]);
-         switch (dest_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER32:((int*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case COMPLEX_REAL32:((float*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-         case COMPLEX_REAL64:((double*)dest)[ii] = ((short int*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case COMPLEX_INTEGER32:
-      for ( ii=0; ii<samples_gotten*2; ii++ ) {
-        big32(((int *)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER32:((int*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case COMPLEX_REAL32:((float*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-         case COMPLEX_REAL64:((double*)dest)[ii] = ((int*)temp_buffer)[ii];break;
-        }
-      }
-      break;
-    case COMPLEX_REAL64:
-      for ( ii=0; ii<samples_gotten*2; ii++ ) {
-        ieee_big64(((double*)temp_buffer)[ii]);
-        switch (dest_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case COMPLEX_INTEGER32:((int*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case COMPLEX_REAL32:((float*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-         case COMPLEX_REAL64:((double*)dest)[ii] = ((double*)temp_buffer)[ii];break;
-        }
-      }
-  }
-
-  FREE(temp_buffer);
   return samples_gotten;
 }
 
+/*******************************************************************************
+ * Get x number of lines of data (any data type) and fill a pre-allocated array
+ * with it. The data is assumed to be in the byte order given in the metadata
+ * (normally big endian) and will be converted to the native machine's format.
+ * The line_number argument is the zero-indexed line number to get. The dest
+ * argument must be a pointer to existing memory.  Full-width requests are read
+ * with a single seek and read, partial lines with one per line. Returns the
+ * amount of samples successfully read & converted. */
+int get_data_lines(FILE *file, meta_parameters *meta,
+       int line_number, int num_lines_to_get,
+       int sample_number, int num_samples_to_get,
+       void *dest, int dest_data_type)
+{
+  return get_data_runs(file, NULL, meta, line_number, num_lines_to_get,
+      sample_number, num_samples_to_get, dest, dest_data_type);
+}
+
 int get_partial_byte_line(FILE *file, meta_parameters *meta, int line_number,
         int sample_number, int num_samples_to_get,
         unsigned char *dest)
@@ -368,22 +582,148 @@ int get_complexFloat_lines(FILE *file, meta_parameters *meta, int line_number,
       0, meta->general->sample_count, dest, COMPLEX_REAL32);
 }
 
+/*******************************************************************************
+ * Open an image file for reading through a memory mapping of the whole file,
+ * so that readers share the page cache instead of copying the data, and
+ * threads can read the same image at once (a mapping, unlike a FILE, has no
+ * file position).  Samples are still byteswapped and converted as they are
+ * read.  Files that can't be mapped (pipes, for instance, or files too large
+ * for the address space) are read with stdio, as get_data_lines() does, in
+ * which case the map must not be shared between threads.  Returns NULL, with
+ * errno set, if the file can't be opened. */
+image_map_t *image_map_open(const char *file_name)
+{
+  image_map_t *map;
+  FILE *fp = fopen(file_name, "rb");
+
+  if (!fp)
+    return NULL;
+
+  map = (image_map_t *)MALLOC(sizeof(image_map_t));
+  map->fp = fp;
+  map->data = NULL;
+  map->size = 0;
+
+#ifndef win32
+  {
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0 && (unsigned long long)st.st_size <= (size_t)-1)
+    {
+      void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                        fileno(fp), 0);
+      if (data != MAP_FAILED) {
+        map->data = (const unsigned char *)data;
+        map->size = (long long)st.st_size;
+        fclose(fp);
+        map->fp = NULL;
+      }
+    }
+  }
+#endif
+
+  return map;
+}
+
+void image_map_close(image_map_t *map)
+{
+  if (!map)
+    return;
+#ifndef win32
+  if (map->data)
+    munmap((void *)map->data, (size_t)map->size);
+#endif
+  if (map->fp)
+    fclose(map->fp);
+  FREE(map);
+}
+
+/* TRUE if the image is being read through a memory mapping. */
+int image_map_is_mapped(const image_map_t *map)
+{
+  return map->data != NULL;
+}
+
+/*******************************************************************************
+ * Pointer to length bytes of the file starting offset bytes in, as they are
+ * stored in the file (i.e., in meta->general->byte_order), without copying
+ * them.  Returns NULL
+ * if the image isn't mapped or the bytes aren't all in the file, in which
+ * case image_map_read() can be used instead. */
+const void *image_map_bytes(const image_map_t *map, long long offset,
+                            long long length)
+{
+  if (!map->data || offset < 0 || length < 0 || offset + length > map->size)
+    return NULL;
+  return map->data + offset;
+}
+
+/*******************************************************************************
+ * Copy up to length bytes of the file starting offset bytes in into dest, as
+ * they are stored in the file.  Returns the number of bytes copied. */
+size_t image_map_read(image_map_t *map, long long offset, size_t length,
+                      void *dest)
+{
+  if (map->data) {
+    if (offset < 0 || offset >= map->size)
+      return 0;
+    if ((long long)length > map->size - offset)
+      length = (size_t)(map->size - offset);
+    memcpy(dest, map->data + offset, length);
+    return length;
+  }
+  FSEEK64(map->fp, offset, SEEK_SET);
+  return ASF_FREAD(dest, 1, length, map->fp);
+}
+
+/*******************************************************************************
+ * Same as get_data_lines(), but reading from an image opened with
+ * image_map_open(). */
+int image_map_get_data_lines(image_map_t *map, meta_parameters *meta,
+       int line_number, int num_lines_to_get,
+       int sample_number, int num_samples_to_get,
+       void *dest, int dest_data_type)
+{
+  return get_data_runs(map->fp, map->data ? map : NULL, meta,
+      line_number, num_lines_to_get, sample_number, num_samples_to_get,
+      dest, dest_data_type);
+}
+
+int image_map_get_float_line(image_map_t *map, meta_parameters *meta,
+                             int line_number, float *dest)
+{
+  return image_map_get_data_lines(map, meta, line_number, 1,
+      0, meta->general->sample_count, dest, REAL32);
+}
+
+int image_map_get_float_lines(image_map_t *map, meta_parameters *meta,
+                              int line_number, int num_lines_to_get,
+                              float *dest)
+{
+  return image_map_get_data_lines(map, meta, line_number, num_lines_to_get,
+      0, meta->general->sample_count, dest, REAL32);
+}
+
 /*******************************************************************************
  * Write x number of lines of any data type to file in the data format specified
- * by the meta structure. It is always written in big endian format. Returns the
+ * by the meta structure, in the byte order it specifies. Returns the
  * amount of samples successfully converted & written. Will not write more lines
  * than specified in the supplied meta struct. */
 static int put_data_lines(FILE *file, meta_parameters *meta, int band_number,
                           int line_number_in_band, int num_lines_to_put,
                           const void *source, int source_data_type)
 {
-  int ii;               /* Sample index.                       */
-  int samples_put;      /* Number of samples written           */
-  size_t sample_size;   /* Sample size in bytes.               */
-  void *out_buffer;     /* Buffer of converted data to write.  */
+  double chunk[IO_CHUNK_BYTES/sizeof(double)]; /* Converted data to write.  */
+  size_t chunk_samples;  /* Number of samples that fit in the chunk.   */
+  size_t samples_put=0;  /* Number of samples written                  */
+  size_t sample_size;    /* Sample size in bytes.                      */
+  size_t source_sample_size;
+  sample_converter_t convert;
+  int components;
+  const unsigned char *in = (const unsigned char *)source;
   int sample_count       = meta->general->sample_count;
   int data_type          = meta->general->data_type;
-  int num_samples_to_put = num_lines_to_put * sample_count;
+  size_t num_samples_to_put = (size_t)num_lines_to_put * sample_count;
   int line_number        = meta->general->line_count * band_number +
                                line_number_in_band;
 
@@ -401,8 +741,11 @@ static int put_data_lines(FILE *file, meta_parameters *meta, int band_number,
   if (meta->optical)
     data_type = ASF_BYTE;
 
-  /* Determine sample size.  */
+  /* Determine sample sizes and the conversion kernel.  */
   sample_size = data_type2sample_size(data_type);
+  source_sample_size = data_type2sample_size(source_data_type);
+  components = components_per_sample(data_type);
+  convert = buffer_to_file(meta, source_data_type, data_type);
 
   /* Make sure not to make file bigger than meta says it should be */
   if (line_number > meta->general->line_count * meta->general->band_count) {
@@ -418,136 +761,29 @@ static int put_data_lines(FILE *file, meta_parameters *meta, int band_number,
 		  num_lines_to_put, line_number, meta->general->band_count);
 
   FSEEK64(file, (long long)sample_size*sample_count*line_number, SEEK_SET);
-  out_buffer = MALLOC( sample_size * sample_count * num_lines_to_put );
 
-  /* Fill in destination array.  */
-  switch (data_type) {
-    case REAL32:
-      for ( ii=0; ii<num_samples_to_put; ii++ ) {
-        switch (source_data_type) {
-         case ASF_BYTE:((float*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case INTEGER16:((float*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case INTEGER32:((float*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case REAL32:((float*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case REAL64:((float*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        ieee_big32( ((float*)out_buffer)[ii] );
-      }
-      break;
-    case COMPLEX_REAL32:
-      for ( ii=0; ii<num_samples_to_put*2; ii++ ) {
-        switch (source_data_type) {
-         case COMPLEX_BYTE:((float*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case COMPLEX_INTEGER16:((float*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case COMPLEX_INTEGER32:((float*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case COMPLEX_REAL32:((float*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case COMPLEX_REAL64:((float*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        ieee_big32( ((float*)out_buffer)[ii] );
-      }
-      break;
-    case ASF_BYTE:
-      for ( ii=0; ii<num_samples_to_put; ii++ ) {
-        switch (source_data_type) {
-         case ASF_BYTE:((unsigned char*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case INTEGER16:((unsigned char*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case INTEGER32:((unsigned char*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case REAL32:((unsigned char*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case REAL64:((unsigned char*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-      }
-      break;
-    case INTEGER16:
-      for ( ii=0; ii<num_samples_to_put; ii++ ) {
-        switch (source_data_type) {
-         case ASF_BYTE:((short int*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case INTEGER16:((short int*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case INTEGER32:((short int*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case REAL32:((short int*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case REAL64:((short int*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        big16( ((short int*)out_buffer)[ii] );
-      }
-      break;
-    case INTEGER32:
-      for ( ii=0; ii<num_samples_to_put; ii++ ) {
-        switch (source_data_type) {
-         case ASF_BYTE:((int*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case INTEGER16:((int*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case INTEGER32:((int*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case REAL32:((int*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case REAL64:((int*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        big32( ((int*)out_buffer)[ii] );
-      }
-      break;
-    case REAL64:
-      for ( ii=0; ii<num_samples_to_put; ii++ ) {
-        switch (source_data_type) {
-         case ASF_BYTE:((double*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case INTEGER16:((double*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case INTEGER32:((double*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case REAL32:((double*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case REAL64:((double*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        ieee_big64( ((double*)out_buffer)[ii] );
-      }
-      break;
-    case COMPLEX_BYTE:
-      for ( ii=0; ii<num_samples_to_put*2; ii++ )
-        switch (source_data_type) {
-         case COMPLEX_BYTE:((unsigned char*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case COMPLEX_INTEGER16:((unsigned char*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case COMPLEX_INTEGER32:((unsigned char*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case COMPLEX_REAL32:((unsigned char*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case COMPLEX_REAL64:((unsigned char*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-     break;
-    case COMPLEX_INTEGER16:
-      for ( ii=0; ii<num_samples_to_put*2; ii++ ) {
-        switch (source_data_type) {
-         case COMPLEX_BYTE:((short int*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case COMPLEX_INTEGER16:((short int*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case COMPLEX_INTEGER32:((short int*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case COMPLEX_REAL32:((short int*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case COMPLEX_REAL64:((short int*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        big16( ((short int*)out_buffer)[ii] );
-      }
-      break;
-    case COMPLEX_INTEGER32:
-      for ( ii=0; ii<num_samples_to_put*2; ii++ ) {
-        switch (source_data_type) {
-         case COMPLEX_BYTE:((int*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case COMPLEX_INTEGER16:((int*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case COMPLEX_INTEGER32:((int*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case COMPLEX_REAL32:((int*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case COMPLEX_REAL64:((int*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        big32( ((int*)out_buffer)[ii] );
-      }
-      break;
-    case COMPLEX_REAL64:
-      for ( ii=0; ii<num_samples_to_put*2; ii++ ) {
-        switch (source_data_type) {
-         case COMPLEX_BYTE:((double*)out_buffer)[ii] = ((unsigned char*)source)[ii];break;
-         case COMPLEX_INTEGER16:((double*)out_buffer)[ii] = ((short int*)source)[ii];break;
-         case COMPLEX_INTEGER32:((double*)out_buffer)[ii] = ((int*)source)[ii];break;
-         case COMPLEX_REAL32:((double*)out_buffer)[ii] = ((float*)source)[ii];break;
-         case COMPLEX_REAL64:((double*)out_buffer)[ii] = ((double*)source)[ii];break;
-        }
-        ieee_big64( ((double*)out_buffer)[ii] );
-      }
+  /* Convert and write the data a cache sized chunk at a time, or all at
+     once if it needs no converting.  */
+  chunk_samples = IO_CHUNK_BYTES / sample_size;
+  if (!convert)
+    samples_put = ASF_FWRITE(in, sample_size, num_samples_to_put, file);
+  while (convert && samples_put < num_samples_to_put) {
+    size_t n = num_samples_to_put - samples_put;
+    size_t written;
+    if (n > chunk_samples)
+      n = chunk_samples;
+    convert(in + samples_put*source_sample_size, chunk, n*components);
+    written = ASF_FWRITE(chunk, sample_size, n, file);
+    samples_put += written;
+    if (written != n)
       break;
   }
-  samples_put = ASF_FWRITE(out_buffer, sample_size, num_samples_to_put, file);
-  FREE(out_buffer);
 
   if ( samples_put != num_samples_to_put ) {
     printf("put_data_lines: failed to write the correct number of samples\n");
   }
 
-  return samples_put;
+  return (int)samples_put;
 }
 
 /*******************************************************************************
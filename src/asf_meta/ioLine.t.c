@@ -0,0 +1,280 @@
+#include "CUnit/Basic.h"
+#include "asf_meta.h"
+
+#include <string.h>
+#include <unistd.h>
+
+// The sample converter tables are static
+#include "ioLine.c"
+
+// Stores v as sample ii of buf, a buffer of the given base type (see
+// base_type()) in the given byte order -- done byte by byte, without the
+// converters.
+static void encode_sample(int type, byte_order_t byte_order, double v,
+                          void *buf, int ii)
+{
+  size_t size = data_type2sample_size(ASF_BYTE + type);
+  unsigned char bytes[8], *out = (unsigned char *)buf + ii*size;
+  size_t jj;
+  unsigned char b = (unsigned char)v;
+  short int i16 = (short int)v;
+  int i32 = (int)v;
+  float r32 = (float)v;
+  double r64 = v;
+  const void *host[5] = { &b, &i16, &i32, &r32, &r64 };
+
+  memcpy(bytes, host[type], size);
+  for (jj=0; jj<size; jj++)
+    out[jj] = byte_order == meta_native_byte_order() ?
+      bytes[jj] : bytes[size-1-jj];
+}
+
+// Runs every converter in the tables: each sample type to each file type
+// in each byte order, checking the bytes it makes, and back again.
+static void converters_round_trip(void)
+{
+  const int n = 300;
+  byte_order_t orders[2] = { META_BIG_ENDIAN, META_LITTLE_ENDIAN };
+  unsigned char src[8*300], encoded[8*300], expected[8*300], back[8*300];
+  int oo, ss, dd, ii;
+
+  for (oo=0; oo<2; oo++) {
+    const sample_converter_t (*to)[5] =
+      orders[oo] == META_BIG_ENDIAN ? convert_to_big : convert_to_lil;
+    const sample_converter_t (*from)[5] =
+      orders[oo] == META_BIG_ENDIAN ? convert_from_big : convert_from_lil;
+
+    for (ss=0; ss<5; ss++) {
+      for (dd=0; dd<5; dd++) {
+        size_t src_size = data_type2sample_size(ASF_BYTE + ss);
+        size_t dst_size = data_type2sample_size(ASF_BYTE + dd);
+
+        // values every type holds exactly
+        for (ii=0; ii<n; ii++) {
+          encode_sample(ss, meta_native_byte_order(), (ii*7)%250, src, ii);
+          encode_sample(dd, orders[oo], (ii*7)%250, expected, ii);
+        }
+
+        to[ss][dd](src, encoded, n);
+        CU_ASSERT(memcmp(encoded, expected, n*dst_size) == 0);
+        from[dd][ss](encoded, back, n);
+        CU_ASSERT(memcmp(back, src, n*src_size) == 0);
+      }
+    }
+  }
+}
+
+// Writes a small two band image of the given data type and byte order,
+// checks the first samples are stored in that byte order, and checks that
+// full, multi-line and partial reads convert back to the original values.
+static void round_trip(int data_type, byte_order_t byte_order)
+{
+  const int ns = 57, nl = 9;
+  int ii, jj, n = ns*nl*2;
+  double *src = MALLOC(sizeof(double)*n);
+  double *dst = MALLOC(sizeof(double)*n);
+  float *fdst = MALLOC(sizeof(float)*n);
+  unsigned char *bdst = MALLOC(n);
+  meta_parameters *meta = raw_init();
+  FILE *fp = tmpfile();
+  CU_ASSERT_FATAL(fp != NULL);
+
+  meta->general->data_type = data_type;
+  meta->general->line_count = nl;
+  meta->general->sample_count = ns;
+  meta->general->band_count = 2;
+  meta->general->byte_order = byte_order;
+
+  for (ii=0; ii<n; ii++)
+    src[ii] = (ii*7)%250;
+
+  CU_ASSERT(put_double_lines(fp, meta, 0, nl*2, src) == n);
+
+  {
+    unsigned char raw[4*8], expected[4*8];
+    size_t size = data_type2sample_size(data_type);
+    for (ii=0; ii<4; ii++)
+      encode_sample(base_type(data_type), byte_order, src[ii], expected, ii);
+    FSEEK64(fp, 0, SEEK_SET);
+    CU_ASSERT(fread(raw, size, 4, fp) == 4);
+    CU_ASSERT(memcmp(raw, expected, 4*size) == 0);
+  }
+
+  CU_ASSERT(get_double_lines(fp, meta, 0, nl*2, dst) == n);
+  for (ii=0; ii<n; ii++)
+    CU_ASSERT(dst[ii] == src[ii]);
+
+  CU_ASSERT(get_band_float_lines(fp, meta, 1, 2, 3, fdst) == 3*ns);
+  for (ii=0; ii<3*ns; ii++)
+    CU_ASSERT(fdst[ii] == (float)src[(nl+2)*ns + ii]);
+
+  CU_ASSERT(get_partial_byte_lines(fp, meta, 4, 5, 10, 20, bdst) == 5*20);
+  for (ii=0; ii<5; ii++)
+    for (jj=0; jj<20; jj++)
+      CU_ASSERT(bdst[ii*20+jj] == (unsigned char)src[(4+ii)*ns + 10+jj]);
+
+  fclose(fp);
+  meta_free(meta);
+  FREE(src);
+  FREE(dst);
+  FREE(fdst);
+  FREE(bdst);
+}
+
+static void complex_round_trip(int data_type, byte_order_t byte_order)
+{
+  const int ns = 33, nl = 5;
+  int ii, n = ns*nl;
+  complexFloat *src = MALLOC(sizeof(complexFloat)*n);
+  complexFloat *dst = MALLOC(sizeof(complexFloat)*n);
+  meta_parameters *meta = raw_init();
+  FILE *fp = tmpfile();
+  CU_ASSERT_FATAL(fp != NULL);
+
+  meta->general->data_type = data_type;
+  meta->general->line_count = nl;
+  meta->general->sample_count = ns;
+  meta->general->band_count = 1;
+  meta->general->byte_order = byte_order;
+
+  for (ii=0; ii<n; ii++) {
+    src[ii].real = ii%100;
+    src[ii].imag = (ii*3)%100;
+  }
+
+  CU_ASSERT(put_complexFloat_lines(fp, meta, 0, nl, src) == n);
+  CU_ASSERT(get_complexFloat_lines(fp, meta, 0, nl, dst) == n);
+  for (ii=0; ii<n; ii++) {
+    CU_ASSERT(dst[ii].real == src[ii].real);
+    CU_ASSERT(dst[ii].imag == src[ii].imag);
+  }
+
+  fclose(fp);
+  meta_free(meta);
+  FREE(src);
+  FREE(dst);
+}
+
+// Reads the same lines through image_map_open() and through stdio, into
+// buffers filled with the same junk, and checks they come out identical.
+static void compare_map_and_stdio(const char *name, meta_parameters *meta,
+                                  int line, int num_lines, int sample,
+                                  int num_samples, int dest_data_type)
+{
+  size_t size = (size_t)num_lines*num_samples*
+    data_type2sample_size(dest_data_type);
+  unsigned char *from_map = MALLOC(size);
+  unsigned char *from_stdio = MALLOC(size);
+  image_map_t *map = image_map_open(name);
+  FILE *fp = fopen(name, "rb");
+  int map_count, stdio_count;
+  size_t ii;
+  CU_ASSERT_FATAL(map != NULL && fp != NULL);
+  CU_ASSERT(image_map_is_mapped(map));
+
+  memset(from_map, 0xab, size);
+  memset(from_stdio, 0xab, size);
+  map_count = image_map_get_data_lines(map, meta, line, num_lines,
+                                       sample, num_samples, from_map,
+                                       dest_data_type);
+  stdio_count = get_data_lines(fp, meta, line, num_lines,
+                               sample, num_samples, from_stdio,
+                               dest_data_type);
+  // fread() may leave part of a sample it couldn't finish in the buffer,
+  // so only what both say they read is compared -- and the mapping must
+  // not have touched anything after that
+  CU_ASSERT(map_count == stdio_count);
+  if (map_count == stdio_count) {
+    size_t got = (size_t)map_count*data_type2sample_size(dest_data_type);
+    CU_ASSERT(memcmp(from_map, from_stdio, got) == 0);
+    for (ii=got; ii<size; ii++)
+      CU_ASSERT(from_map[ii] == 0xab);
+  }
+
+  fclose(fp);
+  image_map_close(map);
+  FREE(from_map);
+  FREE(from_stdio);
+}
+
+// Writes an image, then compares reading it through the memory mapping
+// and through stdio: whole, in pieces, and again after cutting the file
+// off partway through a sample of its last line.
+static void map_matches_stdio(int data_type)
+{
+  const char *name = "ioLine_test.img";
+  const int ns = 41, nl = 7;
+  int complex = data_type >= COMPLEX_BYTE;
+  int ii, n = ns*nl;
+  double *src = MALLOC(sizeof(double)*2*n);
+  meta_parameters *meta = raw_init();
+  behavior_on_error_t behavior = caplib_behavior_on_error;
+  FILE *fp = fopen(name, "wb");
+  CU_ASSERT_FATAL(fp != NULL);
+
+  meta->general->data_type = data_type;
+  meta->general->line_count = nl;
+  meta->general->sample_count = ns;
+  meta->general->band_count = 1;
+
+  for (ii=0; ii<2*n; ii++)
+    src[ii] = (ii*13)%250;
+  if (complex) {
+    complexFloat *csrc = MALLOC(sizeof(complexFloat)*n);
+    for (ii=0; ii<n; ii++) {
+      csrc[ii].real = src[2*ii];
+      csrc[ii].imag = src[2*ii+1];
+    }
+    CU_ASSERT(put_complexFloat_lines(fp, meta, 0, nl, csrc) == n);
+    FREE(csrc);
+  }
+  else
+    CU_ASSERT(put_double_lines(fp, meta, 0, nl, src) == n);
+  fclose(fp);
+
+  // Short reads at the end of the file are expected below
+  caplib_behavior_on_error = BEHAVIOR_ON_ERROR_CONTINUE;
+
+  for (ii=0; ii<2; ii++) {
+    if (complex) {
+      compare_map_and_stdio(name, meta, 0, nl, 0, ns, data_type);
+      compare_map_and_stdio(name, meta, 0, nl, 0, ns, COMPLEX_REAL32);
+      compare_map_and_stdio(name, meta, 2, nl-2, 5, 30, COMPLEX_REAL64);
+    }
+    else {
+      compare_map_and_stdio(name, meta, 0, nl, 0, ns, data_type);
+      compare_map_and_stdio(name, meta, 0, nl, 0, ns, REAL32);
+      compare_map_and_stdio(name, meta, 2, nl-2, 5, 30, REAL64);
+      compare_map_and_stdio(name, meta, nl-1, 1, 0, ns, ASF_BYTE);
+    }
+    compare_map_and_stdio(name, meta, nl-1, 1, 30, 11, data_type);
+
+    // Now cut the last line short, in the middle of a sample if they
+    // are more than a byte
+    CU_ASSERT(truncate(name, (off_t)data_type2sample_size(data_type)*
+                       (n - ns/2) - 1) == 0);
+  }
+
+  caplib_behavior_on_error = behavior;
+  remove(name);
+  meta_free(meta);
+  FREE(src);
+}
+
+void test_ioLine()
+{
+  int data_type;
+  converters_round_trip();
+  for (data_type=ASF_BYTE; data_type<=REAL64; data_type++) {
+    round_trip(data_type, META_BIG_ENDIAN);
+    round_trip(data_type, META_LITTLE_ENDIAN);
+  }
+  for (data_type=COMPLEX_BYTE; data_type<=COMPLEX_REAL64; data_type++) {
+    complex_round_trip(data_type, META_BIG_ENDIAN);
+    complex_round_trip(data_type, META_LITTLE_ENDIAN);
+  }
+  for (data_type=ASF_BYTE; data_type<=REAL64; data_type++)
+    map_matches_stdio(data_type);
+  for (data_type=COMPLEX_BYTE; data_type<=COMPLEX_REAL64; data_type++)
+    map_matches_stdio(data_type);
+}
@@ -0,0 +1,182 @@
+// Test program useful for checking the throughput of the get_data_lines()
+// and put_data_lines() conversion engine in ioLine.c.
+//
+// Writes a scratch image of each tested data type, then reads it back with
+// get_float_lines(), with a copy of the old per-line, per-sample switch read
+// loop, and through a memory mapping with image_map_get_float_lines(), and
+// reports throughput in GB/s of converted output.
+//
+// Usage: ioLine_speed [lines samples [lines_per_read]]
+
+#include <assert.h>
+#include <time.h>
+
+#include "asf.h"
+#include "asf_meta.h"
+#include "asf_endian.h"
+
+// The read loop get_data_lines() used before it was given per type kernels:
+// a temporary buffer per call, a seek and read per line, and a switch on the
+// destination type for every sample.  Only the non-complex types to REAL32
+// are kept, which is what the benchmark exercises.
+static int old_get_float_lines(FILE *file, meta_parameters *meta,
+                               int line_number, int num_lines_to_get,
+                               float *dest)
+{
+  int ii, samples_gotten = 0;
+  int sample_count = meta->general->sample_count;
+  int data_type = meta->general->data_type;
+  size_t sample_size = data_type2sample_size(data_type);
+  void *temp_buffer = MALLOC(sample_size * num_lines_to_get * sample_count);
+  int dest_data_type = REAL32;
+
+  for (ii=0; ii<num_lines_to_get; ii++) {
+    long long offset = (long long)sample_size * sample_count *
+      (line_number + ii);
+    FSEEK64(file, offset, SEEK_SET);
+    samples_gotten += ASF_FREAD((char *)temp_buffer +
+                                ii*sample_count*sample_size,
+                                sample_size, sample_count, file);
+  }
+
+  for (ii=0; ii<samples_gotten; ii++) {
+    switch (data_type) {
+      case ASF_BYTE:
+        switch (dest_data_type) {
+          case REAL32:dest[ii] = ((unsigned char*)temp_buffer)[ii];break;
+        }
+        break;
+      case INTEGER16:
+        big16(((short int *)temp_buffer)[ii]);
+        switch (dest_data_type) {
+          case REAL32:dest[ii] = ((short int*)temp_buffer)[ii];break;
+        }
+        break;
+      case INTEGER32:
+        big32(((int *)temp_buffer)[ii]);
+        switch (dest_data_type) {
+          case REAL32:dest[ii] = ((int*)temp_buffer)[ii];break;
+        }
+        break;
+      case REAL32:
+        ieee_big32(((float*)temp_buffer)[ii]);
+        switch (dest_data_type) {
+          case REAL32:dest[ii] = ((float*)temp_buffer)[ii];break;
+        }
+        break;
+      case REAL64:
+        ieee_big64(((double*)temp_buffer)[ii]);
+        switch (dest_data_type) {
+          case REAL32:dest[ii] = ((double*)temp_buffer)[ii];break;
+        }
+        break;
+    }
+  }
+
+  FREE(temp_buffer);
+  return samples_gotten;
+}
+
+static double seconds_since(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double gb_per_second(meta_parameters *meta, double seconds)
+{
+  double bytes = (double)meta->general->line_count *
+    meta->general->sample_count * sizeof(float);
+  return seconds > 0 ? bytes / seconds / 1.0e9 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  int lines = argc > 2 ? atoi(argv[1]) : 4096;
+  int samples = argc > 2 ? atoi(argv[2]) : 4096;
+  int chunk = argc > 3 ? atoi(argv[3]) : CHUNK_OF_LINES;
+  int types[] = { ASF_BYTE, INTEGER16, INTEGER32, REAL32, REAL64 };
+  const char *type_names[] = { "BYTE", "INTEGER16", "INTEGER32", "REAL32",
+                               "REAL64" };
+  float *line_buf = MALLOC(sizeof(float) * samples * chunk);
+  float *check_buf = MALLOC(sizeof(float) * samples * chunk);
+  meta_parameters *meta = raw_init();
+  int ii, tt;
+
+  assert(lines > 0 && samples > 0 && chunk > 0);
+  meta->general->line_count = lines;
+  meta->general->sample_count = samples;
+  meta->general->band_count = 1;
+
+  printf("%d lines x %d samples, %d lines per read\n", lines, samples, chunk);
+  printf("%-10s %12s %12s %12s %12s\n", "type", "write GB/s", "old GB/s",
+         "new GB/s", "mapped GB/s");
+
+  for (tt = 0; tt < (int)(sizeof(types)/sizeof(types[0])); tt++) {
+    const char *tmp_name = "ioLine_speed.tmp";
+    FILE *fp = FOPEN(tmp_name, "w+b");
+    double put_time, old_time, new_time, mapped_time;
+    image_map_t *map;
+    clock_t start;
+
+    meta->general->data_type = types[tt];
+    for (ii = 0; ii < samples * chunk; ii++)
+      line_buf[ii] = ii % 251;
+
+    start = clock();
+    for (ii = 0; ii < lines; ii += chunk) {
+      int n = ii + chunk > lines ? lines - ii : chunk;
+      put_float_lines(fp, meta, ii, n, line_buf);
+    }
+    fflush(fp);
+    put_time = seconds_since(start);
+
+    // Warm the page cache so both readers see the same conditions.
+    for (ii = 0; ii < lines; ii += chunk) {
+      int n = ii + chunk > lines ? lines - ii : chunk;
+      get_float_lines(fp, meta, ii, n, line_buf);
+    }
+
+    start = clock();
+    for (ii = 0; ii < lines; ii += chunk) {
+      int n = ii + chunk > lines ? lines - ii : chunk;
+      old_get_float_lines(fp, meta, ii, n, check_buf);
+    }
+    old_time = seconds_since(start);
+
+    start = clock();
+    for (ii = 0; ii < lines; ii += chunk) {
+      int n = ii + chunk > lines ? lines - ii : chunk;
+      get_float_lines(fp, meta, ii, n, line_buf);
+    }
+    new_time = seconds_since(start);
+
+    // Both readers should agree on the last chunk read.
+    for (ii = 0; ii < samples * ((lines - 1) % chunk + 1); ii++)
+      assert(line_buf[ii] == check_buf[ii]);
+
+    map = image_map_open(tmp_name);
+    assert(map != NULL);
+    start = clock();
+    for (ii = 0; ii < lines; ii += chunk) {
+      int n = ii + chunk > lines ? lines - ii : chunk;
+      image_map_get_float_lines(map, meta, ii, n, check_buf);
+    }
+    mapped_time = seconds_since(start);
+
+    for (ii = 0; ii < samples * ((lines - 1) % chunk + 1); ii++)
+      assert(line_buf[ii] == check_buf[ii]);
+
+    printf("%-10s %12.3f %12.3f %12.3f %12.3f%s\n", type_names[tt],
+           gb_per_second(meta, put_time), gb_per_second(meta, old_time),
+           gb_per_second(meta, new_time), gb_per_second(meta, mapped_time),
+           image_map_is_mapped(map) ? "" : " (not mapped)");
+    image_map_close(map);
+    FCLOSE(fp);
+    remove(tmp_name);
+  }
+
+  FREE(line_buf);
+  FREE(check_buf);
+  meta_free(meta);
+  return EXIT_SUCCESS;
+}
@@ -271,7 +271,8 @@ envi_header* meta2envi(meta_parameters *meta)
   sprintf(envi->interleave, "bsq"); /* Taken as the default value for now,
                                        since we don't have multiband imagery */
   sprintf(envi->sensor_type, "Unknown");
-  envi->byte_order = 1; /* big endian data */
+  /* big endian data, unless the metadata says otherwise */
+  envi->byte_order = meta->general->byte_order == META_LITTLE_ENDIAN ? 0 : 1;
   envi->ref_pixel_x = 0;
   envi->ref_pixel_y = 0;
   envi->pixel_easting = MAGIC_UNSET_DOUBLE;
@@ -0,0 +1,548 @@
+/****************************************************************
+FUNCTION NAME:  meta_geo_context_*, meta_get_*_arr
+
+DESCRIPTION:
+   Geolocation of many points of one image.
+
+   For slant and ground range images that are located with state
+   vectors, the context holds the orbit interpolation coefficients
+   (the same cubics interp_stVec uses, or the nine vector Legendre
+   scheme of meta_interp_stVec), so they are set up just once.
+
+   Going from line and sample to latitude and longitude, the target
+   is found by solving the three range-doppler equations (on the
+   ellipsoid, at the given slant range, at the given doppler) for the
+   target position with Newton's method.  This is the same model
+   getLoc() iterates over look and yaw angles.
+
+   Going back, the target position is known, so only the time of
+   the line has to be found: Newton's method on the doppler equation,
+   with the derivative from the orbit's velocity and acceleration.
+   The slant range at that time gives the sample.  This replaces the
+   search meta_get_lineSamp() used to do with meta_get_latLon().
+
+   All other images are passed on to meta_get_latLon() and
+   meta_get_lineSamp().
+
+RETURN VALUE:
+
+SPECIAL CONSIDERATIONS:
+   Nothing in the context (or the metadata) is changed after
+   meta_geo_context_new(), so threads may share a context.
+
+PROGRAM HISTORY:
+****************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+
+/*******************************************************************
+ * Prototypes                                                     */
+void meta_choose_reverse_transform(meta_parameters *meta);
+int meta_get_lineSamp_search(meta_parameters *meta,
+                             double lat, double lon, double elev,
+                             double *yLine, double *xSamp);
+int meta_get_lineSamp_orbit(meta_parameters *meta,
+                            double lat, double lon, double elev,
+                            double *yLine, double *xSamp);
+
+#define SQR(x) ((x)*(x))
+
+/* WGS-84, as in init_geolocate() */
+#define GEO_RE 6378137.0
+#define GEO_RP (GEO_RE - GEO_RE/298.257223563)
+
+#define GEO_MAX_ITER 20
+#define GEO_TIME_TOL 1e-7   /* seconds -- well under a millimeter */
+#define GEO_POS_TOL 1e-4    /* meters */
+
+/* Cubic through two state vectors, over t = (time - start)/length,
+   set up just as interp_stVec() does it. */
+typedef struct {
+  double start, length;
+  double coefs[3][4];
+} orbit_segment;
+
+struct meta_geo_context {
+  meta_parameters *meta;
+  int uses_orbit;           /* Located with state vectors?              */
+  int legendre;             /* Nine vectors -- meta_interp_stVec scheme */
+  int segment_count;
+  orbit_segment *segments;  /* NULL: worked out in orbit_at() as needed */
+  char side;                /* Look direction, 'R' or 'L'               */
+  double lambda;            /* Wavelength [m]                           */
+  double center_time;       /* Starting guess for the inverse           */
+
+  /* Ground range images with a constant earth radius and satellite
+     height have a closed form for sample as a function of slant.  */
+  int constant_ground;
+  double er, ht, min_phi;
+};
+
+/* Same test meta_get_latLon() makes before using the state vectors. */
+static int uses_orbit(meta_parameters *meta)
+{
+  return !meta->projection && !meta->airsar && !meta->uavsar &&
+         !meta->latlon && !meta->transform && meta->sar &&
+         (meta->sar->image_type == 'S' || meta->sar->image_type == 'G') &&
+         meta->state_vectors && meta->state_vectors->vector_count >= 2;
+}
+
+/* The cubic between state vectors ii and ii+1. */
+static void orbit_segment_init(const meta_state_vectors *sv, int ii,
+                               orbit_segment *seg)
+{
+  const stateVector *st1 = &sv->vecs[ii].vec, *st2 = &sv->vecs[ii+1].vec;
+  double p1[3] = { st1->pos.x, st1->pos.y, st1->pos.z };
+  double p2[3] = { st2->pos.x, st2->pos.y, st2->pos.z };
+  double v1[3] = { st1->vel.x, st1->vel.y, st1->vel.z };
+  double v2[3] = { st2->vel.x, st2->vel.y, st2->vel.z };
+  int kk;
+
+  seg->start = sv->vecs[ii].time;
+  seg->length = sv->vecs[ii+1].time - sv->vecs[ii].time;
+  for (kk=0; kk<3; kk++) {
+    double A = p1[kk], B = p2[kk];
+    double Av = v1[kk]*seg->length, Bv = v2[kk]*seg->length;
+    seg->coefs[kk][0] = A;
+    seg->coefs[kk][1] = Av;
+    seg->coefs[kk][2] = 3*B - 3*A - 2*Av - Bv;
+    seg->coefs[kk][3] = 2*A - 2*B + Av + Bv;
+  }
+}
+
+/* Everything but the segments, which are left NULL: orbit_at() then
+   works out the one it needs each time.  That is all a single point
+   needs, without allocating anything. */
+static void geo_context_init(meta_geo_context *ctx, meta_parameters *meta)
+{
+  ctx->meta = meta;
+  ctx->uses_orbit = uses_orbit(meta);
+  ctx->legendre = FALSE;
+  ctx->segment_count = 0;
+  ctx->segments = NULL;
+  ctx->constant_ground = FALSE;
+
+  if (!ctx->uses_orbit)
+    return;
+
+  meta_state_vectors *sv = meta->state_vectors;
+  meta_sar *ms = meta->sar;
+
+  ctx->side = ms->look_direction;
+  ctx->lambda = ms->wavelength;
+  ctx->center_time = meta_get_time(meta, meta->general->line_count/2, 0);
+
+  if (sv->vector_count == 9)
+    ctx->legendre = TRUE;
+  else
+    ctx->segment_count = sv->vector_count - 1;
+
+  if (ms->image_type == 'G' && meta_is_valid_double(ms->earth_radius) &&
+      meta_is_valid_double(ms->satellite_height)) {
+    ctx->constant_ground = TRUE;
+    ctx->er = ms->earth_radius;
+    ctx->ht = ms->satellite_height;
+    ctx->min_phi = acos((SQR(ctx->ht) + SQR(ctx->er) -
+                         SQR(ms->slant_range_first_pixel)) /
+                        (2.0*ctx->ht*ctx->er));
+  }
+}
+
+/*******************************************************************
+ * meta_geo_context_new:
+ * Sets up the context for geolocating points of the given image.
+ * The metadata is not copied, so it must outlive the context.*/
+meta_geo_context *meta_geo_context_new(meta_parameters *meta)
+{
+  meta_geo_context *ctx = MALLOC(sizeof(meta_geo_context));
+  int ii;
+
+  // meta_get_lineSamp() makes this decision (and records it in the
+  // metadata) the first time it is called -- make it now, so that
+  // the calls using the context don't change anything
+  meta_choose_reverse_transform(meta);
+
+  geo_context_init(ctx, meta);
+  if (ctx->segment_count > 0) {
+    ctx->segments = MALLOC(sizeof(orbit_segment) * ctx->segment_count);
+    for (ii=0; ii<ctx->segment_count; ii++)
+      orbit_segment_init(meta->state_vectors, ii, &ctx->segments[ii]);
+  }
+
+  return ctx;
+}
+
+void meta_geo_context_free(meta_geo_context *ctx)
+{
+  if (ctx) {
+    FREE(ctx->segments);
+    FREE(ctx);
+  }
+}
+
+/* Position from the nine vector Legendre scheme, exactly as
+   interpolate_prc_vector_position() in meta_get.c has it. */
+static vector legendre_position(const meta_state_vectors *sv, double time)
+{
+  static const int noemer[9] =
+    {40320, -5040, 1440, -720, 576, -720, 1440, -5040, 40320};
+  double t1 = sv->vecs[0].time;
+  double tn = sv->vecs[8].time;
+  double x = (time-t1)/(tn-t1)*8.0 + 1.0;
+  double teller = (x-1)*(x-2)*(x-3)*(x-4)*(x-5)*(x-6)*(x-7)*(x-8)*(x-9);
+  vector pos;
+  int kx;
+
+  if (FLOAT_EQUIVALENT(teller, 0.0)) {
+    kx = (int)(x + 0.5) - 1;
+    return sv->vecs[kx].vec.pos;
+  }
+
+  pos.x = pos.y = pos.z = 0.0;
+  for (kx=0; kx<9; kx++) {
+    double coeff = teller/noemer[kx]/(x-kx-1);
+    pos.x += coeff*sv->vecs[kx].vec.pos.x;
+    pos.y += coeff*sv->vecs[kx].vec.pos.y;
+    pos.z += coeff*sv->vecs[kx].vec.pos.z;
+  }
+  return pos;
+}
+
+/* Earth-fixed position, velocity and acceleration of the satellite.
+   Position and velocity are what meta_get_stVec() returns; the
+   acceleration is only used in derivatives. */
+static void orbit_at(const meta_geo_context *ctx, double time,
+                     vector *pos, vector *vel, vector *acc)
+{
+  if (ctx->legendre) {
+    const meta_state_vectors *sv = ctx->meta->state_vectors;
+    vector before = legendre_position(sv, time-0.5);
+    vector after = legendre_position(sv, time+0.5);
+    *pos = legendre_position(sv, time);
+    vecSub(after, before, vel);
+    if (acc) {
+      vector b1 = legendre_position(sv, time-1.0);
+      vector a1 = legendre_position(sv, time+1.0);
+      acc->x = a1.x - 2*pos->x + b1.x;
+      acc->y = a1.y - 2*pos->y + b1.y;
+      acc->z = a1.z - 2*pos->z + b1.z;
+    }
+  }
+  else {
+    // the segment meta_get_stVec() would pick: the last one starting
+    // before the given time (and the first or last one outside)
+    const meta_state_vectors *sv = ctx->meta->state_vectors;
+    int lo = 0, hi = ctx->segment_count - 1, kk;
+    while (lo < hi) {
+      int mid = (lo + hi + 1)/2;
+      if (sv->vecs[mid].time < time)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+
+    orbit_segment local;
+    const orbit_segment *seg;
+    if (ctx->segments)
+      seg = &ctx->segments[lo];
+    else {
+      orbit_segment_init(sv, lo, &local);
+      seg = &local;
+    }
+    double t = (time - seg->start)/seg->length, t2 = t*t;
+    double p[3], v[3], a[3];
+    for (kk=0; kk<3; kk++) {
+      const double *c = seg->coefs[kk];
+      p[kk] = c[0] + c[1]*t + c[2]*t2 + c[3]*t2*t;
+      v[kk] = (c[1] + 2.0*c[2]*t + 3.0*c[3]*t2)/seg->length;
+      a[kk] = (2.0*c[2] + 6.0*c[3]*t)/SQR(seg->length);
+    }
+    pos->x = p[0]; pos->y = p[1]; pos->z = p[2];
+    vel->x = v[0]; vel->y = v[1]; vel->z = v[2];
+    if (acc) {
+      acc->x = a[0]; acc->y = a[1]; acc->z = a[2];
+    }
+  }
+}
+
+/* Earth-fixed position of a point at the given geodetic latitude and
+   longitude (radians) on the ellipsoid with radii re and rp -- which
+   getLatLongMeta() raises by the elevation. */
+static vector ellipsoid_point(double lat, double lon, double re, double rp)
+{
+  double glat = atan(tan(lat)*SQR(rp/re));   // geocentric
+  double r = 1.0/sqrt(SQR(cos(glat)/re) + SQR(sin(glat)/rp));
+  vector T;
+  T.x = r*cos(glat)*cos(lon);
+  T.y = r*cos(glat)*sin(lon);
+  T.z = r*sin(glat);
+  return T;
+}
+
+/* Sample for the given slant range, undoing meta_get_slant(). */
+static double slant_to_sample(const meta_geo_context *ctx,
+                              double yLine, double slant)
+{
+  meta_parameters *meta = ctx->meta;
+  double sample;
+
+  slant -= meta->sar->slant_shift;
+  if (meta->sar->image_type == 'S') {
+    sample = (slant - meta->sar->slant_range_first_pixel) /
+      meta->general->x_pixel_size;
+  }
+  else {
+    double er, ht, min_phi, phi;
+    if (ctx->constant_ground) {
+      er = ctx->er;
+      ht = ctx->ht;
+      min_phi = ctx->min_phi;
+    }
+    else {
+      er = meta_get_earth_radius(meta, yLine, 0);
+      ht = meta_get_sat_height(meta, yLine, 0);
+      min_phi = acos((SQR(ht) + SQR(er) -
+                      SQR(meta->sar->slant_range_first_pixel)) /
+                     (2.0*ht*er));
+    }
+    phi = acos((SQR(ht) + SQR(er) - SQR(slant)) / (2.0*ht*er));
+    sample = (phi - min_phi)*er/meta->general->x_pixel_size;
+  }
+  return sample - meta->general->start_sample;
+}
+
+static double doppler_at(const meta_geo_context *ctx,
+                         double yLine, double xSample)
+{
+  if (ctx->meta->sar->deskewed == 1)
+    return 0.0;
+  return meta_get_dop(ctx->meta, yLine, xSample);
+}
+
+/* Solves a 3x3 linear system by Cramer's rule. */
+static int solve3(const vector row[3], const double rhs[3], vector *x)
+{
+  vector c12, c20, c01;
+  double det;
+
+  vecCross(row[1], row[2], &c12);
+  vecCross(row[2], row[0], &c20);
+  vecCross(row[0], row[1], &c01);
+  det = vecDot(row[0], c12);
+  if (fabs(det) < 1e-30)
+    return 1;
+  x->x = (rhs[0]*c12.x + rhs[1]*c20.x + rhs[2]*c01.x)/det;
+  x->y = (rhs[0]*c12.y + rhs[1]*c20.y + rhs[2]*c01.y)/det;
+  x->z = (rhs[0]*c12.z + rhs[1]*c20.z + rhs[2]*c01.z)/det;
+  return 0;
+}
+
+/*******************************************************************
+ * orbit_latLon:
+ * The target at the given slant range and doppler from the satellite
+ * at the given time, on the ellipsoid raised by elev.  Solves
+ *   F1 = (x^2 + y^2 + z^2 (re/rp)^2 - re^2)/2 = 0   (on the ellipsoid)
+ *   F2 = (|T-S|^2 - slant^2)/2 = 0                  (at the range)
+ *   F3 = (T-S).V - dop lambda slant/2 = 0           (at the doppler)
+ * for the target T.  In earth-fixed coordinates the doppler getDoppler()
+ * computes is 2 (T-S).V/(lambda slant), with V the satellite's
+ * earth-fixed velocity.*/
+static int orbit_latLon(const meta_geo_context *ctx,
+                        double yLine, double xSample, double elev,
+                        double *lat, double *lon)
+{
+  double re = GEO_RE + elev, rp = GEO_RP + elev, e2 = SQR(re/rp);
+  double time, slant, dop, ht, look, yaw, rn, s_look, c_look;
+  vector S, V, ax, ay, az, vhat, T;
+  int iter;
+
+  meta_get_timeSlantDop(ctx->meta, yLine, xSample, &time, &slant, &dop);
+  orbit_at(ctx, time, &S, &V, NULL);
+
+  // Starting guess: look angle from the law of cosines, with the
+  // earth radius below the satellite, and the yaw the doppler implies
+  az = S;
+  vecNormalize(&az);
+  vhat = V;
+  vecNormalize(&vhat);
+  vecCross(az, vhat, &ay);
+  vecNormalize(&ay);
+  vecCross(ay, az, &ax);
+  ht = vecMagnitude(S);
+  rn = 1.0/sqrt((SQR(az.x) + SQR(az.y))/SQR(re) + SQR(az.z)/SQR(rp));
+  c_look = (SQR(ht) + SQR(slant) - SQR(rn))/(2.0*ht*slant);
+  c_look = fmax(-1.0, fmin(1.0, c_look));
+  look = acos(c_look);
+  s_look = (ctx->side == 'L' ? -1.0 : 1.0) * sin(look);
+  yaw = asin(fmax(-1.0, fmin(1.0, dop*ctx->lambda/(2.0*vecMagnitude(V)))));
+  T.x = S.x + slant*(ax.x*sin(yaw) - ay.x*s_look*cos(yaw) - az.x*c_look*cos(yaw));
+  T.y = S.y + slant*(ax.y*sin(yaw) - ay.y*s_look*cos(yaw) - az.y*c_look*cos(yaw));
+  T.z = S.z + slant*(ax.z*sin(yaw) - ay.z*s_look*cos(yaw) - az.z*c_look*cos(yaw));
+
+  for (iter=0; iter<GEO_MAX_ITER; iter++) {
+    vector row[3], R, step;
+    double F[3];
+
+    vecSub(T, S, &R);
+    F[0] = -0.5*(SQR(T.x) + SQR(T.y) + SQR(T.z)*e2 - SQR(re));
+    F[1] = -0.5*(vecDot(R, R) - SQR(slant));
+    F[2] = -(vecDot(R, V) - 0.5*dop*ctx->lambda*slant);
+    row[0].x = T.x;
+    row[0].y = T.y;
+    row[0].z = T.z*e2;
+    row[1] = R;
+    row[2] = V;
+    if (solve3(row, F, &step))
+      return 1;
+    vecAdd(T, step, &T);
+    if (vecMagnitude(step) < GEO_POS_TOL)
+      break;
+  }
+  if (iter == GEO_MAX_ITER)
+    return 1;
+
+  // geodetic latitude, as getLatLongMeta() converts it
+  *lat = atan2(T.z*e2, sqrt(SQR(T.x) + SQR(T.y)))*R2D;
+  *lon = atan2(T.y, T.x)*R2D;
+  return 0;
+}
+
+/*******************************************************************
+ * orbit_lineSamp:
+ * The line and sample that image the given point.  Finds the time t
+ * at which
+ *   h(t) = (T-S).V - dop lambda |T-S|/2 = 0
+ * with Newton's method, where the derivative is
+ *   h'(t) = (T-S).A - V.V + dop lambda (T-S).V/(2 |T-S|)
+ * (taking the doppler as constant over a step).*/
+static int orbit_lineSamp(const meta_geo_context *ctx,
+                          double lat, double lon, double elev,
+                          double *yLine, double *xSamp)
+{
+  meta_parameters *meta = ctx->meta;
+  double atpp = meta->sar->azimuth_time_per_pixel;
+  double time = ctx->center_time, line = 0, sample = 0;
+  vector T = ellipsoid_point(lat*D2R, lon*D2R, GEO_RE + elev, GEO_RP + elev);
+  int iter;
+
+  for (iter=0; iter<GEO_MAX_ITER; iter++) {
+    vector S, V, A, R;
+    double slant, dop, RV, h, dh, dt;
+
+    orbit_at(ctx, time, &S, &V, &A);
+    vecSub(T, S, &R);
+    slant = vecMagnitude(R);
+    line = (time - meta->sar->time_shift)/atpp - meta->general->start_line;
+    sample = slant_to_sample(ctx, line, slant);
+    dop = doppler_at(ctx, line, sample);
+
+    RV = vecDot(R, V);
+    h = RV - 0.5*dop*ctx->lambda*slant;
+    dh = vecDot(R, A) - vecDot(V, V) + 0.5*dop*ctx->lambda*RV/slant;
+    if (dh == 0.0)
+      return 1;
+    dt = h/dh;
+    time -= dt;
+    if (fabs(dt) < GEO_TIME_TOL)
+      break;
+  }
+  if (iter == GEO_MAX_ITER)
+    return 1;
+
+  // line and sample at the converged time
+  {
+    vector S, V, R;
+    orbit_at(ctx, time, &S, &V, NULL);
+    vecSub(T, S, &R);
+    line = (time - meta->sar->time_shift)/atpp - meta->general->start_line;
+    sample = slant_to_sample(ctx, line, vecMagnitude(R));
+  }
+  if (!meta_is_valid_double(line) || !meta_is_valid_double(sample))
+    return 1;
+
+  *yLine = line;
+  *xSamp = sample;
+  return 0;
+}
+
+/*******************************************************************
+ * meta_get_lineSamp_orbit:
+ * Used by meta_get_lineSamp() for images located with state vectors.
+ * Returns nonzero for other images, or if it can't find the point.
+ * For just one point, it isn't worth setting up all the segments, so
+ * this uses a context on the stack that works them out as needed.*/
+int meta_get_lineSamp_orbit(meta_parameters *meta,
+                            double lat, double lon, double elev,
+                            double *yLine, double *xSamp)
+{
+  meta_geo_context ctx;
+
+  if (!uses_orbit(meta))
+    return 1;
+  geo_context_init(&ctx, meta);
+  return orbit_lineSamp(&ctx, lat, lon, elev, yLine, xSamp);
+}
+
+/*******************************************************************
+ * meta_get_latLon_arr:
+ * meta_get_latLon() for n points.*/
+int meta_get_latLon_arr(const meta_geo_context *ctx, int n,
+                        const double *yLine, const double *xSample,
+                        const double *elev, double *lat, double *lon)
+{
+  int ii, failed = 0;
+
+  for (ii=0; ii<n; ii++) {
+    double h = elev ? elev[ii] : 0.0;
+    int err;
+
+    if (ctx->uses_orbit) {
+      err = orbit_latLon(ctx, yLine[ii], xSample[ii], h, &lat[ii], &lon[ii]);
+      if (err)
+        err = meta_get_latLon(ctx->meta, yLine[ii], xSample[ii], h,
+                              &lat[ii], &lon[ii]);
+    }
+    else
+      err = meta_get_latLon(ctx->meta, yLine[ii], xSample[ii], h,
+                            &lat[ii], &lon[ii]);
+
+    if (err) {
+      lat[ii] = lon[ii] = MAGIC_UNSET_DOUBLE;
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+/*******************************************************************
+ * meta_get_lineSamp_arr:
+ * meta_get_lineSamp() for n points.*/
+int meta_get_lineSamp_arr(const meta_geo_context *ctx, int n,
+                          const double *lat, const double *lon,
+                          const double *elev, double *yLine, double *xSample)
+{
+  int ii, failed = 0;
+
+  for (ii=0; ii<n; ii++) {
+    double h = elev ? elev[ii] : 0.0;
+    int err;
+
+    if (ctx->uses_orbit) {
+      err = orbit_lineSamp(ctx, lat[ii], lon[ii], h, &yLine[ii], &xSample[ii]);
+      if (err)
+        err = meta_get_lineSamp_search(ctx->meta, lat[ii], lon[ii], h,
+                                       &yLine[ii], &xSample[ii]);
+    }
+    else
+      err = meta_get_lineSamp(ctx->meta, lat[ii], lon[ii], h,
+                              &yLine[ii], &xSample[ii]);
+
+    if (err) {
+      yLine[ii] = xSample[ii] = MAGIC_UNSET_DOUBLE;
+      failed++;
+    }
+  }
+
+  return failed;
+}
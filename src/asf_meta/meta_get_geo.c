@@ -27,6 +27,13 @@ int is_valid_map2s_transform(meta_parameters *meta);
 int is_valid_map2l_transform(meta_parameters *meta);
 int is_valid_ll2l_transform(meta_parameters *meta);
 int is_valid_ll2s_transform(meta_parameters *meta);
+void meta_choose_reverse_transform(meta_parameters *meta);
+int meta_get_lineSamp_search(meta_parameters *meta,
+                             double lat, double lon, double elev,
+                             double *yLine, double *xSamp);
+int meta_get_lineSamp_orbit(meta_parameters *meta,
+                            double lat, double lon, double elev,
+                            double *yLine, double *xSamp);
 
 /*Geolocation Calls:*/
 
@@ -403,6 +410,42 @@ static int meta_get_lineSamp_imp(meta_parameters *meta,
   return 0;
 }
 
+/******************************************************************
+ * meta_choose_reverse_transform:
+ * Decides, the first time it is needed, whether meta_get_lineSamp
+ * can use the transform block's reverse coefficients.  Used by
+ * meta_geo_context_new too, so that contexts never change the
+ * metadata they were made from.*/
+void meta_choose_reverse_transform(meta_parameters *meta)
+{
+  if (!meta->transform)
+    return;
+
+  if (meta->transform->use_reverse_transform == MAGIC_UNSET_INT) {
+    double *a = get_a_coeffs(meta);
+    double *b = get_b_coeffs(meta);
+
+    if (a != NULL && b != NULL) {
+        //strcmp_case(meta->general->sensor, "ALOS")==0 &&
+        //strcmp_case(meta->general->sensor_name, "SAR")==0) {
+      meta->transform->use_reverse_transform = TRUE;
+      asfPrintStatus("PALSAR/Sentinel -- Using reverse transform block.\n");
+    }
+    else {
+      meta->transform->use_reverse_transform = FALSE;
+      asfPrintStatus("Not PALSAR -- Using iterative reverse transform.\n");
+    }
+  }
+
+  if (meta->sar && meta->sar->image_type == 'G' &&
+      strcmp_case(meta->transform->type, "slant") == 0 &&
+      meta->transform->use_reverse_transform) {
+    asfPrintStatus("PALSAR -- Slant range transform, but image is ground "
+                   "range.\n          Using iterative reverse transform.\n");
+    meta->transform->use_reverse_transform = FALSE;
+  }
+}
+
 static double tolerance = 0.2;
 void meta_set_lineSamp_tolerance(double tol)
 {
@@ -448,29 +491,7 @@ int meta_get_lineSamp(meta_parameters *meta,
 
   if (meta->transform) {
 
-    if (meta->transform->use_reverse_transform == MAGIC_UNSET_INT) {
-      double *a = get_a_coeffs(meta);
-      double *b = get_b_coeffs(meta);
-
-      if (a != NULL && b != NULL) {
-          //strcmp_case(meta->general->sensor, "ALOS")==0 &&
-          //strcmp_case(meta->general->sensor_name, "SAR")==0) {
-        meta->transform->use_reverse_transform = TRUE;
-        asfPrintStatus("PALSAR/Sentinel -- Using reverse transform block.\n");
-      }
-      else {
-        meta->transform->use_reverse_transform = FALSE;
-        asfPrintStatus("Not PALSAR -- Using iterative reverse transform.\n");
-      }
-    }
-
-    if (meta->sar && meta->sar->image_type == 'G' &&
-        strcmp_case(meta->transform->type, "slant") == 0 &&
-        meta->transform->use_reverse_transform) {
-      asfPrintStatus("PALSAR -- Slant range transform, but image is ground "
-                     "range.\n          Using iterative reverse transform.\n");
-      meta->transform->use_reverse_transform = FALSE;
-    }
+    meta_choose_reverse_transform(meta);
 
     if (meta->transform->use_reverse_transform) {
       double *a = get_a_coeffs(meta); // Usually meta->transform->map2ls_a;
@@ -691,7 +712,22 @@ int meta_get_lineSamp(meta_parameters *meta,
     }
   }
 
-  // no shortcuts -- use the iterative method
+  // slant and ground range images located by their state vectors --
+  // solve the range-doppler equations directly
+  if (meta_get_lineSamp_orbit(meta, lat, lon, elev, yLine, xSamp) == 0)
+    return 0;
+
+  return meta_get_lineSamp_search(meta, lat, lon, elev, yLine, xSamp);
+}
+
+/******************************************************************
+ * meta_get_lineSamp_search:
+ * The general (and slow) way of finding the line and sample: search
+ * for the point whose meta_get_latLon is closest to the given one.*/
+int meta_get_lineSamp_search(meta_parameters *meta,
+                             double lat, double lon, double elev,
+                             double *yLine, double *xSamp)
+{
   double tol_incr = tolerance;
   double x0, y0, tol = tolerance;
   int err,num_iter = 0;
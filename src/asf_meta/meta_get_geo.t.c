@@ -154,7 +154,45 @@ void test_meta_get_latLon()
 }
 
 
+// The array calls should agree with the single point calls, and take
+// each point back to where it started
+static void context_test(const char *filename)
+{
+  meta_parameters *meta = meta_read(filename);
+  int nl = meta->general->line_count;
+  int ns = meta->general->sample_count;
+  double line[9], samp[9], elev[9], lat[9], lon[9], line1[9], samp1[9];
+  int ii;
+
+  for (ii=0; ii<9; ii++) {
+    line[ii] = nl * (ii/3) / 2.0;
+    samp[ii] = ns * (ii%3) / 2.0;
+    elev[ii] = 1000.0 * (ii%2);
+  }
+
+  meta_geo_context *ctx = meta_geo_context_new(meta);
+  CU_ASSERT(meta_get_latLon_arr(ctx, 9, line, samp, elev, lat, lon) == 0);
+  CU_ASSERT(meta_get_lineSamp_arr(ctx, 9, lat, lon, elev, line1, samp1) == 0);
+
+  for (ii=0; ii<9; ii++) {
+    double lat2, lon2, line2, samp2;
+    meta_get_latLon(meta, line[ii], samp[ii], elev[ii], &lat2, &lon2);
+    CU_ASSERT(fabs(lat[ii]-lat2) < .0001);
+    CU_ASSERT(fabs(lon[ii]-lon2) < .0001);
+    meta_get_lineSamp(meta, lat[ii], lon[ii], elev[ii], &line2, &samp2);
+    CU_ASSERT(fabs(line1[ii]-line2) < .01);
+    CU_ASSERT(fabs(samp1[ii]-samp2) < .01);
+    CU_ASSERT(within_tol(line[ii],line1[ii],.2));
+    CU_ASSERT(within_tol(samp[ii],samp1[ii],.2));
+  }
+
+  meta_geo_context_free(ctx);
+  meta_free(meta);
+}
+
 void test_meta_get_lineSamp()
 {
+  context_test("test_input/ers1.meta");
+  context_test("test_input/palsar_fbd.meta");
 }
 
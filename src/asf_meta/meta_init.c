@@ -66,6 +66,7 @@ meta_general *meta_general_init(void)
   general->bit_error_rate = MAGIC_UNSET_DOUBLE;
   general->missing_lines = MAGIC_UNSET_INT;
   general->no_data = MAGIC_UNSET_DOUBLE;
+  general->byte_order = META_BIG_ENDIAN;
   return general;
 }
 
@@ -328,6 +329,7 @@ meta_statistics *meta_statistics_init(int band_count)
       statistics->band_stats[i].rmse           = MAGIC_UNSET_DOUBLE;
       statistics->band_stats[i].std_deviation  = MAGIC_UNSET_DOUBLE;
       statistics->band_stats[i].mask           = MAGIC_UNSET_DOUBLE;
+      strcpy (statistics->band_stats[i].data_key, MAGIC_UNSET_STRING);
     }
   }
   return statistics;
@@ -360,6 +362,7 @@ meta_stats *meta_stats_init()
   stats->rmse           = MAGIC_UNSET_DOUBLE;
   stats->std_deviation  = MAGIC_UNSET_DOUBLE;
   stats->mask           = MAGIC_UNSET_DOUBLE;
+  strcpy (stats->data_key, MAGIC_UNSET_STRING);
   return stats;
 }
 */
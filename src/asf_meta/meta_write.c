@@ -406,6 +406,10 @@ void meta_write(meta_parameters *meta, const char *file_name)
       "Number of missing lines in data take");
   meta_put_double_lf(fp,"no_data:", meta->general->no_data, 4,
       "Value indicating no data for a pixel");
+  // Big endian data files are the norm, so only flag the exceptions
+  if (meta->general->byte_order == META_LITTLE_ENDIAN)
+    meta_put_string(fp,"byte_order:", "LITTLE_ENDIAN",
+        "Byte order of the data file");
   meta_put_string(fp,"}", "","End general");
 
   /* SAR block.  */
@@ -1017,6 +1021,9 @@ void meta_write(meta_parameters *meta, const char *file_name)
           "Percent of valid values");
       meta_put_double(fp,"mask:",meta->stats->band_stats[ii].mask,
           "Value ignored while taking statistics");
+      if (strcmp(meta->stats->band_stats[ii].data_key, MAGIC_UNSET_STRING) != 0)
+        meta_put_string(fp,"data_key:",meta->stats->band_stats[ii].data_key,
+            "Data file the statistics were taken from");
       meta_put_string(fp,"}","","End band statistics block");
     }
     meta_put_string(fp,"}","","End stats");
@@ -611,6 +611,16 @@ void fill_structure_field(char *field_name, void *valp)
       { MGENERAL->missing_lines = VALP_AS_INT; return; }
     if ( !strcmp(field_name, "no_data") )
       { MGENERAL->no_data = (float) VALP_AS_DOUBLE; return; }
+    if ( !strcmp(field_name, "byte_order") ) {
+      if ( !strcmp(VALP_AS_CHAR_POINTER, "BIG_ENDIAN") )
+        MGENERAL->byte_order = META_BIG_ENDIAN;
+      else if ( !strcmp(VALP_AS_CHAR_POINTER, "LITTLE_ENDIAN") )
+        MGENERAL->byte_order = META_LITTLE_ENDIAN;
+      else
+        warning_message("Unrecognized byte_order (%s).\n",
+                        VALP_AS_CHAR_POINTER);
+      return;
+    }
   }
 
   /* Fields which normally go in the sar block of the metadata file.  */
@@ -1287,6 +1297,8 @@ void fill_structure_field(char *field_name, void *valp)
     { (MSTATSBLOCK)->percent_valid = VALP_AS_DOUBLE; return; }
     if ( !strcmp(field_name, "mask") )
     { (MSTATSBLOCK)->mask = VALP_AS_DOUBLE; return; }
+    if ( !strcmp(field_name, "data_key") )
+    { strcpy((MSTATSBLOCK)->data_key, VALP_AS_CHAR_POINTER); return; }
   }
   // Band stats block for metadata v2.3-
   if ( !strcmp(stack_top->block_name, "stats") )
@@ -1307,6 +1319,8 @@ void fill_structure_field(char *field_name, void *valp)
     { (MSTATS)->percent_valid = VALP_AS_DOUBLE; return; }
     if ( !strcmp(field_name, "mask") )
     { (MSTATS)->mask = VALP_AS_DOUBLE; return; }
+    if ( !strcmp(field_name, "data_key") )
+    { strcpy((MSTATS)->data_key, VALP_AS_CHAR_POINTER); return; }
   }
 
   /* Fields which go in the location block of the metadata file. */
@@ -7,6 +7,7 @@ void test_read_proj_file();
 void test_meta_read();
 void test_date();
 void test_longdate();
+void test_ioLine();
 
 int main()
 {
@@ -29,6 +30,7 @@ int main()
        (NULL == CU_add_test(pSuite, "meta_read", test_meta_read)) ||
        (NULL == CU_add_test(pSuite, "date", test_date)) ||
        (NULL == CU_add_test(pSuite, "longdate", test_longdate)) ||
+       (NULL == CU_add_test(pSuite, "ioLine", test_ioLine)) ||
        (NULL == CU_add_test(pSuite, "meta_get_latLon", test_meta_get_latLon)) ||
        (NULL == CU_add_test(pSuite, "meta_get_lineSamp", test_meta_get_lineSamp)))
    {
@@ -1,4 +1,5 @@
 #include "asf_view.h"
+#include "asf_glib.h"
 #include <asf_contact.h>
 
 /************************************************************************
@@ -284,6 +285,10 @@ main(int argc, char **argv)
     // which keeps the window from showing up until after it has been loaded,
     // which looks much nicer
 
+    // before any threads are started (overview pyramids are built in the
+    // background)
+    asf_thread_init();
+
     // initialize globals
     reset_globals(TRUE);
 
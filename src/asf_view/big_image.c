@@ -1,6 +1,7 @@
 #include "asf_view.h"
 #include <gdk/gdkkeysyms.h>
 #include "libasf_proj.h"
+#include "asf_glib.h"
 //#include "cr.h"
 
 UserPolygon g_polys[MAX_POLYS];
@@ -744,7 +745,36 @@ static void add_north_arrow(GdkPixbuf *pb, ImageInfo *ii)
   put_line(pb, y0, x0, y1, x1, GREEN, ii);
 }
 
-GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
+// The image cache loads tiles in the background while the big image is
+// drawn with placeholders for them, and calls this (from the loading
+// thread) when they arrive, so we redraw once the GUI is idle.
+G_LOCK_DEFINE_STATIC(redraw);
+static int redraw_pending = FALSE;
+
+static gboolean redraw_after_tile_loaded(gpointer data)
+{
+    G_LOCK(redraw);
+    redraw_pending = FALSE;
+    G_UNLOCK(redraw);
+
+    fill_big(curr);
+    return FALSE;
+}
+
+void big_image_tile_loaded()
+{
+    G_LOCK(redraw);
+    if (!redraw_pending) {
+        redraw_pending = TRUE;
+        g_idle_add(redraw_after_tile_loaded, NULL);
+    }
+    G_UNLOCK(redraw);
+}
+
+// With wait_for_data FALSE, parts of the image that aren't in the cache are
+// shown as a checkerboard, and redrawn once they have been loaded.
+static GdkPixbuf * render_big_image(ImageInfo *ii, int show_crosshair,
+                                    int wait_for_data)
 {
     assert(ii->data_ci);
     assert(ii->meta);
@@ -767,8 +797,32 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
     }
 
     if (!mask) {
+        // when zoomed out, draw from the overview pyramid level closest
+        // to the display scale, which is f times smaller than the image
+        int f;
+        CachedImage *ci = cached_image_get_overview(ii->data_ci, zoom, &f);
+        double z = zoom/f;
+
+        // rows past the top line on the screen that each screen row
+        // needs, for the averaging below
+        int span = z<2 ? 0 : z<3 ? 1 : z<4 ? 2 : 2*(int)floor(z/3);
+
+        if (!wait_for_data) {
+            double l0, l1, s0;
+            img2ls(0,0,&l0,&s0);
+            img2ls(0,bih-1,&l1,&s0);
+            cached_image_prefetch(ci, (int)floor(l0/f),
+                                  (int)floor(l1/f) + span);
+        }
+
         int mm = 0;
         for (i=0; i<bih; ++i) {
+            double row_l, row_s;
+            img2ls(0,i,&row_l,&row_s);
+            int row_line = (int)floor(row_l/f);
+            int row_loaded = wait_for_data ||
+                cached_image_rows_loaded(ci, row_line, row_line + span);
+
             for (j=0; j<biw; ++j) {
                 double l, s;
                 img2ls(j,i,&l,&s);
@@ -780,35 +834,42 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
                     g = background_green;
                     b = background_blue;
                 }
+                else if (!row_loaded) {
+                    // still loading
+                    r = g = b = ((i/8 + j/8) % 2) ? 96 : 128;
+                }
                 else {
+                    l /= f;
+                    s /= f;
+
                     // here we have some averaging, that will make the
                     // images look a bit smoother when zoomed out
-                    if (zoom<2) {
+                    if (z<2) {
                         // one-to-one (or thereabouts) view -- no averaging
-                        cached_image_get_rgb(ii->data_ci, (int)floor(l),
+                        cached_image_get_rgb(ci, (int)floor(l),
                             (int)floor(s), &r, &g, &b);
                     }
-                    else if (zoom<3) {
+                    else if (z<3) {
                         // 2x view -- average 4 pixels to produce 1.
                         int l2 = (int)floor(l);
                         int s2 = (int)floor(s);
                         unsigned char r1,r2,r3,r4,g1,g2,g3,g4,b1,b2,b3,b4;
-                        cached_image_get_rgb(ii->data_ci, l2,   s2,   &r1,&g1,&b1);
-                        cached_image_get_rgb(ii->data_ci, l2+1, s2,   &r2,&g2,&b2);
-                        cached_image_get_rgb(ii->data_ci, l2,   s2+1, &r3,&g3,&b3);
-                        cached_image_get_rgb(ii->data_ci, l2+1, s2+1, &r4,&g4,&b4);
+                        cached_image_get_rgb(ci, l2,   s2,   &r1,&g1,&b1);
+                        cached_image_get_rgb(ci, l2+1, s2,   &r2,&g2,&b2);
+                        cached_image_get_rgb(ci, l2,   s2+1, &r3,&g3,&b3);
+                        cached_image_get_rgb(ci, l2+1, s2+1, &r4,&g4,&b4);
                         r=(r1+r2+r3+r4)/4;
                         g=(g1+g2+g3+g4)/4;
                         b=(b1+b2+b3+b4)/4;
                     }
-                    else if (zoom<4) {
+                    else if (z<4) {
                         // 3x view -- average 9 pixels to produce 1.
                         int l2 = (int)floor(l);
                         int s2 = (int)floor(s);
                         int rt=0, gt=0, bt=0;
                         for (m=0; m<3; ++m) {
                             for (n=0; n<3; ++n) {
-                                cached_image_get_rgb(ii->data_ci, l2+m, s2+n,
+                                cached_image_get_rgb(ci, l2+m, s2+n,
                                                     &r, &g, &b);
                                 rt += (int)r;
                                 gt += (int)g;
@@ -823,11 +884,11 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
                         // 4x or greater view -- average 9 pixels to produce 1.
                         int l2 = (int)floor(l);
                         int s2 = (int)floor(s);
-                        int fac = (int)floor(zoom/3);
+                        int fac = (int)floor(z/3);
                         int rt=0, gt=0, bt=0;
                         for (m=0; m<3; ++m) {
                             for (n=0; n<3; ++n) {
-                                cached_image_get_rgb(ii->data_ci,
+                                cached_image_get_rgb(ci,
                                                     l2+m*fac, s2+n*fac,
                                                     &r, &g, &b);
                                 rt += (int)r;
@@ -1014,19 +1075,24 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
     return pb;
 }
 
+GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
+{
+    return render_big_image(ii, show_crosshair, TRUE);
+}
+
 void fill_big(ImageInfo *ii)
 {
     GdkPixbuf *pb = NULL;
     if (subimages == 1) {
         // never show the crosshair for the planner -- not needed any longer
-        pb = make_big_image(ii, !planner_is_active());
+        pb = render_big_image(ii, !planner_is_active(), FALSE);
     }
     else if (subimages == 2) {
         int next_image_info_index = (current_image_info_index + 1) % n_images_loaded;
         ImageInfo *ii1 = &image_info[next_image_info_index];
 
-        GdkPixbuf *pb1 = make_big_image(ii, !planner_is_active());
-        GdkPixbuf *pb2 = make_big_image(ii1, !planner_is_active());
+        GdkPixbuf *pb1 = render_big_image(ii, !planner_is_active(), FALSE);
+        GdkPixbuf *pb2 = render_big_image(ii1, !planner_is_active(), FALSE);
 
         int w = get_big_image_width_sub();
         int h = get_big_image_height_sub();
@@ -1049,10 +1115,10 @@ void fill_big(ImageInfo *ii)
         ImageInfo *ii2 = &image_info[ind2];
         ImageInfo *ii3 = &image_info[ind3];
 
-        GdkPixbuf *pb0 = make_big_image(ii, !planner_is_active());
-        GdkPixbuf *pb1 = make_big_image(ii1, !planner_is_active());
-        GdkPixbuf *pb2 = make_big_image(ii2, !planner_is_active());
-        GdkPixbuf *pb3 = make_big_image(ii3, !planner_is_active());
+        GdkPixbuf *pb0 = render_big_image(ii, !planner_is_active(), FALSE);
+        GdkPixbuf *pb1 = render_big_image(ii1, !planner_is_active(), FALSE);
+        GdkPixbuf *pb2 = render_big_image(ii2, !planner_is_active(), FALSE);
+        GdkPixbuf *pb3 = render_big_image(ii3, !planner_is_active(), FALSE);
 
         int w = get_big_image_width_sub();
         int h = get_big_image_height_sub();
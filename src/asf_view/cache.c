@@ -46,6 +46,36 @@ static const int MAX_TILES = 24;
 // quit blathering?
 int quiet = FALSE;
 
+//---------------------------------------------------------------------------
+// Background tile loading.  When drawing, the tiles in view that aren't in
+// the cache are queued up (see cached_image_prefetch()), along with the next
+// tile in the direction the user is panning, and are read by a loader
+// thread while the view is drawn with placeholders.  Loaded tiles are
+// handed back, and are only put into the cache by the GUI thread, so the
+// GUI thread never has a tile evicted out from under it.
+
+#define MAX_TILE_REQUESTS 8
+
+typedef struct {
+    int rs;                 // first row of the tile
+    int visible;            // redraw when this one is loaded?
+    unsigned char *data;    // the tile, once loaded
+} TileRequest;
+
+struct tile_loader {
+    GThread *thread;
+    GMutex *lock;           // guards everything below
+    GCond *changed;         // signalled when a request is added, or done
+    TileRequest queue[MAX_TILE_REQUESTS];  // to be loaded, in this order
+    int n_queued;
+    int loading;            // first row of the tile being loaded, or -1
+    TileRequest done[MAX_TILE_REQUESTS];   // loaded, not yet in the cache
+    int n_done;
+    int failed;             // couldn't allocate a tile -- load as we go
+    int quit;
+    meta_parameters *meta;  // loader's copy of the metadata
+};
+
 static int data_size(CachedImage *self)
 {
     switch (self->data_type) {
@@ -63,6 +93,23 @@ static int data_size(CachedImage *self)
     }
 }
 
+int cached_image_pixel_size(CachedImage *self)
+{
+    return data_size(self);
+}
+
+// Reads rows from the file through the client.  The overview pyramid is
+// built in the background from the same client, so the reads must take
+// turns.
+void cached_image_read_rows(CachedImage *self, int row_start, int n_rows,
+                            void *dest, meta_parameters *meta)
+{
+    g_mutex_lock(self->read_lock);
+    self->client->read_fn(row_start, n_rows, dest,
+        self->client->read_client_info, meta, self->client->data_type);
+    g_mutex_unlock(self->read_lock);
+}
+
 static void print_cache_size(CachedImage *self)
 {
     int i;
@@ -75,13 +122,101 @@ static void print_cache_size(CachedImage *self)
         (float)size/1024./1024.);
 }
 
-static unsigned char *get_pixel(CachedImage *self, int line, int samp)
+static int least_recently_used(CachedImage *self)
 {
-    // check if outside the image
-    static unsigned char zero = 0;
-    if (line<0 || samp<0 || line >= self->nl || samp >= self->ns)
-        return &zero;
+    int i, spot = 0;
+    int least_access_count = self->access_counts[0];
+    for (i=0; i<self->n_tiles; ++i) {
+        if (self->access_counts[i] < least_access_count) {
+            least_access_count = self->access_counts[i];
+            spot = i;
+        }
+    }
+    return spot;
+}
+
+static int tile_in_cache(CachedImage *self, int rs)
+{
+    int i;
+    for (i=0; i<self->n_tiles; ++i)
+        if (self->rowstarts[i] == rs)
+            return TRUE;
+    return FALSE;
+}
+
+// Puts a tile read by the loader into the cache, in a new spot if we have
+// room for one, otherwise in place of the least recently used tile.
+static void insert_tile(CachedImage *self, int rs, unsigned char *data)
+{
+    int spot;
+
+    // loaded in the meantime, because it was needed right away
+    if (tile_in_cache(self, rs)) {
+        free(data);
+        return;
+    }
 
+    if (!self->reached_max_tiles) {
+        spot = self->n_tiles++;
+        if (self->n_tiles == MAX_TILES)
+            self->reached_max_tiles = TRUE;
+    } else {
+        spot = least_recently_used(self);
+        free(self->cache[spot]);
+    }
+
+    self->cache[spot] = data;
+    self->rowstarts[spot] = rs;
+    self->access_counts[spot] = self->n_access++;
+}
+
+static void adopt_loaded_tiles(CachedImage *self)
+{
+    TileLoader *tl = self->loader;
+    TileRequest done[MAX_TILE_REQUESTS];
+    int i, n_done;
+
+    if (!tl)
+        return;
+
+    g_mutex_lock(tl->lock);
+    n_done = tl->n_done;
+    memcpy(done, tl->done, sizeof(TileRequest)*n_done);
+    tl->n_done = 0;
+    if (n_done > 0)
+        g_cond_broadcast(tl->changed);
+    g_mutex_unlock(tl->lock);
+
+    for (i=0; i<n_done; ++i)
+        insert_tile(self, done[i].rs, done[i].data);
+}
+
+// The tile starting at row rs is needed right away: take it off the queue
+// if the loader hasn't started on it, otherwise wait for the loader to
+// finish it.  Either way, it is in the cache afterwards if it was loaded.
+static void finish_tile_request(CachedImage *self, int rs)
+{
+    TileLoader *tl = self->loader;
+    int i;
+
+    g_mutex_lock(tl->lock);
+    for (i=0; i<tl->n_queued; ++i) {
+        if (tl->queue[i].rs == rs) {
+            memmove(&tl->queue[i], &tl->queue[i+1],
+                    sizeof(TileRequest)*(tl->n_queued-i-1));
+            --tl->n_queued;
+            break;
+        }
+    }
+    while (tl->loading == rs)
+        g_cond_wait(tl->changed, tl->lock);
+    g_mutex_unlock(tl->lock);
+
+    adopt_loaded_tiles(self);
+}
+
+static unsigned char *find_pixel(CachedImage *self, int line, int samp)
+{
     // size of each pixel
     int ds = data_size(self);
 
@@ -110,6 +245,33 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
         }
     }
 
+    return NULL;
+}
+
+static unsigned char *get_pixel(CachedImage *self, int line, int samp)
+{
+    // check if outside the image
+    static unsigned char zero = 0;
+    if (line<0 || samp<0 || line >= self->nl || samp >= self->ns)
+        return &zero;
+
+    // size of each pixel
+    int ds = data_size(self);
+
+    unsigned char *p = find_pixel(self, line, samp);
+    if (p)
+        return p;
+
+    // the loader may have it, or be working on it
+    if (self->loader) {
+        finish_tile_request(self,
+            (line / self->rows_per_tile) * self->rows_per_tile);
+        p = find_pixel(self, line, samp);
+        if (p)
+            return p;
+    }
+
+    int i;
     int spot = 0;
     if (!self->reached_max_tiles) {
         assert(self->cache[self->n_tiles] == NULL);
@@ -135,13 +297,7 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
     if (self->reached_max_tiles) {
         // dump an existing cached tile
         // not found in the cache -- find least used spot
-        int least_access_count = self->access_counts[0];
-        for (i=0; i<self->n_tiles; ++i) {
-            if (self->access_counts[i] < least_access_count) {
-                least_access_count = self->access_counts[i];
-                spot = i;
-            }
-        }
+        spot = least_recently_used(self);
     }
 
     if (!self->reached_max_tiles && self->n_tiles == MAX_TILES) {
@@ -185,8 +341,8 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
         //print_cache_size(self);
     }
 
-    self->client->read_fn(rs, rows_to_get, (void*)(self->cache[spot]),
-        self->client->read_client_info, self->meta, self->client->data_type);
+    cached_image_read_rows(self, rs, rows_to_get, (void*)(self->cache[spot]),
+        self->meta);
 
     assert((line-rs)*self->ns + samp <= self->ns*self->rows_per_tile);
     return &self->cache[spot][((line-rs)*self->ns + samp)*ds];
@@ -224,10 +380,200 @@ void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
 
         quiet=FALSE;
     } else {
+        g_mutex_lock(self->read_lock);
         self->client->thumb_fn(thumb_size_x, thumb_size_y,
             self->meta, self->client->read_client_info, dest_void,
             self->client->data_type);
+        g_mutex_unlock(self->read_lock);
+    }
+}
+
+static gpointer tile_loader_thread(gpointer data)
+{
+    CachedImage *self = (CachedImage*)data;
+    TileLoader *tl = self->loader;
+    size_t tile_size = (size_t)data_size(self)*self->ns*self->rows_per_tile;
+
+    g_mutex_lock(tl->lock);
+    while (TRUE) {
+        while (!tl->quit && (tl->n_queued == 0 ||
+                             tl->n_done == MAX_TILE_REQUESTS))
+            g_cond_wait(tl->changed, tl->lock);
+        if (tl->quit)
+            break;
+
+        TileRequest req = tl->queue[0];
+        --tl->n_queued;
+        memmove(&tl->queue[0], &tl->queue[1],
+                sizeof(TileRequest)*tl->n_queued);
+        tl->loading = req.rs;
+        g_mutex_unlock(tl->lock);
+
+        // as in get_pixel(), zero the part past the end of the file
+        req.data = malloc(tile_size);
+        if (req.data) {
+            int rows_to_get = self->rows_per_tile;
+            if (req.rs + rows_to_get > self->nl)
+                rows_to_get = self->nl - req.rs;
+            memset(req.data, 0, tile_size);
+            cached_image_read_rows(self, req.rs, rows_to_get, req.data,
+                                   tl->meta);
+        }
+
+        g_mutex_lock(tl->lock);
+        tl->loading = -1;
+        if (req.data)
+            tl->done[tl->n_done++] = req;
+        else
+            tl->failed = TRUE;
+        g_cond_broadcast(tl->changed);
+        if (req.visible || !req.data)
+            big_image_tile_loaded();
+    }
+    g_mutex_unlock(tl->lock);
+
+    return NULL;
+}
+
+static void start_tile_loader(CachedImage *self)
+{
+    TileLoader *tl = CALLOC(1, sizeof(TileLoader));
+    tl->lock = asf_mutex_new();
+    tl->changed = asf_cond_new();
+    tl->loading = -1;
+    tl->meta = meta_copy(self->meta);
+    self->loader = tl;
+
+    tl->thread = asf_thread_new("tile_loader", tile_loader_thread, self);
+    if (!tl->thread)
+        tl->failed = TRUE;
+}
+
+static void stop_tile_loader(CachedImage *self)
+{
+    TileLoader *tl = self->loader;
+    int i;
+
+    if (tl->thread) {
+        g_mutex_lock(tl->lock);
+        tl->quit = TRUE;
+        g_cond_broadcast(tl->changed);
+        g_mutex_unlock(tl->lock);
+        g_thread_join(tl->thread);
     }
+
+    for (i=0; i<tl->n_done; ++i)
+        free(tl->done[i].data);
+
+    meta_free(tl->meta);
+    asf_cond_free(tl->changed);
+    asf_mutex_free(tl->lock);
+    free(tl);
+    self->loader = NULL;
+}
+
+// Adds the tile starting at row rs to the loader's queue, unless it is
+// already cached, queued or being loaded.  Call with the loader locked.
+static void queue_tile(CachedImage *self, int rs, int visible)
+{
+    TileLoader *tl = self->loader;
+    int i;
+
+    if (rs < 0 || rs >= self->nl || tile_in_cache(self, rs) ||
+        tl->loading == rs || tl->n_queued == MAX_TILE_REQUESTS)
+        return;
+    for (i=0; i<tl->n_queued; ++i)
+        if (tl->queue[i].rs == rs)
+            return;
+    for (i=0; i<tl->n_done; ++i)
+        if (tl->done[i].rs == rs)
+            return;
+
+    tl->queue[tl->n_queued].rs = rs;
+    tl->queue[tl->n_queued].visible = visible;
+    tl->queue[tl->n_queued].data = NULL;
+    ++tl->n_queued;
+}
+
+// Called before drawing a view of rows first_line..last_line: queues up
+// the tiles in view that aren't in the cache, middle ones first, followed
+// by the next tile in the direction the view has been moving.  Requests
+// for earlier views that haven't been started are dropped.
+void cached_image_prefetch(CachedImage *self, int first_line, int last_line)
+{
+    // the client has to read everything in one go
+    if (self->client->require_full_load)
+        return;
+
+    if (first_line < 0) first_line = 0;
+    if (last_line >= self->nl) last_line = self->nl - 1;
+    if (first_line > last_line)
+        return;
+
+    if (!self->loader)
+        start_tile_loader(self);
+    adopt_loaded_tiles(self);
+
+    int rpt = self->rows_per_tile;
+    int center = (first_line + last_line) / 2;
+    if (self->view_center >= 0 && center != self->view_center)
+        self->pan_direction = center > self->view_center ? 1 : -1;
+    self->view_center = center;
+
+    TileLoader *tl = self->loader;
+    g_mutex_lock(tl->lock);
+    tl->n_queued = 0;
+
+    int first_tile = first_line / rpt;
+    int last_tile = last_line / rpt;
+    int center_tile = center / rpt;
+    int i;
+    for (i=0; i<=last_tile-first_tile; ++i) {
+        if (center_tile-i >= first_tile)
+            queue_tile(self, (center_tile-i)*rpt, TRUE);
+        if (i > 0 && center_tile+i <= last_tile)
+            queue_tile(self, (center_tile+i)*rpt, TRUE);
+    }
+
+    if (self->pan_direction > 0)
+        queue_tile(self, (last_tile+1)*rpt, FALSE);
+    else if (self->pan_direction < 0)
+        queue_tile(self, (first_tile-1)*rpt, FALSE);
+
+    g_cond_broadcast(tl->changed);
+    g_mutex_unlock(tl->lock);
+}
+
+// Are rows first_line..last_line in the cache?  If not, they will be (see
+// cached_image_prefetch()), and big_image_tile_loaded() is called when they
+// are.  Rows outside the image don't need loading.
+int cached_image_rows_loaded(CachedImage *self, int first_line, int last_line)
+{
+    TileLoader *tl = self->loader;
+    int failed;
+
+    if (!tl)
+        return TRUE;
+
+    g_mutex_lock(tl->lock);
+    failed = tl->failed;
+    g_mutex_unlock(tl->lock);
+    if (failed)
+        return TRUE;
+
+    adopt_loaded_tiles(self);
+
+    if (first_line < 0) first_line = 0;
+    if (last_line >= self->nl) last_line = self->nl - 1;
+    if (first_line > last_line)
+        return TRUE;
+
+    int rpt = self->rows_per_tile;
+    int t;
+    for (t = first_line/rpt; t <= last_line/rpt; ++t)
+        if (!tile_in_cache(self, t*rpt))
+            return FALSE;
+    return TRUE;
 }
 
 CachedImage * cached_image_new_from_file(
@@ -251,6 +597,13 @@ CachedImage * cached_image_new_from_file(
     self->stats_g = stats_g;   // do NOT take ownership of this
     self->stats_b = stats_b;   // do NOT take ownership of this
 
+    asf_thread_init();
+    self->read_lock = asf_mutex_new();
+    self->pyramid = NULL;      // see cached_image_open_pyramid()
+    self->loader = NULL;       // see cached_image_prefetch()
+    self->view_center = -1;
+    self->pan_direction = 0;
+
     // line line_count may have been fudges, if we are multilooking
     self->nl = meta->general->line_count;
     self->ns = meta->general->sample_count;
@@ -269,6 +622,10 @@ CachedImage * cached_image_new_from_file(
 
         // test line -- uncomment this for very small tiles
         //self->rows_per_tile = 2*1024*1024 / (self->ns*data_size(self));
+
+        // no point in a tile bigger than the image
+        if (self->rows_per_tile > self->nl)
+            self->rows_per_tile = self->nl;
     }
 
     asfPrintStatus("Using %d rows per tile.\n", self->rows_per_tile);
@@ -402,6 +759,13 @@ void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
 void cached_image_free (CachedImage *self)
 {
     int i;
+
+    // this waits for the pyramid to stop reading from the client
+    if (self->pyramid)
+        overview_pyramid_free(self->pyramid);
+    if (self->loader)
+        stop_tile_loader(self);
+
     for (i=0; i<self->n_tiles; ++i) {
         if (self->cache[i])
             free(self->cache[i]);
@@ -414,6 +778,7 @@ void cached_image_free (CachedImage *self)
     free(self->access_counts);
     free(self->cache);
     free(self->client);
+    asf_mutex_free(self->read_lock);
 
     // we do not own the metadata -- don't free it!
 
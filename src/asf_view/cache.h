@@ -91,6 +91,14 @@ typedef struct {
 } ClientInterface;
 
 
+//---------------------------------------------------------------------------
+// Overview pyramid -- reduced resolution copies of a large image, saved in
+// a file next to it, for drawing zoomed out views.  See pyramid.c
+typedef struct overview_pyramid OverviewPyramid;
+
+// Loads tiles in the background, see cache.c
+typedef struct tile_loader TileLoader;
+
 //---------------------------------------------------------------------------
 // Here is the ImageCache stuff.  The global ImageCache that holds the
 // loaded image is "data_ci".  This is all private data.
@@ -111,6 +119,11 @@ typedef struct {
   ImageStatsRGB *stats_r;   // not owned by us, not populated by us
   ImageStatsRGB *stats_g;   // not owned by us, not populated by us
   ImageStatsRGB *stats_b;   // not owned by us, not populated by us
+  GMutex *read_lock;        // held while calling the client's read functions
+  OverviewPyramid *pyramid; // for zoomed out views, NULL if we have none
+  TileLoader *loader;       // background tile loading, NULL until needed
+  int view_center;          // middle row of the last view, -1 if none yet
+  int pan_direction;        // 1 if the view last moved down, -1 if up
 } CachedImage;
 
 CachedImage * cached_image_new_from_file(
@@ -128,6 +141,20 @@ void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
 void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
                          void *dest);
 
+int cached_image_pixel_size(CachedImage *self);
+void cached_image_read_rows(CachedImage *self, int row_start, int n_rows,
+                            void *dest, meta_parameters *meta);
+void cached_image_prefetch(CachedImage *self, int first_line, int last_line);
+int cached_image_rows_loaded(CachedImage *self, int first_line,
+                             int last_line);
+
 void cached_image_free (CachedImage *self);
 
+// pyramid.c
+void cached_image_open_pyramid(CachedImage *self, const char *file,
+                               const char *band);
+CachedImage *cached_image_get_overview(CachedImage *self, double zoom,
+                                       int *factor);
+void overview_pyramid_free(OverviewPyramid *pyramid);
+
 #endif
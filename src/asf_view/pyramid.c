@@ -0,0 +1,442 @@
+// Overview pyramid, for drawing zoomed out views of large images.
+//
+// Each level of the pyramid is the level above it reduced by averaging
+// each 2x2 block of pixels, down to a level that fits in the window.
+// Classified images, and others shown through a look up table, are
+// subsampled instead, since the average of two class values (or LUT
+// indices) is some other class.  The
+// levels are saved in a file next to the image ("<image>.pyr"), which is
+// built in a background thread the first time the image is viewed, and is
+// used as is in later sessions unless the image has been modified since.
+//
+// When zoomed out, big_image.c draws from the level closest to the display
+// scale (see cached_image_get_overview()), so instead of reading through
+// the entire image, only a fraction of it is read.  The levels are read
+// through their own CachedImage, so they are cached the same way as the
+// image itself.
+
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "asf_view.h"
+#include "asf_nan.h"
+#include "asf_glib.h"
+
+// images smaller than this (in bytes) are quick enough to read that they
+// don't get a pyramid
+static const double MIN_PYRAMID_IMAGE_SIZE = 128.*1024.*1024.;
+
+// levels are added until the image is no bigger than this across
+static const int MIN_LEVEL_SIZE = 512;
+
+// when building, read about this many bytes at a time
+static const int BUILD_CHUNK_SIZE = 16*1024*1024;
+
+#define PYRAMID_MAGIC "ASFPYR2"
+#define MAX_LEVELS 30
+
+// The pyramid file starts with this, followed by the levels (from 1 on)
+// one after the other, each stored row by row like the image.  It is only
+// ever read on the machine that wrote it, so it is in native byte order.
+typedef struct {
+    char magic[8];          // PYRAMID_MAGIC
+    int byte_order;         // 1, as written
+    int data_type;          // ssv_data_type_t of the pixels
+    int nl, ns;             // size of the full resolution image
+    int n_levels;           // not counting the full resolution image
+    int subsampled;         // TRUE if levels are subsampled, not averaged
+    long long mtime, size;  // of the image file the pyramid was made from
+    char band[256];         // band(s) being viewed, if not the default
+} PyramidHeader;
+
+struct overview_pyramid {
+    char *file;             // pyramid file
+    char *tmp_file;         // where the pyramid file is built
+    PyramidHeader header;
+    int nl[MAX_LEVELS+1];   // size of each level, level 0 is the image
+    int ns[MAX_LEVELS+1];
+    long long offset[MAX_LEVELS+1];            // where each level starts
+    CachedImage *levels[MAX_LEVELS+1];         // opened as needed
+    meta_parameters *level_meta[MAX_LEVELS+1]; // sizes, for the caches
+
+    CachedImage *image;     // what this is a pyramid of -- not owned
+    meta_parameters *meta;  // builder's copy of the image's metadata
+    GThread *builder;       // NULL unless building
+    GMutex *lock;           // guards ready & cancel
+    int ready;              // TRUE once the pyramid file is complete
+    int cancel;             // tells the builder to quit
+};
+
+// client info for reading a level out of the pyramid file
+typedef struct {
+    FILE *fp;
+    long long offset;       // where the level starts
+    int row_size;           // bytes
+} PyramidLevelInfo;
+
+static int read_pyramid_level(int row_start, int n_rows_to_get,
+                              void *dest, void *read_client_info,
+                              meta_parameters *meta, int data_type)
+{
+    PyramidLevelInfo *info = (PyramidLevelInfo*)read_client_info;
+    FSEEK64(info->fp, info->offset + (long long)row_start*info->row_size,
+            SEEK_SET);
+    ASF_FREAD(dest, info->row_size, n_rows_to_get, info->fp);
+    return TRUE;
+}
+
+static void free_pyramid_level(void *read_client_info)
+{
+    PyramidLevelInfo *info = (PyramidLevelInfo*)read_client_info;
+    FCLOSE(info->fp);
+    free(info);
+}
+
+static int is_float_type(int data_type)
+{
+    return data_type == GREYSCALE_FLOAT || data_type == RGB_FLOAT;
+}
+
+static int n_channels(int data_type)
+{
+    return data_type == RGB_BYTE || data_type == RGB_FLOAT ? 3 : 1;
+}
+
+// Averages each 2x2 block of the n_rows x ns pixels in src into one pixel
+// of dst.  With an odd number of rows or columns, the last one is averaged
+// in pairs (or on its own, in the corner).  Floating point values that
+// aren't numbers are left out of the averages.  With subsample, the top
+// left pixel of each block is taken as is.
+static void reduce_rows(const unsigned char *src, int n_rows, int ns,
+                        unsigned char *dst, int data_type, int subsample)
+{
+    int nc = n_channels(data_type);
+    int is_float = is_float_type(data_type);
+    int out_nl = (n_rows+1)/2;
+    int out_ns = (ns+1)/2;
+    const float *fsrc = (const float*)src;
+    float *fdst = (float*)dst;
+    int i, j, c, m, n;
+
+    for (i=0; i<out_nl; ++i) {
+        for (j=0; j<out_ns; ++j) {
+            for (c=0; c<nc; ++c) {
+                if (subsample) {
+                    int k = (i*out_ns + j)*nc + c;
+                    if (!is_float)
+                        dst[k] = src[(2*i*ns + 2*j)*nc + c];
+                    else
+                        fdst[k] = fsrc[(2*i*ns + 2*j)*nc + c];
+                    continue;
+                }
+                double sum = 0;
+                int count = 0;
+                for (m=2*i; m<2*i+2 && m<n_rows; ++m) {
+                    for (n=2*j; n<2*j+2 && n<ns; ++n) {
+                        int k = (m*ns + n)*nc + c;
+                        if (!is_float) {
+                            sum += src[k];
+                            ++count;
+                        }
+                        else if (!ISNAN(fsrc[k])) {
+                            sum += fsrc[k];
+                            ++count;
+                        }
+                    }
+                }
+                int k = (i*out_ns + j)*nc + c;
+                if (!is_float)
+                    dst[k] = (unsigned char)(sum/count + .5);
+                else if (count > 0)
+                    fdst[k] = (float)(sum/count);
+                else
+                    fdst[k] = fsrc[(2*i*ns + 2*j)*nc + c];
+            }
+        }
+    }
+}
+
+static int cancelled(OverviewPyramid *self)
+{
+    g_mutex_lock(self->lock);
+    int ret = self->cancel;
+    g_mutex_unlock(self->lock);
+    return ret;
+}
+
+// Background thread that writes the pyramid file: level 1 is made from
+// the image, read through the image's client, each level after that from
+// the one before it, read back from the file.
+static gpointer build_pyramid(gpointer data)
+{
+    OverviewPyramid *self = (OverviewPyramid*)data;
+    int ds = cached_image_pixel_size(self->image);
+    int data_type = self->image->data_type;
+    int k, ok;
+
+    FILE *fp = fopen(self->tmp_file, "w+b");
+    if (!fp) {
+        asfPrintStatus("Could not create %s, zoomed out views will be "
+                       "slow.\n", self->tmp_file);
+        return NULL;
+    }
+
+    ok = fwrite(&self->header, sizeof(PyramidHeader), 1, fp) == 1;
+
+    for (k=1; ok && k<=self->header.n_levels; ++k) {
+        int src_ns = self->ns[k-1];
+        int dst_row_size = self->ns[k]*ds;
+
+        // rows to reduce at a time -- an even number
+        int chunk = 2*(BUILD_CHUNK_SIZE/(2*src_ns*ds));
+        if (chunk < 2) chunk = 2;
+
+        unsigned char *src = MALLOC(chunk*src_ns*ds);
+        unsigned char *dst = MALLOC((chunk/2)*dst_row_size);
+
+        int row;
+        for (row=0; ok && row<self->nl[k-1]; row+=chunk) {
+            if (cancelled(self)) {
+                ok = FALSE;
+                break;
+            }
+
+            int n_rows = MIN(chunk, self->nl[k-1] - row);
+            if (k == 1) {
+                cached_image_read_rows(self->image, row, n_rows, src,
+                                       self->meta);
+            } else {
+                FSEEK64(fp, self->offset[k-1] + (long long)row*src_ns*ds,
+                        SEEK_SET);
+                ok = fread(src, src_ns*ds, n_rows, fp) == n_rows;
+            }
+
+            if (ok) {
+                int out_rows = (n_rows+1)/2;
+                reduce_rows(src, n_rows, src_ns, dst, data_type,
+                            self->header.subsampled);
+                FSEEK64(fp, self->offset[k] + (long long)(row/2)*dst_row_size,
+                        SEEK_SET);
+                ok = fwrite(dst, dst_row_size, out_rows, fp) == out_rows;
+            }
+        }
+
+        free(src);
+        free(dst);
+    }
+
+    if (fclose(fp) != 0)
+        ok = FALSE;
+
+    if (ok) {
+        // only a complete pyramid file ever has the real name
+        remove(self->file);
+        ok = rename(self->tmp_file, self->file) == 0;
+    }
+
+    if (ok) {
+        g_mutex_lock(self->lock);
+        self->ready = TRUE;
+        g_mutex_unlock(self->lock);
+        asfPrintStatus("Saved overview pyramid: %s\n", self->file);
+    } else {
+        remove(self->tmp_file);
+        if (!cancelled(self))
+            asfPrintStatus("Failed to write %s, zoomed out views will be "
+                           "slow.\n", self->tmp_file);
+    }
+
+    return NULL;
+}
+
+// Is the pyramid file there, made from the current version of the image?
+static int pyramid_file_ok(OverviewPyramid *self)
+{
+    PyramidHeader header;
+    struct stat st;
+    int ok;
+
+    FILE *fp = fopen(self->file, "rb");
+    if (!fp)
+        return FALSE;
+
+    ok = fread(&header, sizeof(PyramidHeader), 1, fp) == 1;
+    fclose(fp);
+
+    // the file must also be the right size -- in case it was truncated
+    int k = self->header.n_levels;
+    long long expected_size = self->offset[k] +
+        (long long)self->nl[k]*self->ns[k]*cached_image_pixel_size(self->image);
+
+    return ok &&
+        memcmp(&header, &self->header, sizeof(PyramidHeader)) == 0 &&
+        stat(self->file, &st) == 0 && (long long)st.st_size == expected_size;
+}
+
+void cached_image_open_pyramid(CachedImage *self, const char *file,
+                               const char *band)
+{
+    struct stat st;
+    int ds = cached_image_pixel_size(self);
+    int k;
+
+    // small images, and those the client has to load all at once anyway,
+    // don't need one
+    if (self->client->require_full_load ||
+        (double)self->nl * self->ns * ds < MIN_PYRAMID_IMAGE_SIZE)
+        return;
+
+    if (stat(file, &st) != 0)
+        return;
+
+    OverviewPyramid *p = CALLOC(1, sizeof(OverviewPyramid));
+    p->image = self;
+
+    // the pyramid depends on the band(s) shown, so they are part of the
+    // name of the pyramid file
+    if (band && strlen(band) > 0) {
+        char *b = STRDUP(band);
+        char *c;
+        for (c=b; *c; ++c)
+            if (!isalnum((unsigned char)*c)) *c = '_';
+        p->file = MALLOC(sizeof(char)*(strlen(file)+strlen(b)+10));
+        sprintf(p->file, "%s.%s.pyr", file, b);
+        free(b);
+    } else {
+        p->file = MALLOC(sizeof(char)*(strlen(file)+10));
+        sprintf(p->file, "%s.pyr", file);
+    }
+    p->tmp_file = MALLOC(sizeof(char)*(strlen(p->file)+10));
+    sprintf(p->tmp_file, "%s.tmp", p->file);
+
+    // the header is filled in completely (padding too), so that it can
+    // be compared to what is in the file with memcmp()
+    memset(&p->header, 0, sizeof(PyramidHeader));
+    strcpy(p->header.magic, PYRAMID_MAGIC);
+    p->header.byte_order = 1;
+    p->header.data_type = self->data_type;
+    p->header.nl = self->nl;
+    p->header.ns = self->ns;
+    p->header.mtime = (long long)st.st_mtime;
+    p->header.size = (long long)st.st_size;
+    if (band)
+        strncpy(p->header.band, band, sizeof(p->header.band)-1);
+
+    // images that are always shown through a look up table
+    p->header.subsampled = self->meta->colormap != NULL ||
+        self->meta->general->image_data_type == LUT_IMAGE ||
+        self->meta->general->image_data_type == POLARIMETRIC_SEGMENTATION;
+
+    p->nl[0] = self->nl;
+    p->ns[0] = self->ns;
+    p->offset[0] = 0;
+    p->offset[1] = sizeof(PyramidHeader);
+    for (k=1; k<MAX_LEVELS; ++k) {
+        p->nl[k] = (p->nl[k-1]+1)/2;
+        p->ns[k] = (p->ns[k-1]+1)/2;
+        if (k>1)
+            p->offset[k] = p->offset[k-1] +
+                (long long)p->nl[k-1]*p->ns[k-1]*ds;
+        if (p->nl[k] <= MIN_LEVEL_SIZE && p->ns[k] <= MIN_LEVEL_SIZE)
+            break;
+    }
+    p->header.n_levels = k;
+
+    p->lock = asf_mutex_new();
+    self->pyramid = p;
+
+    if (pyramid_file_ok(p)) {
+        asfPrintStatus("Using overview pyramid: %s\n", p->file);
+        p->ready = TRUE;
+    } else {
+        asfPrintStatus("Building overview pyramid in the background: %s\n",
+                       p->file);
+        p->meta = meta_copy(self->meta);
+        p->builder = asf_thread_new("pyramid", build_pyramid, p);
+        if (!p->builder)
+            asfPrintStatus("Failed to start building the overview pyramid.\n");
+    }
+}
+
+// Returns the cache to draw from at the given zoom (image pixels per
+// screen pixel): the pyramid level that is reduced by the largest power of
+// 2 (returned in factor) no bigger than the zoom.  Returns the image itself
+// (factor 1) when not zoomed out, or there is no pyramid (yet), or the
+// pyramid is averaged but a look up table is being applied.
+CachedImage *cached_image_get_overview(CachedImage *self, double zoom,
+                                       int *factor)
+{
+    OverviewPyramid *p = self->pyramid;
+    int k = 0;
+
+    *factor = 1;
+    if (!p || zoom < 2)
+        return self;
+
+    g_mutex_lock(p->lock);
+    int ready = p->ready;
+    g_mutex_unlock(p->lock);
+    if (!ready || (have_lut() && !p->header.subsampled))
+        return self;
+
+    if (p->builder) {
+        // done, so this won't wait
+        g_thread_join(p->builder);
+        p->builder = NULL;
+    }
+
+    while (k < p->header.n_levels && 2*(1<<k) <= zoom)
+        ++k;
+
+    if (!p->levels[k]) {
+        PyramidLevelInfo *info = MALLOC(sizeof(PyramidLevelInfo));
+        info->fp = FOPEN(p->file, "rb");
+        info->offset = p->offset[k];
+        info->row_size = p->ns[k]*cached_image_pixel_size(self);
+
+        ClientInterface *client = MALLOC(sizeof(ClientInterface));
+        client->read_fn = read_pyramid_level;
+        client->thumb_fn = NULL;
+        client->free_fn = free_pyramid_level;
+        client->read_client_info = info;
+        client->data_type = self->data_type;
+        client->require_full_load = FALSE;
+
+        p->level_meta[k] = raw_init();
+        p->level_meta[k]->general->line_count = p->nl[k];
+        p->level_meta[k]->general->sample_count = p->ns[k];
+
+        p->levels[k] = cached_image_new_from_file(p->file, p->level_meta[k],
+            client, self->stats, self->stats_r, self->stats_g, self->stats_b);
+    }
+
+    *factor = 1<<k;
+    return p->levels[k];
+}
+
+void overview_pyramid_free(OverviewPyramid *self)
+{
+    int k;
+
+    if (self->builder) {
+        g_mutex_lock(self->lock);
+        self->cancel = TRUE;
+        g_mutex_unlock(self->lock);
+        g_thread_join(self->builder);
+    }
+
+    for (k=0; k<=MAX_LEVELS; ++k) {
+        if (self->levels[k])
+            cached_image_free(self->levels[k]);
+        if (self->level_meta[k])
+            meta_free(self->level_meta[k]);
+    }
+
+    if (self->meta)
+        meta_free(self->meta);
+    asf_mutex_free(self->lock);
+    free(self->file);
+    free(self->tmp_file);
+    free(self);
+}
@@ -257,6 +257,11 @@ int read_file(const char *filename, const char *band, int multilook,
                         &(curr->stats_b));
     assert(curr->data_ci);
 
+    // zoomed out views of large images come from an overview pyramid --
+    // masks are only ever looked at full resolution
+    if (curr != mask)
+        cached_image_open_pyramid(curr->data_ci, data_name, band);
+
     int nl = meta->general->line_count;
     curr->nl = nl;
 
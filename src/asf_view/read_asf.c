@@ -1,7 +1,7 @@
 #include "asf_view.h"
 
 typedef struct {
-    FILE *fp;    // data file pointer
+    image_map_t *map; // data file, memory mapped when possible
     int is_rgb;  // are we doing rgb compositing
     int band_gs; // which band we are using (when viewing as greyscale)
     int band_r;  // which band we are using for red (when rgb compositing)
@@ -122,10 +122,10 @@ static void get_asf_line(ReadAsfClientInfo *info, meta_parameters *meta,
         meta->general->line_count = g_saved_line_count;
 
         // FIXME: figure a nice way to avoid allocating every time we read a line
-        get_float_line(info->fp, meta, row, buf);
+        image_map_get_float_line(info->map, meta, row, buf);
         float *tmp = MALLOC(sizeof(float)*meta->general->sample_count);
         for (k=1; k<nlooks; ++k) {
-            get_float_line(info->fp, meta, row+k, tmp);
+            image_map_get_float_line(info->map, meta, row+k, tmp);
             for (j=0; j<meta->general->sample_count; ++j)
                 buf[j] += tmp[j];
         }
@@ -137,7 +137,7 @@ static void get_asf_line(ReadAsfClientInfo *info, meta_parameters *meta,
     }
     else {
         // no multilooking case
-        get_float_line(info->fp, meta, row, buf);
+        image_map_get_float_line(info->map, meta, row, buf);
     }
 }
 
@@ -161,13 +161,13 @@ static void get_asf_lines(ReadAsfClientInfo *info, meta_parameters *meta,
         float *tmp = MALLOC(sizeof(float)*ns);
         for (i=0; i<n; ++i) {
             float *this_row = buf + i*ns;
-            get_float_line(info->fp, meta, row+i*nlooks, this_row);
+            image_map_get_float_line(info->map, meta, row+i*nlooks, this_row);
             int n_read = nlooks;
             for (k=1; k<nlooks; ++k) {
                 if (row+n*nlooks+k >= meta->general->line_count) {
                     --n_read;
                 } else {
-                    get_float_line(info->fp, meta, row+i*nlooks+k, tmp);
+                    image_map_get_float_line(info->map, meta, row+i*nlooks+k, tmp);
                     for (j=0; j<meta->general->sample_count; ++j)
                         this_row[j] += tmp[j];
                 }
@@ -181,7 +181,7 @@ static void get_asf_lines(ReadAsfClientInfo *info, meta_parameters *meta,
     }
     else {
         // no multilooking case
-        get_float_lines(info->fp, meta, row, n, buf);
+        image_map_get_float_lines(info->map, meta, row, n, buf);
     }
 }
 
@@ -197,8 +197,9 @@ int read_asf_client(int row_start, int n_rows_to_get,
         unsigned char *dest = (unsigned char*)dest_void;
         if (data_type==GREYSCALE_BYTE) {
             // reading byte data directly into the byte cache
-            FSEEK64(info->fp, ns*(row_start + nl*info->band_gs), SEEK_SET);
-            ASF_FREAD(dest, sizeof(unsigned char), n_rows_to_get*ns, info->fp);
+            image_map_read(info->map,
+                           (long long)ns*(row_start + nl*info->band_gs),
+                           (size_t)n_rows_to_get*ns, dest);
         }
         else {
             // will have to figure this one out
@@ -222,8 +223,7 @@ int read_asf_client(int row_start, int n_rows_to_get,
                 int i,j,off = ns*(row_start + nl*info->band_r);
                 for (i=0; i<n_rows_to_get; ++i) {
                     int k = 3*ns*i;
-                    FSEEK64(info->fp, off + i*ns, SEEK_SET);
-                    ASF_FREAD(buf, sizeof(unsigned char), ns, info->fp);
+                    image_map_read(info->map, (long long)off + i*ns, ns, buf);
                     for (j=0; j<ns; ++j, k += 3)
                         dest[k] = buf[j];
                 }
@@ -234,8 +234,7 @@ int read_asf_client(int row_start, int n_rows_to_get,
                 int i,j,off = ns*(row_start + nl*info->band_g);
                 for (i=0; i<n_rows_to_get; ++i) {
                     int k = 3*ns*i+1;
-                    FSEEK64(info->fp, off + i*ns, SEEK_SET);
-                    ASF_FREAD(buf, sizeof(unsigned char), ns, info->fp);
+                    image_map_read(info->map, (long long)off + i*ns, ns, buf);
                     for (j=0; j<ns; ++j, k += 3)
                         dest[k] = buf[j];
                 }
@@ -246,8 +245,7 @@ int read_asf_client(int row_start, int n_rows_to_get,
                 int i,j,off = ns*(row_start + nl*info->band_b);
                 for (i=0; i<n_rows_to_get; ++i) {
                     int k = 3*ns*i+2;
-                    FSEEK64(info->fp, off + i*ns, SEEK_SET);
-                    ASF_FREAD(buf, sizeof(unsigned char), ns, info->fp);
+                    image_map_read(info->map, (long long)off + i*ns, ns, buf);
                     for (j=0; j<ns; ++j, k += 3)
                         dest[k] = buf[j];
                 }
@@ -476,7 +474,7 @@ int get_asf_thumbnail_data(int thumb_size_x, int thumb_size_y,
 void free_asf_client_info(void *read_client_info)
 {
     ReadAsfClientInfo *info = (ReadAsfClientInfo*) read_client_info;
-    if (info->fp) fclose(info->fp);
+    if (info->map) image_map_close(info->map);
     free(info);
 }
 
@@ -554,8 +552,8 @@ int open_asf_data(const char *filename, const char *band, int multilook,
     }
 
 
-    info->fp = fopen(filename, "rb");
-    if (!info->fp) {
+    info->map = image_map_open(filename);
+    if (!info->map) {
         asfPrintWarning("Failed to open ASF Internal file %s: %s\n",
             filename, strerror(errno));
         return FALSE;
@@ -7,7 +7,8 @@ void usage()
 {
   printf("Usage:\n\n");
   printf(" kernel -type <kernel_type> [ -size <kernel size> ] [ -nlooks <value> ]\n");
-  printf("        [ -dampling <damping factor> ] <infile> <outfile>\n\n");
+  printf("        [ -dampling <damping factor> ] [ -threads <count> ]\n");
+  printf("        <infile> <outfile>\n\n");
   printf("Produces an outfile with the specified kernel applied.\n");
   printf("The given kernel is applied to all pixels in the input.\n");
   printf("image, to produce the output.\n\n");
@@ -15,7 +16,10 @@ void usage()
   printf("  Note that not all options apply to all kernel types!\n\n");
   printf("  -size     Kernel size to use, must be odd.\n");
   printf("  -nlooks   Number of looks in the radar image.\n");
-  printf("  -damping  Exponential damping factor.\n\n");
+  printf("  -damping  Exponential damping factor.\n");
+  printf("  -threads  Number of threads to use.  The default is 1, 0 uses one\n");
+  printf("            thread per processor.  The output is the same for any\n");
+  printf("            number of threads.\n\n");
   printf("Valid kernel types:\n");
   printf("  Name      Description (options used)\n");
   printf("  ----      --------------------------\n");
@@ -50,6 +54,10 @@ int main(int argc, char *argv[])
      extract_int_options(&argc, &argv, &nLooks, "-looks","--looks","-nlooks",
                          "--nlooks","-n","-l",NULL);
 
+  int thread_count=1;
+  extract_int_options(&argc, &argv, &thread_count, "-threads","--threads",NULL);
+  kernel_filter_set_thread_count(thread_count);
+
   filter_type_t ktype;
 
   if (strcmp_case(type, "AVERAGE") == 0 || strcmp_case(type, "AVG") == 0) {
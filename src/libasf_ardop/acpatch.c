@@ -48,118 +48,115 @@ PROGRAM HISTORY:   Converted from FORTRAN subroutine for ROI.f 	T. Logan 8/96
 #include "asf.h"
 #include "asf_meta.h"
 #include "ardop_defs.h"
+#include "asf_glib.h"
 
 int ac_direction=0;/*Used only by dop_prf*/
 
-void acpatch(patch *p,const satellite *s)
-{
 #define sinCosTableEntries 4096
 #define sinCosTableBitmask 0x0fff
 
+/*The sin/cos table is made once and shared (read-only) by all the threads.*/
+static complexFloat *sinCosTable=NULL;
+G_LOCK_DEFINE_STATIC(sin_cos_table);
 
-	static complexFloat *sinCosTable=NULL;
-	float sinCosTableConv=1.0/pi2*sinCosTableEntries;
 #define sinCos(phase) (sinCosTable[((int)((phase)*sinCosTableConv))&sinCosTableBitmask])
 
+typedef struct {
+	patch *p;
+	const satellite *s;
+} ac_patch_info;
+
+/*Azimuth compress one range line of the patch.  scratch holds the
+azimuth reference function.*/
+static void ac_line(int lineNo,void *scratch,void *data)
+{
+	patch *p=((ac_patch_info *)data)->p;
+	const satellite *s=((ac_patch_info *)data)->s;
+	float sinCosTableConv=1.0/pi2*sinCosTableEntries;
 	float  r, y, f0, f_rate;
 	int    np/*, ind*/;
-	complexFloat *ref=(complexFloat *)MALLOC(sizeof(complexFloat)*p->n_az);
+	complexFloat *ref=(complexFloat *)scratch;
 	float  phase, az_resamp;
 	float  dop_deskew;
 	int    n, nfc, nf0;
-	int    lineNo, j;
+	int    j;
 	complexFloat cZero=Czero();
 	float pixel2time=1.0/s->prf;
 	float *win;
 	/*float alpha;*/
 
-	
-	if (sinCosTable==NULL)
-	{
-		int tableIndex;
-		sinCosTable=(complexFloat *)MALLOC(sizeof(complexFloat)*sinCosTableEntries);
-		for (tableIndex=0;tableIndex<sinCosTableEntries;tableIndex++)
-		{
-			float tablePhase=(float)tableIndex/sinCosTableConv;
-			sinCosTable[tableIndex].real = cos(tablePhase);
-			sinCosTable[tableIndex].imag = sin(tablePhase);
-		}
-	}
+	int lineOffset=lineNo*p->n_az;/*Offset to the current line in the trans array.*/
 
-	for (lineNo=0; lineNo< p->n_range; lineNo++)
-	{
-		int lineOffset=lineNo*p->n_az;/*Offset to the current line in the trans array.*/
-
-		r = p->slantToFirst + (float)lineNo*p->slantPer;
-		f0 = p->fd + p->fdd*lineNo + p->fddd*lineNo*lineNo;
-		f_rate=getDopplerRate(r,f0,p->g);
-		np = (int)(r*s->refPerRange)/2;
-
-		/*Compute the pixel shift for this line.*/
-		/*az_resamp=Pixel shift caused by resampling function*/
-		az_resamp = p->yResampScale * lineNo + p->yResampOffset;
-		dop_deskew = s->a2*f0*r-s->dop_precomp;
-		y =  (az_resamp - dop_deskew)*pi2/(float)p->n_az;
-		
-		/* create reference function */
-		for (j=0; j<p->n_az ; j++) 
-			ref[j] = cZero;
-		
-		phase = PI * pow(f0,2.0)/f_rate;
-		ref[0] = sinCos(phase);
-		
-		/* Check to see if we are going to truncate the bandwidth in azimuth */
+	r = p->slantToFirst + (float)lineNo*p->slantPer;
+	f0 = p->fd + p->fdd*lineNo + p->fddd*lineNo*lineNo;
+	f_rate=getDopplerRate(r,f0,p->g);
+	np = (int)(r*s->refPerRange)/2;
+
+	/*Compute the pixel shift for this line.*/
+	/*az_resamp=Pixel shift caused by resampling function*/
+	az_resamp = p->yResampScale * lineNo + p->yResampOffset;
+	dop_deskew = s->a2*f0*r-s->dop_precomp;
+	y =  (az_resamp - dop_deskew)*pi2/(float)p->n_az;
+
+	/* create reference function */
+	for (j=0; j<p->n_az ; j++)
+		ref[j] = cZero;
+
+	phase = PI * pow(f0,2.0)/f_rate;
+	ref[0] = sinCos(phase);
+
+	/* Check to see if we are going to truncate the bandwidth in azimuth */
 /* Jeremy Made a big change here!
-		s->pctbwaz=0.5; */
-		if (s->pctbwaz!=0)
-			np=np*(1-s->pctbwaz);
-
-		if (ac_direction==0)
-		  for (j = 1; j <= np; j++)
-		  { /*Normal case: write both halves of reference function*/
-			float t = j*pixel2time;
-			float quadratic_phase=PI * f_rate*t*t;
-			float linear_phase=pi2*f0*t;
-			ref[j] = sinCos(quadratic_phase+linear_phase);
-			ref[p->n_az-j] = sinCos(quadratic_phase-linear_phase);
-		  }
+	s->pctbwaz=0.5; */
+	if (s->pctbwaz!=0)
+		np=np*(1-s->pctbwaz);
+
+	if (ac_direction==0)
+	  for (j = 1; j <= np; j++)
+	  { /*Normal case: write both halves of reference function*/
+		float t = j*pixel2time;
+		float quadratic_phase=PI * f_rate*t*t;
+		float linear_phase=pi2*f0*t;
+		ref[j] = sinCos(quadratic_phase+linear_phase);
+		ref[p->n_az-j] = sinCos(quadratic_phase-linear_phase);
+	  }
+	else
+	  for (j = 1; j <= np; j++)
+	  { /*Loop for dop_prf: write only one half of reference function*/
+		float t = j*pixel2time;
+		float quadratic_phase=PI * f_rate*t*t;
+		float linear_phase=pi2*f0*t;
+		if (ac_direction>0)
+		  ref[j] = sinCos(quadratic_phase+linear_phase);
 		else
-		  for (j = 1; j <= np; j++)
-		  { /*Loop for dop_prf: write only one half of reference function*/
-			float t = j*pixel2time;
-			float quadratic_phase=PI * f_rate*t*t;
-			float linear_phase=pi2*f0*t;
-			if (ac_direction>0)
-			  ref[j] = sinCos(quadratic_phase+linear_phase);
-			else
-			  ref[p->n_az-j] = sinCos(quadratic_phase-linear_phase);
-		  }
-		
-		if (s->hamming == 1)
+		  ref[p->n_az-j] = sinCos(quadratic_phase-linear_phase);
+	  }
+
+	if (s->hamming == 1)
+	{
+		FILE *hamFile;
+		float weight;
+		hamFile=FOPEN("Hamming.window","w");
+
+		win=(float *)MALLOC(sizeof(float)*p->n_az);
+		for(j=0;j<p->n_az;j++)
+			win[j]=0.0;
+
+		/* Use a azimuth reference weighting function (Hamming Window) */
+		for(j=0;j<np;j++)
+		{
+			weight=0.8;
+			win[j]=weight-(1.0-weight)*-cos(2.0*PI*j/(2*np));
+			win[p->n_az-j-1]=weight-(1.0-weight)*-cos(2.0*PI*j/(2*np));
+		}
+		for(j=0;j<p->n_az;j++)
 		{
-			FILE *hamFile;
-			float weight;
-			hamFile=FOPEN("Hamming.window","w");
-
-			win=(float *)MALLOC(sizeof(float)*p->n_az);
-			for(j=0;j<p->n_az;j++)
-				win[j]=0.0;
-
-			/* Use a azimuth reference weighting function (Hamming Window) */
-			for(j=0;j<np;j++)
-			{
-				weight=0.8;
-				win[j]=weight-(1.0-weight)*-cos(2.0*PI*j/(2*np));
-				win[p->n_az-j-1]=weight-(1.0-weight)*-cos(2.0*PI*j/(2*np));
-			}	
-			for(j=0;j<p->n_az;j++)
-			{
-				fprintf(hamFile,"%f\n",win[j]);
-				ref[j]=Csmul(win[j],ref[j]);
-			}
-			FCLOSE(hamFile);
-			free(win);
+			fprintf(hamFile,"%f\n",win[j]);
+			ref[j]=Csmul(win[j],ref[j]);
 		}
+		FCLOSE(hamFile);
+		free(win);
+	}
 
 	/*	if (s->kaiser == 1)
                 {
@@ -185,47 +182,78 @@ void acpatch(patch *p,const satellite *s)
                 if (s->debugFlag & AZ_REF_T)
                     debugWritePatch_Line(lineNo, ref, "az_ref_t", p->n_range,
                                          p->n_az);
-		
-		/* forward transform the reference */
-		cfft1d(p->n_az,ref,-1);
-		
-		if (s->debugFlag & AZ_REF_F)
+
+	/* forward transform the reference */
+	cfft1d(p->n_az,ref,-1);
+
+	if (s->debugFlag & AZ_REF_F)
                     debugWritePatch_Line(lineNo, ref, "az_ref_f", p->n_range,
                                          p->n_az);
-		
-		/* multiply the reference by the data */
-		if (!(s->debugFlag & NO_AZIMUTH))
-		{
+
+	/* multiply the reference by the data */
+	if (!(s->debugFlag & NO_AZIMUTH))
+	{
                         int k;
-			n = NINT(f0/s->prf);
-			nf0 = p->n_az*(f0-n*s->prf)/s->prf;
-			nfc = nf0 + p->n_az/2;
-			if (nfc > p->n_az) nfc = nfc - p->n_az;
-			phase = - y * nf0;
-			for (k = 0; k<nfc; k++)
-			{
-				p->trans[lineOffset+k] =
-				    Cmul(Cmul(p->trans[lineOffset+k],Cconj(ref[k])),sinCos(phase));
-				phase += y;
-			} 
-			phase = - y * nf0;
-			for (k = p->n_az-1; k>= nfc; k--)
-			{
-				p->trans[lineOffset+k]  =
-			    	Cmul(Cmul(p->trans[lineOffset+k],Cconj(ref[k])),sinCos(phase));
-				phase -= y;
-			}
+		n = NINT(f0/s->prf);
+		nf0 = p->n_az*(f0-n*s->prf)/s->prf;
+		nfc = nf0 + p->n_az/2;
+		if (nfc > p->n_az) nfc = nfc - p->n_az;
+		phase = - y * nf0;
+		for (k = 0; k<nfc; k++)
+		{
+			p->trans[lineOffset+k] =
+			    Cmul(Cmul(p->trans[lineOffset+k],Cconj(ref[k])),sinCos(phase));
+			phase += y;
 		}
+		phase = - y * nf0;
+		for (k = p->n_az-1; k>= nfc; k--)
+		{
+			p->trans[lineOffset+k]  =
+			    Cmul(Cmul(p->trans[lineOffset+k],Cconj(ref[k])),sinCos(phase));
+			phase -= y;
+		}
+	}
                 if (s->debugFlag & AZ_X_F)
                     debugWritePatch_Line(lineNo, &(p->trans[lineOffset]),
                                          "az_X_f", p->n_range, p->n_az);
-		/* inverse transform the product */
-		cfft1d(p->n_az,&(p->trans[lineOffset]),1);
+	/* inverse transform the product */
+	cfft1d(p->n_az,&(p->trans[lineOffset]),1);
 
-		if (!quietflag && (lineNo%1024 == 0))
+	if (!quietflag && (lineNo%1024 == 0))
                   asfPrintStatus("   ...Processing Line %i\n",lineNo);
+}
+
+void acpatch(patch *p,const satellite *s)
+{
+	ac_patch_info info;
+	int thread_count=ardop_get_thread_count();
+
+	G_LOCK(sin_cos_table);
+	if (sinCosTable==NULL)
+	{
+		float sinCosTableConv=1.0/pi2*sinCosTableEntries;
+		int tableIndex;
+		complexFloat *table=(complexFloat *)MALLOC(sizeof(complexFloat)*sinCosTableEntries);
+		for (tableIndex=0;tableIndex<sinCosTableEntries;tableIndex++)
+		{
+			float tablePhase=(float)tableIndex/sinCosTableConv;
+			table[tableIndex].real = cos(tablePhase);
+			table[tableIndex].imag = sin(tablePhase);
+		}
+		sinCosTable=table;
 	}
-	FREE((void *)ref);
+	G_UNLOCK(sin_cos_table);
+
+	/*The Hamming window and the per-line debugging images are written
+	to files a line at a time, in order, so those need a single thread.*/
+	if (s->hamming == 1 || (s->debugFlag & (AZ_REF_T|AZ_REF_F|AZ_X_F)))
+		thread_count=1;
+
+	info.p=p;
+	info.s=s;
+	ardop_for_lines(p->n_range,thread_count,sizeof(complexFloat)*p->n_az,
+	                ac_line,&info);
+
 	if (s->debugFlag & AZ_X_T) debugWritePatch(p,"az_X_t");
 }
 
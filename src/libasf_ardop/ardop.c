@@ -109,7 +109,6 @@ int ardop(struct INPUT_ARDOP_PARAMS * params_in)
     fill_default_ardop_params(&params);
 
 /*Structures: these are passed to the sub-routines which need them.*/
-    patch *p;
     satellite *s;
     rangeRef *r;
     getRec *signalGetRec;
@@ -117,7 +116,6 @@ int ardop(struct INPUT_ARDOP_PARAMS * params_in)
 
 /*Variables.*/
     int n_az,n_range;/*Region to be processed.*/
-    int patchNo;/*Loop counter.*/
 
 /*Setup metadata*/
     /*Create ARDOP_PARAMS struct as well as meta_parameters.*/
@@ -193,35 +191,13 @@ int ardop(struct INPUT_ARDOP_PARAMS * params_in)
     if (!quietflag) {
       printf("   Processing %dx %d az by %d range patches...\n",f->nPatches,n_az,n_range);
       printf("   Of the %d azimuth lines, only %d are valid.\n",n_az,f->n_az_valid);
+      if (ardop_get_thread_count()>1)
+        printf("   Using %d threads.\n",ardop_get_thread_count());
     }
 
-/*
-Create "patch" of data.  This patch is re-used to process
-all of the input data.
-*/
-    p=newPatch(n_az,n_range);
+/*Process each patch of data present, and write it out.*/
+    processPatches(signalGetRec,r,s,meta,f,n_az,n_range);
 
-/*Loop over each patch of data present, and process it.*/
-    for (patchNo=1; patchNo<=f->nPatches; patchNo++)
-    {
-        int lineToBeRead;
-        if (!quietflag) printf("\n   *****    PROCESSING PATCH %i    *****\n\n",patchNo);
-
-        lineToBeRead = f->firstLineToProcess + (patchNo-1) * f->n_az_valid;
-        if (lineToBeRead+p->n_az>signalGetRec->nLines) {
-          if (!quietflag) printf("   Read all the patches in the input file.\n");
-          if (logflag) printLog("   Read all the patches in the input file.\n");
-          break;
-        }
-
-        /*Update patch parameters for location.*/
-        setPatchLoc(p,s,meta,f->skipFile,f->skipSamp,lineToBeRead);
-        processPatch(p,signalGetRec,r,s);/*SAR Process patch.*/
-        writePatch(p,s,meta,f,patchNo);/*Output patch data to file.*/
-    } /***********************end patch loop***********************************/
-
-
-    destroyPatch(p);
 /*  if (!quietflag) printf("\nPROGRAM COMPLETED\n\n");*/
 
     if (logflag) {
@@ -90,6 +90,18 @@ rangeRef: the range reference function, for rciq.
 satellite: sundry imaging-related parameters, for rmpatch and acpatch.
 file: parameters describing output file.
 */
+/*Wall clock seconds spent in each stage of processing patches.*/
+typedef struct {
+	double read;/*Reading signal data ahead of time.*/
+	double readWait;/*Waiting for signal data to be read.*/
+	double range;/*Range compression (including reading, if not done ahead).*/
+	double azFFT;/*Transforming lines along azimuth.*/
+	double migrate;/*Range migration.*/
+	double azimuth;/*Azimuth compression.*/
+	double write;/*Writing patches out.*/
+	double writeWait;/*Waiting for a patch to be written.*/
+} stageTimes;
+
 typedef struct {
 	int n_az,n_range;/*Number of samples in azimuth and range directions.*/
 	complexFloat *trans;/*Complex buffer-- indexed as trans[x*n_az+y].*/
@@ -99,6 +111,8 @@ typedef struct {
 	float xResampScale,xResampOffset;/*Resampling range coefficients.*/
 	float yResampScale,yResampOffset;/*Resampling azimuth coefficients.*/
 	int fromSample,fromLine;/*Patch's location in original file.*/
+	const signalBlock *signal;/*Signal data read in ahead of time, or NULL.*/
+	stageTimes *times;/*If not NULL, processPatch adds its stage times here.*/
 } patch;
 
 typedef struct {
@@ -162,6 +176,7 @@ double fftEstDop(getRec *inFile,int startLine,int xStride,int nLines);
 void estdop(char file[], int nDopLines, float *a, float *b,float *c);
 void calc_range_ref(complexFloat *range_ref, int rangeFFT, int refLen);
 void elapse(int fnc);
+double wallClock(void);
 void multilook(complexFloat *patch,int n_range,int nlooks, float *pwrs);
 
 /*-------------Populating ARDOP_PARAMS and the metadata---------------*/
@@ -185,6 +200,8 @@ void processPatch(patch *p,const getRec *signalGetRec,
 void writePatch(const patch *p,const satellite *s,meta_parameters *meta,
 	const file *f,int patchNo);
 void destroyPatch(patch *p);
+int processPatches(getRec *signalGetRec,const rangeRef *r,satellite *s,
+	meta_parameters *meta,const file *f,int n_az,int n_range);
 
 /*-------Routines to manipulate patches.----------*/
 void rciq(patch *p,const getRec *signalGetRec,const rangeRef *r);
@@ -192,4 +209,11 @@ void rmpatch(patch *p,const satellite *s);
 void acpatch(patch *p,const satellite *s);
 void antptn_correct(meta_parameters *meta,complexFloat *outputBuf,int curLine,int numSamples,const satellite *s);
 void writeTable(meta_parameters *meta, const satellite *s, int numSamples);
+
+/*-------Worker threads for the lines of a patch (ardop_threads.c).------*/
+typedef void (*ardop_line_func)(int line, void *scratch, void *data);
+void ardop_set_thread_count(int count);
+int ardop_get_thread_count(void);
+void ardop_for_lines(int n_lines, int thread_count, size_t scratch_size,
+	ardop_line_func func, void *data);
 #endif
@@ -48,19 +48,17 @@ PROGRAM HISTORY:  Ver 1.0  T. Logan - Most routines are new
 #include "ardop_defs.h"
 #include "locinc.h"
 
-/* Global Variables used by the complexFloat Arithmetic Routines */
-complexFloat a,b,x;
-float d;
-int i;
-
+/* The complexFloat arithmetic routines keep their results in locals, so
+   they can be called from several threads at once. */
 float  Cabs(complexFloat a)
 {
-  d = sqrt (a.real*a.real + a.imag*a.imag);
+  float d = sqrt (a.real*a.real + a.imag*a.imag);
   return d;
 }
 
 complexFloat Cconj(complexFloat a)
 {
+  complexFloat x;
   x.real = a.real;
   x.imag = -a.imag;
   return x;
@@ -68,6 +66,7 @@ complexFloat Cconj(complexFloat a)
 
 complexFloat Czero()
 {
+  complexFloat x;
   x.real = 0.0;
   x.imag = 0.0;
   return x;
@@ -75,6 +74,7 @@ complexFloat Czero()
 
 complexFloat Cadd (complexFloat a, complexFloat b)
 {
+  complexFloat x;
   x.real = a.real+b.real;
   x.imag = a.imag+b.imag;
   return x;
@@ -82,6 +82,7 @@ complexFloat Cadd (complexFloat a, complexFloat b)
 
 complexFloat Cmplx(float a, float b)
 {
+  complexFloat x;
   x.real = a;
   x.imag = b;
   return x;
@@ -89,6 +90,7 @@ complexFloat Cmplx(float a, float b)
 
 complexFloat Csmul(float s, complexFloat a)
 {
+  complexFloat x;
   x.real=s*a.real;
   x.imag=s*a.imag;
   return x;
@@ -96,6 +98,7 @@ complexFloat Csmul(float s, complexFloat a)
 
 complexFloat Cmul (complexFloat a, complexFloat b)
 {
+  complexFloat x;
   x.real = a.real*b.real - a.imag*b.imag;
   x.imag = a.real*b.imag + a.imag*b.real;
   return x;
@@ -123,6 +126,14 @@ void elapse(int fnc)
     }
   }
 
+/* Wall clock time in seconds, for timing the stages of processing. */
+double wallClock(void)
+  {
+    struct timeval tp;
+    gettimeofday(&tp,NULL);
+    return tp.tv_sec+tp.tv_usec*1.0e-6;
+  }
+
 /******************************************************************************
 NAME:       yaxb.c
 DESCRIPTION:    Computes a and b for y = ax + b using linear regression
@@ -0,0 +1,263 @@
+/****************************************************************************
+*                                                                             *
+*   ardop_pipeline.c - Reads, processes and writes patches in a pipeline      *
+*                                                                             *
+* You should have received an ASF SOFTWARE License Agreement with this source *
+* code. Please consult this agreement for license grant information.          *
+*                                                                             *
+******************************************************************************/
+/****************************************************************************
+FUNCTION NAME: processPatches - SAR process and write out all the patches
+
+SYNTAX: processPatches(signalGetRec, r, s, meta, f, n_az, n_range)
+
+PARAMETERS:
+    NAME:         TYPE:            PURPOSE:
+    --------------------------------------------------------
+    signalGetRec  getRec *         Raw signal data input
+    r             rangeRef *       Range reference function
+    s             satellite *      Sundry coefficients
+    meta          meta_parameters  Metadata, for locating and writing patches
+    f             file *           Output file parameters
+    n_az,n_range  int              Size of a patch
+
+DESCRIPTION:
+    Processes the patches of the input one after another, the same way
+    ardop always has: read and range compress the patch, transform it
+    along azimuth, range migrate it, azimuth compress it, and write it
+    out (see processPatch and writePatch).
+
+    With more than one thread (see ardop_set_thread_count) this is
+    done as a three stage pipeline, so the disk and processors are kept
+    busy at the same time:
+      - a reader thread reads the signal data for the next patch into
+        memory in one go while the current patch is processed,
+      - the main thread processes the patch (on the worker threads),
+      - a writer thread writes out the previous patch.
+    Each stage is at most one patch ahead of the next, so this takes
+    two patch buffers and two patches of signal data.  The output is
+    the same as processing the patches one at a time.
+
+    At the end the wall clock time spent in each stage is printed, so
+    it can be seen which stage limits throughput.
+
+RETURN VALUE: The number of patches processed.
+****************************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+#include "ardop_defs.h"
+#include "asf_glib.h"
+
+/*What the three stages share.  Patch k's signal data and patch buffer
+are in slot k%2.*/
+typedef struct {
+  GMutex *lock;            /* Guards the counts below.*/
+  GCond *changed;          /* Signalled when any of them changes.*/
+  int nToDo;               /* Number of patches to process.*/
+  int nRead;               /* Patches whose signal data has been read.*/
+  int nProcessed;          /* Patches processed (and signal data freed).*/
+  int nWritten;            /* Patches written out.*/
+
+  getRec *signalGetRec;
+  const satellite *s;
+  meta_parameters *meta;   /* The writer's own copy of the metadata.*/
+  const file *f;
+  int n_az;
+  signalBlock *signal[2];
+  patch *patches[2];
+  double readTime, writeTime;
+} patch_pipeline;
+
+/*First input line of patch number patchNo (counting from 1).*/
+static int patchTop(const file *f,int patchNo)
+{
+  return f->firstLineToProcess + (patchNo-1) * f->n_az_valid;
+}
+
+static gpointer reader_thread(gpointer data)
+{
+  patch_pipeline *q = (patch_pipeline *) data;
+  int k;
+
+  for (k=0; k<q->nToDo; k++)
+  {
+    double start;
+    signalBlock *b;
+
+    /*Wait until patch k-2 is done with its slot.*/
+    g_mutex_lock(q->lock);
+    while (q->nProcessed < k-1)
+      g_cond_wait(q->changed, q->lock);
+    g_mutex_unlock(q->lock);
+
+    start = wallClock();
+    b = readSignalBlock(q->signalGetRec, patchTop(q->f,k+1), q->n_az);
+
+    g_mutex_lock(q->lock);
+    q->readTime += wallClock() - start;
+    q->signal[k%2] = b;
+    q->nRead = k+1;
+    g_cond_broadcast(q->changed);
+    g_mutex_unlock(q->lock);
+  }
+  return NULL;
+}
+
+static gpointer writer_thread(gpointer data)
+{
+  patch_pipeline *q = (patch_pipeline *) data;
+  int k;
+
+  for (k=0; k<q->nToDo; k++)
+  {
+    double start;
+
+    g_mutex_lock(q->lock);
+    while (q->nProcessed <= k)
+      g_cond_wait(q->changed, q->lock);
+    g_mutex_unlock(q->lock);
+
+    start = wallClock();
+    writePatch(q->patches[k%2], q->s, q->meta, q->f, k+1);
+
+    g_mutex_lock(q->lock);
+    q->writeTime += wallClock() - start;
+    q->nWritten = k+1;
+    g_cond_broadcast(q->changed);
+    g_mutex_unlock(q->lock);
+  }
+  return NULL;
+}
+
+static void printStageTimes(const stageTimes *t,int pipelined)
+{
+  asfPrintStatus("\n   Wall clock time spent in each stage (seconds):\n");
+  if (pipelined) {
+    asfPrintStatus("     Reading signal data:        %8.1f\n", t->read);
+    asfPrintStatus("     Waiting for signal data:    %8.1f\n", t->readWait);
+    asfPrintStatus("     Range compression:          %8.1f\n", t->range);
+  }
+  else
+    asfPrintStatus("     Reading, range compression: %8.1f\n", t->range);
+  asfPrintStatus("     Azimuth transforms:         %8.1f\n", t->azFFT);
+  asfPrintStatus("     Range migration:            %8.1f\n", t->migrate);
+  asfPrintStatus("     Azimuth compression:        %8.1f\n", t->azimuth);
+  asfPrintStatus("     Writing patches:            %8.1f\n", t->write);
+  if (pipelined)
+    asfPrintStatus("     Waiting for patch writes:   %8.1f\n", t->writeWait);
+  asfPrintStatus("\n");
+}
+
+int processPatches(getRec *signalGetRec,const rangeRef *r,satellite *s,
+                   meta_parameters *meta,const file *f,int n_az,int n_range)
+{
+  stageTimes times;
+  patch_pipeline q;
+  GThread *reader, *writer;
+  int nToDo, k;
+
+  memset(&times, 0, sizeof(times));
+
+  /*Only process the patches that fit in the input file.*/
+  for (nToDo=0; nToDo<f->nPatches; nToDo++)
+    if (patchTop(f,nToDo+1)+n_az>signalGetRec->nLines) {
+      if (!quietflag) printf("   Read all the patches in the input file.\n");
+      if (logflag) printLog("   Read all the patches in the input file.\n");
+      break;
+    }
+
+  /*One patch at a time, just as it always was.*/
+  if (ardop_get_thread_count() <= 1 || nToDo <= 1)
+  {
+    patch *p=newPatch(n_az,n_range);
+    p->times=&times;
+    for (k=0; k<nToDo; k++)
+    {
+      double start;
+      if (!quietflag) printf("\n   *****    PROCESSING PATCH %i    *****\n\n",k+1);
+
+      /*Update patch parameters for location.*/
+      setPatchLoc(p,s,meta,f->skipFile,f->skipSamp,patchTop(f,k+1));
+      processPatch(p,signalGetRec,r,s);/*SAR Process patch.*/
+      start=wallClock();
+      writePatch(p,s,meta,f,k+1);/*Output patch data to file.*/
+      times.write+=wallClock()-start;
+    }
+    destroyPatch(p);
+    printStageTimes(&times,FALSE);
+    return nToDo;
+  }
+
+  asf_thread_init();
+  q.lock = asf_mutex_new();
+  q.changed = asf_cond_new();
+  q.nToDo = nToDo;
+  q.nRead = q.nProcessed = q.nWritten = 0;
+  q.signalGetRec = signalGetRec;
+  q.s = s;
+  q.meta = meta_copy(meta);
+  q.f = f;
+  q.n_az = n_az;
+  q.signal[0] = q.signal[1] = NULL;
+  q.patches[0] = newPatch(n_az,n_range);
+  q.patches[1] = newPatch(n_az,n_range);
+  q.readTime = q.writeTime = 0.0;
+
+  reader = asf_thread_new("ardop_read", reader_thread, &q);
+  writer = asf_thread_new("ardop_write", writer_thread, &q);
+  if (reader == NULL || writer == NULL)
+    asfPrintError("Failed to create SAR processing thread\n");
+
+  for (k=0; k<nToDo; k++)
+  {
+    patch *p = q.patches[k%2];
+    double start;
+    if (!quietflag) printf("\n   *****    PROCESSING PATCH %i    *****\n\n",k+1);
+
+    /*Wait for patch k-2 to be written out of this patch buffer, and
+    for this patch's signal data.*/
+    start = wallClock();
+    g_mutex_lock(q.lock);
+    while (q.nWritten < k-1)
+      g_cond_wait(q.changed, q.lock);
+    times.writeWait += wallClock() - start;
+    start = wallClock();
+    while (q.nRead <= k)
+      g_cond_wait(q.changed, q.lock);
+    p->signal = q.signal[k%2];
+    g_mutex_unlock(q.lock);
+    times.readWait += wallClock() - start;
+
+    /*Update patch parameters for location.*/
+    setPatchLoc(p,s,meta,f->skipFile,f->skipSamp,patchTop(f,k+1));
+    p->times = &times;
+    processPatch(p,signalGetRec,r,s);/*SAR Process patch.*/
+
+    freeSignalBlock((signalBlock *)p->signal);
+    p->signal = NULL;
+    g_mutex_lock(q.lock);
+    q.signal[k%2] = NULL;
+    q.nProcessed = k+1;
+    g_cond_broadcast(q.changed);
+    g_mutex_unlock(q.lock);
+  }
+
+  /*Wait for the last patches to be written.*/
+  {
+    double start = wallClock();
+    g_thread_join(reader);
+    g_thread_join(writer);
+    times.writeWait += wallClock() - start;
+  }
+
+  times.read = q.readTime;
+  times.write = q.writeTime;
+  printStageTimes(&times,TRUE);
+
+  destroyPatch(q.patches[0]);
+  destroyPatch(q.patches[1]);
+  meta_free(q.meta);
+  asf_cond_free(q.changed);
+  asf_mutex_free(q.lock);
+  return nToDo;
+}
@@ -328,6 +328,8 @@ patch *newPatch(int num_az,int num_range)
     p->trans =(complexFloat *) MALLOC (p->n_range*p->n_az*sizeof(complexFloat));
     p->slantPer=rngpix;
     p->g=NULL;
+    p->signal=NULL;
+    p->times=NULL;
     return p;
 }
 
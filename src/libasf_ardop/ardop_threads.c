@@ -0,0 +1,140 @@
+/****************************************************************************
+*                                                                             *
+*   ardop_threads.c - Worker threads for processing the lines of a patch     *
+*                                                                             *
+* You should have received an ASF SOFTWARE License Agreement with this source *
+* code. Please consult this agreement for license grant information.          *
+*                                                                             *
+******************************************************************************/
+/****************************************************************************
+FUNCTION NAME: ardop_for_lines - run a per-line routine on worker threads
+
+SYNTAX: ardop_for_lines(n_lines, thread_count, scratch_size, func, data)
+
+PARAMETERS:
+    NAME:         TYPE:            PURPOSE:
+    --------------------------------------------------------
+    n_lines       int              Number of lines to process
+    thread_count  int              Number of threads to use
+    scratch_size  size_t           Bytes of scratch space for each thread
+    func          ardop_line_func  Called as func(line, scratch, data)
+    data          void *           Passed on to func
+
+DESCRIPTION:
+    Each stage of processing a patch (range compression, the azimuth
+    transforms, range migration and azimuth compression) works on one
+    line of the patch at a time, and every line only touches its own
+    row or column of the patch.  ardop_for_lines hands the lines out to
+    thread_count threads in small batches, each with its own scratch
+    buffer, and returns once they are all done.  Each line is processed
+    exactly as it would be by a plain loop, so the output does not
+    depend on the number of threads.
+
+    With a thread_count of 1 the lines are processed in order by the
+    calling thread, which is what the debugging output (written a line
+    at a time to shared files) needs.
+
+RETURN VALUE: None
+
+SPECIAL CONSIDERATIONS:
+    func must not use any state shared between lines other than what it
+    only reads.  The FFT tables for the sizes used must already be set up
+    (cfft1d with dir=0), since fftInit is not thread safe.
+****************************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+#include "ardop_defs.h"
+#include "asf_glib.h"
+
+/* Number of threads ardop uses for each patch, see ardop_set_thread_count.*/
+static int ardop_thread_count = 1;
+
+void ardop_set_thread_count(int count)
+{
+  ardop_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+int ardop_get_thread_count(void)
+{
+  return ardop_thread_count;
+}
+
+/* Lines handed out at a time, to keep the locking down.*/
+#define LINES_PER_BATCH 16
+
+typedef struct {
+  GMutex *lock;        /* Guards next_line.*/
+  int next_line;       /* Next line to hand out.*/
+  int n_lines;
+  size_t scratch_size;
+  ardop_line_func func;
+  void *data;
+} line_queue;
+
+static gpointer line_worker(gpointer arg)
+{
+  line_queue *q = (line_queue *) arg;
+  void *scratch = q->scratch_size > 0 ? MALLOC(q->scratch_size) : NULL;
+
+  for (;;)
+  {
+    int first, last, line;
+
+    g_mutex_lock(q->lock);
+    first = q->next_line;
+    q->next_line += LINES_PER_BATCH;
+    g_mutex_unlock(q->lock);
+
+    if (first >= q->n_lines)
+      break;
+    last = MIN(first + LINES_PER_BATCH, q->n_lines);
+    for (line = first; line < last; line++)
+      q->func(line, scratch, q->data);
+  }
+
+  if (scratch) FREE(scratch);
+  return NULL;
+}
+
+void ardop_for_lines(int n_lines, int thread_count, size_t scratch_size,
+                     ardop_line_func func, void *data)
+{
+  line_queue q;
+  GThread **threads;
+  int tt;
+
+  if (thread_count > n_lines / LINES_PER_BATCH)
+    thread_count = n_lines / LINES_PER_BATCH;
+
+  if (thread_count <= 1)
+  {
+    void *scratch = scratch_size > 0 ? MALLOC(scratch_size) : NULL;
+    int line;
+    for (line = 0; line < n_lines; line++)
+      func(line, scratch, data);
+    if (scratch) FREE(scratch);
+    return;
+  }
+
+  asf_thread_init();
+
+  q.lock = asf_mutex_new();
+  q.next_line = 0;
+  q.n_lines = n_lines;
+  q.scratch_size = scratch_size;
+  q.func = func;
+  q.data = data;
+
+  threads = (GThread **) MALLOC(sizeof(GThread *) * thread_count);
+  for (tt = 0; tt < thread_count; tt++)
+  {
+    threads[tt] = asf_thread_new("ardop", line_worker, &q);
+    if (threads[tt] == NULL)
+      asfPrintError("Failed to create SAR processing thread\n");
+  }
+  for (tt = 0; tt < thread_count; tt++)
+    g_thread_join(threads[tt]);
+
+  FREE(threads);
+  asf_mutex_free(q.lock);
+}
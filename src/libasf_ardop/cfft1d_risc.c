@@ -46,28 +46,18 @@ SPECIAL CONSIDERATIONS:
 
 void cfft1d(int n, complexFloat *c, int dir)
 {
-        static int prev_m = 0;
  	int m=(int)(log(n)/log(2.0)+0.5);
 	if (dir == 0)
 	{
-            //printf("fftInit called for m=%d\n", m);
-            if (prev_m != m) {
-                if (prev_m > 0) {
-                    //printf("Freeing FFT data for m=%d\n", prev_m);
-                    fftFree();
-                }
+		/* Tables (and FFTW plans) for each size are kept until fftFree,
+		   so range and azimuth transforms don't keep rebuilding them. */
 		int ret=fftInit(m);
 		if (ret!=0) {
 		  sprintf(errbuf,"   ERROR: Problem %d in FFT!\n",ret);
 		  printErr(errbuf);
 		}
-                prev_m = m;
-            } else {
-                //printf("Already initialized FFT for m=%d.\n", m);
-            }
 	}
 	if (dir > 0)  iffts((float *)c,m,1);
 	if (dir < 0)  ffts((float *)c,m, 1);
 }
 
-
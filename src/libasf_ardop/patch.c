@@ -286,6 +286,13 @@ void debugWritePatch(const patch *p,char *basename)
   patchToRGBImage(outname, TRUE);
 }
 
+/*Forward transform one range line of the patch along azimuth.*/
+static void az_fft_line(int line,void *scratch,void *data)
+{
+  patch *p=(patch *)data;
+  cfft1d(p->n_az,&p->trans[line*p->n_az],-1);
+}
+
 /*
   processPatch:
   Performs all processing necessary on the given patch.
@@ -296,40 +303,49 @@ void debugWritePatch(const patch *p,char *basename)
   - range migrate the data (rmpatch).
   - azimuth compress the data (acpatch).
   the data is returned in the patch's trans array.
+  Each step works on the lines of the patch with ardop_get_thread_count()
+  threads; the result is the same for any number of threads.
 */
 void processPatch(patch *p,const getRec *signalGetRec,const rangeRef *r,
           const satellite *s)
 {
-  int i;
+  double start=wallClock();
 
   update_status("Range compressing");
   if (!quietflag) printf("   RANGE COMPRESSING CHANNELS...\n");
   elapse(0);
   rciq(p,signalGetRec,r);
   if (!quietflag) elapse(1);
+  if (p->times) p->times->range+=wallClock()-start;
   if (s->debugFlag & AZ_RAW_T) debugWritePatch(p,"az_raw_t");
 
   update_status("Starting azimuth compression");
   if (!quietflag) printf("   TRANSFORMING LINES...\n");
   elapse(0);
+  start=wallClock();
   cfft1d(p->n_az,NULL,0);
-  for (i=0; i<p->n_range; i++) cfft1d(p->n_az,&p->trans[i*p->n_az],-1);
+  ardop_for_lines(p->n_range,ardop_get_thread_count(),0,az_fft_line,p);
   if (!quietflag) elapse(1);
+  if (p->times) p->times->azFFT+=wallClock()-start;
   if (s->debugFlag & AZ_RAW_F) debugWritePatch(p,"az_raw_f");
   if (!(s->debugFlag & NO_RCM))
     {
       update_status("Range cell migration");
       if (!quietflag) printf("   START RANGE MIGRATION CORRECTION...\n");
       elapse(0);
+      start=wallClock();
       rmpatch(p,s);
       if (!quietflag) elapse(1);
+      if (p->times) p->times->migrate+=wallClock()-start;
       if (s->debugFlag & AZ_MIG_F) debugWritePatch(p,"az_mig_f");
     }
   update_status("Finishing azimuth compression");
   if (!quietflag) printf("   INVERSE TRANSFORMING LINES...\n");
   elapse(0);
+  start=wallClock();
   acpatch(p,s);
   if (!quietflag) elapse(1);
+  if (p->times) p->times->azimuth+=wallClock()-start;
 
   /*    if (!quietflag) printf("  Range-Doppler done...\n");*/
 }
@@ -362,9 +378,10 @@ void writePatch(const patch *p,const satellite *s,meta_parameters *meta,
     writeNoiseTable=1;  /* If first patch AND antenna pattern correction,
                write the noise table */
 
+  double start=wallClock(); /*Not elapse(), as this may run alongside processPatch.*/
+
   update_status("Range-doppler done");
   if (!quietflag) printf("   WRITING PATCH OUT...\n");
-  elapse(0);
 
   /* Allocate buffer space  ------------------------*/
   amps = (float *) MALLOC(p->n_range*sizeof(float));
@@ -568,7 +585,8 @@ void writePatch(const patch *p,const satellite *s,meta_parameters *meta,
   if (metaSigma) meta_free(metaSigma);
   if (metaGamma) meta_free(metaGamma);
   if (metaBeta)  meta_free(metaBeta);
-  if (!quietflag) elapse(1);
+  if (!quietflag)
+    printf("   elapsed time = %i seconds.\n\n",(int)(wallClock()-start));
 }
 
 
@@ -49,10 +49,77 @@ PROGRAM HISTORY:  Converted from H Zebker's rciq.c - T. Logan 8/96
 
 extern struct ARDOP_PARAMS g;/*ARDOP Globals, defined in ardop_params.h*/
 
+/*What rciq's worker threads share for one patch.*/
+typedef struct {
+  patch *p;
+  const getRec *signalGetRec;
+  const rangeRef *r;
+  int readSamples;
+  patch *r_f, *raw_f, *raw_t, *r_x_f;
+} rc_patch_info;
+
+/*Read and range compress one line of the patch.  scratch is the FFT buffer.*/
+static void rc_line(int lineNo,void *scratch,void *data)
+{
+  const rc_patch_info *c=(const rc_patch_info *)data;
+  patch *p=c->p;
+  const rangeRef *r=c->r;
+  int readSamples=c->readSamples;
+  patch *r_f=c->r_f, *raw_f=c->raw_f, *raw_t=c->raw_t, *r_x_f=c->r_x_f;
+  complexFloat *fft=(complexFloat *)scratch;
+  register int i;
+
+  if(!quietflag && ((lineNo%1024) == 0))
+    asfPrintStatus("   ...Processing Line %i\n",lineNo);
+
+/*Read i/q values into fft input buffer (from memory, if they were read
+  in ahead of time).*/
+  getSignalBlockLine(c->signalGetRec,p->signal,p->fromLine+lineNo,fft,
+                     p->fromSample,readSamples);
+
+/*Zero-fill the end of the FFT buffer.*/
+  for (i=readSamples;i<r->rangeFFT;i++)
+    fft[i].real = fft[i].imag = 0.0;
+  if (raw_t) {
+    for (i=0; i<p->n_range; i++)
+      raw_t->trans[i*p->n_az+lineNo]=fft[i];
+  }
+/* forward transform the data.*/
+  cfft1d(r->rangeFFT,fft,-1);
+  if (raw_f) {
+    for (i=0; i<p->n_range; i++)
+      raw_f->trans[i*p->n_az+lineNo]=fft[i];
+  }
+/*Multiply by the reference function*/
+  if (!(g.iflag & NO_RANGE))
+  {
+    for (i=0; i<r->rangeFFT; i++)
+    {
+      float tmp_r = fft[i].real;
+      fft[i].real = tmp_r*r->ref[i].real - fft[i].imag*r->ref[i].imag;
+      fft[i].imag = tmp_r*r->ref[i].imag + fft[i].imag*r->ref[i].real;
+    }
+  }
+  if (r_x_f) {
+    for (i=0; i<p->n_range; i++)
+      r_x_f->trans[i*p->n_az+lineNo] = fft[i];
+  }
+
+/*Reverse transform the (now range-compressed) data.*/
+  cfft1d(r->rangeFFT,fft,1);
+
+/* Copy data into the p->trans array - transposed */
+  for (i=0; i<p->n_range; i++)
+    p->trans[i*p->n_az+lineNo]=fft[i];
+  if (r_f) {
+    for (i=0; i<p->n_range; i++)
+      r_f->trans[i*p->n_az+lineNo] = r->ref[i];
+  }
+}
+
 void rciq(patch *p,const getRec *signalGetRec,const rangeRef *r)
 {
-  static complexFloat *fft=NULL;
-  register int i,lineNo;
+  rc_patch_info c;
   int readSamples=p->n_range+r->refLen;/*readSamples is the number of samples 
 				  of uncompressed signal which are to be read in.*/
   patch *r_f=NULL, *raw_f=NULL, *raw_t=NULL, *r_x_f = NULL;
@@ -62,64 +129,23 @@ void rciq(patch *p,const getRec *signalGetRec,const rangeRef *r)
   if (g.iflag & RANGE_RAW_T) raw_t=copyPatch(p);
   if (g.iflag & RANGE_X_F) r_x_f=copyPatch(p);
 
-/*Initialize fft buffer.*/
-  if (fft==NULL)
-    fft=(complexFloat *)MALLOC(sizeof(complexFloat)*r->rangeFFT);
-
 /*Check to see if we're reading past the end of the file.*/
   if (p->fromSample+readSamples>signalGetRec->nSamples)
     readSamples=signalGetRec->nSamples-p->fromSample;
 
 /* Initialize the FFT routine */
-  cfft1d(r->rangeFFT,fft,0);	
+  cfft1d(r->rangeFFT,NULL,0);
+
+/*Range compress the lines on the worker threads, each with its own FFT
+  buffer.  Reading the signal data is serialized by getSignalLine.*/
+  c.p=p;
+  c.signalGetRec=signalGetRec;
+  c.r=r;
+  c.readSamples=readSamples;
+  c.r_f=r_f; c.raw_f=raw_f; c.raw_t=raw_t; c.r_x_f=r_x_f;
+  ardop_for_lines(p->n_az,ardop_get_thread_count(),
+                  sizeof(complexFloat)*r->rangeFFT,rc_line,&c);
 
-  for (lineNo=0; lineNo<p->n_az; lineNo++)
-  {
-    if(!quietflag && ((lineNo%1024) == 0)) 
-      asfPrintStatus("   ...Processing Line %i\n",lineNo); 
-
-  /*Read i/q values into fft input buffer.*/
-    getSignalLine(signalGetRec,p->fromLine+lineNo,fft,p->fromSample,readSamples);
-
-  /*Zero-fill the end of the FFT buffer.*/	
-    for (i=readSamples;i<r->rangeFFT;i++)
-      fft[i].real = fft[i].imag = 0.0;
-    if (raw_t) {
-      for (i=0; i<p->n_range; i++) 
-        raw_t->trans[i*p->n_az+lineNo]=fft[i];
-    }
-  /* forward transform the data.*/
-      cfft1d(r->rangeFFT,fft,-1);
-      if (raw_f) {
-        for (i=0; i<p->n_range; i++)
-          raw_f->trans[i*p->n_az+lineNo]=fft[i];
-      }
-  /*Multiply by the reference function*/
-    if (!(g.iflag & NO_RANGE))
-    {
-      for (i=0; i<r->rangeFFT; i++)
-      {
-        float tmp_r = fft[i].real;
-        fft[i].real = tmp_r*r->ref[i].real - fft[i].imag*r->ref[i].imag;
-        fft[i].imag = tmp_r*r->ref[i].imag + fft[i].imag*r->ref[i].real;
-      }
-    }
-    if (r_x_f) {
-      for (i=0; i<p->n_range; i++) 
-	r_x_f->trans[i*p->n_az+lineNo] = fft[i];
-    }
-
-  /*Reverse transform the (now range-compressed) data.*/
-    cfft1d(r->rangeFFT,fft,1);
-
-  /* Copy data into the p->trans array - transposed */
-    for (i=0; i<p->n_range; i++) 
-      p->trans[i*p->n_az+lineNo]=fft[i];
-    if (r_f) {
-      for (i=0; i<p->n_range; i++)
-       r_f->trans[i*p->n_az+lineNo] = r->ref[i];
-    }
-  }
   if (r_f) {debugWritePatch(r_f,"range_ref_map"); destroyPatch(r_f);}
   if (raw_t) {debugWritePatch(raw_t,"range_raw_t"); destroyPatch(raw_t);}
   if (raw_f) {debugWritePatch(raw_f,"range_raw_f"); destroyPatch(raw_f);}
@@ -11,6 +11,9 @@ RDS RADARSAT Engineering files, and raw data.
 
 getRec * fillOutGetRec(char file[]);
 void getSignalLine(getRec *r,long long lineNo,complexFloat *destArr,int readStart,int readLen);
+signalBlock *readSignalBlock(const getRec *r,long long firstLine,int nLines);
+void getSignalBlockLine(const getRec *r,const signalBlock *b,long long lineNo,
+                        complexFloat *destArr,int readStart,int readLen);
 
 */
 #include "asf.h"
@@ -18,6 +21,7 @@ void getSignalLine(getRec *r,long long lineNo,complexFloat *destArr,int readStar
 #include "asf_meta.h"
 #include "ardop_defs.h"
 #include "ceos.h"
+#include "asf_glib.h"
 
 /****************************************
 getSignalFormat:
@@ -148,49 +152,44 @@ getRec * fillOutGetRec(char file[])
     return r;
 }
 /****************************************
-getSignalLine:
-    Fetches and unpacks a single line of signal data
-into the given array.
+signalWindow:
+    Works out which samples of line lineNo getSignalLine
+reads: the file samples from *leftClip up to *rightClip,
+once the line's window shift is taken into account.
+Returns the file sample that lands at destArr[0].
 */
-void getSignalLine(const getRec *r,long long lineNo,complexFloat *destArr,int readStart,int readLen)
+static int signalWindow(const getRec *r,long long lineNo,int readStart,int readLen,
+                        int *leftClip,int *rightClip)
+{
+    int left,windowShift=0;
+    if (r->lines!=NULL)
+        windowShift=r->lines[lineNo].shiftBy;
+    *leftClip=left=readStart-windowShift;
+    if (*leftClip<0) {*leftClip=0; /*left=0;*/}
+    *rightClip=left+readLen;
+    if (*rightClip>r->nSamples) *rightClip=r->nSamples;
+    return left;
+}
+
+/****************************************
+unpackSignalLine:
+    Unpacks the samples of line lineNo read in by
+getSignalLine (inputArr starts at file sample leftClip,
+see signalWindow) into the given array.
+*/
+static void unpackSignalLine(const getRec *r,long long lineNo,const unsigned char *inputArr,
+                             complexFloat *destArr,int readStart,int readLen)
 {
     int x;
     int left,leftClip,rightClip;
-    int windowShift=0;
     float agcScale=1.0;
     complexFloat czero=Czero();
 
-/*If the line is out of bounds, return zeros.*/
-    if ((lineNo>=r->nLines)||(lineNo<0))
-    {
-        for (x=0;x<readLen;x++)
-            destArr[x]=czero;
-        return;
-    }
-/*Fetch window shift and AGC comp. if possible*/
+/*Fetch AGC comp. if possible*/
     if (r->lines!=NULL)
-    {
-        windowShift=r->lines[lineNo].shiftBy;
         agcScale=r->lines[lineNo].scaleBy;
-    }
 
-/*Compute which part of the line we'll read in.*/
-    leftClip=left=readStart-windowShift;
-    if (leftClip<0) {leftClip=0; /*left=0;*/}
-    rightClip=left+readLen;
-    if (rightClip>r->nSamples) rightClip=r->nSamples;
-
-/*Read line of raw signal data.*/
-    FSEEK64(r->fp_in,r->header+lineNo*r->lineSize+leftClip*r->sampleSize,0);
-    if (rightClip-leftClip!=
-        fread(r->inputArr,r->sampleSize,rightClip-leftClip,r->fp_in))
-        {
-         sprintf(errbuf,"   ERROR: Problem reading signal data file on line %lld!\n",lineNo);
-/*       fprintf(stderr,"Read length = %d, Left = %d Readstart = %d\n",readLen, left,readStart);
-         fprintf(stderr,"Lines = %lld Samples = %lld, rightClip = %d, leftClip = %d window = %d\n"
-             ,r->nLines, r->nSamples, rightClip, leftClip, windowShift); */
-         printErr(errbuf);
-        }
+    left=signalWindow(r,lineNo,readStart,readLen,&leftClip,&rightClip);
     leftClip-=left;
     rightClip-=left;
 
@@ -204,22 +203,128 @@ void getSignalLine(const getRec *r,long long lineNo,complexFloat *destArr,int re
         for (x=leftClip;x<rightClip;x++)
         {
             int index=2*(x-leftClip);
-            destArr[x].real=agcScale*(r->inputArr[index+1]-r->dcOffsetQ);
-            destArr[x].imag=agcScale*(r->inputArr[index]-r->dcOffsetI);
+            destArr[x].real=agcScale*(inputArr[index+1]-r->dcOffsetQ);
+            destArr[x].imag=agcScale*(inputArr[index]-r->dcOffsetI);
         }
     else /*if (r->flipIQ=='n')*/
         /*is Raw data (one byte I, next byte Q)*/
         for (x=leftClip;x<rightClip;x++)
         {
             int index=2*(x-leftClip);
-            destArr[x].real=agcScale*(r->inputArr[index]-r->dcOffsetI);
-            destArr[x].imag=agcScale*(r->inputArr[index+1]-r->dcOffsetQ);
+            destArr[x].real=agcScale*(inputArr[index]-r->dcOffsetI);
+            destArr[x].imag=agcScale*(inputArr[index+1]-r->dcOffsetQ);
         }
 
 /*Fill the right side with zeros.*/
     for (x=rightClip;x<readLen;x++)
         destArr[x]=czero;
 }
+
+/****************************************
+getSignalLine:
+    Fetches and unpacks a single line of signal data
+into the given array.  The file and read buffer in the
+getRec are shared, so only one thread at a time reads.
+*/
+G_LOCK_DEFINE_STATIC(signal_read);
+
+void getSignalLine(const getRec *r,long long lineNo,complexFloat *destArr,int readStart,int readLen)
+{
+    int x;
+    int leftClip,rightClip;
+    complexFloat czero=Czero();
+
+/*If the line is out of bounds, return zeros.*/
+    if ((lineNo>=r->nLines)||(lineNo<0))
+    {
+        for (x=0;x<readLen;x++)
+            destArr[x]=czero;
+        return;
+    }
+
+/*Compute which part of the line we'll read in.*/
+    signalWindow(r,lineNo,readStart,readLen,&leftClip,&rightClip);
+
+/*Read line of raw signal data.*/
+    G_LOCK(signal_read);
+    FSEEK64(r->fp_in,r->header+lineNo*r->lineSize+leftClip*r->sampleSize,0);
+    if (rightClip-leftClip!=
+        fread(r->inputArr,r->sampleSize,rightClip-leftClip,r->fp_in))
+        {
+         sprintf(errbuf,"   ERROR: Problem reading signal data file on line %lld!\n",lineNo);
+/*       fprintf(stderr,"Read length = %d, Left = %d Readstart = %d\n",readLen, left,readStart);
+         fprintf(stderr,"Lines = %lld Samples = %lld, rightClip = %d, leftClip = %d window = %d\n"
+             ,r->nLines, r->nSamples, rightClip, leftClip, windowShift); */
+         printErr(errbuf);
+        }
+
+    unpackSignalLine(r,lineNo,r->inputArr,destArr,readStart,readLen);
+    G_UNLOCK(signal_read);
+}
+
+/****************************************
+readSignalBlock:
+    Reads lines firstLine through firstLine+nLines-1 of
+signal data (those that are in the file) into memory with
+a single read, so a patch's worth of lines can be fetched
+ahead of time by another thread.
+*/
+signalBlock *readSignalBlock(const getRec *r,long long firstLine,int nLines)
+{
+    signalBlock *b=(signalBlock *)MALLOC(sizeof(signalBlock));
+    long long lastLine=firstLine+nLines;
+    size_t bytes;
+
+    if (firstLine<0) firstLine=0;
+    if (lastLine>r->nLines) lastLine=r->nLines;
+    b->firstLine=firstLine;
+    b->nLines=lastLine>firstLine ? lastLine-firstLine : 0;
+    b->data=NULL;
+    if (b->nLines==0)
+        return b;
+
+/*The last line only needs its samples, not the next line's header.*/
+    bytes=(size_t)(b->nLines-1)*r->lineSize+r->nSamples*r->sampleSize;
+    b->data=(unsigned char *)MALLOC(bytes);
+    G_LOCK(signal_read);
+    FSEEK64(r->fp_in,r->header+firstLine*r->lineSize,0);
+    if (bytes!=fread(b->data,1,bytes,r->fp_in))
+        {
+         sprintf(errbuf,"   ERROR: Problem reading signal data file on lines %lld to %lld!\n",
+                 firstLine,lastLine-1);
+         printErr(errbuf);
+        }
+    G_UNLOCK(signal_read);
+    return b;
+}
+
+/****************************************
+getSignalBlockLine:
+    Like getSignalLine, but takes the line from the given
+block if it is there.  Several threads may do this at once.
+*/
+void getSignalBlockLine(const getRec *r,const signalBlock *b,long long lineNo,
+                        complexFloat *destArr,int readStart,int readLen)
+{
+    int leftClip,rightClip;
+    if (b==NULL || lineNo<b->firstLine || lineNo>=b->firstLine+b->nLines)
+    {
+        getSignalLine(r,lineNo,destArr,readStart,readLen);
+        return;
+    }
+    signalWindow(r,lineNo,readStart,readLen,&leftClip,&rightClip);
+    unpackSignalLine(r,lineNo,
+                     b->data+(lineNo-b->firstLine)*r->lineSize+leftClip*r->sampleSize,
+                     destArr,readStart,readLen);
+}
+
+void freeSignalBlock(signalBlock *b)
+{
+    if (b->data)
+        FREE(b->data);
+    FREE(b);
+}
+
 /**************************************
 freeGetRec:
     Disposes of a getRec structure.
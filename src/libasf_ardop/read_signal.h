@@ -25,11 +25,24 @@ typedef struct {
 	signalLineRec *lines;/*Information about each line of data (can be NULL)*/
 } getRec;
 
+/*A run of lines of signal data, read in ahead of time.*/
+typedef struct {
+	long long firstLine;/*First line in the block.*/
+	int nLines;/*Number of lines in the block.*/
+	unsigned char *data;/*The lines as they are in the file, lineSize bytes apart.*/
+} signalBlock;
+
 /*For fetching SAR echo data:*/
 getRec * fillOutGetRec(char file[]);
 void getSignalLine(const getRec *r,long long lineNo,complexFloat *destArr,int readStart,int readLen);
 void freeGetRec(getRec *r);
 
+/*For fetching SAR echo data a block of lines at a time:*/
+signalBlock *readSignalBlock(const getRec *r,long long firstLine,int nLines);
+void getSignalBlockLine(const getRec *r,const signalBlock *b,long long lineNo,
+	complexFloat *destArr,int readStart,int readLen);
+void freeSignalBlock(signalBlock *b);
+
 /*For fetching the range pulse replica (range reference function).*/
 void fetchReferenceFunction(char *fname,complexFloat *ref,int refLen);
 
@@ -52,41 +52,115 @@ PROGRAM HISTORY:  converted from H. Zebker's RMpatch.f - T. Logan 8/96
 #include "asf.h"
 #include "asf_meta.h"
 #include "ardop_defs.h"
+#include "asf_glib.h"
 void create_sinc(int nfilter, float *xintp);
 
-void rmpatch(patch *p,const satellite *s)
-{
 #define OVERLAP 10 /*Zero pixels to append to end of single-line buffer*/
 #define NUM_SINC 2048
-    static float *sincInterp=NULL;
-    static complexFloat *trans_buf,*interpolated_line;
-    static double  *SR;
-    static float   *f0, *f_rate, *xResampVec;
 
+/*The sinc interpolation kernels are the same for every patch, so they are
+made once and shared (read-only) by all the threads.*/
+static float *sincInterp=NULL;
+G_LOCK_DEFINE_STATIC(sinc);
+
+/*Per-range-bin values for one patch, shared by all its azimuth lines.*/
+typedef struct {
+    const patch *p;
+    const satellite *s;
     double wavPerPix;/*Wavelengths per pixel*/
     double invN_azPRF,invPRF;
-    int     azimuth_line;
+    double *SR;
+    float  *f0, *f_rate, *xResampVec;
+} rm_patch_info;
+
+/*Range migrate one azimuth line (one frequency bin) of the patch.
+scratch holds the line buffer and the interpolated line.*/
+static void rm_line(int azimuth_line,void *scratch,void *data)
+{
+    const rm_patch_info *m=(const rm_patch_info *)data;
+    const patch *p=m->p;
+    const satellite *s=m->s;
+    complexFloat *trans_buf=(complexFloat *)scratch;
+    complexFloat *interpolated_line=trans_buf+p->n_range+2*OVERLAP;
+    register int i;
+
+    /*Buffer this line of complex data (adding zeros at the ends).*/
+    for (i=0;i<OVERLAP;i++)
+        trans_buf[i]=Czero();
+    for (i=0; i<p->n_range; i++)
+        trans_buf[i+OVERLAP]=p->trans[i*p->n_az+azimuth_line];
+    for (i=0;i<OVERLAP;i++)
+        trans_buf[i+OVERLAP+p->n_range]=Czero();
+    /*.. for each pixel along range...*/
+    for (i=0; i<p->n_range; i++)
+    {
+        /*Get the amount to move this pixel along range. */
+        register float interp_real,interp_imag;
+        float st,offset,offset_frac;
+        int offset_int;
+        float freq=(float)azimuth_line*m->invN_azPRF;
+        /* frequencies must be within 0.5*prf of centroid */
+        freq -= (float) (NINT((freq-m->f0[i])*m->invPRF) * s->prf);
+
+        /*Figure out the slow time for this line*/
+        st=(freq-m->f0[i])/m->f_rate[i];
+        offset = m->xResampVec[i]+i-0.5*m->wavPerPix*(
+                 m->f0[i]*st+m->f_rate[i]*0.5*st*st);
+        offset_int = (int) offset;
+        offset_frac = offset - floor(offset);
+        /*Now interpolate 8 pixels of the trans array into one pixel of this new array,*/
+        interp_real=interp_imag=0.0;
+        if (offset_int >= 0 && offset_int < p->n_range)
+        {
+            register int k,index=offset_int-3+OVERLAP;
+            int kernelNo = (int)(offset_frac*(float)NUM_SINC);
+            if (kernelNo>=NUM_SINC)
+            {
+                if (!quietflag) printf("   Kernel_no=%i,offset_frac=%f!\n",kernelNo,offset_frac);
+                kernelNo=NUM_SINC-1;
+            }
+            kernelNo*=8;/*Each interpolation kernel has size 8.*/
+            for (k = 0; k < 8; k++)
+            {
+                float scale=sincInterp[kernelNo+k];
+                interp_real += scale*trans_buf[index].real;
+                interp_imag += scale*trans_buf[index++].imag;
+            }
+        }
+        interpolated_line[i].real = interp_real;
+        interpolated_line[i].imag = interp_imag;
+    }
+    /*Write this interpolated range line back into the trans array.*/
+    for (i=0; i<p->n_range; i++)
+        p->trans[i*p->n_az+azimuth_line] = interpolated_line[i];
+}
+
+void rmpatch(patch *p,const satellite *s)
+{
+    rm_patch_info m;
     register int i;
     float outScale,outOffset;
 
     /********* initializations *********/
+    G_LOCK(sinc);
     if (sincInterp==NULL)
     {
         sincInterp=(float *)MALLOC(8*sizeof(float)*NUM_SINC);
         create_sinc(NUM_SINC,sincInterp);
-        trans_buf=(complexFloat *)MALLOC(sizeof(complexFloat)*(p->n_range+2*OVERLAP));
-        interpolated_line=(complexFloat *)MALLOC(sizeof(complexFloat)*p->n_range);
-        SR=(double *)MALLOC(sizeof(double)*p->n_range);
-        f0=(float *)MALLOC(sizeof(float)*p->n_range);
-        f_rate=(float *)MALLOC(sizeof(float)*p->n_range);
-        xResampVec=(float *)MALLOC(sizeof(float)*p->n_range);
     }
+    G_UNLOCK(sinc);
+    m.p=p;
+    m.s=s;
+    m.SR=(double *)MALLOC(sizeof(double)*p->n_range);
+    m.f0=(float *)MALLOC(sizeof(float)*p->n_range);
+    m.f_rate=(float *)MALLOC(sizeof(float)*p->n_range);
+    m.xResampVec=(float *)MALLOC(sizeof(float)*p->n_range);
 
     /*Azimuth distance on the ground per pulse.*/
-    wavPerPix=s->wavl/p->slantPer;
+    m.wavPerPix=s->wavl/p->slantPer;
 
-    invN_azPRF=s->prf/(float)(p->n_az);
-    invPRF=1.0/s->prf;
+    m.invN_azPRF=s->prf/(float)(p->n_az);
+    m.invPRF=1.0/s->prf;
 
 /*Since we resample based on the output pixel, but we are given the scale
 and offset as a function of input pixel, we must convert:*/
@@ -95,67 +169,23 @@ and offset as a function of input pixel, we must convert:*/
 
     for (i=0; i<p->n_range; i++)
     {
-        SR[i]     = p->slantToFirst + i*p->slantPer;/* slant range to the line */
-        f0[i]= p->fd+p->fdd*i+p->fddd*i*i;    /* Doppler coefficient*/
-        f_rate[i] = getDopplerRate(SR[i],f0[i],p->g);
-        xResampVec[i]   = outScale * i + outOffset; /* interferogram range resampling. */
+        m.SR[i]     = p->slantToFirst + i*p->slantPer;/* slant range to the line */
+        m.f0[i]= p->fd+p->fdd*i+p->fddd*i*i;    /* Doppler coefficient*/
+        m.f_rate[i] = getDopplerRate(m.SR[i],m.f0[i],p->g);
+        m.xResampVec[i]   = outScale * i + outOffset; /* interferogram range resampling. */
         if (s->ideskew == 1)
-          xResampVec[i]+=((SR[i]-SR[0]-(s->wavl/4.0)*f0[i]*f0[i]/f_rate[i]))/p->slantPer-i;
-    }
-    /*For each line along range...*/
-    for (azimuth_line=0; azimuth_line<p->n_az; azimuth_line++)
-    {
-    /*Buffer this line of complex data (adding zeros at the ends).*/
-        for (i=0;i<OVERLAP;i++)
-            trans_buf[i]=Czero();
-        for (i=0; i<p->n_range; i++)
-            trans_buf[i+OVERLAP]=p->trans[i*p->n_az+azimuth_line];
-        for (i=0;i<OVERLAP;i++)
-            trans_buf[i+OVERLAP+p->n_range]=Czero();
-        /*.. for each pixel along range...*/
-        for (i=0; i<p->n_range; i++)
-        {
-            /*Get the amount to move this pixel along range. */
-            register float interp_real,interp_imag;
-            float st,offset,offset_frac;
-            int offset_int;
-            float freq=(float)azimuth_line*invN_azPRF;
-            /* frequencies must be within 0.5*prf of centroid */
-            freq -= (float) (NINT((freq-f0[i])*invPRF) * s->prf);
-
-            /*Figure out the slow time for this line*/
-            st=(freq-f0[i])/f_rate[i];
-            offset = xResampVec[i]+i-0.5*wavPerPix*(
-                     f0[i]*st+f_rate[i]*0.5*st*st);
-            offset_int = (int) offset;
-            offset_frac = offset - floor(offset);
-            /*Now interpolate 8 pixels of the trans array into one pixel of this new array,*/
-            interp_real=interp_imag=0.0;
-            if (offset_int >= 0 && offset_int < p->n_range)
-            {
-                register int k,index=offset_int-3+OVERLAP;
-                int kernelNo = (int)(offset_frac*(float)NUM_SINC);
-                if (kernelNo>=NUM_SINC)
-                {
-                    if (!quietflag) printf("   Kernel_no=%i,offset_frac=%f!\n",kernelNo,offset_frac);
-                    kernelNo=NUM_SINC-1;
-                }
-                kernelNo*=8;/*Each interpolation kernel has size 8.*/
-                for (k = 0; k < 8; k++)
-                {
-                    float scale=sincInterp[kernelNo+k];
-                    interp_real += scale*trans_buf[index].real;
-                    interp_imag += scale*trans_buf[index++].imag;
-                }
-            }
-            interpolated_line[i].real = interp_real;
-            interpolated_line[i].imag = interp_imag;
-        }
-        /*Write this interpolated range line back into the trans array.*/
-        for (i=0; i<p->n_range; i++)
-            p->trans[i*p->n_az+azimuth_line] = interpolated_line[i];
+          m.xResampVec[i]+=((m.SR[i]-m.SR[0]-(s->wavl/4.0)*m.f0[i]*m.f0[i]/m.f_rate[i]))/p->slantPer-i;
     }
+    /*For each line along range (each azimuth frequency), on the worker
+    threads, each with its own line buffers...*/
+    ardop_for_lines(p->n_az,ardop_get_thread_count(),
+                    sizeof(complexFloat)*(2*p->n_range+2*OVERLAP),rm_line,&m);
     /* ... end of along-range line loop */
+
+    FREE(m.SR);
+    FREE(m.f0);
+    FREE(m.f_rate);
+    FREE(m.xResampVec);
 }
 /****************************************************************
 FUNCTION NAME:  create_sinc
@@ -2680,11 +2680,19 @@ static char *do_processing(convert_config *cfg, const char *inFile_in, int saveD
 	      cfg->general->suffix);
     }
     
+    // The final product is always big endian, whatever the intermediates are.
+    // Without export, the test data trim copies this file's bytes and
+    // metadata into the final product, so it has to be big endian too.
+    byte_order_t byte_order = meta_get_output_byte_order();
+    if (!cfg->general->export)
+      meta_set_output_byte_order(META_BIG_ENDIAN);
+
     // Pass in command line
     check_return(asf_geocode_from_proj_file(cfg->geocoding->projection,
                                             force_flag, resample_method, average_height, datum,
 					    pixel_size, NULL, inFile, outFile, background_val),
 		   "geocoding data file (asf_geocode)\n");
+    meta_set_output_byte_order(byte_order);
   }
   
   if (cfg->general->testdata) {
@@ -3775,12 +3783,15 @@ int asf_convert_ext(int createflag, char *configFileName, int saveDEM)
   // Batch mode processing
   else if (strlen(cfg->general->batchFile) > 0) {
     convert_config *tmp_cfg=NULL;
-    char tmp_dir[255];
-    char tmpCfgName[255];
+    char tmp_dir[1024];
+    char tmpCfgName[1024];
     char line[255];
-    int n_ok = 0, n_bad = 0;
+    int n_jobs = 0, n_bad = 0, jobs_alloc = 0;
+    int batch_jobs = asf_convert_get_batch_jobs(cfg);
+    batch_job_t *jobs = NULL;
     FILE *fBatch = FOPEN(cfg->general->batchFile, "r");
 
+    // Set up all the jobs first, then run them
     strcpy(tmp_dir, cfg->general->tmp_dir);
     while (fgets(line, 255, fBatch) != NULL) {
       char batchItem[255], batchItemFile[255], batchItemDir[255];
@@ -3813,7 +3824,20 @@ int asf_convert_ext(int createflag, char *configFileName, int saveDEM)
       FREE(tmpDir);
       FREE(tmpFile);
 
-      // Create temporary configuration file
+      // Create temporary configuration file.  All the configuration files
+      // are written before the first job runs, and each job removes its
+      // temporary directory when it is done, so every item needs a
+      // directory of its own -- numbered, as items from different
+      // directories may have the same name.
+      if (strlen(tmp_dir) > 0) {
+        DIR *dirp = opendir(tmp_dir);
+        if (!dirp)
+          create_clean_dir(tmp_dir);
+        else
+          closedir(dirp);
+        sprintf(tmp_dir, "%s%c%s-%d", cfg->general->tmp_dir, DIR_SEPARATOR,
+                batchItemFile, n_jobs + 1);
+      }
       create_and_set_tmp_dir(batchItem, cfg->general->default_out_dir, tmp_dir);
       sprintf(tmpCfgName, "%s/%s.cfg", tmp_dir, batchItemFile);
 
@@ -3831,6 +3855,9 @@ int asf_convert_ext(int createflag, char *configFileName, int saveDEM)
                 cfg->general->default_out_dir, DIR_SEPARATOR,
                 cfg->general->prefix, batchItemFile, cfg->general->suffix);
       fprintf(fConfig, "tmp dir = %s\n", tmp_dir);
+      if (batch_jobs > 1)
+        fprintf(fConfig, "status file = %s/%s.status\n", tmp_dir,
+                batchItemFile);
       FCLOSE(fConfig);
       FREE(defaults);
 
@@ -3847,31 +3874,56 @@ int asf_convert_ext(int createflag, char *configFileName, int saveDEM)
       // of a step backwards, it seems.  Unfortunately, in order to keep
       // processing the batch even if an error occurs, we're stuck with
       // this method.  (Otherwise, we'd have to teach asfPrintError to
-      // get us back here, to continue the loop.)
-      asfPrintStatus("\nProcessing %s ...\n", batchItem);
-      char cmd[1024];
-      if (logflag) {
+      // get us back here, to continue the loop.)  It does let us run
+      // several of them at once, though, each with a log of its own.
+      char cmd[2048], jobLog[1024];
+      if (batch_jobs > 1) {
+          sprintf(jobLog, "%s/%s.log", tmp_dir, batchItemFile);
+          sprintf(cmd, "%sasf_mapready%s -quiet -log %s %s",
+                get_argv0(), bin_postfix(), jobLog, tmpCfgName);
+      }
+      else if (logflag) {
+          strcpy(jobLog, "");
           sprintf(cmd, "%sasf_mapready%s -log %s %s",
                 get_argv0(), bin_postfix(), logFile, tmpCfgName);
       }
       else {
+          strcpy(jobLog, "");
           sprintf(cmd, "%sasf_mapready%s %s",
                 get_argv0(), bin_postfix(), tmpCfgName);
       }
-      int ret = asfSystem(cmd);
-
-      if (ret != 0) {
-          asfPrintStatus("%s: failed\n", batchItem);
-          ++n_bad;
-      } else {
-          asfPrintStatus("%s: ok\n", batchItem);
-          ++n_ok;
+      if (n_jobs == jobs_alloc) {
+          batch_job_t *more;
+          jobs_alloc = jobs_alloc > 0 ? 2*jobs_alloc : 16;
+          more = realloc(jobs, sizeof(batch_job_t)*jobs_alloc);
+          if (!more) {
+              int ii;
+              for (ii = 0; ii < n_jobs; ii++)
+                  batch_job_free(&jobs[ii]);
+              free(jobs);
+              asfPrintError("Out of memory setting up batch job %d (%s)\n",
+                            n_jobs + 1, batchItem);
+          }
+          jobs = more;
       }
+      batch_job_init(&jobs[n_jobs++], batchItem, cmd, jobLog);
 
       strcpy(tmp_dir, cfg->general->tmp_dir);
     }
     FCLOSE(fBatch);
 
+    n_bad = run_batch_jobs(jobs, n_jobs, batch_jobs,
+                           (double)cfg->general->batch_memory);
+    int ii, n_ok = n_jobs - n_bad;
+    for (ii = 0; ii < n_jobs; ii++)
+      batch_job_free(&jobs[ii]);
+    free(jobs);
+
+    // The jobs have removed their own directories, remove the one that
+    // held them too unless something was kept in it
+    if (strlen(cfg->general->tmp_dir) > 0)
+      rmdir(cfg->general->tmp_dir);
+
     asfPrintStatus("\n\nBatch Complete.\n");
     asfPrintStatus("Successfully processed %d/%d file%s.\n", n_ok,
         n_ok + n_bad, n_ok + n_bad == 1 ? "" : "s");
@@ -34,6 +34,10 @@ typedef struct
   int dump_envi;          // true if we should dump .hdr files
   char *defaults;         // default values file
   char *batchFile;        // batch file name
+  int batch_jobs;         // number of batch items to process at a time,
+                          // 0 for one per processor
+  int batch_memory;       // memory budget in MB for concurrent batch items,
+                          // 0 for no limit
   char *prefix;           // prefix for output file naming scheme
   char *suffix;           // suffix for output file naming scheme
   char *tmp_dir;          // name of the directory for intermediate files
@@ -317,6 +321,25 @@ int asf_convert(int createflag, char *configFileName);
 int asf_convert_ext(int createflag, char *configFileName, int saveDEM);
 int call_asf_convert(char *configFile); // FIXME: Change the name ... Now calls asf_mapready
 
+// batch processing
+typedef struct
+{
+  char *name;             // batch item
+  char *command;          // asf_mapready command that processes it
+  char *log;              // log file of the command, if it has its own
+  double size;            // size of the item's files in MB
+  double memory;          // estimated memory needed to process it in MB
+  int status;             // exit status of the command
+} batch_job_t;
+
+void asf_convert_set_batch_jobs(int count);
+int asf_convert_get_batch_jobs(convert_config *cfg);
+void batch_job_init(batch_job_t *job, const char *batchItem,
+                    const char *command, const char *log);
+void batch_job_free(batch_job_t *job);
+int run_batch_jobs(batch_job_t *jobs, int n_jobs, int max_jobs,
+                   double memory_budget);
+
 int isInSAR(const char *infile);
 int is_uavsar(const char *infile);
 int isPolSARpro(const char * infile);
@@ -0,0 +1,257 @@
+// Batch job scheduler for asf_mapready.
+//
+// Every item in a batch file is processed by running asf_mapready on a
+// configuration file of its own, so the items are independent of each other
+// and can be processed by as many concurrent processes as there are job
+// slots.  A job is only started when the memory estimates of the running
+// jobs and the new one fit in the memory budget, and jobs are started in
+// batch file order.
+
+#include <asf_convert.h>
+#include <asf_glib.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h> /* 'DIR' structure (for opendir) */
+#include <dirent.h>    /* for opendir itself            */
+
+#ifndef win32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "asf.h"
+
+// Number of concurrent jobs requested on the command line, or -1 to go with
+// the "batch jobs" configuration file setting.
+static int batch_job_count = -1;
+
+void asf_convert_set_batch_jobs(int count)
+{
+  batch_job_count = count;
+}
+
+int asf_convert_get_batch_jobs(convert_config *cfg)
+{
+  int count = batch_job_count >= 0 ? batch_job_count : cfg->general->batch_jobs;
+  if (count <= 0)
+    count = asf_processor_count();
+#ifdef win32
+  if (count > 1) {
+    asfPrintWarning("Concurrent batch jobs are not supported on this "
+                    "platform.\nProcessing one file at a time.\n");
+    count = 1;
+  }
+#endif
+  return count;
+}
+
+// Size in MB of the files that make up a batch item: all files in its
+// directory whose names contain the item's name, which covers the CEOS naming
+// schemes as well as ASF internal and GeoTIFF files.
+static double batch_item_size(const char *batchItem)
+{
+  char *dir = MALLOC(sizeof(char)*(strlen(batchItem)+2));
+  char *file = MALLOC(sizeof(char)*(strlen(batchItem)+2));
+  double bytes = 0.0;
+  struct dirent *dp;
+  DIR *dirp;
+
+  split_dir_and_file(batchItem, dir, file);
+  dirp = opendir(strlen(dir) > 0 ? dir : ".");
+  if (dirp) {
+    while ((dp = readdir(dirp)) != NULL) {
+      char *path;
+      struct stat st;
+      if (!strstr(dp->d_name, file))
+        continue;
+      path = MALLOC(sizeof(char)*(strlen(dir)+strlen(dp->d_name)+2));
+      sprintf(path, "%s%s", dir, dp->d_name);
+      if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+        bytes += (double)st.st_size;
+      FREE(path);
+    }
+    closedir(dirp);
+  }
+  FREE(dir);
+  FREE(file);
+
+  return bytes / 1048576.0;
+}
+
+// Sets up a job that processes batchItem by running command, which logs to
+// log (if not empty).  The memory needed is guessed to be a few times the
+// size of the item's files, as the data is expanded to floating point and
+// intermediate results are kept around.
+void batch_job_init(batch_job_t *job, const char *batchItem,
+                    const char *command, const char *log)
+{
+  job->name = STRDUP(batchItem);
+  job->command = STRDUP(command);
+  job->log = STRDUP(log);
+  job->size = batch_item_size(batchItem);
+  job->memory = 4.0 * job->size;
+  job->status = 0;
+}
+
+void batch_job_free(batch_job_t *job)
+{
+  FREE(job->name);
+  FREE(job->command);
+  FREE(job->log);
+}
+
+#ifndef win32
+// Starts the job's command in a new process, returns its process id.
+static pid_t start_batch_job(batch_job_t *job)
+{
+  pid_t pid;
+
+  fflush(stdout);
+  fflush(stderr);
+  pid = fork();
+  if (pid == 0) {
+    execl("/bin/sh", "sh", "-c", job->command, (char *) NULL);
+    _exit(127);
+  }
+  if (pid < 0)
+    asfPrintWarning("Could not start a process for %s: %s\n", job->name,
+                    strerror(errno));
+  return pid;
+}
+
+// Kills and reaps the jobs that are still running, so that none are left
+// behind when the batch has to be abandoned.  pids[ii] is 0 for jobs that
+// have finished and negative for jobs that couldn't be started.
+static void stop_batch_jobs(batch_job_t *jobs, pid_t *pids, int n_started)
+{
+  int ii;
+
+  for (ii = 0; ii < n_started; ii++)
+    if (pids[ii] > 0)
+      kill(pids[ii], SIGTERM);
+  for (ii = 0; ii < n_started; ii++) {
+    if (pids[ii] > 0) {
+      while (waitpid(pids[ii], NULL, 0) < 0 && errno == EINTR)
+        ;
+      asfPrintStatus("%s: stopped\n", jobs[ii].name);
+      pids[ii] = 0;
+    }
+  }
+}
+#endif
+
+static void report_batch_job(batch_job_t *job, time_t started)
+{
+  int seconds = (int) difftime(time(NULL), started);
+
+  if (job->status != 0) {
+    asfPrintStatus("%s: failed (%d s)\n", job->name, seconds);
+    if (strlen(job->log) > 0)
+      asfPrintStatus("  See %s for details.\n", job->log);
+  }
+  else {
+    asfPrintStatus("%s: ok (%d s)\n", job->name, seconds);
+  }
+}
+
+// Runs all n_jobs jobs, at most max_jobs at a time and, if memory_budget (in
+// MB) is positive, only as many at a time as fit in it (but always at least
+// one).  Each job's status is set to its command's exit status.  Returns the
+// number of jobs that failed.
+int run_batch_jobs(batch_job_t *jobs, int n_jobs, int max_jobs,
+                   double memory_budget)
+{
+  time_t start = time(NULL);
+  double input_mb = 0.0;
+  int ii, n_bad = 0;
+
+  for (ii = 0; ii < n_jobs; ii++)
+    input_mb += jobs[ii].size;
+
+  if (max_jobs <= 1) {
+    for (ii = 0; ii < n_jobs; ii++) {
+      time_t job_start = time(NULL);
+      asfPrintStatus("\nProcessing %s ...\n", jobs[ii].name);
+      jobs[ii].status = asfSystem(jobs[ii].command);
+      report_batch_job(&jobs[ii], job_start);
+      if (jobs[ii].status != 0)
+        ++n_bad;
+    }
+  }
+#ifndef win32
+  else {
+    pid_t *pids = MALLOC(sizeof(pid_t)*n_jobs);
+    time_t *started = MALLOC(sizeof(time_t)*n_jobs);
+    double running_memory = 0.0;
+    int next = 0, running = 0;
+
+    asfPrintStatus("\nProcessing %d files, up to %d at a time", n_jobs,
+                   max_jobs);
+    if (memory_budget > 0)
+      asfPrintStatus(" within %.0f MB", memory_budget);
+    asfPrintStatus(" ...\n");
+
+    while (next < n_jobs || running > 0) {
+      // Start as many jobs as there are free slots and memory for
+      while (next < n_jobs && running < max_jobs &&
+             (running == 0 || memory_budget <= 0 ||
+              running_memory + jobs[next].memory <= memory_budget))
+      {
+        asfPrintStatus("Starting %s (%.0f MB estimated)\n", jobs[next].name,
+                       jobs[next].memory);
+        started[next] = time(NULL);
+        pids[next] = start_batch_job(&jobs[next]);
+        if (pids[next] < 0) {
+          jobs[next].status = -1;
+          report_batch_job(&jobs[next], started[next]);
+          ++n_bad;
+        }
+        else {
+          running_memory += jobs[next].memory;
+          ++running;
+        }
+        ++next;
+      }
+      if (running == 0)
+        continue;
+
+      // Wait for one of them to finish
+      int status;
+      pid_t pid = waitpid(-1, &status, 0);
+      if (pid < 0) {
+        int err = errno;
+        if (err == EINTR)
+          continue;
+        stop_batch_jobs(jobs, pids, next);
+        asfPrintError("Lost track of the batch jobs: %s\n", strerror(err));
+      }
+      for (ii = 0; ii < next; ii++) {
+        if (pids[ii] == pid) {
+          pids[ii] = 0;
+          jobs[ii].status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+          running_memory -= jobs[ii].memory;
+          --running;
+          report_batch_job(&jobs[ii], started[ii]);
+          if (jobs[ii].status != 0)
+            ++n_bad;
+          break;
+        }
+      }
+    }
+
+    FREE(pids);
+    FREE(started);
+  }
+#endif
+
+  double seconds = difftime(time(NULL), start);
+  if (seconds > 0 && n_jobs > 0)
+    asfPrintStatus("\nProcessed %d file%s in %.0f s (%.1f files/hour, "
+                   "%.2f MB/s of input data).\n", n_jobs,
+                   n_jobs == 1 ? "" : "s", seconds,
+                   n_jobs * 3600.0 / seconds, input_mb / seconds);
+
+  return n_bad;
+}
@@ -306,6 +306,14 @@ int init_convert_config(char *configFile)
   fprintf(fConfig, "# asf_mapready can be used in a batch mode to run a large number of data\n"
           "# sets through the processing flow with the same processing parameters.\n\n");
   fprintf(fConfig, "batch file = \n\n");
+  // batch jobs
+  fprintf(fConfig, "# The batch items can be processed concurrently, this many at a time\n"
+          "# (0 for one per processor).\n\n");
+  fprintf(fConfig, "batch jobs = 1\n\n");
+  // batch memory
+  fprintf(fConfig, "# Concurrent batch items are only started when their estimated memory\n"
+          "# needs fit in this many MB (0 for no limit).\n\n");
+  fprintf(fConfig, "batch memory = 0\n\n");
   // prefix
   fprintf(fConfig, "# A prefix can be added to the outfile name to avoid overwriting\n"
           "# files (e.g. when running the same data sets through the processing flow\n"
@@ -486,6 +494,8 @@ convert_config *init_fill_convert_config(char *configFile)
   cfg->general->mosaic = 0;
   cfg->general->batchFile = (char *)MALLOC(sizeof(char)*255);
   strcpy(cfg->general->batchFile, "");
+  cfg->general->batch_jobs = 1;
+  cfg->general->batch_memory = 0;
   cfg->general->defaults = (char *)MALLOC(sizeof(char)*255);
   strcpy(cfg->general->defaults, "");
   cfg->general->status_file = (char *)MALLOC(sizeof(char)*1024);
@@ -734,6 +744,10 @@ convert_config *init_fill_convert_config(char *configFile)
           strcpy(cfg->general->tmp_dir, read_str(line, "tmp dir"));
         if (strncmp(test, "status file", 11)==0)
           strcpy(cfg->general->status_file, read_str(line, "status file"));
+        if (strncmp(test, "batch jobs", 10)==0)
+          cfg->general->batch_jobs = read_int(line, "batch jobs");
+        if (strncmp(test, "batch memory", 12)==0)
+          cfg->general->batch_memory = read_int(line, "batch memory");
         if (strncmp(test, "prefix", 6)==0)
           strcpy(cfg->general->prefix, read_str(line, "prefix"));
         if (strncmp(test, "suffix", 6)==0)
@@ -1049,6 +1063,10 @@ convert_config *init_fill_convert_config(char *configFile)
             strcpy(cfg->general->status_file, read_str(line, "status file"));
         if (strncmp(test, "batch file", 10)==0)
             strcpy(cfg->general->batchFile, read_str(line, "batch file"));
+        if (strncmp(test, "batch jobs", 10)==0)
+            cfg->general->batch_jobs = read_int(line, "batch jobs");
+        if (strncmp(test, "batch memory", 12)==0)
+            cfg->general->batch_memory = read_int(line, "batch memory");
         if (strncmp(test, "prefix", 6)==0)
             strcpy(cfg->general->prefix, read_str(line, "prefix"));
         if (strncmp(test, "suffix", 6)==0)
@@ -1131,6 +1149,10 @@ convert_config *read_convert_config(char *configFile)
         strcpy(cfg->general->status_file, read_str(line, "status file"));
       if (strncmp(test, "batch file", 10)==0)
         strcpy(cfg->general->batchFile, read_str(line, "batch file"));
+      if (strncmp(test, "batch jobs", 10)==0)
+        cfg->general->batch_jobs = read_int(line, "batch jobs");
+      if (strncmp(test, "batch memory", 12)==0)
+        cfg->general->batch_memory = read_int(line, "batch memory");
       if (strncmp(test, "prefix", 6)==0)
         strcpy(cfg->general->prefix, read_str(line, "prefix"));
       if (strncmp(test, "suffix", 6)==0)
@@ -1657,6 +1679,9 @@ int write_convert_config(char *configFile, convert_config *cfg)
               "# be kept until processing is completed. Then the entire directory and its\n"
               "# contents will be deleted.\n\n");
     fprintf(fConfig, "tmp dir = %s\n", cfg->general->tmp_dir);
+    // Status file - for internal use only (GUI, batch jobs)
+    if (strlen(cfg->general->status_file) > 0)
+      fprintf(fConfig, "status file = %s\n", cfg->general->status_file);
     // Test data generation flag - for internal use only
     if (cfg->general->testdata)
       fprintf(fConfig, "testdata = %d\n", cfg->general->testdata);
@@ -2289,6 +2314,14 @@ int write_convert_config(char *configFile, convert_config *cfg)
       fprintf(fConfig, "# asf_mapready has a batch mode to run a large number of data sets\n"
               "# through the processing flow with the same processing parameters\n\n");
     fprintf(fConfig, "batch file = %s\n\n", cfg->general->batchFile);
+    if (!shortFlag)
+      fprintf(fConfig, "# The batch items can be processed concurrently, this many at a time\n"
+              "# (0 for one per processor).\n\n");
+    fprintf(fConfig, "batch jobs = %d\n\n", cfg->general->batch_jobs);
+    if (!shortFlag)
+      fprintf(fConfig, "# Concurrent batch items are only started when their estimated memory\n"
+              "# needs fit in this many MB (0 for no limit).\n\n");
+    fprintf(fConfig, "batch memory = %d\n\n", cfg->general->batch_memory);
     if (!shortFlag)
       fprintf(fConfig, "# A prefix can be added to the outfile name to avoid overwriting\n"
               "# files (e.g. when running the same data sets through the processing flow\n"
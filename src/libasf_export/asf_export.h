@@ -200,6 +200,14 @@ int lut_to_tiff_palette(unsigned short **colors, int size, char *look_up_table_n
 void dump_palette_tiff_color_map(unsigned short *colors, int map_size);
 int meta_colormap_to_tiff_palette(unsigned short **colors, int *byte_image, meta_colormap *colormap);
 
+// Prototypes from tiff_tiles.c
+void asf_export_set_tiff_options(int tile_size, const char *compression,
+                                 int overviews);
+void asf_export_set_thread_count(int count);
+void set_tiff_layout(TIFF *otif);
+void write_tiff_scanline(TIFF *otif, void *buf, int line);
+void finish_tiff_layout(TIFF *otif);
+
 // Prototypes from export_netcdf.c
 void export_netcdf(const char *in_base_name, char *output_file_name,
   int *noutputs, char ***output_names);
@@ -92,6 +92,89 @@ static char *touzi5_decomposition[4] =
   {"TSVM_alpha_s.bin","TSVM_phi_s.bin","TSVM_tau_m.bin","TSVM_psi.bin"};
 
 int is_slant_range(meta_parameters *md);
+// Channel of the image that band kk of the export is read from
+static int export_channel(meta_parameters *md, char **band_name,
+                          int band_count, int kk)
+{
+  if (md->general->image_data_type >  POLARIMETRIC_IMAGE &&
+      md->general->image_data_type <= POLARIMETRIC_T4_MATRIX)
+    return kk;
+  else if (md->general->band_count == 1)
+    return 0;
+  else
+    return get_band_number(md->general->bands, band_count, band_name[kk]);
+}
+
+// TRUE if the metadata already has usable statistics for the channel,
+// taken from this very image (metadata copied from another image can
+// carry that image's statistics)
+static int have_meta_stats(const char *image_data_file_name,
+                           meta_parameters *md, int channel,
+                           scale_t sample_mapping)
+{
+  return sample_mapping != HISTOGRAM_EQUALIZE &&
+         have_cached_band_stats(image_data_file_name, md, channel,
+                                md->general->no_data);
+}
+
+// Same, for the band with the given name
+static int have_named_meta_stats(const char *image_data_file_name,
+                                 meta_parameters *md, char *band_name,
+                                 scale_t sample_mapping)
+{
+  if (!meta_is_valid_string(band_name) || strlen(band_name) == 0)
+    return FALSE;
+  return have_meta_stats(image_data_file_name, md,
+                         get_band_number(md->general->bands,
+                                         md->general->band_count, band_name),
+                         sample_mapping);
+}
+
+// Gathers the statistics of band kk, along with those of the bands after
+// it that will need them, in a single pass over the image.  The stats
+// for band ii end up in band_stats[ii], with have_band_stats[ii] set.
+static void gather_band_stats(const char *image_data_file_name,
+                              meta_parameters *md, char **band_name,
+                              int band_count, int kk, scale_t sample_mapping,
+                              channel_stats_t *band_stats,
+                              int *have_band_stats)
+{
+  char **bands = MALLOC(sizeof(char *) * band_count);
+  int *which = MALLOC(sizeof(int) * band_count);
+  channel_stats_t *stats = MALLOC(sizeof(channel_stats_t) * band_count);
+  int ii, n = 0;
+
+  for (ii = kk; ii < band_count; ii++) {
+    int channel;
+    if (ii > kk) {
+      // Only the later bands that are certain to be in the image
+      if (!band_name[ii] || have_band_stats[ii] ||
+          (md->general->band_count > 1 &&
+           get_band_number(md->general->bands, md->general->band_count,
+                           band_name[ii]) < 0))
+        continue;
+      channel = export_channel(md, band_name, band_count, ii);
+      if (channel < 0 || channel > MAX_BANDS ||
+          have_meta_stats(image_data_file_name, md, channel, sample_mapping))
+        continue;
+    }
+    bands[n] = band_name[ii];
+    which[n++] = ii;
+  }
+
+  calc_band_stats_from_file(image_data_file_name, n, bands,
+                            md->general->no_data,
+                            sample_mapping == HISTOGRAM_EQUALIZE, stats);
+  for (ii = 0; ii < n; ii++) {
+    band_stats[which[ii]] = stats[ii];
+    have_band_stats[which[ii]] = TRUE;
+  }
+
+  FREE(stats);
+  FREE(which);
+  FREE(bands);
+}
+
 void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
                            const char *output_file_name,
                            const char *metadata_file_name,
@@ -141,6 +224,31 @@ static char *format2str(output_format_t format)
   return format2str_buf;
 }
 
+// Gathers the statistics of the RGB channels flagged in 'need', reading
+// the image just once for all of them
+static void gather_channel_stats(const char *image_data_file_name,
+                                 meta_parameters *md, char **band_name,
+                                 const int *need, int histogram,
+                                 channel_stats_t **channel_stats)
+{
+  char *bands[3];
+  channel_stats_t stats[3];
+  int ii, n = 0;
+
+  for (ii = 0; ii < 3; ii++)
+    if (need[ii])
+      bands[n++] = band_name[ii];
+  if (n == 0)
+    return;
+
+  asfPrintStatus("\nGathering channel statistics ...\n");
+  calc_band_stats_from_file(image_data_file_name, n, bands,
+                            md->general->no_data, histogram, stats);
+  for (ii = 0, n = 0; ii < 3; ii++)
+    if (need[ii])
+      *channel_stats[ii] = stats[n++];
+}
+
 void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
                            const char *output_file_name,
                            const char *metadata_file_name,
@@ -151,7 +259,6 @@ void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
 {
   unsigned short sample_size;
   int max_dn, map_size = 0, palette_color = 0;
-  unsigned short rows_per_strip;
   unsigned short *colors = NULL;
   int have_look_up_table = look_up_table_name && strlen(look_up_table_name) > 0;
     
@@ -238,7 +345,6 @@ void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
   TIFFSetField(*otif, TIFFTAG_IMAGEWIDTH, md->general->sample_count);
   TIFFSetField(*otif, TIFFTAG_IMAGELENGTH, md->general->line_count);
   TIFFSetField(*otif, TIFFTAG_BITSPERSAMPLE, sample_size * 8);
-  TIFFSetField(*otif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
   if  (
        (!have_look_up_table && rgb           )  ||
        ( have_look_up_table && !palette_color)
@@ -268,15 +374,6 @@ void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
     TIFFSetField(*otif, TIFFTAG_SAMPLESPERPIXEL, 1);
   }
 
-  // Set rows per strip to 1, 4, 8, or 16 ...trying to set a near optimal 8k strip size
-  // FIXME: Implement the creation of TIFFS with optimized number of rows per strip ...someday
-  rows_per_strip = 1;//((OPT_STRIP_BYTES / (sample_size * md->general->sample_count)) < 4)  ? 1  :
-                   //((OPT_STRIP_BYTES / (sample_size * md->general->sample_count)) < 8)  ? 4  :
-                   //((OPT_STRIP_BYTES / (sample_size * md->general->sample_count)) < 16) ? 8  :
-                   //((OPT_STRIP_BYTES / (sample_size * md->general->sample_count)) < 32) ? 16 :
-                     //                                             (unsigned short) USHORT_MAX;
-  TIFFSetField(*otif, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
-
   TIFFSetField(*otif, TIFFTAG_XRESOLUTION, 1.0);
   TIFFSetField(*otif, TIFFTAG_YRESOLUTION, 1.0);
   TIFFSetField(*otif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_NONE);
@@ -298,6 +395,9 @@ void initialize_tiff_file (TIFF **otif, GTIF **ogtif,
     FREE(xml_meta);
   }
 
+  // Compression, and strips or tiles ...needs the tags set above
+  set_tiff_layout(*otif);
+
   *palette_color_tiff = palette_color;
 
   meta_free(md);
@@ -1298,6 +1398,7 @@ void finalize_tiff_file(TIFF *otif, GTIF *ogtif, int is_geotiff)
 
   // Finalize the TIFF file
   if (otif != NULL) {
+    finish_tiff_layout (otif);
     XTIFFClose (otif);
   }
 }
@@ -1505,14 +1606,29 @@ export_band_image (const char *metadata_file_name,
 
         /*** Normal straight per-channel stats (no combined-band stats) */
 
+        // Channels whose stats aren't in the metadata are all gathered
+        // in one pass over the image
+        {
+          channel_stats_t *all_stats[3] = {&red_stats, &green_stats, &blue_stats};
+          int channels[3] = {red_channel, green_channel, blue_channel};
+          int need[3];
+          for (ii = 0; ii < 3; ii++) {
+            int have_stats = have_named_meta_stats(image_data_file_name, md,
+                                                   band_name[ii],
+                                                   sample_mapping);
+            need[ii] = !ignored[channels[ii]] && sample_mapping != NONE &&
+                       !have_stats;
+          }
+          gather_channel_stats(image_data_file_name, md, band_name, need,
+                               sample_mapping == HISTOGRAM_EQUALIZE,
+                               all_stats);
+        }
+
         // Red channel statistics
         if (!ignored[red_channel]                           &&  // Non-blank band
             sample_mapping != NONE                          &&  // Float-to-byte resampling needed
-            sample_mapping != HISTOGRAM_EQUALIZE            &&  // A histogram is not needed
-            md->stats      != NULL                          &&  // Stats exist and are valid
-            md->stats       > 0                             &&
-            meta_is_valid_string(band_name[0])              &&  // Band name exists and is valid
-            strlen(band_name[0]) > 0)
+            have_named_meta_stats(image_data_file_name, md, // Current stats exist
+                                  band_name[0], sample_mapping))
         {
           // If the stats already exist, then use them
           int band_no = get_band_number(md->general->bands,
@@ -1536,13 +1652,8 @@ export_band_image (const char *metadata_file_name,
 			       &red_stats.min, &red_stats.max);
         }
         else {
-          // Calculate the stats if you have to...
+          // Stats gathered above, if they were needed
           if (sample_mapping != NONE && !ignored[red_channel]) { // byte image
-            asfPrintStatus("\nGathering red channel statistics ...\n");
-            calc_stats_from_file(image_data_file_name, band_name[0],
-                                md->general->no_data,
-                                &red_stats.min, &red_stats.max, &red_stats.mean,
-                                &red_stats.standard_deviation, &red_stats.hist);
             if (sample_mapping == SIGMA) {
               double omin = red_stats.mean - 2*red_stats.standard_deviation;
               double omax = red_stats.mean + 2*red_stats.standard_deviation;
@@ -1563,11 +1674,8 @@ export_band_image (const char *metadata_file_name,
         // Green channel statistics
         if (!ignored[green_channel]                          &&  // Non-blank band
              sample_mapping != NONE                          &&  // Float-to-byte resampling needed
-             sample_mapping != HISTOGRAM_EQUALIZE            &&  // A histogram is not needed
-             md->stats      != NULL                          &&  // Stats exist and are valid
-             md->stats       > 0                             &&
-             meta_is_valid_string(band_name[1])              &&  // Band name exists and is valid
-             strlen(band_name[1]) > 0)
+             have_named_meta_stats(image_data_file_name, md, // Current stats exist
+                                   band_name[1], sample_mapping))
         {
           // If the stats already exist, then use them
           int band_no = get_band_number(md->general->bands,
@@ -1591,15 +1699,8 @@ export_band_image (const char *metadata_file_name,
 			       &green_stats.min, &green_stats.max);
         }
         else {
-          // Calculate the stats if you have to...
+          // Stats gathered above, if they were needed
           if (sample_mapping != NONE && !ignored[green_channel]) { // byte image
-            asfPrintStatus("\nGathering green channel statistics ...\n");
-            calc_stats_from_file(image_data_file_name, band_name[1],
-                                md->general->no_data,
-                                &green_stats.min, &green_stats.max,
-                                &green_stats.mean,
-                                &green_stats.standard_deviation,
-                                &green_stats.hist);
             if (sample_mapping == SIGMA) {
               double omin = green_stats.mean - 2*green_stats.standard_deviation;
               double omax = green_stats.mean + 2*green_stats.standard_deviation;
@@ -1620,11 +1721,8 @@ export_band_image (const char *metadata_file_name,
         // Blue channel statistics
         if (!ignored[blue_channel]                          &&  // Non-blank band
              sample_mapping != NONE                         &&  // Float-to-byte resampling needed
-             sample_mapping != HISTOGRAM_EQUALIZE           &&  // A histogram is not needed
-             md->stats      != NULL                         &&  // Stats exist and are valid
-             md->stats       > 0                            &&
-             meta_is_valid_string(band_name[2])             &&  // Band name exists and is valid
-             strlen(band_name[2]) > 0)
+             have_named_meta_stats(image_data_file_name, md, // Current stats exist
+                                   band_name[2], sample_mapping))
         {
           // If the stats already exist, then use them
           int band_no = get_band_number(md->general->bands,
@@ -1648,15 +1746,8 @@ export_band_image (const char *metadata_file_name,
 			       &blue_stats.min, &blue_stats.max);
         }
         else {
-          // Calculate the stats if you have to...
+          // Stats gathered above, if they were needed
           if (sample_mapping != NONE && !ignored[blue_channel]) { // byte image
-            asfPrintStatus("\nGathering blue channel statistics ...\n");
-            calc_stats_from_file(image_data_file_name, band_name[2],
-                                md->general->no_data,
-                                &blue_stats.min, &blue_stats.max,
-                                &blue_stats.mean,
-                                &blue_stats.standard_deviation,
-                                &blue_stats.hist);
             if (sample_mapping == SIGMA) {
               double omin = blue_stats.mean - 2*blue_stats.standard_deviation;
               double omax = blue_stats.mean + 2*blue_stats.standard_deviation;
@@ -1755,12 +1846,20 @@ export_band_image (const char *metadata_file_name,
       asfPrintStatus("\nSampling color channels for 2-sigma contrast-expanded %s output...\n",
                      true_color ? "True Color" : false_color ? "False Color" : "Unknown");
 
+      // Gather whatever stats aren't in the metadata in one pass
+      {
+        channel_stats_t *all_stats[3] = {&red_stats, &green_stats, &blue_stats};
+        int need[3];
+        for (ii = 0; ii < 3; ii++)
+          need[ii] = !have_named_meta_stats(image_data_file_name, md,
+                                            band_name[ii], sample_mapping);
+        gather_channel_stats(image_data_file_name, md, band_name, need,
+                             FALSE, all_stats);
+      }
+
       // Set up red resampling
-      if (md->stats                                     &&
-          md->stats->band_count >= 3                    &&
-          meta_is_valid_string(band_name[0])            &&
-          strlen(band_name[0]) > 0                      &&
-          sample_mapping != HISTOGRAM_EQUALIZE)
+      if (have_named_meta_stats(image_data_file_name, md, band_name[0],
+                                sample_mapping))
       {
           // If the stats already exist, then use them
         int band_no = get_band_number(md->general->bands,
@@ -1773,24 +1872,14 @@ export_band_image (const char *metadata_file_name,
         red_stats.hist     = NULL;
         red_stats.hist_pdf = NULL;
       }
-      else {
-        asfPrintStatus("\nGathering red channel statistics...\n");
-        calc_stats_from_file(image_data_file_name, band_name[0],
-                             md->general->no_data,
-                             &red_stats.min, &red_stats.max, &red_stats.mean,
-                             &red_stats.standard_deviation, &red_stats.hist);
-      }
       r_omin = red_stats.mean - 2*red_stats.standard_deviation;
       r_omax = red_stats.mean + 2*red_stats.standard_deviation;
       if (r_omin < red_stats.min) r_omin = red_stats.min;
       if (r_omax > red_stats.max) r_omax = red_stats.max;
 
       // Set up green resampling
-      if (md->stats                                       &&
-          md->stats->band_count >= 3                      &&
-          meta_is_valid_string(band_name[1])              &&
-          strlen(band_name[1]) > 0                        &&
-          sample_mapping != HISTOGRAM_EQUALIZE)
+      if (have_named_meta_stats(image_data_file_name, md, band_name[1],
+                                sample_mapping))
       {
         // If the stats already exist, then use them
         int band_no = get_band_number(md->general->bands,
@@ -1803,24 +1892,14 @@ export_band_image (const char *metadata_file_name,
         green_stats.hist     = NULL;
         green_stats.hist_pdf = NULL;
       }
-      else {
-        asfPrintStatus("\nGathering green channel statistics...\n");
-        calc_stats_from_file(image_data_file_name, band_name[1],
-                              md->general->no_data,
-                              &green_stats.min, &green_stats.max, &green_stats.mean,
-                              &green_stats.standard_deviation, &green_stats.hist);
-      }
       g_omin = green_stats.mean - 2*green_stats.standard_deviation;
       g_omax = green_stats.mean + 2*green_stats.standard_deviation;
       if (g_omin < green_stats.min) g_omin = green_stats.min;
       if (g_omax > green_stats.max) g_omax = green_stats.max;
 
       // Set up blue resampling
-      if (md->stats                                      &&
-          md->stats->band_count >= 3                     &&
-          meta_is_valid_string(band_name[2])             &&
-          strlen(band_name[2]) > 0                       &&
-          sample_mapping != HISTOGRAM_EQUALIZE)
+      if (have_named_meta_stats(image_data_file_name, md, band_name[2],
+                                sample_mapping))
       {
         // If the stats already exist, then use them
         int band_no = get_band_number(md->general->bands,
@@ -1833,13 +1912,6 @@ export_band_image (const char *metadata_file_name,
         blue_stats.hist     = NULL;
         blue_stats.hist_pdf = NULL;
       }
-      else {
-        asfPrintStatus("\nGathering blue channel statistics...\n\n");
-        calc_stats_from_file(image_data_file_name, band_name[2],
-                             md->general->no_data,
-                             &blue_stats.min, &blue_stats.max, &blue_stats.mean,
-                             &blue_stats.standard_deviation, &blue_stats.hist);
-      }
       b_omin = blue_stats.mean - 2*blue_stats.standard_deviation;
       b_omax = blue_stats.mean + 2*blue_stats.standard_deviation;
       if (b_omin < blue_stats.min) b_omin = blue_stats.min;
@@ -2125,6 +2197,11 @@ export_band_image (const char *metadata_file_name,
     int kk;
     int is_colormap_band;
 
+    // Statistics gathered ahead of time for the bands still to come
+    channel_stats_t *band_stats =
+      (channel_stats_t *) CALLOC(band_count, sizeof(channel_stats_t));
+    int *have_band_stats = (int *) CALLOC(band_count, sizeof(int));
+
     for (kk=0; kk<band_count; kk++) {
       if (band_name[kk]) {
         is_colormap_band = FALSE;
@@ -2484,18 +2561,9 @@ export_band_image (const char *metadata_file_name,
         *noutputs += 1;
 
         // Determine which channel to read
-        int channel;
-        if (md->general->image_data_type >  POLARIMETRIC_IMAGE &&
-	    md->general->image_data_type <= POLARIMETRIC_T4_MATRIX)
-          channel = kk;
-        else {
-          if (md->general->band_count == 1)
-            channel = 0;
-          else
-            channel = get_band_number(md->general->bands, band_count, band_name[kk]);
-          asfRequire(channel >= 0 && channel <= MAX_BANDS,
-            "Band number out of range\n");
-        }
+        int channel = export_channel(md, band_name, band_count, kk);
+        asfRequire(channel >= 0 && channel <= MAX_BANDS,
+          "Band number out of range\n");
 
         int sample_count = md->general->sample_count;
         int offset = md->general->line_count;
@@ -2509,13 +2577,8 @@ export_band_image (const char *metadata_file_name,
           asfRequire (sizeof(unsigned char) == 1,
             "Size of the unsigned char data type on this machine is "
             "different than expected.\n");
-          if (md->stats                  &&
-            md->stats->band_count > 0  &&
-            meta_is_valid_double(md->stats->band_stats[channel].mean) &&
-            meta_is_valid_double(md->stats->band_stats[channel].min) &&
-            meta_is_valid_double(md->stats->band_stats[channel].max) &&
-            meta_is_valid_double(md->stats->band_stats[channel].std_deviation) &&
-            sample_mapping != HISTOGRAM_EQUALIZE)
+          if (have_meta_stats(image_data_file_name, md, channel,
+                              sample_mapping))
           {
             asfPrintStatus("Using metadata statistics - skipping stats computations.\n");
             stats.min  = md->stats->band_stats[channel].min;
@@ -2525,11 +2588,14 @@ export_band_image (const char *metadata_file_name,
             stats.hist = NULL;
           }
           else {
-            asfPrintStatus("Gathering statistics ...\n");
-            calc_stats_from_file(image_data_file_name, band_name[kk],
-              md->general->no_data,
-              &stats.min, &stats.max, &stats.mean,
-              &stats.standard_deviation, &stats.hist);
+            if (!have_band_stats[kk]) {
+              asfPrintStatus("Gathering statistics ...\n");
+              gather_band_stats(image_data_file_name, md, band_name,
+                                band_count, kk, sample_mapping,
+                                band_stats, have_band_stats);
+            }
+            stats = band_stats[kk];
+            band_stats[kk].hist = NULL; // Now freed along with 'stats'
           }
           if (sample_mapping == TRUNCATE && !have_look_up_table) {
             if (stats.mean >= 255)
@@ -2725,6 +2791,10 @@ export_band_image (const char *metadata_file_name,
         FREE(out_file);
       }
     } // End for each band (kk is band number)
+    for (kk=0; kk<band_count; kk++)
+      if (band_stats[kk].hist) gsl_histogram_free(band_stats[kk].hist);
+    FREE(band_stats);
+    FREE(have_band_stats);
 
     if (free_band_names) {
       for (ii=0; ii<band_count; ++ii)
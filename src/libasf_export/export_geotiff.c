@@ -65,10 +65,8 @@ void export_geotiff(const char *input_file_list, const char *output_file_name)
   TIFFSetField(otif, TIFFTAG_IMAGEWIDTH, sample_count);
   TIFFSetField(otif, TIFFTAG_IMAGELENGTH, line_count);
   TIFFSetField(otif, TIFFTAG_BITSPERSAMPLE, 32);
-  TIFFSetField(otif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
   TIFFSetField(otif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
   TIFFSetField(otif, TIFFTAG_SAMPLESPERPIXEL, band);
-  TIFFSetField(otif, TIFFTAG_ROWSPERSTRIP, 1);
   TIFFSetField(otif, TIFFTAG_XRESOLUTION, 1.0);
   TIFFSetField(otif, TIFFTAG_YRESOLUTION, 1.0);
   TIFFSetField(otif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_NONE);
@@ -661,6 +659,9 @@ void export_geotiff(const char *input_file_list, const char *output_file_name)
   }
   FCLOSE(fpList);
   
+  // Compression, and strips or tiles
+  set_tiff_layout(otif);
+
   // Write the data to the file
   float *float_out_line = (float *) MALLOC(sizeof(float) * sample_count * band);
   for (ii=0; ii<md->general->line_count; ii++) {
@@ -670,7 +671,7 @@ void export_geotiff(const char *input_file_list, const char *output_file_name)
       for (jj=0; jj<band; jj++)
         float_out_line[kk*band+jj] = files[jj].line[kk];
     }
-    TIFFWriteScanline(otif, float_out_line, ii, 0);
+    write_tiff_scanline(otif, float_out_line, ii);
     asfLineMeter(ii, md->general->line_count);
   }
   FREE(float_out_line);
@@ -679,6 +680,7 @@ void export_geotiff(const char *input_file_list, const char *output_file_name)
   int ret = GTIFWriteKeys (ogtif);
   asfRequire(ret, "Error writing GeoTIFF keys.\n");
   GTIFFree(ogtif);
+  finish_tiff_layout(otif);
   XTIFFClose(otif);
   
   // Clean up
@@ -0,0 +1,657 @@
+// Tiled (cloud optimized) GeoTIFF output for asf_export.
+//
+// By default the TIFF files written by asf_export are LZW compressed strips
+// of one row each, written a scanline at a time by libtiff.  With a tile
+// size set (see asf_export_set_tiff_options) the scanlines handed to
+// write_tiff_scanline are instead collected into bands of tile rows, each
+// band is cut into tiles, and the tiles are compressed on worker threads and
+// written out in row major order.  If overviews are wanted, each overview
+// level is built from the level above it in the same pass (by averaging
+// 2x2 blocks of pixels, leaving out no data values) and written as a
+// reduced resolution subfile after the full resolution image, with its
+// tiles in the same order, so the result can be read like a cloud optimized
+// GeoTIFF.
+//
+// The predictor and the deflate compression are done here, so that the
+// tiles can be compressed in parallel; LZW and ZSTD tiles are passed to
+// libtiff's own (serial) codecs.
+//
+// Usage: initialize_tiff_file() calls set_tiff_layout() once all of the
+// image's tags are set, the write_tiff_*() functions call
+// write_tiff_scanline() for each line, and finalize_tiff_file() calls
+// finish_tiff_layout() after the GeoTIFF keys are written.
+
+#include <asf.h>
+#include <asf_export.h>
+#include <asf_glib.h>
+#include <zlib.h>
+
+// Output settings, see asf_export_set_tiff_options()
+static int tiff_tile_size = 0;
+static int tiff_compression = COMPRESSION_LZW;
+static int tiff_overviews = FALSE;
+
+// Number of threads used to compress tiles, see asf_export_set_thread_count()
+static int export_thread_count = 1;
+
+void asf_export_set_tiff_options(int tile_size, const char *compression,
+                                 int overviews)
+{
+  if (tile_size < 0)
+    tile_size = 0;
+  if (tile_size % 16 != 0) {
+    // The TIFF spec wants tile dimensions that are multiples of 16
+    int rounded = (tile_size / 16 + 1) * 16;
+    asfPrintWarning("TIFF tile size must be a multiple of 16, using %d "
+                    "instead of %d\n", rounded, tile_size);
+    tile_size = rounded;
+  }
+  tiff_tile_size = tile_size;
+
+  if (!compression || strlen(compression) == 0 ||
+      strcmp_case(compression, "lzw") == 0)
+    tiff_compression = COMPRESSION_LZW;
+  else if (strcmp_case(compression, "deflate") == 0)
+    tiff_compression = COMPRESSION_ADOBE_DEFLATE;
+  else if (strcmp_case(compression, "zstd") == 0) {
+#ifdef COMPRESSION_ZSTD
+    if (TIFFIsCODECConfigured(COMPRESSION_ZSTD))
+      tiff_compression = COMPRESSION_ZSTD;
+    else
+#endif
+    {
+      asfPrintWarning("This libtiff does not support ZSTD compression, "
+                      "using DEFLATE instead.\n");
+      tiff_compression = COMPRESSION_ADOBE_DEFLATE;
+    }
+  }
+  else if (strcmp_case(compression, "none") == 0)
+    tiff_compression = COMPRESSION_NONE;
+  else
+    asfPrintError("Unknown TIFF compression: %s\n"
+                  "Use one of lzw, deflate, zstd or none.\n", compression);
+
+  if (overviews && tile_size == 0)
+    asfPrintWarning("TIFF overviews are only written for tiled output.\n");
+  tiff_overviews = overviews && tile_size > 0;
+}
+
+void asf_export_set_thread_count(int count)
+{
+  export_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+// One resolution level of a tiled image
+typedef struct {
+  int width, height;            // Pixels in this level
+  int tiles_across, tiles_down;
+  unsigned char *rows;          // The rows of the current band of tiles
+  int n_rows;                   // Rows collected so far in the band
+  int band;                     // Index of the current band of tiles
+  unsigned char *reduced;       // Scratch row for the next level down
+  long long *offsets;           // Overviews: where each tile is in the
+  size_t *sizes;                //   temporary file, and how big it is
+} tiff_level;
+
+typedef struct {
+  TIFF *tif;
+  int tile_size;
+  int compression;
+  int predictor;
+  int spp, bps, sample_format, palette;
+  size_t pixel_bytes, row_bytes, tile_bytes;
+  int have_no_data;
+  double no_data;
+  int n_levels;
+  tiff_level *levels;
+  FILE *overview_fp;            // Overview tiles until they are written
+  unsigned char **out;          // Tiles of the band being written
+  size_t *out_size;
+  size_t out_max;
+} tiled_tiff;
+
+// The TIFF files being written with tiles.  asf_export writes one or two
+// (the InSAR RGB products) at a time.
+#define MAX_TILED_TIFFS 8
+static tiled_tiff *tiled_tiffs[MAX_TILED_TIFFS];
+
+static tiled_tiff *find_tiled_tiff(TIFF *tif)
+{
+  int ii;
+  for (ii = 0; ii < MAX_TILED_TIFFS; ii++)
+    if (tiled_tiffs[ii] && tiled_tiffs[ii]->tif == tif)
+      return tiled_tiffs[ii];
+  return NULL;
+}
+
+static int host_is_big_endian(void)
+{
+  unsigned short one = 1;
+  return *(unsigned char *)&one == 0;
+}
+
+/******************************** Predictors *******************************/
+
+// TIFF predictor 2: each sample is replaced by its difference from the
+// same sample of the pixel to its left.
+static void horizontal_diff(tiled_tiff *t, unsigned char *row, int n)
+{
+  int ii, spp = t->spp;
+  if (t->bps == 8) {
+    for (ii = n*spp - 1; ii >= spp; ii--)
+      row[ii] -= row[ii - spp];
+  }
+  else {
+    unsigned short *s = (unsigned short *) row;
+    for (ii = n*spp - 1; ii >= spp; ii--)
+      s[ii] -= s[ii - spp];
+  }
+}
+
+// TIFF predictor 3: the bytes of the row's samples are rearranged into
+// planes (most significant bytes first), then each byte is replaced by its
+// difference from the byte one pixel to its left.
+static void float_diff(tiled_tiff *t, unsigned char *row, unsigned char *tmp,
+                       int n)
+{
+  int bytes = t->bps / 8, count = n * t->spp, stride = t->spp;
+  int big_endian = host_is_big_endian();
+  size_t cc = (size_t)count * bytes, ii;
+  int jj, b;
+
+  memcpy(tmp, row, cc);
+  for (jj = 0; jj < count; jj++)
+    for (b = 0; b < bytes; b++)
+      row[(big_endian ? b : bytes - b - 1) * count + jj] = tmp[bytes*jj + b];
+  for (ii = cc - 1; ii >= (size_t)stride; ii--)
+    row[ii] -= row[ii - stride];
+}
+
+/*********************************** Tiles *********************************/
+
+// Copies tile tx of the level's current band into tile, padding with zeros
+// past the right and bottom edges of the image.
+static void extract_tile(tiled_tiff *t, tiff_level *lv, int tx,
+                         unsigned char *tile)
+{
+  int x0 = tx * t->tile_size;
+  int n = MIN(t->tile_size, lv->width - x0);
+  size_t tile_row = t->tile_size * t->pixel_bytes;
+  size_t level_row = lv->width * t->pixel_bytes;
+  int y;
+
+  memset(tile, 0, t->tile_bytes);
+  for (y = 0; y < lv->n_rows; y++)
+    memcpy(tile + y*tile_row, lv->rows + y*level_row + x0*t->pixel_bytes,
+           n * t->pixel_bytes);
+}
+
+// Applies the predictor to a tile and deflates it into out.
+static size_t deflate_tile(tiled_tiff *t, unsigned char *tile,
+                           unsigned char *tmp, unsigned char *out)
+{
+  size_t tile_row = t->tile_size * t->pixel_bytes;
+  uLongf out_size = t->out_max;
+  int y;
+
+  if (t->predictor == PREDICTOR_HORIZONTAL)
+    for (y = 0; y < t->tile_size; y++)
+      horizontal_diff(t, tile + y*tile_row, t->tile_size);
+  else if (t->predictor == PREDICTOR_FLOATINGPOINT)
+    for (y = 0; y < t->tile_size; y++)
+      float_diff(t, tile + y*tile_row, tmp, t->tile_size);
+
+  if (compress2(out, &out_size, tile, t->tile_bytes, Z_DEFAULT_COMPRESSION)
+      != Z_OK)
+    asfPrintError("Failed to compress a TIFF tile\n");
+  return out_size;
+}
+
+// The tiles of one band, handed out to the threads compressing them
+typedef struct {
+  GMutex *lock;        // Guards next_tile
+  int next_tile;
+  tiled_tiff *t;
+  tiff_level *lv;
+} tile_queue;
+
+static gpointer tile_worker(gpointer data)
+{
+  tile_queue *q = (tile_queue *) data;
+  tiled_tiff *t = q->t;
+  unsigned char *tile = MALLOC(t->tile_bytes);
+  unsigned char *tmp = MALLOC(t->tile_size * t->pixel_bytes);
+
+  for (;;) {
+    int tx;
+    if (q->lock) g_mutex_lock(q->lock);
+    tx = q->next_tile++;
+    if (q->lock) g_mutex_unlock(q->lock);
+    if (tx >= q->lv->tiles_across)
+      break;
+
+    if (t->compression == COMPRESSION_ADOBE_DEFLATE) {
+      extract_tile(t, q->lv, tx, tile);
+      t->out_size[tx] = deflate_tile(t, tile, tmp, t->out[tx]);
+    }
+    else {
+      // libtiff compresses these when they are written
+      extract_tile(t, q->lv, tx, t->out[tx]);
+      t->out_size[tx] = t->tile_bytes;
+    }
+  }
+
+  FREE(tile);
+  FREE(tmp);
+  return NULL;
+}
+
+// Compresses the level's current band of tiles and writes them out: the
+// full resolution tiles go straight into the TIFF, the overview tiles go to
+// the temporary file until the full resolution image is done.
+static void write_band(tiled_tiff *t, int level)
+{
+  tiff_level *lv = &t->levels[level];
+  int thread_count = MIN(export_thread_count, lv->tiles_across);
+  tile_queue q;
+  int tx;
+
+  q.next_tile = 0;
+  q.t = t;
+  q.lv = lv;
+  if (thread_count > 1 && t->compression == COMPRESSION_ADOBE_DEFLATE) {
+    GThread **threads = MALLOC(sizeof(GThread *) * thread_count);
+    int tt;
+
+    asf_thread_init();
+    q.lock = asf_mutex_new();
+    for (tt = 0; tt < thread_count; tt++) {
+      threads[tt] = asf_thread_new("tiff_tiles", tile_worker, &q);
+      if (threads[tt] == NULL)
+        asfPrintError("Failed to create TIFF compression thread\n");
+    }
+    for (tt = 0; tt < thread_count; tt++)
+      g_thread_join(threads[tt]);
+    asf_mutex_free(q.lock);
+    FREE(threads);
+  }
+  else {
+    q.lock = NULL;
+    tile_worker(&q);
+  }
+
+  for (tx = 0; tx < lv->tiles_across; tx++) {
+    int index = lv->band * lv->tiles_across + tx;
+    if (level == 0) {
+      tsize_t ret;
+      if (t->compression == COMPRESSION_ADOBE_DEFLATE)
+        ret = TIFFWriteRawTile(t->tif, index, t->out[tx], t->out_size[tx]);
+      else
+        ret = TIFFWriteEncodedTile(t->tif, index, t->out[tx],
+                                   t->out_size[tx]);
+      if (ret < 0)
+        asfPrintError("Error writing TIFF tile %d\n", index);
+    }
+    else {
+      lv->offsets[index] = FTELL64(t->overview_fp);
+      lv->sizes[index] = t->out_size[tx];
+      ASF_FWRITE(t->out[tx], 1, t->out_size[tx], t->overview_fp);
+    }
+  }
+
+  lv->band++;
+  lv->n_rows = 0;
+}
+
+/********************************* Overviews *******************************/
+
+static double get_sample(tiled_tiff *t, const unsigned char *row, int ii)
+{
+  if (t->sample_format == SAMPLEFORMAT_IEEEFP)
+    return ((const float *) row)[ii];
+  else if (t->bps == 16)
+    return ((const unsigned short *) row)[ii];
+  else
+    return row[ii];
+}
+
+static void set_sample(tiled_tiff *t, unsigned char *row, int ii, double val)
+{
+  if (t->sample_format == SAMPLEFORMAT_IEEEFP)
+    ((float *) row)[ii] = (float) val;
+  else if (t->bps == 16)
+    ((unsigned short *) row)[ii] = (unsigned short) (val + 0.5);
+  else
+    row[ii] = (unsigned char) (val + 0.5);
+}
+
+static int valid_sample(tiled_tiff *t, double val)
+{
+  return !ISNAN(val) && !(t->have_no_data && val == t->no_data);
+}
+
+// Makes a row of the next level down from rows a and b (b is NULL at the
+// bottom edge of an image with an odd number of rows).  Each pixel is the
+// average of the valid pixels in its 2x2 block, or no data if there are
+// none.  Palette images are subsampled instead, since averaging color
+// indexes makes no sense.
+static void reduce_rows(tiled_tiff *t, tiff_level *lv,
+                        const unsigned char *a, const unsigned char *b,
+                        unsigned char *out)
+{
+  int out_width = (lv->width + 1) / 2;
+  int spp = t->spp;
+  int x, s;
+
+  if (t->palette) {
+    for (x = 0; x < out_width; x++)
+      out[x] = a[2*x];
+    return;
+  }
+
+  for (x = 0; x < out_width; x++) {
+    for (s = 0; s < spp; s++) {
+      const unsigned char *block_rows[2];
+      double sum = 0.0;
+      int n = 0, r, dx;
+
+      block_rows[0] = a;
+      block_rows[1] = b;
+      for (r = 0; r < 2; r++) {
+        if (!block_rows[r])
+          continue;
+        for (dx = 0; dx < 2 && 2*x + dx < lv->width; dx++) {
+          double val = get_sample(t, block_rows[r], (2*x + dx)*spp + s);
+          if (valid_sample(t, val)) {
+            sum += val;
+            ++n;
+          }
+        }
+      }
+
+      if (n > 0)
+        set_sample(t, out, x*spp + s, sum / n);
+      else if (t->have_no_data)
+        set_sample(t, out, x*spp + s, t->no_data);
+      else
+        set_sample(t, out, x*spp + s, get_sample(t, a, 2*x*spp + s));
+    }
+  }
+}
+
+// Adds a row to a level, writing out the band when it is full.  Every
+// second row is reduced together with the one before it and passed down to
+// the next level.  Bands have an even number of rows, so both rows of a
+// pair are always in the same band.
+static void add_row(tiled_tiff *t, int level, const unsigned char *row)
+{
+  tiff_level *lv = &t->levels[level];
+  unsigned char *dest = lv->rows + lv->n_rows * lv->width * t->pixel_bytes;
+
+  memcpy(dest, row, lv->width * t->pixel_bytes);
+  lv->n_rows++;
+
+  if (level + 1 < t->n_levels && lv->n_rows % 2 == 0) {
+    reduce_rows(t, lv, dest - lv->width * t->pixel_bytes, dest, lv->reduced);
+    add_row(t, level + 1, lv->reduced);
+  }
+
+  if (lv->n_rows == t->tile_size)
+    write_band(t, level);
+}
+
+/********************************* Interface *******************************/
+
+// Sets the compression, and the tiling or strips, of a TIFF file whose
+// other tags (image size, samples, sample format and photometric
+// interpretation, and the GDAL no data tag if there is one) are already
+// set.  Must be called before the first line is written.
+void set_tiff_layout(TIFF *otif)
+{
+  uint32 width, height;
+  uint16 spp, bps, sample_format, photometric;
+  tiled_tiff *t;
+  char *no_data;
+  int ii, w, h;
+
+  TIFFGetField(otif, TIFFTAG_IMAGEWIDTH, &width);
+  TIFFGetField(otif, TIFFTAG_IMAGELENGTH, &height);
+  TIFFGetFieldDefaulted(otif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+  TIFFGetFieldDefaulted(otif, TIFFTAG_BITSPERSAMPLE, &bps);
+  TIFFGetFieldDefaulted(otif, TIFFTAG_SAMPLEFORMAT, &sample_format);
+  TIFFGetField(otif, TIFFTAG_PHOTOMETRIC, &photometric);
+
+  TIFFSetField(otif, TIFFTAG_COMPRESSION, tiff_compression);
+  if (tiff_tile_size == 0) {
+    // One row per strip, as asf_export has always written them
+    TIFFSetField(otif, TIFFTAG_ROWSPERSTRIP, 1);
+    return;
+  }
+
+  t = CALLOC(1, sizeof(tiled_tiff));
+  t->tif = otif;
+  t->tile_size = tiff_tile_size;
+  t->compression = tiff_compression;
+  t->spp = spp;
+  t->bps = bps;
+  t->sample_format = sample_format;
+  t->palette = photometric == PHOTOMETRIC_PALETTE;
+  t->pixel_bytes = spp * bps / 8;
+  t->row_bytes = width * t->pixel_bytes;
+  t->tile_bytes = (size_t)t->tile_size * t->tile_size * t->pixel_bytes;
+
+  t->predictor = PREDICTOR_NONE;
+  if (t->compression != COMPRESSION_NONE && !t->palette) {
+    if (sample_format == SAMPLEFORMAT_IEEEFP)
+      t->predictor = PREDICTOR_FLOATINGPOINT;
+    else if (bps == 8 || bps == 16)
+      t->predictor = PREDICTOR_HORIZONTAL;
+  }
+
+  if (TIFFGetField(otif, TIFFTAG_GDAL_NODATA, &no_data)) {
+    t->have_no_data = TRUE;
+    t->no_data = atof(no_data);
+  }
+
+  TIFFSetField(otif, TIFFTAG_TILEWIDTH, t->tile_size);
+  TIFFSetField(otif, TIFFTAG_TILELENGTH, t->tile_size);
+  if (t->predictor != PREDICTOR_NONE)
+    TIFFSetField(otif, TIFFTAG_PREDICTOR, t->predictor);
+
+  // Overviews are made until the image fits in a single tile
+  t->n_levels = 1;
+  if (tiff_overviews)
+    for (w = width, h = height; w > t->tile_size || h > t->tile_size;
+         w = (w + 1) / 2, h = (h + 1) / 2)
+      t->n_levels++;
+
+  t->levels = CALLOC(t->n_levels, sizeof(tiff_level));
+  for (ii = 0, w = width, h = height; ii < t->n_levels;
+       ii++, w = (w + 1) / 2, h = (h + 1) / 2)
+  {
+    tiff_level *lv = &t->levels[ii];
+    lv->width = w;
+    lv->height = h;
+    lv->tiles_across = (w + t->tile_size - 1) / t->tile_size;
+    lv->tiles_down = (h + t->tile_size - 1) / t->tile_size;
+    lv->rows = MALLOC(t->tile_size * w * t->pixel_bytes);
+    if (ii + 1 < t->n_levels)
+      lv->reduced = MALLOC(((w + 1) / 2) * t->pixel_bytes);
+    if (ii > 0) {
+      lv->offsets =
+        MALLOC(sizeof(long long) * lv->tiles_across * lv->tiles_down);
+      lv->sizes = MALLOC(sizeof(size_t) * lv->tiles_across * lv->tiles_down);
+    }
+  }
+
+  if (t->n_levels > 1) {
+    t->overview_fp = tmpfile();
+    if (!t->overview_fp)
+      asfPrintError("Could not create a temporary file for the TIFF "
+                    "overviews\n");
+  }
+
+  t->out_max = compressBound(t->tile_bytes);
+  t->out = MALLOC(sizeof(unsigned char *) * t->levels[0].tiles_across);
+  t->out_size = MALLOC(sizeof(size_t) * t->levels[0].tiles_across);
+  for (ii = 0; ii < t->levels[0].tiles_across; ii++)
+    t->out[ii] = MALLOC(t->out_max);
+
+  for (ii = 0; ii < MAX_TILED_TIFFS; ii++)
+    if (!tiled_tiffs[ii]) {
+      tiled_tiffs[ii] = t;
+      break;
+    }
+  if (ii == MAX_TILED_TIFFS)
+    asfPrintError("Too many tiled TIFF files open at once\n");
+
+  if (t->n_levels > 1)
+    asfPrintStatus("Writing %dx%d tiles, with %d overview%s\n",
+                   t->tile_size, t->tile_size, t->n_levels - 1,
+                   t->n_levels > 2 ? "s" : "");
+  else
+    asfPrintStatus("Writing %dx%d tiles\n", t->tile_size, t->tile_size);
+}
+
+// Writes line number 'line' of the image, in place of TIFFWriteScanline().
+// Lines must be written in order for tiled files.
+void write_tiff_scanline(TIFF *otif, void *buf, int line)
+{
+  tiled_tiff *t = find_tiled_tiff(otif);
+
+  if (!t) {
+    if (TIFFWriteScanline(otif, buf, line, 0) < 0)
+      asfPrintError("Error writing line %d of the TIFF file\n", line);
+    return;
+  }
+
+  asfRequire(line == t->levels[0].band * t->tile_size + t->levels[0].n_rows,
+             "TIFF lines must be written in order\n");
+  add_row(t, 0, (const unsigned char *) buf);
+}
+
+// Writes the overview tiles from the temporary file as a reduced
+// resolution subfile.
+static void write_overview(tiled_tiff *t, int level, uint16 *colormap[3])
+{
+  tiff_level *lv = &t->levels[level];
+  int n_tiles = lv->tiles_across * lv->tiles_down, ii;
+  unsigned char *buf = MALLOC(t->out_max);
+
+  TIFFSetField(t->tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+  TIFFSetField(t->tif, TIFFTAG_IMAGEWIDTH, lv->width);
+  TIFFSetField(t->tif, TIFFTAG_IMAGELENGTH, lv->height);
+  TIFFSetField(t->tif, TIFFTAG_BITSPERSAMPLE, t->bps);
+  TIFFSetField(t->tif, TIFFTAG_SAMPLESPERPIXEL, t->spp);
+  TIFFSetField(t->tif, TIFFTAG_SAMPLEFORMAT, t->sample_format);
+  TIFFSetField(t->tif, TIFFTAG_COMPRESSION, t->compression);
+  TIFFSetField(t->tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(t->tif, TIFFTAG_TILEWIDTH, t->tile_size);
+  TIFFSetField(t->tif, TIFFTAG_TILELENGTH, t->tile_size);
+  if (t->predictor != PREDICTOR_NONE)
+    TIFFSetField(t->tif, TIFFTAG_PREDICTOR, t->predictor);
+  if (t->palette) {
+    TIFFSetField(t->tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_PALETTE);
+    TIFFSetField(t->tif, TIFFTAG_COLORMAP, colormap[0], colormap[1],
+                 colormap[2]);
+  }
+  else
+    TIFFSetField(t->tif, TIFFTAG_PHOTOMETRIC,
+                 t->spp == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+
+  for (ii = 0; ii < n_tiles; ii++) {
+    tsize_t ret;
+    FSEEK64(t->overview_fp, lv->offsets[ii], SEEK_SET);
+    ASF_FREAD(buf, 1, lv->sizes[ii], t->overview_fp);
+    if (t->compression == COMPRESSION_ADOBE_DEFLATE)
+      ret = TIFFWriteRawTile(t->tif, ii, buf, lv->sizes[ii]);
+    else
+      ret = TIFFWriteEncodedTile(t->tif, ii, buf, lv->sizes[ii]);
+    if (ret < 0)
+      asfPrintError("Error writing TIFF overview tile %d\n", ii);
+  }
+  if (!TIFFWriteDirectory(t->tif))
+    asfPrintError("Error writing TIFF overview directory\n");
+
+  FREE(buf);
+}
+
+static void free_tiled_tiff(tiled_tiff *t)
+{
+  int ii;
+  for (ii = 0; ii < t->levels[0].tiles_across; ii++)
+    FREE(t->out[ii]);
+  FREE(t->out);
+  FREE(t->out_size);
+  for (ii = 0; ii < t->n_levels; ii++) {
+    tiff_level *lv = &t->levels[ii];
+    FREE(lv->rows);
+    if (lv->reduced) FREE(lv->reduced);
+    if (lv->offsets) FREE(lv->offsets);
+    if (lv->sizes) FREE(lv->sizes);
+  }
+  FREE(t->levels);
+  if (t->overview_fp) FCLOSE(t->overview_fp);
+  FREE(t);
+}
+
+// Writes out the last band of tiles and the overviews.  Must be called
+// before the TIFF file is closed, and after the GeoTIFF keys are written,
+// since they go in the full resolution image's directory.  Does nothing
+// for files that are written in strips.
+void finish_tiff_layout(TIFF *otif)
+{
+  tiled_tiff *t = find_tiled_tiff(otif);
+  uint16 *colormap[3] = { NULL, NULL, NULL };
+  uint16 *red, *green, *blue;
+  int ii;
+
+  if (!t)
+    return;
+
+  // Pass the unpaired last row of an odd height level down, then write
+  // out each level's partial last band
+  for (ii = 0; ii < t->n_levels; ii++) {
+    tiff_level *lv = &t->levels[ii];
+    asfRequire(lv->band * t->tile_size + lv->n_rows == lv->height,
+               "Not all lines of the TIFF file were written\n");
+    if (ii + 1 < t->n_levels && lv->n_rows % 2 == 1) {
+      reduce_rows(t, lv, lv->rows + (lv->n_rows-1)*lv->width*t->pixel_bytes,
+                  NULL, lv->reduced);
+      add_row(t, ii + 1, lv->reduced);
+    }
+    if (lv->n_rows > 0)
+      write_band(t, ii);
+  }
+
+  if (t->n_levels > 1) {
+    // The colormap has to be copied, it goes away with the directory
+    if (t->palette &&
+        TIFFGetField(otif, TIFFTAG_COLORMAP, &red, &green, &blue))
+    {
+      size_t map_size = sizeof(uint16) * (1 << t->bps);
+      colormap[0] = MALLOC(map_size);
+      colormap[1] = MALLOC(map_size);
+      colormap[2] = MALLOC(map_size);
+      memcpy(colormap[0], red, map_size);
+      memcpy(colormap[1], green, map_size);
+      memcpy(colormap[2], blue, map_size);
+    }
+
+    if (!TIFFWriteDirectory(otif))
+      asfPrintError("Error writing TIFF directory\n");
+    for (ii = 1; ii < t->n_levels; ii++)
+      write_overview(t, ii, colormap);
+
+    if (colormap[0]) {
+      FREE(colormap[0]);
+      FREE(colormap[1]);
+      FREE(colormap[2]);
+    }
+  }
+
+  for (ii = 0; ii < MAX_TILED_TIFFS; ii++)
+    if (tiled_tiffs[ii] == t)
+      tiled_tiffs[ii] = NULL;
+  free_tiled_tiff(t);
+}
@@ -13,12 +13,12 @@ void write_tiff_byte2byte(TIFF *otif, unsigned char *byte_line,
                            stats.hist, stats.hist_pdf, NAN);
     }
   }
-  TIFFWriteScanline (otif, byte_line, line, 0);
+  write_tiff_scanline (otif, byte_line, line);
 }
 
 void write_tiff_float2float(TIFF *otif, float *float_line, int line)
 {
-  TIFFWriteScanline (otif, float_line, line, 0);
+  write_tiff_scanline (otif, float_line, line);
 }
 
 void write_tiff_float2int(TIFF *otif, float *float_line, int line, 
@@ -31,7 +31,7 @@ void write_tiff_float2int(TIFF *otif, float *float_line, int line,
 
   for (jj=0; jj<sample_count; jj++)
     int_line[jj] = (int) float_line[jj];
-  TIFFWriteScanline (otif, int_line, line, 0);
+  write_tiff_scanline (otif, int_line, line);
   FREE(int_line);
 }
 
@@ -49,7 +49,7 @@ void write_tiff_float2byte(TIFF *otif, float *float_line,
       pixel_float2byte(float_line[jj], sample_mapping, stats.min, stats.max,
                stats.hist, stats.hist_pdf, no_data);
   }
-  TIFFWriteScanline (otif, byte_line, line, 0);
+  write_tiff_scanline (otif, byte_line, line);
   FREE(byte_line);
 }
 
@@ -70,7 +70,7 @@ void write_rgb_tiff_byte2byte(TIFF *otif,
     rgb_byte_line[(jj*3)+1] = green_byte_line[jj];
     rgb_byte_line[(jj*3)+2] = blue_byte_line[jj];
   }
-  TIFFWriteScanline (otif, rgb_byte_line, line, 0);
+  write_tiff_scanline (otif, rgb_byte_line, line);
   FREE(rgb_byte_line);
 }
 
@@ -84,7 +84,7 @@ void write_tiff_byte2lut(TIFF *otif, unsigned char *byte_line,
   apply_look_up_table_byte(look_up_table_name, byte_line, sample_count,
                            rgb_line);
 
-  TIFFWriteScanline (otif, rgb_line, line, 0);
+  write_tiff_scanline (otif, rgb_line, line);
   FREE(rgb_line);
 }
 
@@ -104,7 +104,7 @@ void write_rgb_tiff_float2float(TIFF *otif,
     rgb_float_line[(jj*3)+1] = green_float_line[jj];
     rgb_float_line[(jj*3)+2] = blue_float_line[jj];
   }
-  TIFFWriteScanline (otif, rgb_float_line, line, 0);
+  write_tiff_scanline (otif, rgb_float_line, line);
   FREE(rgb_float_line);
 }
 
@@ -138,7 +138,7 @@ void write_rgb_tiff_float2byte(TIFF *otif,
                blue_stats.min, blue_stats.max, blue_stats.hist,
                blue_stats.hist_pdf, no_data);
   }
-  TIFFWriteScanline (otif, rgb_byte_line, line, 0);
+  write_tiff_scanline (otif, rgb_byte_line, line);
   FREE(rgb_byte_line);
 }
 
@@ -165,7 +165,7 @@ void write_tiff_float2lut(TIFF *otif, float *float_line,
   apply_look_up_table_byte(look_up_table_name, byte_line, sample_count,
               rgb_line);
 
-  TIFFWriteScanline (otif, rgb_line, line, 0);
+  write_tiff_scanline (otif, rgb_line, line);
   FREE(byte_line);
   FREE(rgb_line);
 }
@@ -360,103 +360,161 @@ struct data_to_fit {
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Hold your nose...
-//
-// These used to be function scoped statics in reverse_map_x and
-// reverse_map_y routines, but that broke horribly when this program
-// got converted into a library function because they never got reset
-// between calls, so now these are globals so that we can reset them
-// all to their initial state when we get to the end of the function.
-// The little '_rmx' and '_rmy' suffixes help remind us that these
-// globals go with the reverse_map_x and reverse_map_y routines,
-// repsectively.
-
-  // True iff this is our first time through this routine.
-  static gboolean first_time_through_rmx = TRUE;
-  // Accelerators and interpolators for the all the vertical columns
-  // of sample points.  Filled in first time through routine.
-  static gsl_interp_accel **y_accel_rmx;
-  static gsl_spline **y_spline_rmx;
-  // Current accelerator and interpolator.  Updated when y argument is
-  // different between calls.
-  static gsl_interp_accel *crnt_accel_rmx;
-  static gsl_spline *crnt_rmx;
-  // Value of y for which current interpolator works.
-  static double last_y_rmx;
-
-  // True iff this is our first time through this routine.
-  static gboolean first_time_through_rmy = TRUE;
+// State used by the reverse_map_x and reverse_map_y routines.  These
+// used to be function scoped statics, and then globals (so they could
+// be reset between library calls), but either way only one mapping
+// could be evaluated at a time.  Now each thread resampling output
+// lines gets a context of its own.  The little '_rmx' and '_rmy'
+// suffixes help remind us which fields go with reverse_map_x and
+// reverse_map_y, repsectively.
+
+typedef struct {
+  // The data to fit.  Mostly ignored after the column splines have
+  // been set up, but not entirely, so it can't be freed or changed
+  // while the context is in use.
+  struct data_to_fit *dtf;
+
   // Accelerators and interpolators for the all the vertical columns
-  // of sample points.  Filled in first time through routine.
-  static gsl_interp_accel **y_accel_rmy;
-  static gsl_spline **y_spline_rmy;
-  // Current accelerator and interpolator.  Updated when y argument is
-  // different between calls.
-  static gsl_interp_accel *crnt_accel_rmy;
-  static gsl_spline *crnt_rmy;
-  // Value of y for which current interpolator works.
-  static double last_y_rmy;
+  // of sample points.
+  gsl_interp_accel **y_accel_rmx;
+  gsl_spline **y_spline_rmx;
+  gsl_interp_accel **y_accel_rmy;
+  gsl_spline **y_spline_rmy;
+
+  // Current accelerator and interpolator (the spline running
+  // horizontally between the column splines).  Updated when the y
+  // argument is different between calls.
+  gsl_interp_accel *crnt_accel_rmx;
+  gsl_spline *crnt_rmx;
+  gsl_interp_accel *crnt_accel_rmy;
+  gsl_spline *crnt_rmy;
+
+  // True iff the current interpolators have been set up, and the
+  // value of y for which they work.
+  gboolean crnt_valid_rmx;
+  double last_y_rmx;
+  gboolean crnt_valid_rmy;
+  double last_y_rmy;
+
+  // Scratch space for the values the current interpolators run through.
+  double *crnt_points;
+} reverse_map_t;
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Set up vertical splines through the columns of the sparse grid
+// points in dtf, mapping projection y coordinates to the pixel
+// coordinates in pixs.
+static void
+column_splines_new (struct data_to_fit *dtf, double *pixs,
+                    gsl_interp_accel ***accels, gsl_spline ***splines)
+{
+  size_t sgs = dtf->sparse_grid_size;
+  double *yprojs = dtf->sparse_y_proj;
+
+  *accels = g_new (gsl_interp_accel *, sgs);
+  *splines = g_new (gsl_spline *, sgs);
+
+  double *cyp = g_new (double, sgs);    // Current y projection values.
+  double *cpix = g_new (double, sgs);   // Current pixel values.
+  size_t ii;
+  for ( ii = 0 ; ii < sgs ; ii++ ) {
+    size_t jj;
+    for ( jj = 0 ; jj < sgs ; jj++ ) {
+      cyp[jj] = yprojs[jj * sgs + ii];
+      cpix[jj] = pixs[jj * sgs + ii];
+    }
+    (*accels)[ii] = gsl_interp_accel_alloc ();
+    (*splines)[ii] = gsl_spline_alloc (gsl_interp_cspline, sgs);
+    gsl_spline_init ((*splines)[ii], cyp, cpix, sgs);
+  }
+  g_free (cpix);
+  g_free (cyp);
+}
+
+static void
+column_splines_free (size_t sgs, gsl_interp_accel **accels,
+                     gsl_spline **splines)
+{
+  size_t ii;
+  for ( ii = 0 ; ii < sgs ; ii++ ) {
+    gsl_interp_accel_free (accels[ii]);
+    gsl_spline_free (splines[ii]);
+  }
+  g_free (accels);
+  g_free (splines);
+}
+
+// Create a reverse mapping context for the data in dtf.
+static reverse_map_t *
+reverse_map_new (struct data_to_fit *dtf)
+{
+  size_t sgs = dtf->sparse_grid_size;
+  reverse_map_t *self = g_new0 (reverse_map_t, 1);
+
+  self->dtf = dtf;
+  column_splines_new (dtf, dtf->sparse_x_pix, &self->y_accel_rmx,
+                      &self->y_spline_rmx);
+  column_splines_new (dtf, dtf->sparse_y_pix, &self->y_accel_rmy,
+                      &self->y_spline_rmy);
+  self->crnt_accel_rmx = gsl_interp_accel_alloc ();
+  self->crnt_rmx = gsl_spline_alloc (gsl_interp_cspline, sgs);
+  self->crnt_accel_rmy = gsl_interp_accel_alloc ();
+  self->crnt_rmy = gsl_spline_alloc (gsl_interp_cspline, sgs);
+  self->crnt_valid_rmx = FALSE;
+  self->crnt_valid_rmy = FALSE;
+  self->crnt_points = g_new (double, sgs);
+
+  return self;
+}
+
+static void
+reverse_map_free (reverse_map_t *self)
+{
+  size_t sgs = self->dtf->sparse_grid_size;
+
+  column_splines_free (sgs, self->y_accel_rmx, self->y_spline_rmx);
+  column_splines_free (sgs, self->y_accel_rmy, self->y_spline_rmy);
+  gsl_interp_accel_free (self->crnt_accel_rmx);
+  gsl_spline_free (self->crnt_rmx);
+  gsl_interp_accel_free (self->crnt_accel_rmy);
+  gsl_spline_free (self->crnt_rmy);
+  g_free (self->crnt_points);
+  g_free (self);
+}
+
+// Set up the spline that runs horizontally between the column splines
+// at projection coordinate y.
+static void
+set_current_spline (reverse_map_t *self, gsl_interp_accel **y_accels,
+                    gsl_spline **y_splines, gsl_interp_accel *crnt_accel,
+                    gsl_spline *crnt, double y)
+{
+  size_t sgs = self->dtf->sparse_grid_size;
+  size_t ii;
+  for ( ii = 0 ; ii < sgs ; ii++ ) {
+    self->crnt_points[ii] = gsl_spline_eval_check (y_splines[ii], y,
+                                                   y_accels[ii]);
+  }
+  gsl_spline_init (crnt, self->dtf->sparse_x_proj, self->crnt_points, sgs);
+  gsl_interp_accel_reset (crnt_accel);
+}
+
 // Reverse map from projection coordinates x, y to input pixel
-// coordinate X.  This function looks at the data to fit on the first
-// time through, in order to set up vertical splines, after which this
-// argument is mostly ignored.  But not entirely, so you can't free or
-// change the dtf.  Mapping is efficient only if the y coordinates are
+// coordinate X.  Mapping is efficient only if the y coordinates are
 // usually identical between calls, since when y changes a new spline
 // between splines has to be created.
 static double
-reverse_map_x (struct data_to_fit *dtf, double x, double y)
+reverse_map_x (reverse_map_t *self, double x, double y)
 {
-  // Convenience aliases.
-  size_t sgs = dtf->sparse_grid_size;
-  double *xprojs = dtf->sparse_x_proj;
-  double *yprojs = dtf->sparse_y_proj;
-  double *xpixs = dtf->sparse_x_pix;
-
-  if ( G_UNLIKELY (first_time_through_rmx || y != last_y_rmx) ) {
-    if ( !first_time_through_rmx ) {
-      // Free the spline from the last line.
-      gsl_interp_accel_free (crnt_accel_rmx);
-      gsl_spline_free (crnt_rmx);
-    } else {
-      // Its our first time through, so set up the splines for the
-      // grid point columns.
-      y_accel_rmx = g_new (gsl_interp_accel *, sgs);
-      y_spline_rmx = g_new (gsl_spline *, sgs);
-      size_t ii;
-      for ( ii = 0 ; ii < sgs ; ii++ ) {
-  gsl_vector *cypv = gsl_vector_alloc (sgs);
-  gsl_vector *cxpixv = gsl_vector_alloc (sgs);
-  size_t jj;
-  for ( jj = 0 ; jj < sgs ; jj++ ) {
-    gsl_vector_set (cypv, jj, yprojs[jj * sgs + ii]);
-    gsl_vector_set (cxpixv, jj, xpixs[jj * sgs + ii]);
-  }
-  y_accel_rmx[ii] = gsl_interp_accel_alloc ();
-  y_spline_rmx[ii] = gsl_spline_alloc (gsl_interp_cspline, sgs);
-  gsl_spline_init (y_spline_rmx[ii], cypv->data, cxpixv->data, sgs);
-  gsl_vector_free (cxpixv);
-  gsl_vector_free (cypv);
-      }
-      first_time_through_rmx = FALSE;
-    }
-    // Set up the spline that runs horizontally, between the column
-    // splines.
-    crnt_accel_rmx = gsl_interp_accel_alloc ();
-    crnt_rmx = gsl_spline_alloc (gsl_interp_cspline, sgs);
-    double *crnt_points = g_new (double, sgs);
-    size_t ii;
-    for ( ii = 0 ; ii < sgs ; ii++ ) {
-      crnt_points[ii] = gsl_spline_eval_check (y_spline_rmx[ii], y, y_accel_rmx[ii]);
-    }
-    gsl_spline_init (crnt_rmx, xprojs, crnt_points, sgs);
-    g_free (crnt_points);
-    last_y_rmx = y;
+  if ( G_UNLIKELY (!self->crnt_valid_rmx || y != self->last_y_rmx) ) {
+    set_current_spline (self, self->y_accel_rmx, self->y_spline_rmx,
+                        self->crnt_accel_rmx, self->crnt_rmx, y);
+    self->crnt_valid_rmx = TRUE;
+    self->last_y_rmx = y;
   }
 
-  double ret = gsl_spline_eval_check (crnt_rmx, x, crnt_accel_rmx);
+  double ret = gsl_spline_eval_check (self->crnt_rmx, x, self->crnt_accel_rmx);
 
   if (!meta_is_valid_double(ret)) {
     asfPrintError("reverse_map_x invalid at L,S: %f,%f: %f\n", y,x,ret);
@@ -466,59 +524,18 @@ reverse_map_x (struct data_to_fit *dtf, double x, double y)
 }
 
 // This routine is analagous to reverse_map_x, including the same
-// caveats and confusing behavior.
+// caveats.
 static double
-reverse_map_y (struct data_to_fit *dtf, double x, double y)
+reverse_map_y (reverse_map_t *self, double x, double y)
 {
-  size_t sgs = dtf->sparse_grid_size;
-  double *xprojs = dtf->sparse_x_proj;
-  double *yprojs = dtf->sparse_y_proj;
-  double *ypixs = dtf->sparse_y_pix;
-
-  if ( G_UNLIKELY (first_time_through_rmy || y != last_y_rmy) ) {
-    if ( !first_time_through_rmy ) {
-      // Free the spline from the last line.
-      gsl_interp_accel_free (crnt_accel_rmy);
-      gsl_spline_free (crnt_rmy);
-    } else {
-      // Its our first time through, so set up the splines for the
-      // grid point columns.
-      y_accel_rmy = g_new (gsl_interp_accel *, sgs);
-      y_spline_rmy = g_new (gsl_spline *, sgs);
-      size_t ii;
-      for ( ii = 0 ; ii < sgs ; ii++ ) {
-  // Current y projection value.
-  gsl_vector *cypv = gsl_vector_alloc (sgs);
-  // Current y pixel value.
-  gsl_vector *cypixv = gsl_vector_alloc (sgs);
-  size_t jj;
-  for ( jj = 0 ; jj < sgs ; jj++ ) {
-    gsl_vector_set (cypv, jj, yprojs[jj * sgs + ii]);
-    gsl_vector_set (cypixv, jj, ypixs[jj * sgs + ii]);
-  }
-  y_accel_rmy[ii] = gsl_interp_accel_alloc ();
-  y_spline_rmy[ii] = gsl_spline_alloc (gsl_interp_cspline, sgs);
-  gsl_spline_init (y_spline_rmy[ii], cypv->data, cypixv->data, sgs);
-  gsl_vector_free (cypixv);
-  gsl_vector_free (cypv);
-      }
-      first_time_through_rmy = FALSE;
-    }
-    // Set up the spline that runs horizontally, between the column
-    // splines.
-    crnt_accel_rmy = gsl_interp_accel_alloc ();
-    crnt_rmy = gsl_spline_alloc (gsl_interp_cspline, sgs);
-    double *crnt_points = g_new (double, sgs);
-    size_t ii;
-    for ( ii = 0 ; ii < sgs ; ii++ ) {
-      crnt_points[ii] = gsl_spline_eval_check (y_spline_rmy[ii], y, y_accel_rmy[ii]);
-    }
-    gsl_spline_init (crnt_rmy, xprojs, crnt_points, sgs);
-    g_free (crnt_points);
-    last_y_rmy = y;
+  if ( G_UNLIKELY (!self->crnt_valid_rmy || y != self->last_y_rmy) ) {
+    set_current_spline (self, self->y_accel_rmy, self->y_spline_rmy,
+                        self->crnt_accel_rmy, self->crnt_rmy, y);
+    self->crnt_valid_rmy = TRUE;
+    self->last_y_rmy = y;
   }
 
-  double ret = gsl_spline_eval_check (crnt_rmy, x, crnt_accel_rmy);
+  double ret = gsl_spline_eval_check (self->crnt_rmy, x, self->crnt_accel_rmy);
 
   if (!meta_is_valid_double(ret)) {
     asfPrintError("reverse_map_y invalid at L,S %f,%f: %f\n", y, x, ret);
@@ -527,6 +544,262 @@ reverse_map_y (struct data_to_fit *dtf, double x, double y)
   return ret;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Even with the spline contexts above, every output line costs a
+// spline between splines for x and another for y, and every output
+// pixel two spline evaluations.  The mapping is very smooth over the
+// scale of a few output pixels though, so we evaluate it only at the
+// nodes of a coarse grid over the output image, and bilinearly
+// interpolate between them.  The grid spacing is chosen so that the
+// interpolation error is well below what symmetry_test() tolerates.
+// If no grid that is coarse enough to be worth having meets that
+// bound, we do without one and evaluate the splines at every pixel.
+
+// Largest and smallest grid spacings we try, in output pixels.
+#define REVERSE_MAP_GRID_MAX_STEP 32
+#define REVERSE_MAP_GRID_MIN_STEP 8
+
+// Largest grid we are willing to keep in memory, in bytes.
+#define REVERSE_MAP_GRID_MAX_BYTES (256 * 1024 * 1024)
+
+// We will insist that meta_get_latLon and meta_get_lineSamp are
+// symmetric to within this many pixels after transforming out and
+// back (see symmetry_test()).
+static const double symmetry_threshold = 0.15;
+
+// The reverse mapping grid must reproduce the spline model to within
+// this fraction of symmetry_threshold.
+static const double reverse_map_grid_tolerance = 1.0 / 3.0;
+
+typedef struct {
+  size_t size_x, size_y;        // Output image size.
+  size_t step;                  // Grid spacing, in output pixels.
+  size_t nodes_x, nodes_y;      // Number of grid nodes across and down.
+  double *x_pix, *y_pix;        // Input pixel coordinates at the nodes.
+} reverse_map_grid_t;
+
+// Output pixel index of grid node k, for an image dimension of size.
+static size_t
+grid_node_position (size_t step, size_t size, size_t k)
+{
+  return MIN (k * step, size - 1);
+}
+
+// Evaluate the exact mapping at each node of the grid.
+static void
+reverse_map_grid_fill (reverse_map_grid_t *self, reverse_map_t *rm,
+                       meta_projection *proj)
+{
+  size_t ii, jj;
+  for ( ii = 0 ; ii < self->nodes_y ; ii++ ) {
+    size_t oiy = grid_node_position (self->step, self->size_y, ii);
+    double y = proj->startY + oiy * proj->perY;
+    for ( jj = 0 ; jj < self->nodes_x ; jj++ ) {
+      size_t oix = grid_node_position (self->step, self->size_x, jj);
+      double x = proj->startX + oix * proj->perX;
+      self->x_pix[ii * self->nodes_x + jj] = reverse_map_x (rm, x, y);
+      self->y_pix[ii * self->nodes_x + jj] = reverse_map_y (rm, x, y);
+    }
+  }
+}
+
+// Find the grid cell containing output pixel index oi (along a
+// dimension of size with nodes nodes), and how far across it oi is.
+static void
+grid_cell (size_t step, size_t size, size_t nodes, size_t oi, size_t *k,
+           double *t)
+{
+  if ( nodes < 2 ) {
+    *k = 0;
+    *t = 0.0;
+    return;
+  }
+  *k = MIN (oi / step, nodes - 2);
+  size_t p0 = grid_node_position (step, size, *k);
+  size_t p1 = grid_node_position (step, size, *k + 1);
+  *t = (double) (oi - p0) / (p1 - p0);
+}
+
+// Input pixel coordinates at grid row position ky + ty, node column kx.
+static void
+grid_row_value (const reverse_map_grid_t *self, size_t ky, double ty,
+                size_t kx, double *x_pix, double *y_pix)
+{
+  size_t i0 = ky * self->nodes_x + kx;
+  size_t i1 = ky + 1 < self->nodes_y ? i0 + self->nodes_x : i0;
+  *x_pix = self->x_pix[i0] + ty * (self->x_pix[i1] - self->x_pix[i0]);
+  *y_pix = self->y_pix[i0] + ty * (self->y_pix[i1] - self->y_pix[i0]);
+}
+
+// Interpolated input pixel coordinates of output pixel oix, oiy.
+static void
+reverse_map_grid_pixel (const reverse_map_grid_t *self, size_t oix,
+                        size_t oiy, double *x_pix, double *y_pix)
+{
+  size_t kx, ky;
+  double tx, ty;
+  grid_cell (self->step, self->size_x, self->nodes_x, oix, &kx, &tx);
+  grid_cell (self->step, self->size_y, self->nodes_y, oiy, &ky, &ty);
+
+  double x0, y0, x1, y1;
+  grid_row_value (self, ky, ty, kx, &x0, &y0);
+  if ( self->nodes_x < 2 ) {
+    *x_pix = x0;
+    *y_pix = y0;
+    return;
+  }
+  grid_row_value (self, ky, ty, kx + 1, &x1, &y1);
+  *x_pix = x0 + tx * (x1 - x0);
+  *y_pix = y0 + tx * (y1 - y0);
+}
+
+// Largest difference between the grid and the exact mapping, checked
+// at the center of each grid cell, where bilinear interpolation is
+// worst.
+static double
+reverse_map_grid_error (const reverse_map_grid_t *self, reverse_map_t *rm,
+                        meta_projection *proj)
+{
+  double largest_error = 0.0;
+  size_t ii, jj;
+  for ( ii = 0 ; ii < MAX (self->nodes_y - 1, 1) ; ii++ ) {
+    size_t y0 = grid_node_position (self->step, self->size_y, ii);
+    size_t y1 = grid_node_position (self->step, self->size_y, ii + 1);
+    size_t oiy = (y0 + y1) / 2;
+    double y = proj->startY + oiy * proj->perY;
+    for ( jj = 0 ; jj < MAX (self->nodes_x - 1, 1) ; jj++ ) {
+      size_t x0 = grid_node_position (self->step, self->size_x, jj);
+      size_t x1 = grid_node_position (self->step, self->size_x, jj + 1);
+      size_t oix = (x0 + x1) / 2;
+      double x = proj->startX + oix * proj->perX;
+      double x_pix, y_pix;
+      reverse_map_grid_pixel (self, oix, oiy, &x_pix, &y_pix);
+      double x_error = x_pix - reverse_map_x (rm, x, y);
+      double y_error = y_pix - reverse_map_y (rm, x, y);
+      double error = sqrt (x_error * x_error + y_error * y_error);
+      if ( error > largest_error ) {
+        largest_error = error;
+      }
+    }
+  }
+
+  return largest_error;
+}
+
+// Number of bytes taken by the nodes of a grid with spacing step over
+// a size_x by size_y output image.
+static size_t
+reverse_map_grid_bytes (size_t step, size_t size_x, size_t size_y)
+{
+  size_t nodes_x = (size_x - 1 + step - 1) / step + 1;
+  size_t nodes_y = (size_y - 1 + step - 1) / step + 1;
+  return 2 * sizeof (double) * nodes_x * nodes_y;
+}
+
+// Create the reverse mapping grid for the size_x by size_y output
+// image with projection proj, using the spline model in rm.  The
+// spacing is halved until the grid is within tolerance of the model
+// everywhere we check.  Returns NULL if that doesn't happen before
+// the spacing gets down to REVERSE_MAP_GRID_MIN_STEP or the grid
+// would take more than REVERSE_MAP_GRID_MAX_BYTES, in which case the
+// spline model has to be used directly.
+static reverse_map_grid_t *
+reverse_map_grid_new (reverse_map_t *rm, meta_projection *proj,
+                      size_t size_x, size_t size_y)
+{
+  reverse_map_grid_t *self = g_new0 (reverse_map_grid_t, 1);
+  double max_error = reverse_map_grid_tolerance * symmetry_threshold;
+  double error;
+
+  g_assert (size_x > 0 && size_y > 0);
+
+  self->size_x = size_x;
+  self->size_y = size_y;
+  self->step = REVERSE_MAP_GRID_MAX_STEP;
+  for ( ; ; ) {
+    self->nodes_x = (size_x - 1 + self->step - 1) / self->step + 1;
+    self->nodes_y = (size_y - 1 + self->step - 1) / self->step + 1;
+    self->x_pix = g_new (double, self->nodes_x * self->nodes_y);
+    self->y_pix = g_new (double, self->nodes_x * self->nodes_y);
+    reverse_map_grid_fill (self, rm, proj);
+    error = reverse_map_grid_error (self, rm, proj);
+    if ( error <= max_error ) {
+      break;
+    }
+    g_free (self->x_pix);
+    g_free (self->y_pix);
+    if ( self->step / 2 < REVERSE_MAP_GRID_MIN_STEP
+         || (reverse_map_grid_bytes (self->step / 2, size_x, size_y)
+             > REVERSE_MAP_GRID_MAX_BYTES) ) {
+      asfPrintWarning ("Reverse mapping grid with %d pixel spacing is off "
+                       "by up to %g pixels,\nmore than the %g pixels "
+                       "allowed.  Evaluating the mapping at every pixel "
+                       "instead,\nwhich will be slower.\n",
+                       (int) self->step, error, max_error);
+      g_free (self);
+      return NULL;
+    }
+    self->step /= 2;
+  }
+
+  asfPrintStatus ("Reverse mapping grid spacing: %d pixels, largest "
+                  "interpolation error %g pixels\n", (int) self->step, error);
+
+  return self;
+}
+
+static void
+reverse_map_grid_free (reverse_map_grid_t *self)
+{
+  if ( self == NULL ) {
+    return;
+  }
+  g_free (self->x_pix);
+  g_free (self->y_pix);
+  g_free (self);
+}
+
+// Interpolated input pixel coordinates of every pixel of output line
+// oiy, stored in x_pix and y_pix.  Each grid cell is filled by a
+// simple linear ramp, which the compiler can vectorize.
+static void
+reverse_map_grid_line (const reverse_map_grid_t *self, size_t oiy,
+                       double *x_pix, double *y_pix)
+{
+  size_t ky;
+  double ty;
+  grid_cell (self->step, self->size_y, self->nodes_y, oiy, &ky, &ty);
+
+  double xa, ya, xb, yb;
+  grid_row_value (self, ky, ty, 0, &xa, &ya);
+  if ( self->nodes_x < 2 ) {
+    x_pix[0] = xa;
+    y_pix[0] = ya;
+    return;
+  }
+
+  size_t kx;
+  for ( kx = 0 ; kx < self->nodes_x - 1 ; kx++ ) {
+    size_t x0 = grid_node_position (self->step, self->size_x, kx);
+    size_t x1 = grid_node_position (self->step, self->size_x, kx + 1);
+    grid_row_value (self, ky, ty, kx + 1, &xb, &yb);
+    double dx = (xb - xa) / (x1 - x0);
+    double dy = (yb - ya) / (x1 - x0);
+    double *xp = x_pix + x0, *yp = y_pix + x0;
+    size_t n = x1 - x0, ii;
+    for ( ii = 0 ; ii < n ; ii++ ) {
+      xp[ii] = xa + ii * dx;
+      yp[ii] = ya + ii * dy;
+    }
+    xa = xb;
+    ya = yb;
+  }
+  // The last node is the last pixel.
+  x_pix[self->size_x - 1] = xa;
+  y_pix[self->size_x - 1] = ya;
+}
+
 static void determine_projection_fns(int projection_type, project_t **project,
                                      project_arr_t **project_arr, unproject_t **unproject,
                                      unproject_arr_t **unproject_arr)
@@ -793,6 +1066,20 @@ int asf_geocode(project_parameters_t *pp, projection_type_t projection_type,
   return ret;
 }
 
+// Number of threads used to resample each band, see
+// asf_geocode_set_thread_count().
+static int geocode_thread_count = 1;
+
+void asf_geocode_set_thread_count(int count)
+{
+  geocode_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+int asf_geocode_get_thread_count()
+{
+  return geocode_thread_count;
+}
+
 int asf_geocode_ext(project_parameters_t *pp, projection_type_t projection_type,
                     int force_flag, resample_method_t resample_method,
                     double average_height, datum_type_t datum, double pixel_size,
@@ -829,9 +1116,7 @@ static int symmetry_test(meta_parameters *imd, double stpx, double stpy,
   ret2 = meta_get_lineSamp (imd, st_lat, st_lon, average_height,
                             &stry, &strx);
 
-  // We will insist that the results are symmetric to within this
-  // fraction after transforming out and back.
-  const double sym_th = 0.15;    // Symmetry threshold (pixels)
+  const double sym_th = symmetry_threshold;  // Convenience alias.
   if (ret1 || ret2) {
     asfPrintWarning("Symmetry test failed! %s %s.\n",
                     ret1 ? "meta_get_latLon returned error" : "",
@@ -857,6 +1142,450 @@ static int symmetry_test(meta_parameters *imd, double stpx, double stpy,
   return ok;
 }
 
+// Here are some convenience macros for the spline model.
+#define X_PIXEL(x, y) reverse_map_x (rm, x, y)
+#define Y_PIXEL(x, y) reverse_map_y (rm, x, y)
+
+// Everything needed to resample the output lines of one band of one
+// input image.  Shared read-only between the threads doing it.
+typedef struct {
+  const reverse_map_grid_t *grid; // Reverse mapping for the image.
+  reverse_map_t *rm;            // Spline model, used if grid is NULL.
+  meta_parameters *imd, *omd;   // Input and output metadata.
+  size_t ii_size_x, ii_size_y;  // Input image size.
+  size_t oix_max, oiy_max;      // Output image size.
+  // Input image, only one of these is non-NULL.
+  FloatImage *iim;
+  UInt8Image *iim_b;
+  float_image_sample_method_t float_image_sample_method;
+  uint8_image_sample_method_t uint8_image_sample_method;
+  int first_image;              // True iff this is the first input image.
+  int band;                     // Band of output_bfi being set.
+  float background_val;
+  overlap_method_t overlap;
+  BandedFloatImage *output_bfi; // Mosaic output, NULL for line output.
+  UInt8Image *tbi;              // Overlap counts, for AVG_OVERLAP.
+} geocode_band_t;
+
+// Resample output line oiy.  If output_line is non-NULL the line is
+// stored there, otherwise it goes into gb->output_bfi.  If line_out
+// and samp_out are non-NULL, they get the input line and sample
+// mapped to each output pixel.  projX, projY, input_x_pixels and
+// input_y_pixels are scratch space for oix_max projection and input
+// pixel coordinates.  Values clipped to the byte range are counted in
+// out_of_range_negative and out_of_range_positive.
+static void
+geocode_line (const geocode_band_t *gb, size_t oiy,
+              float *output_line, float *line_out, float *samp_out,
+              double *projX, double *projY,
+              double *input_x_pixels, double *input_y_pixels,
+              unsigned long *out_of_range_negative,
+              unsigned long *out_of_range_positive)
+{
+  // Convenience aliases.
+  meta_parameters *imd = gb->imd, *omd = gb->omd;
+  size_t ii_size_x = gb->ii_size_x, ii_size_y = gb->ii_size_y;
+  size_t oix_max = gb->oix_max;
+  int output_by_line = output_line != NULL;
+  BandedFloatImage *output_bfi = gb->output_bfi;
+  int kk = gb->band;
+  overlap_method_t overlap = gb->overlap;
+
+  int oix_first_valid = -1;
+  int oix_last_valid = -1;
+
+  // Determine pixels of interest in input image.  The fractional
+  // part is desired, we will use some sampling method to interpolate
+  // between pixel values.
+  reverse_map_t *rm = gb->rm;
+  if (gb->grid)
+    reverse_map_grid_line (gb->grid, oiy, input_x_pixels, input_y_pixels);
+
+  size_t oix;
+  for ( oix = 0 ; oix < oix_max ; oix++ ) {
+
+    // Projection coordinates for the center of this pixel.
+    double oix_pc = omd->projection->startX + oix * omd->projection->perX;
+    double oiy_pc = omd->projection->startY + oiy * omd->projection->perY;
+
+    projX[oix] = oix_pc;
+    projY[oix] = oiy_pc;
+
+    if (!gb->grid) {
+      input_x_pixels[oix] = X_PIXEL (oix_pc, oiy_pc);
+      input_y_pixels[oix] = Y_PIXEL (oix_pc, oiy_pc);
+    }
+
+    double input_x_pixel = input_x_pixels[oix];
+    double input_y_pixel = input_y_pixels[oix];
+
+    if (line_out) {
+      if (input_y_pixel < 0 || input_x_pixel < 0)
+        line_out[oix] = 0;
+      else if (input_y_pixel > (ssize_t) ii_size_y - 1.0 ||
+               input_x_pixel > (ssize_t) ii_size_x - 1.0)
+        line_out[oix] = 0;
+      else
+        line_out[oix] = input_y_pixel;
+    }
+
+    if (samp_out) {
+      if (input_y_pixel < 0 || input_x_pixel < 0)
+        samp_out[oix] = 0;
+      else if (input_y_pixel > (ssize_t) ii_size_y - 1.0 ||
+               input_x_pixel > (ssize_t) ii_size_x - 1.0)
+        samp_out[oix] = 0;
+      else
+        samp_out[oix] = input_x_pixel;
+    }
+
+    g_assert (ii_size_x <= SSIZE_MAX);
+    g_assert (ii_size_y <= SSIZE_MAX);
+
+    float value, ref_value, power;
+
+    // If we are outside the extent of the input image, set to the
+    // fill value.  We do this only on the first image -- subsequent
+    // images will work out the overlap with real data.
+    if (input_x_pixel < 0 ||
+        input_x_pixel > (ssize_t) ii_size_x - 1.0 ||
+        input_y_pixel < 0 ||
+        input_y_pixel > (ssize_t) ii_size_y - 1.0 ) {
+      if (gb->first_image) {
+        if (output_by_line)
+          output_line[oix] = gb->background_val;
+        else
+          banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
+                                       gb->background_val);
+      }
+    }
+    // Otherwise, set to the value from the appropriate position in
+    // the input image.
+    else {
+      if (gb->iim_b) {
+        value =
+          uint8_image_sample(gb->iim_b, input_x_pixel, input_y_pixel,
+                             gb->uint8_image_sample_method);
+      }
+      else if ( imd->general->image_data_type == DEM ) {
+        value = dem_sample(gb->iim, input_x_pixel, input_y_pixel,
+                           gb->float_image_sample_method);
+      }
+      else {
+        if (imd->general->radiometry >= r_SIGMA_DB &&
+            imd->general->radiometry <= r_GAMMA_DB) {
+          power =
+            float_image_sample(gb->iim, input_x_pixel, input_y_pixel,
+                               gb->float_image_sample_method);
+          value = 10.0 * log10(power);
+        }
+        else
+          value =
+            float_image_sample(gb->iim, input_x_pixel, input_y_pixel,
+                               gb->float_image_sample_method);
+
+        if (omd->general->data_type == ASF_BYTE && value < 0.0) {
+          value = 0.0;
+          (*out_of_range_negative)++;
+        }
+        if (omd->general->data_type == ASF_BYTE && value > 255.0) {
+          value = 255.0;
+          (*out_of_range_positive)++;
+        }
+      }
+
+      // Now we are ready to put the pixel value into the output image
+      if (!gb->first_image && imd->general->image_data_type == DEM &&
+          (value == 0 || value < -900)) {
+        // Special case for DEMs -- we don't want to overwrite
+        // "good" elevations with 0s, or "no data" values
+        // (<-900 means "no data" for DEMs)
+        // So, in this situation, we don't do anything
+        ;
+      }
+      else if (meta_is_valid_double(imd->general->no_data) &&
+               value == imd->general->no_data) {
+        // pixel is the "no data" value -- only the first image
+        // will set this in the output image, otherwise we risk
+        // overwriting real data with background.
+        if (gb->first_image) {
+          if (output_by_line)
+            output_line[oix] = value;
+          else {
+            banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
+                                         value);
+            //uint8_image_set_pixel(tbi, oix, oiy, 1);
+          }
+        }
+      }
+      else {
+        // Normal case, set the output pixel value
+        oix_last_valid = oix;
+        if (oix_first_valid == -1) oix_first_valid = oix;
+
+        // FIXME: AVERAGE and NEAR RANGE overlap need some work
+        // Have to track some values in a second image
+
+        // Overlap option: OVERLAY
+        // No action needed, just overwrite previous value
+
+        // New images are intialized with zeros (at least float_image
+        // does that). So we need to check for that when looking for
+        // values.
+        if (output_by_line) {
+          output_line[oix] = value;
+        }
+        else {
+          ref_value =
+            banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
+          if (overlap == MIN_OVERLAP && ref_value != 0 &&
+              ref_value < value) {
+            value = ref_value;
+          }
+          else if (overlap == MAX_OVERLAP && ref_value != 0 &&
+                   ref_value > value) {
+            value = ref_value;
+          }
+          else if (overlap == AVG_OVERLAP) {
+            value += ref_value;
+            uint8_t byte_value = uint8_image_get_pixel(gb->tbi, oix, oiy);
+            if (value != 0.0) {
+              byte_value++;
+            }
+            uint8_image_set_pixel(gb->tbi, oix, oiy, byte_value);
+          }
+          banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
+                                       value);
+        }
+      }
+    }
+  } // end of for-each-sample-in-line set output values
+
+  /* Removing all of this -- we will make the user do the geoid
+   * correction themselves since we can't reliably tell if has
+   * been done or not
+   * KH 8/21/14
+   *
+  // If we are reprojecting a DEM, need to account for the height
+  // difference between the vertical datum (NGVD27) and our WGS84
+  // ellipsoid. Since geoid heights closely match vertical datum
+  // heights, this will work for SAR imagery
+  if (imd->general->image_data_type == DEM ) {
+
+    // At present, don't handle byte DEMs.  Don't think such a thing
+    // is even possible, really.
+    g_assert(gb->iim && !gb->iim_b);
+
+    double *lat, *lon;
+    lat = lon = NULL; // => libproj will allocate for us
+
+    // Need to get each pixel's location in lat/lon in order to get
+    // the geoid height.  We saved each pixel's projection coordinates,
+    // above, so we just to need to convert those, then use the
+    // lat/lon values to get the required geoid height correction,
+    // add it to the height at the pixel.
+
+    // Doing it like this (instead of pixel-by-pixel) allows us to
+    // use the array version of libproj, which is *much* faster.
+
+    unproject_arr(pp, projX, projY, NULL, &lat, &lon, NULL,
+                  oix_max + 1, datum);
+
+    // the outer if guards against the case where no valid pixels
+    // were on this line (i.e., both are -1)
+    if (oix_first_valid > 0 && oix_last_valid > 0) {
+      if (output_by_line) {
+        for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
+          output_line[oix] +=
+            get_geoid_height(lat[oix]*R2D, lon[oix]*R2D);
+        }
+      }
+      else {
+        for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
+          float value = banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
+          banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
+                   value + get_geoid_height(lat[oix]*R2D, lon[oix]*R2D));
+        }
+      }
+    }
+
+    free(lat);
+    free(lon);
+  }
+  */
+}
+
+// Lines handed out to, and collected from, the threads resampling the
+// lines of one band.  Lines are resampled in any order into a window
+// of line buffers, and written out in order as they become ready.
+typedef struct {
+  const geocode_band_t *gb;
+  GMutex *lock;                 // Guards everything below.
+  GCond *line_done;             // Signalled when a line is resampled.
+  GCond *slot_free;             // Signalled when a line is written.
+  size_t next_line;             // Next output line to hand out.
+  size_t lines_written;         // Number of lines written so far.
+  size_t window;                // Number of line buffers.
+  gboolean *done;               // Per buffer, line ready to be written.
+  float **lines;                // Line buffers.
+  float **line_outs, **samp_outs; // Mapping buffers, or NULL.
+  unsigned long out_of_range_negative;
+  unsigned long out_of_range_positive;
+} geocode_line_queue_t;
+
+static gpointer
+geocode_line_worker (gpointer data)
+{
+  geocode_line_queue_t *q = data;
+
+  // Without a mapping grid, each thread evaluates the spline model
+  // with a context of its own, since the model keeps state between
+  // calls.
+  geocode_band_t thread_gb = *q->gb;
+  const geocode_band_t *gb = &thread_gb;
+  if ( !gb->grid ) {
+    thread_gb.rm = reverse_map_new (q->gb->rm->dtf);
+  }
+
+  // Each thread needs its own scratch space.
+  double *projX = g_new (double, gb->oix_max);
+  double *projY = g_new (double, gb->oix_max);
+  double *input_x_pixels = g_new (double, gb->oix_max);
+  double *input_y_pixels = g_new (double, gb->oix_max);
+  unsigned long out_of_range_negative = 0, out_of_range_positive = 0;
+
+  g_mutex_lock (q->lock);
+  for ( ; ; ) {
+    // Wait for a free line buffer, unless we are done.
+    while ( q->next_line < gb->oiy_max
+            && q->next_line >= q->lines_written + q->window ) {
+      g_cond_wait (q->slot_free, q->lock);
+    }
+    if ( q->next_line >= gb->oiy_max ) {
+      break;
+    }
+    size_t oiy = q->next_line++;
+    size_t slot = oiy % q->window;
+    g_mutex_unlock (q->lock);
+
+    geocode_line (gb, oiy, q->lines[slot],
+                  q->line_outs ? q->line_outs[slot] : NULL,
+                  q->samp_outs ? q->samp_outs[slot] : NULL,
+                  projX, projY, input_x_pixels, input_y_pixels,
+                  &out_of_range_negative, &out_of_range_positive);
+
+    g_mutex_lock (q->lock);
+    q->done[slot] = TRUE;
+    g_cond_broadcast (q->line_done);
+  }
+  q->out_of_range_negative += out_of_range_negative;
+  q->out_of_range_positive += out_of_range_positive;
+  g_mutex_unlock (q->lock);
+
+  g_free (input_y_pixels);
+  g_free (input_x_pixels);
+  g_free (projY);
+  g_free (projX);
+  if ( !gb->grid ) {
+    reverse_map_free (thread_gb.rm);
+  }
+
+  return NULL;
+}
+
+// Resample all the output lines of one band using thread_count
+// threads, writing them to outFp (and the line and sample mappings to
+// outLineFp and outSampFp, if they are non-NULL) in order.  The output
+// is identical to that of calling geocode_line for each line in turn.
+static void
+geocode_lines_threaded (const geocode_band_t *gb, int thread_count,
+                        FILE *outFp, FILE *outLineFp, FILE *outSampFp,
+                        unsigned long *out_of_range_negative,
+                        unsigned long *out_of_range_positive)
+{
+  geocode_line_queue_t q;
+  size_t ii;
+
+  asf_thread_init ();
+
+  q.gb = gb;
+  q.lock = asf_mutex_new ();
+  q.line_done = asf_cond_new ();
+  q.slot_free = asf_cond_new ();
+  q.next_line = 0;
+  q.lines_written = 0;
+  // A few buffers per thread, so threads don't sit idle waiting for
+  // a slow line to be written.
+  q.window = 4 * thread_count;
+  q.done = g_new0 (gboolean, q.window);
+  q.lines = g_new (float *, q.window);
+  q.line_outs = outLineFp ? g_new (float *, q.window) : NULL;
+  q.samp_outs = outSampFp ? g_new (float *, q.window) : NULL;
+  for ( ii = 0 ; ii < q.window ; ii++ ) {
+    q.lines[ii] = g_new (float, gb->oix_max);
+    if ( q.line_outs ) q.line_outs[ii] = g_new (float, gb->oix_max);
+    if ( q.samp_outs ) q.samp_outs[ii] = g_new (float, gb->oix_max);
+  }
+  q.out_of_range_negative = 0;
+  q.out_of_range_positive = 0;
+
+  GThread **threads = g_new (GThread *, thread_count);
+  int tt;
+  for ( tt = 0 ; tt < thread_count ; tt++ ) {
+    threads[tt] = asf_thread_new ("asf_geocode", geocode_line_worker, &q);
+    if ( threads[tt] == NULL ) {
+      asfPrintError ("Failed to create geocoding thread\n");
+    }
+  }
+
+  // Write the lines out in order as they are finished.
+  size_t oiy;
+  for ( oiy = 0 ; oiy < gb->oiy_max ; oiy++ ) {
+    size_t slot = oiy % q.window;
+
+    asfLineMeter(oiy, gb->oiy_max);
+
+    g_mutex_lock (q.lock);
+    while ( !q.done[slot] ) {
+      g_cond_wait (q.line_done, q.lock);
+    }
+    g_mutex_unlock (q.lock);
+
+    put_float_line(outFp, gb->omd, oiy, q.lines[slot]);
+    if (outLineFp)
+      put_float_line(outLineFp, gb->omd, oiy, q.line_outs[slot]);
+    if (outSampFp)
+      put_float_line(outSampFp, gb->omd, oiy, q.samp_outs[slot]);
+
+    g_mutex_lock (q.lock);
+    q.done[slot] = FALSE;
+    q.lines_written++;
+    g_cond_broadcast (q.slot_free);
+    g_mutex_unlock (q.lock);
+  }
+
+  for ( tt = 0 ; tt < thread_count ; tt++ ) {
+    g_thread_join (threads[tt]);
+  }
+  g_free (threads);
+
+  *out_of_range_negative += q.out_of_range_negative;
+  *out_of_range_positive += q.out_of_range_positive;
+
+  for ( ii = 0 ; ii < q.window ; ii++ ) {
+    g_free (q.lines[ii]);
+    if ( q.line_outs ) g_free (q.line_outs[ii]);
+    if ( q.samp_outs ) g_free (q.samp_outs[ii]);
+  }
+  g_free (q.samp_outs);
+  g_free (q.line_outs);
+  g_free (q.lines);
+  g_free (q.done);
+  asf_cond_free (q.slot_free);
+  asf_cond_free (q.line_done);
+  asf_mutex_free (q.lock);
+}
+
 int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                int force_flag, resample_method_t resample_method,
                double average_height, datum_type_t datum, 
@@ -1554,6 +2283,7 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
   // and add the geocoding parameters.
   meta_parameters *omd = meta_read (in_base_names[ref_input]);
   g_assert(omd->general->band_count == n_bands);
+  omd->general->byte_order = meta_get_output_byte_order();
   if (omd->stats != NULL) {
     // Geocoding results in resampling.  Consequently, the stats info
     // that may have existed in the metadata is no longer accurate.
@@ -1712,6 +2442,8 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 
   double *projX = MALLOC(sizeof(double)*oix_max);
   double *projY = MALLOC(sizeof(double)*oix_max);
+  double *input_x_pixels = MALLOC(sizeof(double)*oix_max);
+  double *input_y_pixels = MALLOC(sizeof(double)*oix_max);
 
   // When mosaicing -- use banded_float_image to store the output, write
   //                   it out after processing all inputs
@@ -1939,6 +2671,9 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
       size_t current_mapping = 0;
       size_t current_sparse_mapping = 0;
       size_t ii;
+      // The orbit set up once for all the grid points, rather than on
+      // every meta_get_lineSamp call.
+      meta_geo_context *geo = input_projected ? NULL : meta_geo_context_new (imd);
       
       for ( ii = 0 ; ii < grid_size ; ii++ ) {
         size_t jj;
@@ -1992,7 +2727,7 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 						//printf("%zu,%zu: %f %f -> %f %f\n", ii, jj, lat, lon, x_pix, y_pix); 
 					}
 					else {
-						ret = meta_get_lineSamp (imd, lat, lon, average_height,
+						ret = meta_get_lineSamp_arr (geo, 1, &lat, &lon, &average_height,
 									 &y_pix, &x_pix);
 						//printf("lat: %f, lon: %f, x_pix: %f, y_pix: %f\n", 
 						//	lat, lon, x_pix, y_pix);
@@ -2028,10 +2763,10 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 					asfPercentMeter((float)current_mapping / (float)(grid_size*grid_size));
         }
       }
+      meta_geo_context_free (geo);
       
-      // Here are some convenience macros for the spline model.
-#define X_PIXEL(x, y) reverse_map_x (&dtf, x, y)
-#define Y_PIXEL(x, y) reverse_map_y (&dtf, x, y)
+      // Spline model state for the X_PIXEL and Y_PIXEL macros.
+      reverse_map_t *rm = reverse_map_new (&dtf);
       
       // We want to choke if our worst point in the model is off by this
       // many pixels or more.
@@ -2285,6 +3020,13 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
         }
       }
       
+      // Tabulate the mapping over the output image, so it is cheap to
+      // apply to each band.  This gives NULL if the mapping is too
+      // irregular to tabulate, and then the spline model is used
+      // directly.
+      reverse_map_grid_t *grid =
+        reverse_map_grid_new (rm, omd->projection, oix_max, oiy_max);
+
       // Now the mapping function is calculated and we can apply that to
       // all the bands in the file (or to the single band selected with
       // the -band option)
@@ -2368,236 +3110,60 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 					else
 						g_assert(!outFp && !output_line && output_bfi);
 		
-					// Set the pixels of the output image.
-					size_t oix, oiy;    // Output image pixel indicies.
-					for (oiy = 0 ; oiy < oiy_max ; oiy++) {
-			
-						asfLineMeter(oiy, oiy_max);
-			
-						int oix_first_valid = -1;
-						int oix_last_valid = -1;
-			
-						for ( oix = 0 ; oix < oix_max ; oix++ ) {
-
-							// Projection coordinates for the center of this pixel.
-										double oix_pc = omd->projection->startX + oix * omd->projection->perX;
-										double oiy_pc = omd->projection->startY + oiy * omd->projection->perY;
-
-							projX[oix] = oix_pc;
-							projY[oix] = oiy_pc;
-				
-							// Determine pixel of interest in input image.  The fractional
-							// part is desired, we will use some sampling method to
-							// interpolate between pixel values.
-							double input_x_pixel = X_PIXEL (oix_pc, oiy_pc);
-							double input_y_pixel = Y_PIXEL (oix_pc, oiy_pc);
-	
-							if (line_out) {
-								if (input_y_pixel < 0 || input_x_pixel < 0)
-									line_out[oix] = 0;
-								else if (input_y_pixel > (ssize_t) ii_size_y - 1.0 ||
-												 input_x_pixel > (ssize_t) ii_size_x - 1.0)
-									line_out[oix] = 0;
-								else
-									line_out[oix] = input_y_pixel;
-							}
-				
-							if (samp_out) {
-								if (input_y_pixel < 0 || input_x_pixel < 0)
-									samp_out[oix] = 0;
-								else if (input_y_pixel > (ssize_t) ii_size_y - 1.0 ||
-												 input_x_pixel > (ssize_t) ii_size_x - 1.0)
-									samp_out[oix] = 0;
-								else
-									samp_out[oix] = input_x_pixel;
-							}
-				
-							g_assert (ii_size_x <= SSIZE_MAX);
-							g_assert (ii_size_y <= SSIZE_MAX);
-				
-							float value, ref_value, power;
-				
-							// If we are outside the extent of the input image, set to the
-							// fill value.  We do this only on the first image -- subsequent
-							// images will work out the overlap with real data.
-							if (input_x_pixel < 0 || 
-									input_x_pixel > (ssize_t) ii_size_x - 1.0 || 
-									input_y_pixel < 0 || 
-									input_y_pixel > (ssize_t) ii_size_y - 1.0 ) {
-								if (i == 0) { // first image
-									if (output_by_line)
-										output_line[oix] = background_val;
-									else
-										banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
-												 background_val);
-								}
-							}
-							// Otherwise, set to the value from the appropriate position in
-							// the input image.
-							else {
-					if (process_as_byte) {
-						value = 
-							uint8_image_sample(iim_b, input_x_pixel, input_y_pixel,
-										 uint8_image_sample_method);
-					}
-					else if ( imd->general->image_data_type == DEM ) {
-						value = dem_sample(iim, input_x_pixel, input_y_pixel,
-									 float_image_sample_method);
+					// Set up what geocode_line needs to resample this band.
+					geocode_band_t gb;
+					gb.grid = grid;
+					gb.rm = rm;
+					gb.imd = imd;
+					gb.omd = omd;
+					gb.ii_size_x = ii_size_x;
+					gb.ii_size_y = ii_size_y;
+					gb.oix_max = oix_max;
+					gb.oiy_max = oiy_max;
+					gb.iim = iim;
+					gb.iim_b = iim_b;
+					gb.float_image_sample_method = float_image_sample_method;
+					gb.uint8_image_sample_method = uint8_image_sample_method;
+					gb.first_image = i == 0;
+					gb.band = kk;
+					gb.background_val = background_val;
+					gb.overlap = overlap;
+					gb.output_bfi = output_bfi;
+					gb.tbi = tbi;
+
+					// Set the pixels of the output image.  Lines written straight
+					// to the output file can be done by several threads at once;
+					// mosaics and images processed as byte (whose tile cache is
+					// not thread safe) are done a line at a time.
+					int thread_count = asf_geocode_get_thread_count();
+					if (output_by_line && !process_as_byte && thread_count > 1) {
+						asfPrintStatus("Using %d threads.\n", thread_count);
+						geocode_lines_threaded(&gb, thread_count, outFp, outLineFp,
+														 outSampFp, &out_of_range_negative,
+														 &out_of_range_positive);
 					}
 					else {
-						if (imd->general->radiometry >= r_SIGMA_DB &&
-								imd->general->radiometry <= r_GAMMA_DB) {
-							power = 
-								float_image_sample(iim, input_x_pixel, input_y_pixel,
-								 float_image_sample_method);
-							value = 10.0 * log10(power);
-						}
-						else
-							value = 
-								float_image_sample(iim, input_x_pixel, input_y_pixel,
-								 float_image_sample_method);		
-			
-						if (omd->general->data_type == ASF_BYTE && value < 0.0) {
-							value = 0.0;
-							out_of_range_negative++;
-						}
-						if (omd->general->data_type == ASF_BYTE && value > 255.0) {
-							value = 255.0;
-							out_of_range_positive++;
-						}
-					}
-		
-					// Now we are ready to put the pixel value into the output image
-					if (i > 0 && imd->general->image_data_type == DEM &&
-							(value == 0 || value < -900)) {
-						// Special case for DEMs -- we don't want to overwrite
-						// "good" elevations with 0s, or "no data" values
-						// (<-900 means "no data" for DEMs)
-						// So, in this situation, we don't do anything
-						;
-					}
-					else if (meta_is_valid_double(imd->general->no_data) &&
-						 value == imd->general->no_data) {
-						// pixel is the "no data" value -- only the first image
-						// will set this in the output image, otherwise we risk
-						// overwriting real data with background.
-						if (i==0) {
+						size_t oiy;    // Output image line index.
+						for (oiy = 0 ; oiy < oiy_max ; oiy++) {
+
+							asfLineMeter(oiy, oiy_max);
+
+							geocode_line(&gb, oiy, output_line, line_out, samp_out,
+													 projX, projY, input_x_pixels, input_y_pixels,
+													 &out_of_range_negative,
+													 &out_of_range_positive);
+
+							// write the line, if we're doing line-by-line output
 							if (output_by_line)
-								output_line[oix] = value;
-							else {
-								banded_float_image_set_pixel(output_bfi, kk, oix, oiy, 
-										 value);
-								//uint8_image_set_pixel(tbi, oix, oiy, 1);
-							}
-						}
-					}
-					else {
-						// Normal case, set the output pixel value
-						oix_last_valid = oix;
-						if (oix_first_valid == -1) oix_first_valid = oix;
-			
-						// FIXME: AVERAGE and NEAR RANGE overlap need some work
-						// Have to track some values in a second image
-			
-						// Overlap option: OVERLAY
-						// No action needed, just overwrite previous value
-			
-						// New images are intialized with zeros (at least float_image
-						// does that). So we need to check for that when looking for
-						// values.
-						if (output_by_line) {
-							output_line[oix] = value;
-						}
-						else {
-													ref_value = 
-								banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
-													if (overlap == MIN_OVERLAP && ref_value != 0 && 
-						ref_value < value) {
-								value = ref_value;
-													}
-													else if (overlap == MAX_OVERLAP && ref_value != 0 && 
-								 ref_value > value) {
-								value = ref_value;
-													}
-													else if (overlap == AVG_OVERLAP) {
-								value += ref_value;
-								uint8_t byte_value = uint8_image_get_pixel(tbi, oix, oiy);
-								if (value != 0.0) {
-						byte_value++;
-								}
-								uint8_image_set_pixel(tbi, oix, oiy, byte_value);
-													}
-													banded_float_image_set_pixel(output_bfi, kk, oix, oiy, 
-									 value);
-						}
-					}
-	      }
-	    } // end of for-each-sample-in-line set output values
-	    
-	    /* Removing all of this -- we will make the user do the geoid
-             * correction themselves since we can't reliably tell if has
-             * been done or not
-             * KH 8/21/14
-             *
-	    // If we are reprojecting a DEM, need to account for the height
-	    // difference between the vertical datum (NGVD27) and our WGS84
-	    // ellipsoid. Since geoid heights closely match vertical datum
-	    // heights, this will work for SAR imagery
-	    if (imd->general->image_data_type == DEM ) {
-	      
-	      // At present, don't handle byte DEMs.  Don't think such a thing
-	      // is even possible, really.
-	      g_assert(iim && !iim_b);
-	      
-	      double *lat, *lon;
-	      lat = lon = NULL; // => libproj will allocate for us
-	      
-	      // Need to get each pixel's location in lat/lon in order to get
-	      // the geoid height.  We saved each pixel's projection coordinates,
-	      // above, so we just to need to convert those, then use the
-	      // lat/lon values to get the required geoid height correction,
-	      // add it to the height at the pixel.
-	      
-	      // Doing it like this (instead of pixel-by-pixel) allows us to
-	      // use the array version of libproj, which is *much* faster.
-	      
-	      unproject_arr(pp, projX, projY, NULL, &lat, &lon, NULL,
-			    oix_max + 1, datum);
-	      
-	      // the outer if guards against the case where no valid pixels
-	      // were on this line (i.e., both are -1)
-	      if (oix_first_valid > 0 && oix_last_valid > 0) {
-					if (output_by_line) {
-						for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
-							output_line[oix] +=
-								get_geoid_height(lat[oix]*R2D, lon[oix]*R2D);
-						}
-					}
-					else {
-						for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
-							float value = banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
-							banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
-									 value + get_geoid_height(lat[oix]*R2D, lon[oix]*R2D));
-						}
+								put_float_line(outFp, omd, oiy, output_line);
+
+							if (line_out)
+								put_float_line(outLineFp, omd, oiy, line_out);
+							if (samp_out)
+								put_float_line(outSampFp, omd, oiy, samp_out);
+
+						} // End of for-each-line set output values
 					}
-	      }
-	      
-	      free(lat);
-	      free(lon);
-	    }
-	    */
-
-	    // write the line, if we're doing line-by-line output
-	    if (output_by_line) {
-              put_float_line(outFp, omd, oiy, output_line);
-	    }
-	    
-	    if (line_out)
-              put_float_line(outLineFp, omd, oiy, line_out);
-	    if (samp_out)
-              put_float_line(outSampFp, omd, oiy, samp_out);
-	    
-	  } // End of for-each-line set output values
 	  
 	  // done writing this band
 	  if (output_by_line)
@@ -2638,31 +3204,9 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
         unlink(input_image);
       }
       
-      /////////////////////////////////////////////////////////////////////////
-      //
-      // Clear out all the persistent spline memory goop used by the
-      // reverse_map_x and reverse_map_y routines (see comments near the
-      // declarations of these variables).
-      //
-      
-      size_t sgs = dtf.sparse_grid_size; // Convenience alias.
-      
-      first_time_through_rmx = TRUE;
-      first_time_through_rmy = TRUE;
-      for ( ii = 0 ; ii < sgs ; ii++ ) {
-				gsl_interp_accel_free (y_accel_rmx[ii]);
-				gsl_interp_accel_free (y_accel_rmy[ii]);
-				gsl_spline_free (y_spline_rmx[ii]);
-				gsl_spline_free (y_spline_rmy[ii]);
-      }
-      g_free (y_accel_rmx);
-      g_free (y_accel_rmy);
-      g_free (y_spline_rmx);
-      g_free (y_spline_rmy);
-      gsl_interp_accel_free (crnt_accel_rmx);
-      gsl_interp_accel_free (crnt_accel_rmy);
-      gsl_spline_free (crnt_rmx);
-      gsl_spline_free (crnt_rmy);
+      // Done with the spline model.
+      reverse_map_grid_free (grid);
+      reverse_map_free (rm);
       
       /////////////////////////////////////////////////////////////////////////
       // Done with the data being modeled.
@@ -2693,6 +3237,8 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 
   free(projX);
   free(projY);
+  free(input_x_pixels);
+  free(input_y_pixels);
 
   if (output_by_line)
     free(output_line);
@@ -140,6 +140,11 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                char *out_base_name, float background_val, double lat_min,
                double lat_max, double lon_min, double lon_max,
 	       const char *overlap, int save_line_sample_mapping);
+// Number of threads asf_geocode_ext() and friends use to resample
+// each band.  Defaults to 1; a count of 0 or less means one thread per
+// processor.  Mosaics and byte images are always done in one thread.
+void asf_geocode_set_thread_count(int count);
+int asf_geocode_get_thread_count(void);
 void sigsegv_handler (int signal_number);
 int geoid_adjust(const char *input, const char *output);
 void test_geoid(void);
@@ -1299,6 +1299,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   float *amp_float_buf=NULL;
   float *phase_float_buf=NULL;
   float *incid=NULL;
+  cal_plan_t *cal_plan=NULL;
   complexFloat cpx, *cpxFloat_buf=NULL, *cpx_float_ml_buf=NULL;
 
   // Output file will stay open through multiple calls to this function.
@@ -1650,6 +1651,12 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     incid = incid_init(meta);
   }
 
+  // The gain and offset of every sample, so that calibrating is a
+  // multiply-add instead of a get_cal_dn() call per pixel
+  if (meta->sar && radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
+    cal_plan = cal_plan_new_ext(meta, bandExt, db_flag, TRUE, ns);
+  }
+
   // Check whether image needs to be flipped
   if (meta->general->orbit_direction == 'D' &&
       (!meta->projection || meta->projection->type != SCANSAR_PROJECTION) &&
@@ -1834,16 +1841,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
               cpx_float_ml_buf[ll*ns + kk].imag = cpx.imag;
             }
             else {
-                double incidence_angle;
-                if (projected) {
-		  incidence_angle = quadratic_2_incidence_angle(ll, kk, incid);
-                }
-                else {
-		  incidence_angle = incid[kk];
-                }
-                amp_float_buf[ll*ns + kk] = 
-		  get_cal_dn(meta, incidence_angle, kk, fValue, bandExt, 
-			     db_flag);
+                amp_float_buf[ll*ns + kk] = fValue; // calibrated below
                 phase_float_buf[ll*ns + kk] =  atan2(cpx.imag, cpx.real);
             }
           }
@@ -1871,6 +1869,9 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
             }
           }
         }
+        if (cal_plan && !multilook_flag)
+          cal_plan_apply(cal_plan, ii+ll, amp_float_buf + ll*ns,
+                         amp_float_buf + ll*ns);
       }
 
       // Multilook if requested
@@ -1896,16 +1897,8 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
 	  cpx.real /= (float)(alc*rlc);
 	  cpx.imag /= (float)(alc*rlc);
 	  cpx_float_ml_buf[idx] = cpx;
-	  if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-	    double incidence_angle;
-	    if (projected)
-	      incidence_angle = quadratic_2_incidence_angle(ll, kk+nn/2, incid);
-	    else
-	      incidence_angle = incid[kk];
-	    amp_float_buf[idx] = 
-	      get_cal_dn(meta, incidence_angle, kk+nn/2, sqrt(amp), bandExt, 
-			 db_flag);
-	  }
+	  if (cal_plan)
+	    amp_float_buf[idx] = cal_plan_value(cal_plan, ii, kk+nn/2, sqrt(amp));
 	  else 
 	    amp_float_buf[idx] = sqrt(amp);
 	  phase_float_buf[idx] = atan2(cpx.imag, cpx.real);
@@ -2094,16 +2087,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                         byte_buf[kk] = tmp_byte_buf[ns-kk-1];
                     }
                     if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)byte_buf[kk], bandExt, db_flag);
+                        amp_float_buf[kk] = (float)byte_buf[kk]; // calibrated below
                     }
                     else if (radiometry == r_POWER) {
                         amp_float_buf[kk] = (float) byte_buf[kk]*byte_buf[kk];
@@ -2126,16 +2110,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                         short_buf[kk] = tmp_short_buf[ns-kk-1];
                     }
                     if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)short_buf[kk], bandExt, db_flag);
+                        amp_float_buf[kk] = (float)short_buf[kk]; // calibrated below
                     }
                     else if (radiometry == r_POWER) {
                         amp_float_buf[kk] = (float) short_buf[kk]*short_buf[kk];
@@ -2149,16 +2124,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                         int_buf[kk] = tmp_int_buf[ns-kk-1];
                     }
                     if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)int_buf[kk], bandExt, db_flag);
+                        amp_float_buf[kk] = (float)int_buf[kk]; // calibrated below
                     }
                     else if (radiometry == r_POWER) {
                         amp_float_buf[ns+kk] = (float) int_buf[kk]*int_buf[kk];
@@ -2172,16 +2138,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                         float_buf[kk] = tmp_float_buf[ns-kk-1];
                     }
                     if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, float_buf[kk], 
-				     bandExt, db_flag);
+                        amp_float_buf[kk] = float_buf[kk]; // calibrated below
                     }
                     else if (radiometry == r_POWER) {
                         amp_float_buf[kk] = float_buf[kk]*float_buf[kk];
@@ -2195,16 +2152,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                         double_buf[kk] = tmp_double_buf[ns-kk-1];
                     }
                     if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)double_buf[kk], bandExt, db_flag);
+                        amp_float_buf[kk] = (float)double_buf[kk]; // calibrated below
                     }
                     else if (radiometry == r_POWER) {
                         amp_float_buf[kk] = (float) double_buf[kk]*double_buf[kk];
@@ -2221,10 +2169,13 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                     break;
             }
         }
-            if (strcmp(meta->general->sensor,"ERS2") == 0 && apply_ers2_gain_fix_flag)
-            amp_float_buf[kk] =
-                apply_ers2_gain_fix(radiometry, gain_adj, amp_float_buf[kk]);
       }
+      if (cal_plan && !lutName)
+        cal_plan_apply(cal_plan, ii, amp_float_buf, amp_float_buf);
+      if (strcmp(meta->general->sensor,"ERS2") == 0 && apply_ers2_gain_fix_flag)
+        for (kk = 0; kk < ns; kk++)
+          amp_float_buf[kk] =
+            apply_ers2_gain_fix(radiometry, gain_adj, amp_float_buf[kk]);
       if (import_single_band) {
           put_band_float_line(fpOut, meta, 0, ii, amp_float_buf);
       }
@@ -2264,6 +2215,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   // Clean up
   if (incid)
     FREE(incid);
+  cal_plan_free(cal_plan);
   if (byte_buf) {
     FREE(byte_buf);
     FREE(tmp_byte_buf);
@@ -226,6 +226,29 @@ char *proj2str(projection_type_t type);
 ****************************************************************************/
 void project_set_avg_height(double height);
 
+/**************************************************************************
+   project_context_t
+
+   Keeps the libproj projections set up for transformations, keyed on
+   the projection description and datum, so repeated transformations
+   with the same parameters do not set libproj up again.  The project_*
+   functions below share a default context.  Contexts may be used from
+   any thread; the calls into libproj are serialized.
+
+   project_context_transform transforms length points in place, from
+   lat/lon (x = longitude, y = latitude, in radians) to the projection
+   described by projection_description, or back when inverse is TRUE.
+   A NULL ctx is the default context.  Returns TRUE on success.
+****************************************************************************/
+typedef struct project_context project_context_t;
+
+project_context_t *project_context_new(void);
+void project_context_free(project_context_t *ctx);
+int project_context_transform(project_context_t *ctx,
+                              const char *projection_description,
+                              datum_type_t datum, int inverse,
+                              double *x, double *y, double *z, long length);
+
 /* open a projection file */
 FILE *fopen_proj_file(const char *file, const char *mode);
 
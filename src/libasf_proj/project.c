@@ -9,6 +9,7 @@
 
 #include "proj_api.h"
 #include "spheroids.h"
+#include "asf_glib.h"
 
 #define DEFAULT_AVERAGE_HEIGHT 0.0;
 
@@ -84,45 +85,243 @@ static const char * datum_str(datum_type_t datum)
     }
 }
 
+/****************************************************************************
+ Projection contexts
+
+ Setting up a libproj projection (pj_init_plus) means parsing its
+ description and, for NAD27, finding the grid shift files, which costs a
+ lot more than projecting a point.  A project_context_t keeps the
+ projections it has set up, keyed on the description and the datum, so
+ they are only set up once.  The project_* functions share a default
+ context; project_context_new gives a caller a context of its own, whose
+ projections go away with project_context_free.
+
+ libproj keeps its error state in a global (pj_errno), so every call into
+ it is made holding proj_lock.  The lock also guards the static strings
+ returned by the *_projection_desc functions while they are in use here.
+****************************************************************************/
+
+// Builds the libproj description of a projection
+typedef char *(*projection_desc_t)(project_parameters_t *pps,
+				   datum_type_t datum);
+
+// Projections kept by a context, least recently used ones are dropped
+#define PROJECT_CONTEXT_SIZE 16
+
+typedef struct project_handle {
+  char *description;
+  datum_type_t datum;
+  projPJ projection;
+  struct project_handle *next;
+} project_handle_t;
+
+struct project_context {
+  projPJ geographic;          // latlon_description, set up on first use
+  project_handle_t *handles;  // most recently used first
+  int handle_count;
+};
+
+G_LOCK_DEFINE_STATIC(proj_lock);
+static project_context_t *default_context = NULL;
+
+project_context_t *project_context_new(void)
+{
+  project_context_t *ctx =
+    (project_context_t *) MALLOC(sizeof(project_context_t));
+  asf_thread_init();
+  ctx->geographic = NULL;
+  ctx->handles = NULL;
+  ctx->handle_count = 0;
+  return ctx;
+}
+
+static void free_handle(project_handle_t *h)
+{
+  pj_free(h->projection);
+  FREE(h->description);
+  FREE(h);
+}
+
+void project_context_free(project_context_t *ctx)
+{
+  project_handle_t *h;
+
+  if (!ctx)
+    return;
+  G_LOCK(proj_lock);
+  while ((h = ctx->handles) != NULL) {
+    ctx->handles = h->next;
+    free_handle(h);
+  }
+  if (ctx->geographic)
+    pj_free(ctx->geographic);
+  G_UNLOCK(proj_lock);
+  FREE(ctx);
+}
+
+// With proj_lock held
+static project_context_t *get_context(project_context_t *ctx)
+{
+  if (ctx)
+    return ctx;
+  if (!default_context)
+    default_context = project_context_new();
+  return default_context;
+}
+
+// The geographic (lat/lon) projection of a context, with proj_lock held
+static projPJ context_geographic(project_context_t *ctx)
+{
+  if (!ctx->geographic) {
+    pj_errno = 0;
+    ctx->geographic = pj_init_plus(latlon_description);
+    if (pj_errno != 0 || !ctx->geographic) {
+      ctx->geographic = NULL;
+      asfPrintError("libproj Error: %s (initializing geographic "
+		    "projection)\n", pj_strerrno(pj_errno));
+    }
+  }
+  return ctx->geographic;
+}
+
+// The projection for a description and datum, set up if the context does
+// not have it yet.  With proj_lock held.
+static projPJ context_projection(project_context_t *ctx,
+				 const char *projection_description,
+				 datum_type_t datum)
+{
+  project_handle_t *h, *prev = NULL;
+
+  for (h = ctx->handles; h; prev = h, h = h->next)
+    if (h->datum == datum && strcmp(h->description, projection_description) == 0)
+      break;
+
+  if (h) {
+    // Move it to the front
+    if (prev) {
+      prev->next = h->next;
+      h->next = ctx->handles;
+      ctx->handles = h;
+    }
+    return h->projection;
+  }
+
+  pj_errno = 0;
+  projPJ projection = pj_init_plus(projection_description);
+  if (pj_errno != 0 || !projection) {
+    asfPrintError("libproj Error: %s (initializing output projection "
+		  "%s)\n", pj_strerrno(pj_errno), projection_description);
+  }
+
+  // Make room by dropping the least recently used one
+  if (ctx->handle_count >= PROJECT_CONTEXT_SIZE) {
+    for (prev = NULL, h = ctx->handles; h->next; prev = h, h = h->next)
+      ;
+    if (prev)
+      prev->next = NULL;
+    else
+      ctx->handles = NULL;
+    free_handle(h);
+    ctx->handle_count--;
+  }
+
+  h = (project_handle_t *) MALLOC(sizeof(project_handle_t));
+  h->description = STRDUP(projection_description);
+  h->datum = datum;
+  h->projection = projection;
+  h->next = ctx->handles;
+  ctx->handles = h;
+  ctx->handle_count++;
+
+  return projection;
+}
+
+// With proj_lock held.  Returns pj_errno.
+static int context_transform(project_context_t *ctx,
+			     const char *projection_description,
+			     datum_type_t datum, int inverse,
+			     double *x, double *y, double *z, long length)
+{
+  projPJ geographic, projection;
+
+  ctx = get_context(ctx);
+  geographic = context_geographic(ctx);
+  projection = context_projection(ctx, projection_description, datum);
+
+  pj_errno = 0;
+  if (inverse)
+    pj_transform(projection, geographic, length, 1, x, y, z);
+  else
+    pj_transform(geographic, projection, length, 1, x, y, z);
+
+  return pj_errno;
+}
+
+// Builds the description with desc when projection_description is NULL,
+// since desc returns a static string.
+static int locked_transform(project_context_t *ctx,
+			    const char *projection_description,
+			    projection_desc_t desc, project_parameters_t *pps,
+			    datum_type_t datum, int inverse,
+			    double *x, double *y, double *z, long length)
+{
+  int err;
+
+  G_LOCK(proj_lock);
+  if (!projection_description)
+    projection_description = desc(pps, datum);
+  err = context_transform(ctx, projection_description, datum, inverse,
+			  x, y, z, length);
+  G_UNLOCK(proj_lock);
+
+  if (err != 0) {
+    asfPrintWarning("libproj error: %s (%sprojection transformation)\n",
+		    pj_strerrno(err), inverse ? "inverse " : "");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int project_context_transform(project_context_t *ctx,
+			      const char *projection_description,
+			      datum_type_t datum, int inverse,
+			      double *x, double *y, double *z, long length)
+{
+  return locked_transform(ctx, projection_description, NULL, NULL, datum,
+			  inverse, x, y, z, length);
+}
+
 // Returns TRUE if we have grid shift files available for the given point,
 // and returns FALSE if not.  If this returns FALSE for any point in a
 // scene, the NAD27 datum shouldn't be used.
 int test_nad27(double lat, double lon)
 {
-    projPJ ll_proj, utm_proj;
-    ll_proj = pj_init_plus(latlon_description);
-
     char desc[255];
     int zone = utm_zone(lon);
     sprintf(desc, "+proj=utm +zone=%d +datum=NAD27", zone);
-    utm_proj = pj_init_plus(desc);
-/*
-    double *px, *py, *pz;
-    px = MALLOC(sizeof(double));
-    py = MALLOC(sizeof(double));
-    pz = MALLOC(sizeof(double));
-*/
+
     double px[1], py[1], pz[1];
     py[0] = lat*D2R;
     px[0] = lon*D2R;
     pz[0] = 0;
 
-    pj_transform (ll_proj, utm_proj, 1, 1, px, py, pz);
+    G_LOCK(proj_lock);
+    set_proj_lib_path(NAD27_DATUM);
+    int err = context_transform(NULL, desc, NAD27_DATUM, FALSE,
+                                px, py, pz, 1);
+    G_UNLOCK(proj_lock);
 
     int ret = TRUE;
-    if (pj_errno == -38) // -38 indicates error with the grid shift files
+    if (err == -38) // -38 indicates error with the grid shift files
     {
         ret = FALSE;
     }
-    else if (pj_errno != 0) // some other error (pj errors are negative,
-    {                       // system errors are positive)
+    else if (err != 0) // some other error (pj errors are negative,
+    {                  // system errors are positive)
         asfPrintError("libproj Error: %s (test_nad27)\n", 
-		      pj_strerrno(pj_errno));
+		      pj_strerrno(err));
     }
 
-    pj_free(ll_proj);
-    pj_free(utm_proj);
-
     return ret;
 }
 
@@ -145,12 +344,12 @@ static double get_avg_height()
   return DEFAULT_AVERAGE_HEIGHT;
 }
 
-static int project_worker_arr(const char * projection_description,
+static int project_worker_arr(projection_desc_t projection_description,
+                              project_parameters_t *pps, datum_type_t datum,
                               double *lat, double *lon, double *height,
                               double **projected_x, double **projected_y,
                               double **projected_z, long length)
 {
-  projPJ geographic_projection, output_projection;
   int i, ok = TRUE;
 
   // This section is a bit confusing.  The interfaces to the single
@@ -243,51 +442,8 @@ static int project_worker_arr(const char * projection_description,
     }
   }
 
-  //printf("proj: +from %s +to %s\n",
-  //       latlon_description, projection_description);
-
-  geographic_projection = pj_init_plus (latlon_description);
-
-  if (pj_errno != 0)
-  {
-      asfPrintError("libproj Error: %s (initializing geographic projection)\n",
-		    pj_strerrno(pj_errno));
-      ok = FALSE;
-  }
-
-  if (ok)
-  {
-      assert (geographic_projection != NULL);
-
-      output_projection = pj_init_plus (projection_description);
-
-      if (pj_errno != 0)
-      {
-	printf("proj: %s\n", projection_description);
-    asfPrintError("libproj Error: %s (initializing output projection)\n", 
-		  pj_strerrno(pj_errno));
-    ok = FALSE;
-      }
-
-      if (ok)
-      {
-    assert (output_projection != NULL);
-
-    pj_transform (geographic_projection, output_projection, length, 1,
-      px, py, pz);
-
-    if (pj_errno != 0)
-    {
-        asfPrintWarning("libproj error: %s (projection transformation)\n", 
-			pj_strerrno(pj_errno));
-        ok = FALSE;
-    }
-
-    pj_free(output_projection);
-      }
-
-      pj_free(geographic_projection);
-  }
+  ok = locked_transform(NULL, NULL, projection_description, pps, datum,
+                        FALSE, px, py, pz, length);
 
   // Free memory temporarily allocated for height values that we don't
   // really care about.
@@ -302,12 +458,12 @@ static int project_worker_arr(const char * projection_description,
 }
 
 static int
-project_worker_arr_inv(const char * projection_description,
+project_worker_arr_inv(projection_desc_t projection_description,
+                       project_parameters_t *pps, datum_type_t datum,
                        double *x, double *y, double *z,
                        double **lat, double **lon, double **height,
                        long length)
 {
-  projPJ geographic_projection, output_projection;
   int i, ok = TRUE;
 
   // Same issue here as above.  Because both single and array
@@ -393,50 +549,8 @@ project_worker_arr_inv(const char * projection_description,
     }
   }
 
-  //printf("proj: +from %s +to %s\n",
-  //       projection_description, latlon_description);
-
-  geographic_projection = pj_init_plus ( latlon_description );
-
-  if (pj_errno != 0)
-  {
-      asfPrintError("libproj Error: %s (initializing inverse geographic "
-		    "projection)\n", pj_strerrno(pj_errno));
-      ok = FALSE;
-  }
-
-  if (ok)
-  {
-      assert (geographic_projection != NULL);
-
-      output_projection = pj_init_plus (projection_description);
-
-      if (pj_errno != 0)
-      {
-    asfPrintError("libproj Error: %s\n (initializing inverse output "
-		  "projection)\n", pj_strerrno(pj_errno));
-    ok = FALSE;
-      }
-
-      if (ok)
-      {
-    assert (output_projection != NULL);
-
-    pj_transform (output_projection, geographic_projection, length, 1,
-      plon, plat, pheight);
-
-    if (pj_errno != 0)
-    {
-        asfPrintWarning("libproj error: %s (inverse projection transformation)"
-			"\n", pj_strerrno(pj_errno));
-        ok = FALSE;
-    }
-
-    pj_free(output_projection);
-      }
-
-      pj_free(geographic_projection);
-  }
+  ok = locked_transform(NULL, NULL, projection_description, pps, datum,
+                        TRUE, plon, plat, pheight, length);
 
   // Free memory temporarily allocated for height values that we don't
   // really care about.
@@ -529,7 +643,7 @@ int
 project_utm (project_parameters_t * pps, double lat, double lon, double height,
        double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(utm_projection_description(pps, datum),
+    return project_worker_arr(utm_projection_description, pps, datum,
                               &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -540,8 +654,7 @@ project_utm_arr (project_parameters_t * pps,
      double **projected_z, long length,
          datum_type_t datum)
 {
-  return project_worker_arr(
-      utm_projection_description(pps, datum),
+  return project_worker_arr(utm_projection_description, pps, datum,
       lat, lon, height, projected_x, projected_y, projected_z, length);
 }
 
@@ -550,8 +663,7 @@ project_utm_inv (project_parameters_t * pps,
      double x, double y, double z,  double *lat, double *lon,
      double *height, datum_type_t datum)
 {
-  return project_worker_arr_inv(
-      utm_projection_description(pps, datum),
+  return project_worker_arr_inv(utm_projection_description, pps, datum,
       &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -561,8 +673,7 @@ project_utm_arr_inv (project_parameters_t * pps,
          double **lat, double **lon, double **height,
          long length, datum_type_t datum)
 {
-  return project_worker_arr_inv(
-      utm_projection_description(pps, datum),
+  return project_worker_arr_inv(utm_projection_description, pps, datum,
       x, y, z, lat, lon, height, length);
 }
 
@@ -604,7 +715,7 @@ int
 project_ps(project_parameters_t * pps, double lat, double lon, double height,
            double *x, double *y, double *z, datum_type_t datum)
 {
-  return project_worker_arr(ps_projection_desc(pps, datum), &lat, &lon,
+  return project_worker_arr(ps_projection_desc, pps, datum, &lat, &lon,
                 &height, &x, &y, &z, 1);
 }
 
@@ -614,7 +725,7 @@ project_ps_arr(project_parameters_t * pps,
          double **projected_x, double **projected_y,
          double **projected_z, long length, datum_type_t datum)
 {
-  return project_worker_arr(ps_projection_desc(pps, datum), lat, lon, height,
+  return project_worker_arr(ps_projection_desc, pps, datum, lat, lon, height,
           projected_x, projected_y, projected_z, length);
 }
 
@@ -622,7 +733,7 @@ int
 project_ps_inv(project_parameters_t * pps, double x, double y, double z,
          double *lat, double *lon, double *height, datum_type_t datum)
 {
-    return project_worker_arr_inv(ps_projection_desc(pps, datum),
+    return project_worker_arr_inv(ps_projection_desc, pps, datum,
                   &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -632,7 +743,7 @@ project_ps_arr_inv(project_parameters_t * pps,
        double **lat, double **lon, double **height,
        long length, datum_type_t datum)
 {
-    return project_worker_arr_inv(ps_projection_desc(pps, datum),
+    return project_worker_arr_inv(ps_projection_desc, pps, datum,
           x, y, z, lat, lon, height, length);
 }
 
@@ -684,7 +795,7 @@ project_lamaz(project_parameters_t * pps,
         double lat, double lon, double height,
         double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(lamaz_projection_desc(pps, datum),
+    return project_worker_arr(lamaz_projection_desc, pps, datum,
                   &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -694,7 +805,7 @@ project_lamaz_arr(project_parameters_t *pps,
       double **projected_x, double **projected_y,
       double **projected_z, long length, datum_type_t datum)
 {
-    return project_worker_arr(lamaz_projection_desc(pps, datum), lat, lon,
+    return project_worker_arr(lamaz_projection_desc, pps, datum, lat, lon,
                   height, projected_x, projected_y, projected_z, length);
 }
 
@@ -702,7 +813,7 @@ int
 project_lamaz_inv(project_parameters_t *pps, double x, double y, double z,
       double *lat, double *lon, double *height, datum_type_t datum)
 {
-  return project_worker_arr_inv(lamaz_projection_desc(pps, datum),
+  return project_worker_arr_inv(lamaz_projection_desc, pps, datum,
                 &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -712,7 +823,7 @@ project_lamaz_arr_inv(project_parameters_t *pps,
           double **lat, double **lon, double **height,
           long length, datum_type_t datum)
 {
-  return project_worker_arr_inv(lamaz_projection_desc(pps, datum), x, y, z,
+  return project_worker_arr_inv(lamaz_projection_desc, pps, datum, x, y, z,
         lat, lon, height, length);
 }
 
@@ -772,7 +883,7 @@ project_lamcc(project_parameters_t * pps,
         double lat, double lon, double height,
         double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(lamcc_projection_desc(pps, datum),
+    return project_worker_arr(lamcc_projection_desc, pps, datum,
                   &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -782,7 +893,7 @@ project_lamcc_arr(project_parameters_t *pps,
       double **projected_x, double **projected_y,
       double **projected_z, long length, datum_type_t datum)
 {
-  return project_worker_arr(lamcc_projection_desc(pps, datum), lat, lon,
+  return project_worker_arr(lamcc_projection_desc, pps, datum, lat, lon,
                 height, projected_x, projected_y, projected_z, length);
 }
 
@@ -790,7 +901,7 @@ int
 project_lamcc_inv(project_parameters_t *pps, double x, double y, double z,
       double *lat, double *lon, double *height, datum_type_t datum)
 {
-  return project_worker_arr_inv(lamcc_projection_desc(pps, datum),
+  return project_worker_arr_inv(lamcc_projection_desc, pps, datum,
                 &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -800,7 +911,7 @@ project_lamcc_arr_inv(project_parameters_t *pps,
           double **lat, double **lon, double **height,
           long length, datum_type_t datum)
 {
-  return project_worker_arr_inv(lamcc_projection_desc(pps, datum),
+  return project_worker_arr_inv(lamcc_projection_desc, pps, datum,
                 x, y, z, lat, lon, height, length);
 }
 
@@ -841,7 +952,7 @@ project_mer(project_parameters_t *pps,
 	    double lat, double lon, double height,
 	    double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(mer_projection_desc(pps, datum),
+    return project_worker_arr(mer_projection_desc, pps, datum,
             &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -862,7 +973,7 @@ project_mer_arr(project_parameters_t *pps,
   if (negative && positive)
     asfPrintError("Projection problem: Image crosses the dateline.\n"
 		  "Mercator projection does not handle this case well.\n");
-  return project_worker_arr(mer_projection_desc(pps, datum),
+  return project_worker_arr(mer_projection_desc, pps, datum,
                 lat, lon, height, projected_x, projected_y, projected_z,
                 length);
 }
@@ -871,7 +982,7 @@ int
 project_mer_inv(project_parameters_t *pps, double x, double y, double z,
 		double *lat, double *lon, double *height, datum_type_t datum)
 {
-    return project_worker_arr_inv(mer_projection_desc(pps, datum),
+    return project_worker_arr_inv(mer_projection_desc, pps, datum,
                   &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -881,7 +992,7 @@ project_mer_arr_inv(project_parameters_t *pps,
            double **lat, double **lon, double **height,
            long length, datum_type_t datum)
 {
-    return project_worker_arr_inv(mer_projection_desc(pps, datum),
+    return project_worker_arr_inv(mer_projection_desc, pps, datum,
                   x, y, z, lat, lon, height, length);
 }
 
@@ -902,12 +1013,17 @@ char *sin_projection_desc(project_parameters_t *pps)
   return sin_projection_description;
 }
 
+static char *sin_desc(project_parameters_t *pps, datum_type_t datum)
+{
+  return sin_projection_desc(pps);
+}
+
 int
 project_sin(project_parameters_t *pps,
 	    double lat, double lon, double height,
 	    double *x, double *y, double *z, datum_type_t datum)
 {
-  return project_worker_arr(sin_projection_desc(pps),
+  return project_worker_arr(sin_desc, pps, datum,
 			    &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -928,7 +1044,7 @@ project_sin_arr(project_parameters_t *pps,
   if (negative && positive)
     asfPrintError("Projection problem: Image crosses the dateline.\n"
 		  "Sinusoidal projection does not handle this case well.\n");
-  return project_worker_arr(sin_projection_desc(pps),
+  return project_worker_arr(sin_desc, pps, datum,
 			    lat, lon, height, projected_x, projected_y, 
 			    projected_z, length);
 }
@@ -937,7 +1053,7 @@ int
 project_sin_inv(project_parameters_t *pps, double x, double y, double z,
 		double *lat, double *lon, double *height, datum_type_t datum)
 {
-  return project_worker_arr_inv(sin_projection_desc(pps),
+  return project_worker_arr_inv(sin_desc, pps, datum,
 				&x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -947,7 +1063,7 @@ project_sin_arr_inv(project_parameters_t *pps,
 		    double **lat, double **lon, double **height,
 		    long length, datum_type_t datum)
 {
-  return project_worker_arr_inv(sin_projection_desc(pps),
+  return project_worker_arr_inv(sin_desc, pps, datum,
 				x, y, z, lat, lon, height, length);
 }
 
@@ -988,7 +1104,7 @@ project_eqr(project_parameters_t *pps,
 	    double lat, double lon, double height,
 	    double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(eqr_projection_desc(pps, datum),
+    return project_worker_arr(eqr_projection_desc, pps, datum,
             &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -998,7 +1114,7 @@ project_eqr_arr(project_parameters_t *pps,
 		double **projected_x, double **projected_y,
 		double **projected_z, long length, datum_type_t datum)
 {
-  return project_worker_arr(eqr_projection_desc(pps, datum),
+  return project_worker_arr(eqr_projection_desc, pps, datum,
                 lat, lon, height, projected_x, projected_y, projected_z,
                 length);
 }
@@ -1007,7 +1123,7 @@ int
 project_eqr_inv(project_parameters_t *pps, double x, double y, double z,
 		double *lat, double *lon, double *height, datum_type_t datum)
 {
-    return project_worker_arr_inv(eqr_projection_desc(pps, datum),
+    return project_worker_arr_inv(eqr_projection_desc, pps, datum,
                   &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -1017,7 +1133,7 @@ project_eqr_arr_inv(project_parameters_t *pps,
 		    double **lat, double **lon, double **height,
 		    long length, datum_type_t datum)
 {
-    return project_worker_arr_inv(eqr_projection_desc(pps, datum),
+    return project_worker_arr_inv(eqr_projection_desc, pps, datum,
                   x, y, z, lat, lon, height, length);
 }
 
@@ -1046,7 +1162,7 @@ project_eqc(project_parameters_t *pps,
 	    double lat, double lon, double height,
 	    double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(eqc_projection_desc(pps, datum),
+    return project_worker_arr(eqc_projection_desc, pps, datum,
             &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -1068,7 +1184,7 @@ project_eqc_arr(project_parameters_t *pps,
     asfPrintError("Projection problem: Image crosses the dateline.\n"
 		  "Equidistant projection does not handle this case well."
 		  "\n");
-  return project_worker_arr(eqc_projection_desc(pps, datum),
+  return project_worker_arr(eqc_projection_desc, pps, datum,
                 lat, lon, height, projected_x, projected_y, projected_z,
                 length);
 }
@@ -1077,7 +1193,7 @@ int
 project_eqc_inv(project_parameters_t *pps, double x, double y, double z,
 		double *lat, double *lon, double *height, datum_type_t datum)
 {
-    return project_worker_arr_inv(eqc_projection_desc(pps, datum),
+    return project_worker_arr_inv(eqc_projection_desc, pps, datum,
                   &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -1087,7 +1203,7 @@ project_eqc_arr_inv(project_parameters_t *pps,
 		    double **lat, double **lon, double **height,
 		    long length, datum_type_t datum)
 {
-    return project_worker_arr_inv(eqc_projection_desc(pps, datum),
+    return project_worker_arr_inv(eqc_projection_desc, pps, datum,
                   x, y, z, lat, lon, height, length);
 }
 
@@ -1109,12 +1225,17 @@ char *ease_global_projection_desc(project_parameters_t *pps)
   return ease_global_projection_description;
 }
 
+static char *ease_global_desc(project_parameters_t *pps, datum_type_t datum)
+{
+  return ease_global_projection_desc(pps);
+}
+
 int
 project_ease_global(project_parameters_t *pps,
 		    double lat, double lon, double height,
 		    double *x, double *y, double *z)
 {
-  return project_worker_arr(ease_global_projection_desc(pps),
+  return project_worker_arr(ease_global_desc, pps, WGS84_DATUM,
 			    &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -1124,7 +1245,7 @@ project_ease_global_arr(project_parameters_t *pps,
 			double **projected_x, double **projected_y,
 			double **projected_z, long length)
 {
-  return project_worker_arr(ease_global_projection_desc(pps),
+  return project_worker_arr(ease_global_desc, pps, WGS84_DATUM,
 			    lat, lon, height, projected_x, projected_y, 
 			    projected_z, length);
 }
@@ -1133,7 +1254,7 @@ int
 project_ease_global_inv(project_parameters_t *pps, double x, double y, double z,
 		double *lat, double *lon, double *height)
 {
-  return project_worker_arr_inv(ease_global_projection_desc(pps),
+  return project_worker_arr_inv(ease_global_desc, pps, WGS84_DATUM,
 				&x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -1143,7 +1264,7 @@ project_ease_global_arr_inv(project_parameters_t *pps,
 			    double **lat, double **lon, double **height,
 			    long length)
 {
-  return project_worker_arr_inv(ease_global_projection_desc(pps),
+  return project_worker_arr_inv(ease_global_desc, pps, WGS84_DATUM,
 				x, y, z, lat, lon, height, length);
 }
 
@@ -1211,7 +1332,7 @@ project_albers(project_parameters_t *pps,
          double lat, double lon, double height,
          double *x, double *y, double *z, datum_type_t datum)
 {
-    return project_worker_arr(albers_projection_desc(pps, datum),
+    return project_worker_arr(albers_projection_desc, pps, datum,
             &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -1221,7 +1342,7 @@ project_albers_arr(project_parameters_t *pps,
        double **projected_x, double **projected_y,
        double **projected_z, long length, datum_type_t datum)
 {
-  return project_worker_arr(albers_projection_desc(pps, datum),
+  return project_worker_arr(albers_projection_desc, pps, datum,
                 lat, lon, height, projected_x, projected_y, projected_z,
                 length);
 }
@@ -1230,7 +1351,7 @@ int
 project_albers_inv(project_parameters_t *pps, double x, double y, double z,
        double *lat, double *lon, double *height, datum_type_t datum)
 {
-    return project_worker_arr_inv(albers_projection_desc(pps, datum),
+    return project_worker_arr_inv(albers_projection_desc, pps, datum,
                   &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -1240,7 +1361,7 @@ project_albers_arr_inv(project_parameters_t *pps,
            double **lat, double **lon, double **height,
            long length, datum_type_t datum)
 {
-    return project_worker_arr_inv(albers_projection_desc(pps, datum),
+    return project_worker_arr_inv(albers_projection_desc, pps, datum,
                   x, y, z, lat, lon, height, length);
 }
 
@@ -1261,11 +1382,16 @@ static char * pseudo_projection_description(datum_type_t datum)
   return pseudo_projection_description;
 }
 
+static char *pseudo_desc(project_parameters_t *pps, datum_type_t datum)
+{
+  return pseudo_projection_description(datum);
+}
+
 int
 project_pseudo (project_parameters_t *pps, double lat, double lon,
     double height, double *x, double *y, double *z, datum_type_t datum)
 {
-  return project_worker_arr(pseudo_projection_description (datum),
+  return project_worker_arr(pseudo_desc, pps, datum,
           &lat, &lon, &height, &x, &y, &z, 1);
 }
 
@@ -1273,7 +1399,7 @@ int
 project_pseudo_inv (project_parameters_t *pps, double x, double y,
         double z, double *lat, double *lon, double *height, datum_type_t datum)
 {
-  return project_worker_arr_inv(pseudo_projection_description (datum),
+  return project_worker_arr_inv(pseudo_desc, pps, datum,
                 &x, &y, &z, &lat, &lon, &height, 1);
 }
 
@@ -1282,7 +1408,7 @@ project_pseudo_arr (project_parameters_t *pps, double *lat, double *lon,
         double *height, double **x, double **y, double **z,
         long length, datum_type_t datum)
 {
-  return project_worker_arr(pseudo_projection_description (datum),
+  return project_worker_arr(pseudo_desc, pps, datum,
           lat, lon, height, x, y, z, length);
 }
 
@@ -1290,7 +1416,7 @@ int project_pseudo_arr_inv (project_parameters_t *pps, double *x, double *y,
           double *z, double **lat, double **lon,
           double **height, long length, datum_type_t datum)
 {
-  return project_worker_arr_inv(pseudo_projection_description (datum),
+  return project_worker_arr_inv(pseudo_desc, pps, datum,
         x, y, z, lat, lon, height, length);
 }
 
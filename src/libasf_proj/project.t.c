@@ -972,6 +972,53 @@ void perf_test_ps()
     free(x);
 }
 
+void test_context()
+{
+    project_context_t *ctx = project_context_new();
+    project_parameters_t pps;
+    int zone, n = 0;
+
+    /* More zones than a context keeps, so projections get dropped and set
+       up again along the way */
+    for (zone = 1; zone <= 60; ++zone)
+    {
+        char desc[256];
+        double lat = 45 * DEG_TO_RAD;
+        double lon = (zone * 6 - 183) * DEG_TO_RAD;
+        double x, y, xo, yo, z = 0, h;
+
+        pps.utm.zone = zone;
+        pps.utm.false_northing = 0;
+        strcpy(desc, utm_projection_description(&pps, datum));
+
+        x = lon;
+        y = lat;
+        CU_ASSERT(project_context_transform(ctx, desc, datum, FALSE,
+                                            &x, &y, &z, 1));
+        project_utm(&pps, lat, lon, 0, &xo, &yo, &h, datum);
+        if (!within_tol(x, xo) || !within_tol(y, yo))
+            ++n;
+
+        CU_ASSERT(project_context_transform(ctx, desc, datum, TRUE,
+                                            &x, &y, &z, 1));
+        if (!within_tol(x, lon) || !within_tol(y, lat))
+            ++n;
+    }
+    CU_ASSERT(n == 0);
+
+    if (n > 0)
+    {
+        ++nfail;
+        printf("Fail: test_context results don't agree! wrong: %d\n", n);
+    }
+    else
+    {
+        ++nok;
+    }
+
+    project_context_free(ctx);
+}
+
 void test_project()
 {
     test_poly();
@@ -982,6 +1029,7 @@ void test_project()
     test_alb();
 
     perf_test_ps();
+    test_context();
 
     test_random_all();
 
@@ -0,0 +1,150 @@
+// Test program useful for checking the throughput of projecting single
+// points, which is how the geocoding grid setup and the vector tools use
+// libasf_proj.
+//
+// Projects the same random points to UTM and back, one at a time, the way
+// project_utm() used to (setting libproj up and tearing it down for every
+// point), through project_utm()/project_utm_inv() with the cached
+// projections, and with project_utm_arr() for comparison.  Reports points
+// per second, and the largest difference from the old results in meters.
+//
+// Usage: project_speed [points [datum]]
+//        datum is WGS84 (default) or NAD27
+
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "asf.h"
+#include "libasf_proj.h"
+#include "proj_api.h"
+
+static const char *latlon_description = "+proj=latlong +datum=WGS84";
+
+// A single point through libproj, the way project_worker_arr() did it
+// before the projections were cached.
+static int old_project_point(const char *description, int inverse,
+                             double *x, double *y, double *z)
+{
+  projPJ geographic = pj_init_plus(latlon_description);
+  projPJ projection = pj_init_plus(description);
+  int ok;
+
+  assert(geographic && projection);
+  if (inverse)
+    pj_transform(projection, geographic, 1, 1, x, y, z);
+  else
+    pj_transform(geographic, projection, 1, 1, x, y, z);
+  ok = pj_errno == 0;
+  pj_free(projection);
+  pj_free(geographic);
+  return ok;
+}
+
+static double seconds_since(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double rate(int n, double seconds)
+{
+  return seconds > 0 ? n / seconds : 0;
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 20000;
+  datum_type_t datum =
+    argc > 2 && strcmp_case(argv[2], "NAD27") == 0 ? NAD27_DATUM : WGS84_DATUM;
+  double *lat = MALLOC(sizeof(double) * n);
+  double *lon = MALLOC(sizeof(double) * n);
+  double *old_x = MALLOC(sizeof(double) * n);
+  double *old_y = MALLOC(sizeof(double) * n);
+  double *new_x = MALLOC(sizeof(double) * n);
+  double *new_y = MALLOC(sizeof(double) * n);
+  double *arr_x = NULL, *arr_y = NULL;
+  double old_time, new_time, arr_time, old_inv_time, new_inv_time;
+  double max_diff = 0, max_inv_diff = 0;
+  project_parameters_t pps;
+  char description[256];
+  clock_t start;
+  int ii;
+
+  assert(n > 0);
+  pps.utm.zone = 6;
+  pps.utm.false_northing = 0;
+  pps.utm.lon0 = -147;
+  strcpy(description, utm_projection_description(&pps, datum));
+
+  // Points around Fairbanks, in UTM zone 6 (and inside the NAD27 grids)
+  srand(10101);
+  for (ii = 0; ii < n; ii++) {
+    lat[ii] = (63.5 + 2.0 * rand() / RAND_MAX) * D2R;
+    lon[ii] = (-150.0 + 5.0 * rand() / RAND_MAX) * D2R;
+  }
+
+  printf("%d points, %s\n", n, description);
+  printf("%-28s %14s\n", "", "points/s");
+
+  start = clock();
+  for (ii = 0; ii < n; ii++) {
+    double z = 0;
+    old_x[ii] = lon[ii];
+    old_y[ii] = lat[ii];
+    old_project_point(description, FALSE, &old_x[ii], &old_y[ii], &z);
+  }
+  old_time = seconds_since(start);
+
+  start = clock();
+  for (ii = 0; ii < n; ii++)
+    project_utm(&pps, lat[ii], lon[ii], ASF_PROJ_NO_HEIGHT,
+                &new_x[ii], &new_y[ii], NULL, datum);
+  new_time = seconds_since(start);
+
+  start = clock();
+  project_utm_arr(&pps, lat, lon, NULL, &arr_x, &arr_y, NULL, n, datum);
+  arr_time = seconds_since(start);
+
+  for (ii = 0; ii < n; ii++) {
+    max_diff = fmax(max_diff, fabs(new_x[ii] - old_x[ii]));
+    max_diff = fmax(max_diff, fabs(new_y[ii] - old_y[ii]));
+    max_diff = fmax(max_diff, fabs(arr_x[ii] - old_x[ii]));
+    max_diff = fmax(max_diff, fabs(arr_y[ii] - old_y[ii]));
+  }
+
+  start = clock();
+  for (ii = 0; ii < n; ii++) {
+    double x = old_x[ii], y = old_y[ii], z = 0;
+    old_project_point(description, TRUE, &x, &y, &z);
+  }
+  old_inv_time = seconds_since(start);
+
+  start = clock();
+  for (ii = 0; ii < n; ii++) {
+    double back_lat, back_lon;
+    project_utm_inv(&pps, new_x[ii], new_y[ii], ASF_PROJ_NO_HEIGHT,
+                    &back_lat, &back_lon, NULL, datum);
+    max_inv_diff = fmax(max_inv_diff, fabs(back_lat - lat[ii]));
+    max_inv_diff = fmax(max_inv_diff, fabs(back_lon - lon[ii]));
+  }
+  new_inv_time = seconds_since(start);
+
+  printf("%-28s %14.0f\n", "forward, set up per point", rate(n, old_time));
+  printf("%-28s %14.0f\n", "forward, cached", rate(n, new_time));
+  printf("%-28s %14.0f\n", "forward, one array", rate(n, arr_time));
+  printf("%-28s %14.0f\n", "inverse, set up per point", rate(n, old_inv_time));
+  printf("%-28s %14.0f\n", "inverse, cached", rate(n, new_inv_time));
+  printf("largest difference: %g m, round trip: %g deg\n",
+         max_diff, max_inv_diff * R2D);
+
+  FREE(arr_x);
+  FREE(arr_y);
+  FREE(new_y);
+  FREE(new_x);
+  FREE(old_y);
+  FREE(old_x);
+  FREE(lon);
+  FREE(lat);
+
+  return max_diff < 1e-6 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -84,6 +84,16 @@ typedef struct
   int dateline;
 } Poly;
 
+/* Running statistics of the valid values of an image, see stats.c */
+typedef struct {
+  long long count;          // Number of valid values
+  long long total;          // Number of values, valid or not
+  double min;
+  double max;
+  double mean;
+  double m2;                // Sum of squared differences from the mean
+} stats_accumulator_t;
+
 typedef double calc_stats_formula_t(double band_values[], double no_data_value);
 
 // Prototypes from arithmetic.c
@@ -121,6 +131,17 @@ void calc_stats_from_file(const char *inFile, char *band, double mask, double *m
 void calc_stats_from_file_ext(const char *inFile, char *band, double mask, 
         double *min, double *max, double *mean, double *stdDev, double *valid,
 			  gsl_histogram **histogram);
+void calc_band_stats_from_file(const char *inFile, int band_count,
+                               char **bands, double mask, int histogram,
+                               channel_stats_t *stats);
+int have_cached_band_stats(const char *inFile, meta_parameters *meta,
+                           int band, double mask);
+void stats_accumulator_init(stats_accumulator_t *acc);
+void stats_accumulator_add(stats_accumulator_t *acc, const float *data,
+                           int n, double mask);
+void stats_accumulator_merge(stats_accumulator_t *acc,
+                             const stats_accumulator_t *other);
+double stats_accumulator_std_deviation(const stats_accumulator_t *acc);
 void calc_stats(float *data, long long pixel_count, double mask, double *min,
 		double *max, double *mean, double *stdDev);
 void calc_stats_ext(float *data, long long pixel_count, double mask, int report,
@@ -145,10 +166,15 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
 	     int nLooks);
 void kernel_filter(char *inFile, char *outFile, filter_type_t filter, 
 		   int kernel_size, float damping, int nLooks);
+void kernel_filter_set_thread_count(int count);
 
 /* Prototypes from interpolate.c *********************************************/
 float interpolate(interpolate_type_t interpolation, FloatImage *inbuf, float yLine,
 		  float xSample, weighting_type_t weighting, int sinc_points);
+// Return the four cubic convolution weights for the pixels at floor(x) - 1
+// through floor(x) + 2, where fraction = x - floor(x).  The weights are
+// tabulated, and the table is shared read-only between threads.
+const float *cubic_convolution_weights(double fraction);
 
 /* Prototypes from trim.c ****************************************************/
 int trim(char *infile, char *outfile, long long startX, long long startY,
@@ -160,6 +186,9 @@ void trim_wedges(char *infile, char *outfile);
 void trim_latlon(char *infile, char *outfile, double lat_min, double lat_max,
                  double lon_min, double lon_max);
 void trim_to(char *infile, char *outfile, char *metadata_file);
+FloatImage *trim_float_image(FloatImage *image, long long startX,
+                             long long startY, long long sizeX,
+                             long long sizeY);
 void subset_by_latlon(char *infile, char *outfile, double *lat, double *lon, 
   int nCoords);
 void subset_by_map(char *infile, char *outfile, double minX, double maxX,
@@ -170,10 +199,20 @@ void clip_to_polygon(char *inFile, char *outFile, double *lat, double *lon,
 // Prototypes from raster_calc.c
 int raster_calc(char *outFile, char *expression, int input_count, 
 		char **inFiles);
+void raster_calc_set_thread_count(int count);
 
 /* Prototypes from fftMatch.c ************************************************/
 int fftMatch(char *inFile1, char *inFile2, char *corrFile,
 	     float *dx, float *dy, float *certainty);
+int fftMatch_image(FloatImage *image1, FloatImage *image2,
+                   float *dx, float *dy, float *certainty);
+typedef struct fft_match_plan fft_match_plan_t;
+fft_match_plan_t *fft_match_plan_new(int size_x, int size_y);
+void fft_match_plan_free(fft_match_plan_t *plan);
+int fftMatch_chips(fft_match_plan_t *plan,
+                   const float *master, int master_stride,
+                   const float *slave, int slave_stride,
+                   float *dx, float *dy, float *certainty);
 void fftMatch_withOffsetFile(char *inFile1, char *inFile2, char *corrFile,
 			     char *offsetFileName);
 int fftMatch_gridded(char *inFile1, char *inFile2, char *gridFile,
@@ -6,6 +6,17 @@
 char *expression2cookie(const char *expr,int nvars);
 double evaluate(char *cookie,const double *variables);
 
+/* Compiled expressions: evaluate a whole line of pixels at a time.  The
+   results are the same as evaluate() gives pixel by pixel.  A program may
+   be shared between threads, each with its own workspace.*/
+typedef struct expression_program expression_program;
+expression_program *expression_compile(const char *expr,int nvars);
+void expression_program_free(expression_program *prog);
+double *expression_workspace_new(const expression_program *prog);
+void expression_evaluate_line(const expression_program *prog,
+			      const float *const *variables,int y,int ns,
+			      float *out,double *work);
+
 /* Internal Variables.*/
 typedef enum {
 	tokOperator,tokConstant,tokVariable
@@ -18,16 +18,79 @@
 #define modX(x,ns) ((x+ns)%ns)  /*Return x, wrapped to [0..ns-1]*/
 #define modY(y,nl) ((y+nl)%nl)  /*Return y, wrapped to [0..nl-1]*/
 
-/* readImg: reads the image file given by in
+/* Where the images being matched come from: either an image file and
+   its metadata, a FloatImage already in memory, or a plain array of
+   lines (stride floats apart) owned by the caller. */
+typedef struct {
+  FILE *fp;
+  meta_parameters *meta;
+  FloatImage *image;
+  const float *data;
+  int stride;
+  int line_count, sample_count;
+} match_image_t;
+
+static void match_image_from_file(match_image_t *self, char *inFile)
+{
+  self->fp = fopenImage(inFile,"rb");
+  self->meta = meta_read(inFile);
+  self->image = NULL;
+  self->data = NULL;
+  self->line_count = self->meta->general->line_count;
+  self->sample_count = self->meta->general->sample_count;
+}
+
+static void match_image_from_float_image(match_image_t *self,
+                                         FloatImage *image)
+{
+  self->fp = NULL;
+  self->meta = NULL;
+  self->image = image;
+  self->data = NULL;
+  self->line_count = image->size_y;
+  self->sample_count = image->size_x;
+}
+
+static void match_image_from_data(match_image_t *self, const float *data,
+                                  int stride, int line_count,
+                                  int sample_count)
+{
+  self->fp = NULL;
+  self->meta = NULL;
+  self->image = NULL;
+  self->data = data;
+  self->stride = stride;
+  self->line_count = line_count;
+  self->sample_count = sample_count;
+}
+
+static void match_image_close(match_image_t *self)
+{
+  if (self->meta) meta_free(self->meta);
+  if (self->fp) FCLOSE(self->fp);
+}
+
+static void get_match_line(match_image_t *in, int line, float *buf)
+{
+  if (in->data)
+    memcpy(buf, in->data + (size_t)line*in->stride,
+           sizeof(float)*in->sample_count);
+  else if (in->image)
+    float_image_get_row(in->image, line, buf);
+  else
+    get_float_line(in->fp, in->meta, line, buf);
+}
+
+/* readImg: reads the image given by in
    into the (nl x ns) float array dest.  Reads a total of
    (delY x delX) pixels into topleft corner of dest, starting
-   at (startY , startX) in the input file.
+   at (startY , startX) in the input image.
 */
-static void readImage(FILE *in,meta_parameters *meta,
+static void readImage(match_image_t *in,
               int startX,int startY,int delX,int delY,
               float add,float *sum, float *dest, int nl, int ns)
 {
-  float *inBuf=(float *)MALLOC(sizeof(float)*(meta->general->sample_count));
+  float *inBuf=(float *)MALLOC(sizeof(float)*(in->sample_count));
   register int x,y,l;
   double tempSum=0;
 
@@ -42,7 +105,7 @@ static void readImage(FILE *in,meta_parameters *meta,
   /*Read portion of input image into topleft of dest array.*/
   for (y=0;y<delY;y++) {
       l=ns*y;
-      get_float_line(in,meta,startY+y,inBuf);
+      get_match_line(in,startY+y,inBuf);
       if (sum==NULL) {
           for (x=0;x<delX;x++) {
               if (fabs(inBuf[startX+x]) < maxval && meta_is_valid_double(inBuf[startX+x])) {
@@ -156,27 +219,127 @@ static void findPeak(float *corrImage,float *dx,float *dy,float *doubt,
 }
 
 
-/* las_fftProd: reads both given files, and correlates them into the
-created outReal (nl x ns) float array.*/
-static void fftProd(FILE *in1F,meta_parameters *metaMaster,
-            FILE *in2F,meta_parameters *metaSlave,float *outReal[],
-            int ns, int nl, int mX, int mY,
-            int chipX, int chipY, int chipDX, int chipDY,
-            int searchX, int searchY)
+/* FFT sizes and scratch storage for matching images of one size, so
+   that they can be set up once and reused for many matches.  Each plan
+   has its own scratch, so separate threads may match at once as long as
+   each uses its own plan. */
+struct fft_match_plan {
+  int size_x, size_y;      /*Size of the images this plan matches.*/
+  int nl,ns;
+  int mX,mY;               /*Invariant: 2^mX=ns; 2^mY=nl.*/
+  float *in1,*in2;         /*(nl x ns) FFT buffers; in2 gets the correlation.*/
+  float *work;             /*Column storage for rfft2d_r & rifft2d_r.*/
+};
+
+/* Where the search chip is taken from the slave image, and how far to
+   search for the peak. */
+typedef struct {
+  int chipX, chipY;        /*Chip location (top left corner) in second image*/
+  int chipDX,chipDY;       /*Chip size in second image.*/
+  int searchX,searchY;     /*Maximum distance to search for peak*/
+} match_chip_t;
+
+/* Set up a plan for matching images of size_x samples by size_y lines.
+   This calls fft2dInit, which isn't thread safe, so plans must be created
+   before any threads that use them are started. */
+fft_match_plan_t *fft_match_plan_new(int size_x, int size_y)
+{
+  fft_match_plan_t *self = MALLOC(sizeof(fft_match_plan_t));
+  int nl,ns,mX,mY;
+
+  self->size_x = size_x;
+  self->size_y = size_y;
+
+  /*Round to find nearest power of 2 for FFT size.*/
+  mX = (int)(log((float)(size_x))/log(2.0)+0.5);
+  mY = (int)(log((float)(size_y))/log(2.0)+0.5);
+
+  /* Keep size of fft's reasonable */
+  if (mX > 13) mX = 13;
+  if (mY > 15) mY = 15;
+  ns = 1<<mX;
+  nl = 1<<mY;
+
+  /* Test chip size to see if we have enough memory for it */
+  /* Reduce it if necessary, but not below 1024x1024 (which needs 4 Mb of memory) */
+  /* The memory we test with becomes the two FFT buffers. */
+  float *test_mem = (float *)malloc(sizeof(float)*ns*nl*2);
+  if (!test_mem && !quietflag) asfPrintStatus("\n");
+  while (!test_mem) {
+      mX--;
+      mY--;
+      ns = 1<<mX;
+      nl = 1<<mY;
+      if (ns < 1024 || nl < 1024) {
+          asfPrintError("FFT Size too small (%dx%d)...\n", ns, nl);
+      }
+      if (!quietflag) asfPrintStatus("   Not enough memory... reducing FFT Size to %dx%d\n", ns, nl);
+      test_mem = (float *)malloc(sizeof(float)*ns*nl*2);
+  }
+  if (!quietflag) asfPrintStatus("\n");
+
+  self->nl = nl;
+  self->ns = ns;
+  self->mX = mX;
+  self->mY = mY;
+  self->in1 = test_mem;
+  self->in2 = test_mem + ns*nl;
+  self->work = (float *)MALLOC(sizeof(float)*4*2*nl);
+
+  fft2dInit(mY, mX);
+
+  if (!quietflag && ns*nl*2*sizeof(float)>20*1024*1024) {
+    asfPrintStatus(
+            "   These images will take %d megabytes of memory to match.\n\n",
+            ns*nl*2*sizeof(float)/(1024*1024));
+  }
+
+  return self;
+}
+
+void fft_match_plan_free(fft_match_plan_t *self)
+{
+  if (self) {
+    FREE(self->work);
+    FREE(self->in1);/*in2 is part of the same block.*/
+    FREE(self);
+  }
+}
+
+/*Set up search chip size.*/
+static void set_up_chip(fft_match_plan_t *plan, match_image_t *slave,
+                        match_chip_t *chip)
+{
+  int ns=plan->ns, nl=plan->nl;
+
+  chip->chipDX=MINI(slave->sample_count,ns)*3/4;
+  chip->chipDY=MINI(slave->line_count,nl)*3/4;
+  chip->chipX=MINI(slave->sample_count,ns)/8;
+  chip->chipY=MINI(slave->line_count,nl)/8;
+  chip->searchX=MINI(slave->sample_count,ns)*3/8;
+  chip->searchY=MINI(slave->line_count,nl)*3/8;
+}
+
+/* las_fftProd: reads both given images, and correlates them into the
+plan's (nl x ns) float array, which is returned.*/
+static float *fftProd(fft_match_plan_t *plan, match_image_t *master,
+                      match_image_t *slave, match_chip_t *chip)
 {
+  int ns=plan->ns, nl=plan->nl, mX=plan->mX, mY=plan->mY;
+  int chipX=chip->chipX, chipY=chip->chipY;
+  int chipDX=chip->chipDX, chipDY=chip->chipDY;
   float scaleFact=1.0/(chipDX*chipDY);
   register float *in1,*in2,*out;
   register int x,y,l;
   float aveChip;
 
-  in1=(float *)MALLOC(sizeof(float)*ns*nl);
-  in2=(float *)MALLOC(sizeof(float)*ns*nl);
+  in1=plan->in1;
+  in2=plan->in2;
   out=in2;
-  *outReal=in2;
 
   /*Read image 2 (chip)*/
   //asfPrintStatus("Reading Image 2\n");
-  readImage(in2F,metaSlave,
+  readImage(slave,
             chipX,chipY,chipDX,chipDY,
             0.0,&aveChip,in2,nl,ns);
 
@@ -193,18 +356,18 @@ static void fftProd(FILE *in1F,meta_parameters *metaMaster,
 
   /*FFT image 2 */
   //asfPrintStatus("FFT Image 2\n");
-  rfft2d(in2,mY,mX);
+  rfft2d_r(in2,mY,mX,plan->work);
 
   /*Read image 1: Much easier, now that we know the average brightness. */
   //asfPrintStatus("Reading Image 1\n");
-  readImage(in1F,metaMaster,
-            0,0,MINI(metaMaster->general->sample_count,ns),
-            MINI(metaMaster->general->line_count,nl),
+  readImage(master,
+            0,0,MINI(master->sample_count,ns),
+            MINI(master->line_count,nl),
             aveChip,NULL,in1,nl,ns);
 
   /*FFT Image 1 */
   //asfPrintStatus("FFT Image 1\n");
-  rfft2d(in1,mY,mX);
+  rfft2d_r(in1,mY,mX,plan->work);
 
   /*Conjugate in2.*/
   //asfPrintStatus("Conjugate Image 2\n");
@@ -232,9 +395,9 @@ static void fftProd(FILE *in1F,meta_parameters *metaMaster,
 
   /*Inverse-fft the product*/
   //asfPrintStatus("I-FFT\n");
-  rifft2d(out,mY,mX);
+  rifft2d_r(out,mY,mX,plan->work);
 
-  FREE(in1);/*Note: in2 shouldn't be freed, because we return it.*/
+  return out;
 }
 
 static int mini(int a, int b)
@@ -825,72 +988,37 @@ int fftMatch_projList(char *inFile, char *descFile)
   return 0;
 }
 
-int fftMatch(char *inFile1, char *inFile2, char *corrFile,
-          float *bestLocX, float *bestLocY, float *certainty)
+/* Does the work of fftMatch and fftMatch_image.  The correlation
+   image can only be written if the master image came from inFile1. */
+static int match_images(match_image_t *master, match_image_t *slave,
+                        char *inFile1, char *corrFile,
+                        float *bestLocX, float *bestLocY, float *certainty)
 {
+  fft_match_plan_t *plan;
+  match_chip_t chip;
   int nl,ns;
-  int mX,mY;               /*Invariant: 2^mX=ns; 2^mY=nl.*/
-  int chipX, chipY;        /*Chip location (top left corner) in second image*/
-  int chipDX,chipDY;       /*Chip size in second image.*/
-  int searchX,searchY;     /*Maximum distance to search for peak*/
+  int chipX, chipY;
+  int searchX,searchY;
 
   int x,y;
   float doubt;
   float *corrImage=NULL;
-  FILE *corrF=NULL,*in1F,*in2F;
-  meta_parameters *metaMaster, *metaSlave, *metaOut;
-
-  in1F = fopenImage(inFile1,"rb");
-  in2F = fopenImage(inFile2,"rb");
-  metaMaster = meta_read(inFile1);
-  metaSlave = meta_read(inFile2);
-
-  /*Round to find nearest power of 2 for FFT size.*/
-  mX = (int)(log((float)(metaMaster->general->sample_count))/log(2.0)+0.5);
-  mY = (int)(log((float)(metaMaster->general->line_count))/log(2.0)+0.5);
-
-  /* Keep size of fft's reasonable */
-  if (mX > 13) mX = 13;
-  if (mY > 15) mY = 15;
-  ns = 1<<mX;
-  nl = 1<<mY;
-
-  /* Test chip size to see if we have enough memory for it */
-  /* Reduce it if necessary, but not below 1024x1024 (which needs 4 Mb of memory) */
-  float *test_mem = (float *)malloc(sizeof(float)*ns*nl*2);
-  if (!test_mem && !quietflag) asfPrintStatus("\n");
-  while (!test_mem) {
-      mX--;
-      mY--;
-      ns = 1<<mX;
-      nl = 1<<mY;
-      if (ns < 1024 || nl < 1024) {
-          asfPrintError("FFT Size too small (%dx%d)...\n", ns, nl);
-      }
-      if (!quietflag) asfPrintStatus("   Not enough memory... reducing FFT Size to %dx%d\n", ns, nl);
-      test_mem = (float *)malloc(sizeof(float)*ns*nl*2);
-  }
-  FREE(test_mem);
-  if (!quietflag) asfPrintStatus("\n");
-
-  /*Set up search chip size.*/
-  chipDX=MINI(metaSlave->general->sample_count,ns)*3/4;
-  chipDY=MINI(metaSlave->general->line_count,nl)*3/4;
-  chipX=MINI(metaSlave->general->sample_count,ns)/8;
-  chipY=MINI(metaSlave->general->line_count,nl)/8;
-  searchX=MINI(metaSlave->general->sample_count,ns)*3/8;
-  searchY=MINI(metaSlave->general->line_count,nl)*3/8;
+  FILE *corrF=NULL;
+  meta_parameters *metaOut;
 
-  fft2dInit(mY, mX);
+  plan = fft_match_plan_new(master->sample_count, master->line_count);
+  ns = plan->ns;
+  nl = plan->nl;
 
-  if (!quietflag && ns*nl*2*sizeof(float)>20*1024*1024) {
-    asfPrintStatus(
-            "   These images will take %d megabytes of memory to match.\n\n",
-            ns*nl*2*sizeof(float)/(1024*1024));
-  }
+  set_up_chip(plan, slave, &chip);
+  chipX = chip.chipX;
+  chipY = chip.chipY;
+  searchX = chip.searchX;
+  searchY = chip.searchY;
 
   /*Optionally open the correlation image file.*/
   if (corrFile) {
+    g_assert(inFile1 != NULL);
     metaOut = meta_read(inFile1);
     metaOut->general->data_type= REAL32;
     metaOut->general->line_count = 2*searchY;
@@ -899,8 +1027,7 @@ int fftMatch(char *inFile1, char *inFile2, char *corrFile,
   }
 
   /*Perform the correlation.*/
-  fftProd(in1F,metaMaster,in2F,metaSlave,&corrImage,ns,nl,mX,mY,
-          chipX,chipY,chipDX,chipDY,searchX,searchY);
+  corrImage = fftProd(plan,master,slave,&chip);
 
   /*Optionally write out correlation image.*/
   if (corrFile) {
@@ -925,16 +1052,71 @@ int fftMatch(char *inFile1, char *inFile2, char *corrFile,
            chipX,chipY,searchX,searchY);
            *certainty = 1-doubt;
 
-  FREE(corrImage);
+  fft_match_plan_free(plan);
   if (!quietflag) {
     asfPrintStatus("   Offset slave image: dx = %f, dy = %f\n"
                    "   Certainty: %f%%\n",*bestLocX,*bestLocY,100*(1-doubt));
   }
 
-  meta_free(metaSlave);
-  meta_free(metaMaster);
-  FCLOSE(in1F);
-  FCLOSE(in2F);
+  return (0);
+}
+
+int fftMatch(char *inFile1, char *inFile2, char *corrFile,
+          float *bestLocX, float *bestLocY, float *certainty)
+{
+  match_image_t master, slave;
+
+  match_image_from_file(&master, inFile1);
+  match_image_from_file(&slave, inFile2);
+
+  match_images(&master, &slave, inFile1, corrFile,
+               bestLocX, bestLocY, certainty);
+
+  match_image_close(&slave);
+  match_image_close(&master);
+
+  return (0);
+}
+
+/* Same as fftMatch, but for images that are already in memory, so
+   intermediate results needn't be written out just to be matched. */
+int fftMatch_image(FloatImage *image1, FloatImage *image2,
+                   float *bestLocX, float *bestLocY, float *certainty)
+{
+  match_image_t master, slave;
+
+  match_image_from_float_image(&master, image1);
+  match_image_from_float_image(&slave, image2);
+
+  return match_images(&master, &slave, NULL, NULL,
+                      bestLocX, bestLocY, certainty);
+}
+
+/* Match two chips that are already in memory, each plan->size_y lines
+   of plan->size_x samples, with successive lines stride floats apart.
+   Nothing is printed and no global state is touched, so separate threads
+   can match chips at once, each with its own plan.  The same plan can be
+   reused for any number of chip pairs of its size. */
+int fftMatch_chips(fft_match_plan_t *plan,
+                   const float *master, int master_stride,
+                   const float *slave, int slave_stride,
+                   float *bestLocX, float *bestLocY, float *certainty)
+{
+  match_image_t m, s;
+  match_chip_t chip;
+  float doubt;
+  float *corrImage;
+
+  match_image_from_data(&m, master, master_stride,
+                        plan->size_y, plan->size_x);
+  match_image_from_data(&s, slave, slave_stride,
+                        plan->size_y, plan->size_x);
+
+  set_up_chip(plan, &s, &chip);
+  corrImage = fftProd(plan, &m, &s, &chip);
+  findPeak(corrImage,bestLocX,bestLocY,&doubt,plan->nl,plan->ns,
+           chip.chipX,chip.chipY,chip.searchX,chip.searchY);
+  *certainty = 1-doubt;
 
   return (0);
 }
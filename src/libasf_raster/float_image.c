@@ -17,16 +17,15 @@
 #if GLIB_CHECK_VERSION (2, 6, 0)
 #  include <glib/gstdio.h>
 #endif
-#include <gsl/gsl_spline.h>
 #include <gsl/gsl_histogram.h>
 #include <gsl/gsl_math.h>
 
 #include "asf.h"
+#include "asf_glib.h"
 #include "asf_tiff.h"
 #include "asf_jpeg.h"
 #include "float_image.h"
-
-double gsl_spline_eval_check(gsl_spline *, double, gsl_interp_accel *);
+#include "asf_raster.h"
 
 #ifndef linux
 #ifndef darwin
@@ -42,8 +41,16 @@ round (double arg)
 
 #include "asf_glib.h"
 
-// Default cache size to use is 16 megabytes.
-static const size_t default_cache_size = 16 * 1048576;
+// Default cache size to use is 16 megabytes, unless overridden by
+// the ASF_FLOAT_IMAGE_CACHE_MB environment variable or
+// float_image_set_default_cache_size.  Zero means not yet determined.
+static size_t default_cache_size = 0;
+// Largest tile size we use, in pixels on a side.  Big caches would
+// otherwise produce tiles so large that a single miss loads hundreds
+// of megabytes.
+static const size_t maximum_tile_size = 1024;
+// Bits kept for each tile in the tile_flags array.
+#define TILE_REFERENCED 0x1     // Accessed since last passed by the clock hand.
 // This class wide data element keeps track of the number of temporary
 // tile files opened by the current process, in order to give them
 // unique names.
@@ -61,6 +68,105 @@ G_LOCK_DEFINE_STATIC (current_tile_file_number);
 G_LOCK_DEFINE_STATIC (signal_block_activity);
 #endif
 
+size_t
+float_image_get_default_cache_size (void)
+{
+  if ( default_cache_size == 0 ) {
+    size_t size = 16 * 1048576;
+    const gchar *cache_mb = g_getenv ("ASF_FLOAT_IMAGE_CACHE_MB");
+    if ( cache_mb != NULL && atol (cache_mb) > 0 ) {
+      size = (size_t) atol (cache_mb) * 1048576;
+    }
+    default_cache_size = size;
+  }
+
+  return default_cache_size;
+}
+
+void
+float_image_set_default_cache_size (size_t size)
+{
+  // Keep the cache a whole number of pixels, and big enough to be usable.
+  size -= size % sizeof (float);
+  g_assert (size >= 1048576);
+  default_cache_size = size;
+}
+
+// Create the lock that guards tile loading and eviction, and the tile
+// flags.
+static GMutex *
+cache_lock_new (void)
+{
+  asf_thread_init ();
+  return asf_mutex_new ();
+}
+
+static inline void
+cache_lock (FloatImage *self)
+{
+  if ( self->cache_lock != NULL ) {
+    g_mutex_lock (self->cache_lock);
+  }
+}
+
+static inline void
+cache_unlock (FloatImage *self)
+{
+  if ( self->cache_lock != NULL ) {
+    g_mutex_unlock (self->cache_lock);
+  }
+}
+
+// Mark a tile as modified since it was loaded from disk.  This doesn't
+// need the cache lock, so pixels of tiles that stay in memory can be
+// set without it, but tiles that can be evicted have to be marked
+// before the lock is released.  Images without a tile file never write
+// tiles out, so there is nothing to mark.
+static inline void
+mark_tile_dirty (FloatImage *self, size_t tile_offset)
+{
+  if ( self->tile_file != NULL
+       && !g_atomic_int_get (&(self->tile_dirty[tile_offset])) ) {
+    g_atomic_int_set (&(self->tile_dirty[tile_offset]), TRUE);
+  }
+}
+
+// Return true iff every tile of the image fits in the memory cache.
+// Loaded tiles of such images are never evicted, so once a tile
+// address is set it stays valid and can be used without locking.
+static inline gboolean
+all_tiles_cached (FloatImage *self)
+{
+  return self->cache_size_in_tiles >= self->tile_count;
+}
+
+// The address of a tile as last published by load_tile, for the fast
+// paths that look without taking the cache lock, or NULL if the tile
+// has to be looked up under the lock.  Tiles of images that don't fit
+// in the cache can be evicted at any time, so they never take the
+// fast paths.
+static inline float *
+published_tile_address (FloatImage *self, size_t tile_offset)
+{
+  if ( !all_tiles_cached (self) ) {
+    return NULL;
+  }
+  return g_atomic_pointer_get ((gpointer *) &(self->tile_addresses[tile_offset]));
+}
+
+// Allocate the memory cache and the slot bookkeeping for
+// self->cache_size_in_tiles tiles of self->tile_area pixels.
+static void
+allocate_tile_cache (FloatImage *self)
+{
+  self->cache_area = self->cache_size_in_tiles * self->tile_area;
+  self->cache_space = self->cache_area * sizeof (float);
+  self->cache = g_new (float, self->cache_area);
+  self->slot_tiles = g_new (size_t, self->cache_size_in_tiles);
+  self->slots_used = 0;
+  self->clock_hand = 0;
+}
+
 // Return a FILE pointer refering to a new, already unlinked file in a
 // location which hopefully has enough free space to serve as a block
 // cache.
@@ -170,21 +276,26 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
   // differently.  FIXME: it would be slightly better to also detect
   // and specially handle the case where we have long narrow images
   // that can fit in a single stip of tiles in the cache.
+  size_t cache_space = float_image_get_default_cache_size ();
   if ( largest_dimension * largest_dimension * sizeof (float)
-       <= default_cache_size ) {
-    self->cache_space = largest_dimension * largest_dimension * sizeof (float);
-    self->cache_area = self->cache_space / sizeof (float);
+       <= cache_space ) {
     self->tile_size = largest_dimension;
     self->cache_size_in_tiles = 1;
     self->tile_count_x = 1;
     self->tile_count_y = 1;
     self->tile_count = 1;
-    self->tile_area = self->tile_size * self->tile_size;
-    self->cache = g_new (float, self->cache_area);
+    // Rows are still tile_size apart, but only the pixels of the image
+    // itself are ever addressed, so for images at least as wide as they
+    // are tall this is size_x * size_y.
+    self->tile_area = (size_y - 1) * self->tile_size + size_x;
+    allocate_tile_cache (self);
     self->tile_addresses = g_new0 (float *, self->tile_count);
     g_assert (NULL == 0x0);     // Ensure g_new0 effectively sets to NULL.
-    // The tile queue shouldn't ever be needed in this case.
-    self->tile_queue = NULL;
+    self->tile_flags = g_new0 (guchar, self->tile_count);
+    self->tile_dirty = g_new0 (gint, self->tile_count);
+    // The whole image is always in memory, so nothing ever needs
+    // locking.
+    self->cache_lock = NULL;
     // The tile file shouldn't ever be needed, so we set it to NULL to
     // indicate this to a few other methods that use it directly, and
     // to hopefully ensure that it triggers an exception if it is
@@ -197,12 +308,9 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
     return self;
   }
 
-  // The default cache size compiled into the class.
-  self->cache_space = default_cache_size;
-
   // Memory cache space, in pixels.
-  g_assert (self->cache_space % sizeof (float) == 0);
-  self->cache_area = self->cache_space / sizeof (float);
+  g_assert (cache_space % sizeof (float) == 0);
+  size_t cache_area = cache_space / sizeof (float);
 
   // How small do our tiles have to be on a side to fit two full rows
   // of them in the memory cache?  This is slightly tricky.  In order
@@ -210,18 +318,22 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
   // solve
   //
   //      2 * pow (t, 2) * ceil ((double)largest_dimension / t)
-  //           <= self->cache_area
+  //           <= cache_area
   //
   // for tile size t.  I don't know the closed form solution if there
   // is one, so toss out the ceil() and solve the easier
   //
-  //      2 * pow (t, 2) * ((double)largest_dimension / t) <= self->cache_area
+  //      2 * pow (t, 2) * ((double)largest_dimension / t) <= cache_area
   //
-  // and then decrement t iteratively until things work.
-  self->tile_size = self->cache_area / (2 * largest_dimension);
+  // and then decrement t iteratively until things work.  Smaller
+  // tiles than that are fine, so large caches get capped tiles.
+  self->tile_size = cache_area / (2 * largest_dimension);
+  if ( self->tile_size > maximum_tile_size ) {
+    self->tile_size = maximum_tile_size;
+  }
   while ( (2 * self->tile_size * self->tile_size
            * ceil ((double) largest_dimension / self->tile_size))
-          > self->cache_area ) {
+          > cache_area ) {
     self->tile_size--;
   }
 
@@ -237,13 +349,6 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
   // Area of tiles, in pixels.
   self->tile_area = (size_t) (self->tile_size * self->tile_size);
 
-  // Number of tiles which will fit in image cache.
-  self->cache_size_in_tiles = self->cache_area / self->tile_area;
-  // Can we fit at least as much as we intended in the cache?
-  g_assert (self->cache_size_in_tiles
-            >= 2 * (size_t) ceil ((double) largest_dimension
-                                  / self->tile_size));
-
   // Number of tiles image has been split into in x and y directions.
   self->tile_count_x = (size_t) ceil ((double) self->size_x / self->tile_size);
   self->tile_count_y = (size_t) ceil ((double) self->size_y / self->tile_size);
@@ -255,14 +360,22 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
   // we need it to fit into an integer.
   g_assert (self->tile_count < INT_MAX);
 
-  // Did all that math work?
-  g_assert (self->tile_size * self->cache_size_in_tiles / 2
-            >= largest_dimension);
-  g_assert (self->cache_size_in_tiles * self->tile_area <= self->cache_area);
+  // Number of tiles which will fit in image cache.  There is no point
+  // in reserving room for more tiles than the image has.
+  self->cache_size_in_tiles = cache_area / self->tile_area;
+  if ( self->cache_size_in_tiles > self->tile_count ) {
+    self->cache_size_in_tiles = self->tile_count;
+  }
+  // Can we fit at least as much as we intended in the cache?
+  g_assert (self->cache_size_in_tiles
+            >= MIN (self->tile_count,
+                    2 * (size_t) ceil ((double) largest_dimension
+                                       / self->tile_size)));
 
   // Allocate memory for the in-memory cache.
-  self->cache = g_new (float, self->cache_area);
+  allocate_tile_cache (self);
   // Do we want to do mlock() here maybe?
+  g_assert (self->cache_space <= cache_space);
 
   // The addresses in the cache of the starts of each of the tiles.
   // This array contains flattened tile addresses in the same way that
@@ -273,9 +386,12 @@ initialize_float_image_structure (ssize_t size_x, ssize_t size_y)
   self->tile_addresses = g_new0 (float *, self->tile_count);
   g_assert (NULL == 0x0);       // Ensure g_new0 effectively sets to NULL.
 
-  // Create a queue in order to keep track of which tile was loaded
-  // longest ago.
-  self->tile_queue = g_queue_new ();
+  // Referenced and dirty bits for each tile, used to pick tiles to
+  // evict and to avoid writing back tiles that haven't changed.
+  self->tile_flags = g_new0 (guchar, self->tile_count);
+  self->tile_dirty = g_new0 (gint, self->tile_count);
+
+  self->cache_lock = cache_lock_new ();
 
   // Get a new empty tile cache file pointer.
   self->tile_file_name = NULL;
@@ -328,21 +444,24 @@ float_image_thaw (FILE *file_pointer)
 
   // The cache isn't serialized -- its a bit of a pain and probably
   // almost never worth it.
-  self->cache = g_new (float, self->cache_area);
+  allocate_tile_cache (self);
 
   self->tile_addresses = g_new0 (float *, self->tile_count);
-
-  // We don't actually keep the tile queue in the serialized instance,
-  // but if the serialized pointer to it is NULL, we know we aren't
-  // using a tile cache file (i.e. the whole image fits in the memory
-  // cache).
-  read_count = fread (&(self->tile_queue), sizeof (GQueue *), 1, fp);
+  self->tile_flags = g_new0 (guchar, self->tile_count);
+  self->tile_dirty = g_new0 (gint, self->tile_count);
+
+  // A pointer sized marker tells us whether the frozen instance used
+  // a tile cache file (it is NULL if the whole image fit in the
+  // memory cache).
+  gpointer had_tile_file;
+  read_count = fread (&had_tile_file, sizeof (gpointer), 1, fp);
   g_assert (read_count == 1);
 
   // If there was no cache file...
-  if ( self->tile_queue == NULL ) {
+  if ( had_tile_file == NULL ) {
     // The tile_file structure field should also be NULL.
     self->tile_file = NULL;
+    self->cache_lock = NULL;
     // we restore the file directly into the first and only tile (see
     // the end of the float_image_new method).
     self->tile_addresses[0] = self->cache;
@@ -350,10 +469,10 @@ float_image_thaw (FILE *file_pointer)
       self->tile_area, fp);
     g_assert (read_count == self->tile_area);
   }
-  // otherwise, an empty tile queue needs to be initialized, and the
+  // otherwise, the cache lock needs to be initialized, and the
   // remainder of the serialized version is the tile block cache.
   else {
-    self->tile_queue = g_queue_new ();
+    self->cache_lock = cache_lock_new ();
     self->tile_file_name = NULL;
     self->tile_file = initialize_tile_cache_file (&(self->tile_file_name));
     float *buffer = g_new (float, self->tile_area);
@@ -439,8 +558,8 @@ float_image_new (ssize_t size_x, ssize_t size_y)
   else {
     self->tile_addresses[0] = self->cache;
     size_t ii, jj;
-    for ( ii = 0 ; ii < self->tile_size ; ii++ ) {
-      for ( jj = 0 ; jj < self->tile_size ; jj++ ) {
+    for ( ii = 0 ; ii < self->size_y ; ii++ ) {
+      for ( jj = 0 ; jj < self->size_x ; jj++ ) {
         self->tile_addresses[0][ii * self->tile_size + jj] = 0.0;
       }
     }
@@ -498,8 +617,8 @@ float_image_new_with_value (ssize_t size_x, ssize_t size_y, float value)
   else {
     self->tile_addresses[0] = self->cache;
     size_t ii, jj;
-    for ( ii = 0 ; ii < self->tile_size ; ii++ ) {
-      for ( jj = 0 ; jj < self->tile_size ; jj++ ) {
+    for ( ii = 0 ; ii < self->size_y ; ii++ ) {
+      for ( jj = 0 ; jj < self->size_x ; jj++ ) {
         self->tile_addresses[0][ii * self->tile_size + jj] = value;
       }
     }
@@ -1181,9 +1300,32 @@ tile_is_loaded (FloatImage *self, ssize_t x, ssize_t y)
   return self->tile_addresses[tile_offset] != NULL;
 }
 
-// Load (currently unloaded) tile (x, y) from disk cache into memory
-// cache, possibly displacing the oldest tile already loaded, updating
-// the load order queue, and returning the address of the tile loaded.
+// Pick the cache slot whose tile gets displaced by the next load,
+// using the CLOCK approximation of least-recently-used: the clock
+// hand sweeps over the slots, giving tiles that have been referenced
+// since it last passed a second chance.
+static size_t
+choose_victim_slot (FloatImage *self)
+{
+  for ( ; ; ) {
+    size_t slot = self->clock_hand;
+    size_t tile_offset = self->slot_tiles[slot];
+
+    self->clock_hand = (slot + 1) % self->cache_size_in_tiles;
+
+    if ( self->tile_flags[tile_offset] & TILE_REFERENCED ) {
+      self->tile_flags[tile_offset] &= ~TILE_REFERENCED;
+    }
+    else {
+      return slot;
+    }
+  }
+}
+
+// Load tile (x, y) from disk cache into memory cache if it isn't
+// already there, possibly displacing another tile, and return the
+// address of the tile.  Displaced tiles are only written back if
+// they are dirty.  Must be called with the cache lock held.
 static float *
 load_tile (FloatImage *self, ssize_t x, ssize_t y)
 {
@@ -1191,37 +1333,39 @@ load_tile (FloatImage *self, ssize_t x, ssize_t y)
   // file when in fact we should have.
   g_assert (self->tile_file != NULL);
 
-  g_assert (!tile_is_loaded (self, x, y));
-
-  // Address into which tile gets loaded (to be returned).
-  float *tile_address;
-
   // Offset of tile in flattened array.
   size_t tile_offset = self->tile_count_x * y + x;
 
+  // Another thread may have loaded the tile while we were waiting for
+  // the cache lock.
+  if ( tile_is_loaded (self, x, y) ) {
+    return self->tile_addresses[tile_offset];
+  }
+
+  // Address into which tile gets loaded (to be returned), and the
+  // cache slot at that address.
+  float *tile_address;
+  size_t slot;
+
   // We have to check and see if we have to displace an already loaded
   // tile or not.
-  if ( self->tile_queue->length == self->cache_size_in_tiles ) {
-    // Displace tile loaded longest ago.
-    size_t oldest_tile
-      = GPOINTER_TO_INT (g_queue_pop_tail (self->tile_queue));
-    cached_tile_to_disk (self, oldest_tile);
-    tile_address = self->tile_addresses[oldest_tile];
-    self->tile_addresses[oldest_tile] = NULL;
+  if ( self->slots_used == self->cache_size_in_tiles ) {
+    slot = choose_victim_slot (self);
+    size_t victim_offset = self->slot_tiles[slot];
+    if ( g_atomic_int_get (&(self->tile_dirty[victim_offset])) ) {
+      cached_tile_to_disk (self, victim_offset);
+      g_atomic_int_set (&(self->tile_dirty[victim_offset]), FALSE);
+    }
+    tile_address = self->tile_addresses[victim_offset];
+    self->tile_addresses[victim_offset] = NULL;
+    self->tile_flags[victim_offset] = 0;
   }
   else {
     // Load tile into first free slot.
-    tile_address = self->cache + self->tile_queue->length * self->tile_area;
+    slot = self->slots_used++;
+    tile_address = self->cache + slot * self->tile_area;
   }
 
-  // Put the new tile address into the index, and put the index into
-  // the load order queue.
-  self->tile_addresses[tile_offset] = tile_address;
-  // Stash in queue by converting to a pointer (so it must fit in an int).
-  g_assert (tile_offset < INT_MAX);
-  g_queue_push_head (self->tile_queue,
-                     GINT_TO_POINTER ((int) tile_offset));
-
   // Load the tile data.
   int return_code
     = FSEEK64 (self->tile_file,
@@ -1245,6 +1389,32 @@ load_tile (FloatImage *self, ssize_t x, ssize_t y)
   }
   g_assert (read_count == self->tile_area);
 
+  self->slot_tiles[slot] = tile_offset;
+  self->tile_flags[tile_offset] = TILE_REFERENCED;
+
+  // Only publish the address once the data is in place, since readers
+  // of fully cached images look at it without taking the lock.
+  g_atomic_pointer_set ((gpointer *) &(self->tile_addresses[tile_offset]),
+                        tile_address);
+
+  return tile_address;
+}
+
+// Return the address of tile (x, y), loading it if necessary and
+// marking it as referenced.  Must be called with the cache lock held,
+// and unless all_tiles_cached (self) the address is only good until
+// the lock is released.
+static float *
+get_tile_locked (FloatImage *self, size_t x, size_t y)
+{
+  size_t tile_offset = self->tile_count_x * y + x;
+  float *tile_address = self->tile_addresses[tile_offset];
+
+  if ( tile_address == NULL ) {
+    tile_address = load_tile (self, x, y);
+  }
+  self->tile_flags[tile_offset] |= TILE_REFERENCED;
+
   return tile_address;
 }
 
@@ -1268,17 +1438,28 @@ float_image_get_pixel (FloatImage *self, ssize_t x, ssize_t y)
   // Offset of tile x, y, where tiles are viewed as pixels normally are.
   size_t tile_offset = self->tile_count_x * pc_y.quot + pc_x.quot;
 
+  // Offset of the pixel of interest within its tile.
+  size_t pixel_offset = self->tile_size * pc_y.rem + pc_x.rem;
+
   // Address of data for tile containing pixel of interest (may still
   // have to be loaded from disk cache).
-  float *tile_address = self->tile_addresses[tile_offset];
+  float *tile_address = published_tile_address (self, tile_offset);
 
-  // Load the tile containing the pixel of interest if necessary.
-  if ( G_UNLIKELY (tile_address == NULL) ) {
-    tile_address = load_tile (self, pc_x.quot, pc_y.quot);
+  // Loaded tiles of fully cached images stay put, so we can read them
+  // without locking.
+  if ( G_LIKELY (tile_address != NULL) ) {
+    return tile_address[pixel_offset];
   }
 
+  // Otherwise load the tile containing the pixel of interest if
+  // necessary, and keep it from being evicted while we read it.
+  cache_lock (self);
+  tile_address = get_tile_locked (self, pc_x.quot, pc_y.quot);
+  float value = tile_address[pixel_offset];
+  cache_unlock (self);
+
   // Return pixel of interest.
-  return tile_address[self->tile_size * pc_y.rem + pc_x.rem];
+  return value;
 }
 
 void
@@ -1295,17 +1476,88 @@ float_image_set_pixel (FloatImage *self, ssize_t x, ssize_t y, float value)
   // Offset of tile x, y, where tiles are viewed as pixels normally are.
   size_t tile_offset = self->tile_count_x * pc_y.quot + pc_x.quot;
 
+  // Offset of the pixel of interest within its tile.
+  size_t pixel_offset = self->tile_size * pc_y.rem + pc_x.rem;
+
   // Address of data for tile containing pixel of interest (may still
   // have to be loaded from disk cache).
-  float *tile_address = self->tile_addresses[tile_offset];
+  float *tile_address = published_tile_address (self, tile_offset);
 
-  // Load the tile containing the pixel of interest if necessary.
-  if ( G_UNLIKELY (tile_address == NULL) ) {
-    tile_address = load_tile (self, pc_x.quot, pc_y.quot);
+  if ( G_LIKELY (tile_address != NULL) ) {
+    tile_address[pixel_offset] = value;
+    mark_tile_dirty (self, tile_offset);
+    return;
   }
 
-  // Set pixel of interest.
-  tile_address[self->tile_size * pc_y.rem + pc_x.rem] = value;
+  // Load the tile containing the pixel of interest if necessary, and
+  // set pixel of interest.
+  cache_lock (self);
+  tile_address = get_tile_locked (self, pc_x.quot, pc_y.quot);
+  tile_address[pixel_offset] = value;
+  mark_tile_dirty (self, tile_offset);
+  cache_unlock (self);
+}
+
+// Copy the size_x by size_y region with upper left corner at x, y
+// between the image and buffer (into the image if to_image is true),
+// a tile at a time, with one memcpy per tile row span.
+static void
+copy_region (FloatImage *self, size_t x, size_t y, size_t size_x,
+             size_t size_y, float *buffer, gboolean to_image)
+{
+  if ( size_x == 0 || size_y == 0 ) {
+    return;
+  }
+
+  size_t ts = self->tile_size;
+  size_t tx_first = x / ts, tx_last = (x + size_x - 1) / ts;
+  size_t ty_first = y / ts, ty_last = (y + size_y - 1) / ts;
+
+  size_t tx, ty;
+  for ( ty = ty_first ; ty <= ty_last ; ty++ ) {
+    // Image rows of the region that fall in this row of tiles.
+    size_t row_start = MAX (y, ty * ts);
+    size_t row_end = MIN (y + size_y, (ty + 1) * ts);
+    for ( tx = tx_first ; tx <= tx_last ; tx++ ) {
+      // Image columns of the region that fall in this tile.
+      size_t column_start = MAX (x, tx * ts);
+      size_t column_end = MIN (x + size_x, (tx + 1) * ts);
+      size_t span_bytes = (column_end - column_start) * sizeof (float);
+
+      size_t tile_offset = ty * self->tile_count_x + tx;
+      float *tile_address = published_tile_address (self, tile_offset);
+      // See float_image_get_pixel for when we need the lock.
+      gboolean locked = FALSE;
+      if ( G_UNLIKELY (tile_address == NULL) ) {
+        cache_lock (self);
+        locked = TRUE;
+        tile_address = get_tile_locked (self, tx, ty);
+      }
+
+      float *tile_pixel = (tile_address + (row_start - ty * ts) * ts
+                           + (column_start - tx * ts));
+      float *buffer_pixel = (buffer + (row_start - y) * size_x
+                             + (column_start - x));
+      size_t row;
+      for ( row = row_start ; row < row_end ; row++ ) {
+        if ( to_image ) {
+          memcpy (tile_pixel, buffer_pixel, span_bytes);
+        }
+        else {
+          memcpy (buffer_pixel, tile_pixel, span_bytes);
+        }
+        tile_pixel += ts;
+        buffer_pixel += size_x;
+      }
+
+      if ( to_image ) {
+        mark_tile_dirty (self, tile_offset);
+      }
+      if ( locked ) {
+        cache_unlock (self);
+      }
+    }
+  }
 }
 
 void
@@ -1316,29 +1568,24 @@ float_image_get_region (FloatImage *self, ssize_t x, ssize_t y, ssize_t size_x,
 
   g_assert (size_x >= 0);
   g_assert (x >= 0);
-  g_assert ((size_t) x + (size_t) size_x - 1 < self->size_x);
+  g_assert ((size_t) x + (size_t) size_x <= self->size_x);
   g_assert (size_y >= 0);
   g_assert (y >= 0);
-  g_assert ((size_t) y + (size_t) size_y - 1 < self->size_y);
+  g_assert ((size_t) y + (size_t) size_y <= self->size_y);
 
-  ssize_t ii, jj;               // Index variables.
-  for ( ii = 0 ; ii < size_y ; ii++ ) {
-    for ( jj = 0 ; jj < size_x ; jj++ ) {
-      // We are essentially returning a subimage from the big image.
-      // These are the indicies in the big image (self) of the current
-      // pixel.
-      size_t ix = x + jj, iy = y + ii;
-      buffer[ii * size_x + jj] = float_image_get_pixel (self, ix, iy);
-    }
-  }
+  copy_region (self, x, y, size_x, size_y, buffer, FALSE);
 }
 
 void
-float_image_set_region (FloatImage* UNUSED(self),
-                        size_t UNUSED(x), size_t UNUSED(y), size_t UNUSED(size_x),
-                        size_t UNUSED(size_y), float *UNUSED(buffer))
+float_image_set_region (FloatImage *self, size_t x, size_t y, size_t size_x,
+                        size_t size_y, float *buffer)
 {
-  g_assert_not_reached ();      // Stubbed out for now.
+  g_assert (self->reference_count > 0); // Harden against missed ref=1 in new
+
+  g_assert (x + size_x <= self->size_x);
+  g_assert (y + size_y <= self->size_y);
+
+  copy_region (self, x, y, size_x, size_y, buffer, TRUE);
 }
 
 void
@@ -1672,6 +1919,51 @@ float_image_apply_kernel (FloatImage *self, ssize_t x, ssize_t y,
   return sum;
 }
 
+// Fill values with the 4 x 4 block of pixels with upper left corner
+// at x, y, reflecting at the image edges.
+static void
+get_cubic_neighborhood (FloatImage *self, ssize_t x, ssize_t y,
+                        float values[4][4])
+{
+  size_t ts = self->tile_size;   // Convenience alias.
+  int ii, jj;
+
+  // If the block is inside the image and doesn't span a tile edge, we
+  // read it straight from tile memory.
+  if ( G_LIKELY (   x >= 0 && (size_t) x + 3 < self->size_x
+                 && y >= 0 && (size_t) y + 3 < self->size_y
+                 && x / ts == (x + 3) / ts && y / ts == (y + 3) / ts) ) {
+    size_t tx = x / ts, ty = y / ts;
+    size_t tile_offset = ty * self->tile_count_x + tx;
+    float *tile_address = published_tile_address (self, tile_offset);
+    // See float_image_get_pixel for when we need the lock.
+    gboolean locked = FALSE;
+    if ( G_UNLIKELY (tile_address == NULL) ) {
+      cache_lock (self);
+      locked = TRUE;
+      tile_address = get_tile_locked (self, tx, ty);
+    }
+    const float *pixel = tile_address + (y % ts) * ts + x % ts;
+    for ( ii = 0 ; ii < 4 ; ii++ ) {
+      for ( jj = 0 ; jj < 4 ; jj++ ) {
+        values[ii][jj] = pixel[jj];
+      }
+      pixel += ts;
+    }
+    if ( locked ) {
+      cache_unlock (self);
+    }
+  }
+  else {
+    for ( ii = 0 ; ii < 4 ; ii++ ) {
+      for ( jj = 0 ; jj < 4 ; jj++ ) {
+        values[ii][jj]
+          = float_image_get_pixel_with_reflection (self, x + jj, y + ii);
+      }
+    }
+  }
+}
+
 float
 float_image_sample (FloatImage *self, float x, float y,
                     float_image_sample_method_t sample_method)
@@ -1706,14 +1998,21 @@ float_image_sample (FloatImage *self, float x, float y,
         size_t tx = xb / ts, ty = yb / ts;
         // Tile offset in flattened list of tile addresses.
         size_t tile_offset = ty * self->tile_count_x + tx;
-        float *tile_address = self->tile_addresses[tile_offset];
+        float *tile_address = published_tile_address (self, tile_offset);
+        // See float_image_get_pixel for when we need the lock.
+        gboolean locked = FALSE;
         if ( G_UNLIKELY (tile_address == NULL) ) {
-          tile_address = load_tile (self, tx, ty);
+          cache_lock (self);
+          locked = TRUE;
+          tile_address = get_tile_locked (self, tx, ty);
         }
         ul = tile_address[ybto * self->tile_size + xbto];
         ur = tile_address[ybto * self->tile_size + xato];
         ll = tile_address[yato * self->tile_size + xbto];
         lr = tile_address[yato * self->tile_size + xato];
+        if ( locked ) {
+          cache_unlock (self);
+        }
       }
       else {
         // We are spanning a tile edge, so we just get the pixels
@@ -1733,62 +2032,23 @@ float_image_sample (FloatImage *self, float x, float y,
     break;
   case FLOAT_IMAGE_SAMPLE_METHOD_BICUBIC:
     {
-      static gboolean first_time_through = TRUE;
-      // Splines in the x direction, and their lookup accelerators.
-      static double *x_indicies;
-      static double *values;
-      static gsl_spline **xss;
-      static gsl_interp_accel **xias;
-      // Spline between splines in the y direction, and lookup accelerator.
-      static double *y_spline_indicies;
-      static double *y_spline_values;
-      static gsl_spline *ys;
-      static gsl_interp_accel *yia;
-
-      // All these splines have size 4.
-      const size_t ss = 4;
-
-      size_t ii;                // Index variable.
-
-      if ( first_time_through ) {
-        // Allocate memory for the splines in the x direction.
-        x_indicies = g_new (double, ss);
-        values = g_new (double, ss);
-        xss = g_new (gsl_spline *, ss);
-        xias = g_new (gsl_interp_accel *, ss);
-        for ( ii = 0 ; ii < ss ; ii++ ) {
-          xss[ii] = gsl_spline_alloc (gsl_interp_cspline, ss);
-          xias[ii] = gsl_interp_accel_alloc ();
-        }
-
-        // Allocate memory for the spline in the y direction.
-        y_spline_indicies = g_new (double, ss);
-        y_spline_values = g_new (double, ss);
-        ys = gsl_spline_alloc (gsl_interp_cspline, ss);
-        yia = gsl_interp_accel_alloc ();
-        first_time_through = FALSE;
-      }
-
-      // Get the values for the nearest 16 points.
-      size_t jj;                // Index variable.
-      for ( ii = 0 ; ii < ss ; ii++ ) {
-        for ( jj = 0 ; jj < ss ; jj++ ) {
-          x_indicies[jj] = floor (x) - 1 + jj;
-          values[jj]
-            = float_image_get_pixel_with_reflection (self, x_indicies[jj],
-                                                     floor (y) - 1 + ii);
-        }
-        gsl_spline_init (xss[ii], x_indicies, values, ss);
-      }
-
-      // Set up the spline that runs in the y direction.
-      for ( ii = 0 ; ii < ss ; ii++ ) {
-        y_spline_indicies[ii] = floor (y) - 1 + ii;
-        y_spline_values[ii] = gsl_spline_eval_check (xss[ii], x, xias[ii]);
+      // Separable cubic convolution over the nearest 16 pixels, with
+      // tabulated weights.  No state is kept between calls, so this
+      // is safe to use from several threads at once.
+      ssize_t xb = floor (x), yb = floor (y);
+      const float *wx = cubic_convolution_weights (x - xb);
+      const float *wy = cubic_convolution_weights (y - yb);
+      float values[4][4];
+      get_cubic_neighborhood (self, xb - 1, yb - 1, values);
+
+      float result = 0.0;
+      int ii;
+      for ( ii = 0 ; ii < 4 ; ii++ ) {
+        result += wy[ii] * (  wx[0] * values[ii][0] + wx[1] * values[ii][1]
+                            + wx[2] * values[ii][2] + wx[3] * values[ii][3]);
       }
-      gsl_spline_init (ys, y_spline_indicies, y_spline_values, ss);
 
-      return (float) gsl_spline_eval_check (ys, y, yia);
+      return result;
     }
     break;
   default:
@@ -1867,7 +2127,8 @@ float_image_flip_x(FloatImage *self)
 }
 
 // Bring the tile cache file on the disk fully into sync with the
-// latest image data stored in the memory cache.
+// latest image data stored in the memory cache.  Only tiles modified
+// since they were loaded need to be written.
 static void
 synchronize_tile_file_with_memory_cache (FloatImage *self)
 {
@@ -1875,11 +2136,13 @@ synchronize_tile_file_with_memory_cache (FloatImage *self)
   // sense.
   g_assert (self->tile_file != NULL);
 
-  guint ii;
-  for ( ii = 0 ; ii < self->tile_queue->length ; ii++ ) {
-    size_t tile_offset = GPOINTER_TO_INT (g_queue_peek_nth (self->tile_queue,
-                  ii));
-    cached_tile_to_disk (self, tile_offset);
+  size_t ii;
+  for ( ii = 0 ; ii < self->slots_used ; ii++ ) {
+    size_t tile_offset = self->slot_tiles[ii];
+    if ( g_atomic_int_get (&(self->tile_dirty[tile_offset])) ) {
+      cached_tile_to_disk (self, tile_offset);
+      g_atomic_int_set (&(self->tile_dirty[tile_offset]), FALSE);
+    }
   }
 }
 
@@ -1925,14 +2188,15 @@ float_image_freeze (FloatImage *self, FILE *file_pointer)
   // We don't bother serializing the cache -- its a pain to keep track
   // of and probably almost never worth it.
 
-  // We write the tile queue pointer away, so that when we later thaw
+  // We write a pointer sized marker away, so that when we later thaw
   // the serialized version, we can tell if a cache file is in use or
-  // not (if it isn't tile_queue will be NULL).
-  write_count = fwrite (&(self->tile_queue), sizeof (GQueue *), 1, fp);
+  // not (if it isn't the marker will be NULL).
+  gpointer has_tile_file = self->tile_file;
+  write_count = fwrite (&has_tile_file, sizeof (gpointer), 1, fp);
   g_assert (write_count == 1);
 
   // If there was no cache file...
-  if ( self->tile_queue == NULL ) {
+  if ( self->tile_file == NULL ) {
     // We store the contents of the first tile and are done.
     write_count = fwrite (self->tile_addresses[0], sizeof (float),
         self->tile_area, fp);
@@ -2677,16 +2941,47 @@ float_image_export_as_csv (FloatImage *self, const char * filename)
 }
 
 size_t
-float_image_get_cache_size (FloatImage * UNUSED(self))
+float_image_get_cache_size (FloatImage *self)
 {
-  g_assert_not_reached ();      // Stubbed out for now.
-  return 0;
+  g_assert (self->reference_count > 0); // Harden against missed ref=1 in new
+
+  return self->cache_space;
 }
 
 void
-float_image_set_cache_size (FloatImage * UNUSED(self), size_t UNUSED(size))
+float_image_set_cache_size (FloatImage *self, size_t size)
 {
-  g_assert_not_reached ();      // Stubbed out for now.
+  g_assert (self->reference_count > 0); // Harden against missed ref=1 in new
+
+  // Images held in a single tile are always entirely in memory.
+  if ( self->tile_file == NULL ) {
+    return;
+  }
+
+  // Keep at least two full rows or columns of tiles in the cache, as
+  // promised in the interface, but no more tiles than the image has.
+  size_t largest_tile_count = MAX (self->tile_count_x, self->tile_count_y);
+  size_t cache_size_in_tiles = size / (self->tile_area * sizeof (float));
+  cache_size_in_tiles = CLAMP (cache_size_in_tiles,
+                               MIN (2 * largest_tile_count, self->tile_count),
+                               self->tile_count);
+  if ( cache_size_in_tiles == self->cache_size_in_tiles ) {
+    return;
+  }
+
+  // Write back modified tiles, then start over with an empty cache of
+  // the new size.
+  synchronize_tile_file_with_memory_cache (self);
+  size_t ii;
+  for ( ii = 0 ; ii < self->slots_used ; ii++ ) {
+    size_t tile_offset = self->slot_tiles[ii];
+    self->tile_addresses[tile_offset] = NULL;
+    self->tile_flags[tile_offset] = 0;
+  }
+  g_free (self->cache);
+  g_free (self->slot_tiles);
+  self->cache_size_in_tiles = cache_size_in_tiles;
+  allocate_tile_cache (self);
 }
 
 FloatImage *
@@ -2722,10 +3017,11 @@ float_image_free (FloatImage *self)
   // Deallocate dynamic memory.
 
   g_free (self->tile_addresses);
-
-  // If we didn't need a tile file, we also won't have a tile queue.
-  if ( self->tile_queue != NULL ) {
-    g_queue_free (self->tile_queue);
+  g_free (self->tile_flags);
+  g_free (self->tile_dirty);
+  g_free (self->slot_tiles);
+  if ( self->cache_lock != NULL ) {
+    asf_mutex_free (self->cache_lock);
   }
 
   g_free (self->cache);
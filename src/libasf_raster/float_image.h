@@ -5,8 +5,12 @@
 // accesses are spatially correlated.  A variety of useful methods are
 // implemented (filtering, subsetting, interpolating, etc.)
 //
-// Don't try to access the same instance concurrently.  Split your
-// images up into separate instances if you must parallelize things.
+// Any number of threads may read pixels from (or sample) the same
+// instance concurrently.  Threads may also set pixels concurrently, as
+// long as no pixel is set by one thread while another is reading or
+// setting it.  Reads and writes are lock free when every tile of the
+// image fits in the memory cache (see the cache control methods
+// below), and serialized on a per-instance lock otherwise.
 //
 // For many methods, arguments of type ssize_t are used, but are not
 // allowed to be negative.  This is to help prevent people from
@@ -48,7 +52,12 @@ typedef struct {
   size_t tile_area;         // Area of a tile, in pixels.
   float *cache;             // Memory cache.
   float **tile_addresses;   // Addresss of individual tiles in the cache.
-  GQueue *tile_queue;       // Queue of tile offsets kept in load order.
+  guchar *tile_flags;       // Per tile referenced bits.
+  gint *tile_dirty;         // Per tile, modified since loaded from disk.
+  size_t *slot_tiles;       // Offset of the tile held in each cache slot.
+  size_t slots_used;        // Number of cache slots holding a tile.
+  size_t clock_hand;        // Next cache slot considered for eviction.
+  GMutex *cache_lock;       // Guards tile loading and eviction.
   FILE *tile_file;          // File with tiles stored contiguously.
   GString *tile_file_name;  // Name of the tile file
   int reference_count;      // For optional reference counting.
@@ -208,14 +217,19 @@ void
 float_image_set_pixel (FloatImage *self, ssize_t x, ssize_t y, float value);
 
 // Get rectangular image region of size_x, size_y having upper left
-// corner at x, y and copy it into already allocated buffer.  There is
-// not necessarily any caching help for this method, i.e. it may
-// always involve disk access and always be slow.
+// corner at x, y and copy it into already allocated buffer, which is
+// filled row by row.  The region is copied a tile at a time, so each
+// tile it touches is looked up (and possibly loaded from disk) only
+// once, and this is much faster than the equivalent get_pixel loop.
+// Regions that span more tiles than fit in the cache will still
+// cause disk access.
 void
 float_image_get_region (FloatImage *self, ssize_t x, ssize_t y,
             ssize_t size_x, ssize_t size_y, float *buffer);
 
-// This method is analogous to float_image_get_region.
+// This method is analogous to float_image_get_region.  Like
+// float_image_set_pixel, it may be used from several threads at once
+// for regions that don't overlap.
 void
 float_image_set_region (FloatImage *self, size_t x, size_t y, size_t size_x,
             size_t size_y, float *buffer);
@@ -318,7 +332,7 @@ typedef enum {
   FLOAT_IMAGE_SAMPLE_METHOD_NEAREST_NEIGHBOR,
   // Linearly weited average of four nearest pixels
   FLOAT_IMAGE_SAMPLE_METHOD_BILINEAR,
-  // Bicubic spline interpolation (which consideres the nearest 16 pixels).
+  // Cubic convolution (which considers the nearest 16 pixels).
   FLOAT_IMAGE_SAMPLE_METHOD_BICUBIC
 } float_image_sample_method_t;
 
@@ -478,18 +492,35 @@ float_image_export_as_csv (FloatImage *self, const char *file);
 //
 //      2. Otherwise, the tile containing the pixel is loaded,
 //         possibly displacing an already loaded tile, and then the
-//         pixel is fetched or set.  The tile displaced is the one
-//         loaded longest ago (there is no most-recently-accessed
-//         heuristic, as this would make pixel access too slow).
+//         pixel is fetched or set.  The tile displaced is chosen with
+//         the CLOCK approximation of least-recently-used, and is only
+//         written back to disk if it has been modified since it was
+//         loaded.
 //
 // Thus, using a larger memory cache will result in larger tiles being
-// used, and fewer tile loads being needed.  In general, the default
+// used, and fewer tile loads being needed.  Once the cache is big
+// enough to hold every tile of an image no tile is ever evicted, and
+// concurrent reads need no locking at all.  In general, the default
 // behavior is pretty good, but if you know will be performing lots of
 // widely (but not too widely) scattered accesses, you might want to
 // make it bigger.
 //
+// The default cache size is 16 megabytes per image.  It can be
+// changed for the whole process by setting the
+// ASF_FLOAT_IMAGE_CACHE_MB environment variable to a number of
+// megabytes, or with float_image_set_default_cache_size.
+//
 ///////////////////////////////////////////////////////////////////////////////
 
+// Get the cache size in bytes used for images created from now on.
+size_t
+float_image_get_default_cache_size (void);
+
+// Set the cache size in bytes used for images created from now on.
+// This overrides the ASF_FLOAT_IMAGE_CACHE_MB environment variable.
+void
+float_image_set_default_cache_size (size_t size);
+
 // Get the image memory cache size setting, in bytes.  Note that this
 // is the memory cache used per image, not the class-wide cache usage.
 // If you will have a lot of objects instantiated simultaneously, you
@@ -497,9 +528,12 @@ float_image_export_as_csv (FloatImage *self, const char *file);
 size_t
 float_image_get_cache_size (FloatImage *self);
 
-// Set the image memory cache to size bytes.  Changing the cache size
-// requires the tiling to be recomputed, the on-disk tile cache to be
-// regenerated, and the in memory cache to be flushed, so its slow.
+// Set the image memory cache to size bytes.  The tile size is fixed
+// when the image is created, so this only changes how many tiles are
+// kept in memory.  Modified tiles are written back and the in memory
+// cache is flushed, so its slow.  The cache never shrinks below two
+// full rows or columns of tiles, and never grows beyond the whole
+// image.  Requires exclusive access to the instance.
 void
 float_image_set_cache_size (FloatImage *self, size_t size);
 
@@ -0,0 +1,209 @@
+// Test program useful for checking that float_image instances can be
+// written and read from several threads at once.
+//
+// Has a number of threads fill an image with a known pattern at the
+// same time, each setting its own bands of rows (some a pixel at a
+// time, some as regions spanning several tiles), then has them read
+// random pixels and regions from it at the same time and check every
+// value they get back.  This is done with a cache small enough that
+// tiles are continually evicted (and written back) under the cache
+// lock, with a cache holding every tile of a tiled image, so that
+// reads and writes take the lock free paths, and with an image small
+// enough to be held in a single tile.
+//
+// Usage: float_image_threads [threads [image_size [reads_per_thread]]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "asf.h"
+#include "asf_glib.h"
+#include "float_image.h"
+
+#define REGION_SIZE 37
+
+typedef struct {
+  FloatImage *image;
+  ssize_t size;
+  int thread, threads;
+} writer_job;
+
+typedef struct {
+  FloatImage *image;
+  ssize_t size;
+  int reads;
+  unsigned int seed;
+  int errors;
+} reader_job;
+
+// Value stored at x, y.  Exactly representable as a float for the
+// image sizes used here.
+static float pattern (ssize_t x, ssize_t y)
+{
+  return (float) ((y % 4096) * 4096 + (x % 4096));
+}
+
+// Sets the bands of REGION_SIZE rows that belong to this thread,
+// alternately a pixel at a time and as a single region.  Neighboring
+// bands belong to other threads, so tiles are shared between writers.
+static gpointer writer (gpointer data)
+{
+  writer_job *job = (writer_job *) data;
+  float *region = MALLOC (sizeof (float) * job->size * REGION_SIZE);
+  ssize_t band, x, y;
+
+  for ( band = job->thread ; band * REGION_SIZE < job->size ;
+        band += job->threads ) {
+    ssize_t y0 = band * REGION_SIZE;
+    ssize_t rows = MIN (REGION_SIZE, job->size - y0);
+    if ( band % 2 == 0 ) {
+      for ( y = y0 ; y < y0 + rows ; y++ ) {
+        for ( x = 0 ; x < job->size ; x++ ) {
+          float_image_set_pixel (job->image, x, y, pattern (x, y));
+        }
+      }
+    }
+    else {
+      for ( y = 0 ; y < rows ; y++ ) {
+        for ( x = 0 ; x < job->size ; x++ ) {
+          region[y * job->size + x] = pattern (x, y0 + y);
+        }
+      }
+      float_image_set_region (job->image, 0, y0, job->size, rows, region);
+    }
+  }
+
+  FREE (region);
+  return NULL;
+}
+
+static void write_concurrently (FloatImage *image, ssize_t size, int threads)
+{
+  GThread **ids = MALLOC (sizeof (GThread *) * threads);
+  writer_job *jobs = MALLOC (sizeof (writer_job) * threads);
+  int ii;
+
+  for ( ii = 0 ; ii < threads ; ii++ ) {
+    jobs[ii].image = image;
+    jobs[ii].size = size;
+    jobs[ii].thread = ii;
+    jobs[ii].threads = threads;
+    ids[ii] = asf_thread_new ("writer", writer, &jobs[ii]);
+  }
+  for ( ii = 0 ; ii < threads ; ii++ ) {
+    g_thread_join (ids[ii]);
+  }
+
+  FREE (jobs);
+  FREE (ids);
+}
+
+static gpointer reader (gpointer data)
+{
+  reader_job *job = (reader_job *) data;
+  float *region = MALLOC (sizeof (float) * REGION_SIZE * REGION_SIZE);
+  int ii, jj, kk;
+
+  for ( ii = 0 ; ii < job->reads ; ii++ ) {
+    ssize_t x = rand_r (&job->seed) % job->size;
+    ssize_t y = rand_r (&job->seed) % job->size;
+    if ( float_image_get_pixel (job->image, x, y) != pattern (x, y) ) {
+      job->errors++;
+    }
+    // Every so often read a whole region, which may span several tiles.
+    if ( ii % 64 == 0 ) {
+      x = rand_r (&job->seed) % (job->size - REGION_SIZE);
+      y = rand_r (&job->seed) % (job->size - REGION_SIZE);
+      float_image_get_region (job->image, x, y, REGION_SIZE, REGION_SIZE,
+                              region);
+      for ( jj = 0 ; jj < REGION_SIZE ; jj++ ) {
+        for ( kk = 0 ; kk < REGION_SIZE ; kk++ ) {
+          if ( region[jj * REGION_SIZE + kk] != pattern (x + kk, y + jj) ) {
+            job->errors++;
+          }
+        }
+      }
+    }
+  }
+
+  FREE (region);
+  return NULL;
+}
+
+static int read_concurrently (FloatImage *image, ssize_t size, int threads,
+                              int reads)
+{
+  GThread **ids = MALLOC (sizeof (GThread *) * threads);
+  reader_job *jobs = MALLOC (sizeof (reader_job) * threads);
+  int ii, errors = 0;
+
+  for ( ii = 0 ; ii < threads ; ii++ ) {
+    jobs[ii].image = image;
+    jobs[ii].size = size;
+    jobs[ii].reads = reads;
+    jobs[ii].seed = 1234 + ii;
+    jobs[ii].errors = 0;
+    ids[ii] = asf_thread_new ("reader", reader, &jobs[ii]);
+  }
+  for ( ii = 0 ; ii < threads ; ii++ ) {
+    g_thread_join (ids[ii]);
+    errors += jobs[ii].errors;
+  }
+
+  FREE (jobs);
+  FREE (ids);
+  return errors;
+}
+
+// The image is created with a default cache of cache_size bytes, which
+// is then changed to image_cache_size bytes, unless that is zero.
+static int check_image (const char *what, size_t cache_size,
+                        size_t image_cache_size, ssize_t size, int threads,
+                        int reads)
+{
+  FloatImage *image;
+  int errors;
+
+  float_image_set_default_cache_size (cache_size);
+  image = float_image_new (size, size);
+  if ( image_cache_size > 0 ) {
+    float_image_set_cache_size (image, image_cache_size);
+  }
+
+  write_concurrently (image, size, threads);
+  errors = read_concurrently (image, size, threads, reads);
+  printf ("%s: %d threads, %ld x %ld image, %lu byte cache: %d bad values\n",
+          what, threads, (long) size, (long) size,
+          (unsigned long) float_image_get_cache_size (image), errors);
+
+  float_image_free (image);
+  return errors;
+}
+
+int main (int argc, char **argv)
+{
+  int threads = argc > 1 ? atoi (argv[1]) : 8;
+  ssize_t size = argc > 2 ? atoi (argv[2]) : 2000;
+  int reads = argc > 3 ? atoi (argv[3]) : 200000;
+  size_t whole_image = sizeof (float) * size * size;
+  int errors = 0;
+
+  // The smallest cache allowed is a megabyte, so the image has to be
+  // several times bigger than that for tiles to be evicted.
+  assert (threads > 0 && size >= 1024 && reads > 0);
+  asf_thread_init ();
+
+  // Room for only a few tiles, so threads keep evicting each other's.
+  errors += check_image ("evicting tiles", 1048576, 0, size, threads, reads);
+  // Tiled, but with room for every tile, so no tile is ever evicted.
+  errors += check_image ("all tiles cached", 1048576, 2 * whole_image, size,
+                         threads, reads);
+  // Room for the whole image in a single tile.
+  errors += check_image ("single tile", 2 * whole_image, 0, size, threads,
+                         reads);
+
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
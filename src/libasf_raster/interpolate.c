@@ -40,6 +40,16 @@ INPUT: interpolation  - interpolation method (nearest neighbor, bilinear, sinc)
 // NUM_SINCS sinc function to evaluate the result.
 #define NUM_SINCS 512 // Number of sinc functions to compute.
 
+// Number of subpixel phases for which cubic convolution weights are
+// tabulated.  Sample positions are rounded to the nearest phase, i.e.
+// to within 1/2048 of a pixel.
+#define CUBIC_WEIGHT_PHASES 1024
+
+// Cubic convolution weights for each phase, filled in on first use.
+static float cubic_weights[CUBIC_WEIGHT_PHASES + 1][4];
+static gint cubic_weights_ready = FALSE;
+G_LOCK_DEFINE_STATIC (cubic_weights);
+
 // For convenience using buffered image functions
 #define GET_PIXEL(x, y) float_image_get_pixel (inbuf, x, y)
 #define SET_PIXEL(x, y, value) float_image_set_pixel (inbuf, x, y, value)
@@ -81,6 +91,43 @@ INPUT: interpolation  - interpolation method (nearest neighbor, bilinear, sinc)
 //  return inbuf[nSamples * jj + ii];
 //}
 
+// Weights of the cubic convolution kernel of Keys (1981) with a = -0.5
+// for pixels floor(x) - 1 ... floor(x) + 2, where fraction is x -
+// floor(x).  This kernel reproduces quadratics exactly.
+static void
+compute_cubic_weights (double t, float *weights)
+{
+  double t2 = t * t, t3 = t2 * t;
+
+  weights[0] = -0.5 * t3 + t2 - 0.5 * t;
+  weights[1] = 1.5 * t3 - 2.5 * t2 + 1.0;
+  weights[2] = -1.5 * t3 + 2.0 * t2 + 0.5 * t;
+  weights[3] = 0.5 * t3 - 0.5 * t2;
+}
+
+const float *
+cubic_convolution_weights (double fraction)
+{
+  assert (fraction >= 0.0 && fraction <= 1.0);
+
+  // The table is only written once, under the lock, before anyone
+  // is allowed to read it.
+  if ( G_UNLIKELY (!g_atomic_int_get (&cubic_weights_ready)) ) {
+    G_LOCK (cubic_weights);
+    if ( !cubic_weights_ready ) {
+      int ii;
+      for ( ii = 0 ; ii <= CUBIC_WEIGHT_PHASES ; ii++ ) {
+        compute_cubic_weights ((double) ii / CUBIC_WEIGHT_PHASES,
+                               cubic_weights[ii]);
+      }
+      g_atomic_int_set (&cubic_weights_ready, TRUE);
+    }
+    G_UNLOCK (cubic_weights);
+  }
+
+  return cubic_weights[(int) (fraction * CUBIC_WEIGHT_PHASES + 0.5)];
+}
+
 void samples2coefficients(FloatImage *inbuf, char dimension)
 {
   int ii, kk;
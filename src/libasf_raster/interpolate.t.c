@@ -2,6 +2,7 @@
 #include "asf_meta.h"
 #include "asf.h"
 #include "float_image.h"
+#include "uint8_image.h"
 
 #include <stdio.h>
 #include <math.h>
@@ -158,8 +159,158 @@ void rotation_test(interpolate_type_t mode, weighting_type_t f)
   }
 }
 
+// Number of evenly spaced fractions at which the cubic convolution
+// weights are checked.  These all fall on phases of the weight table,
+// so the only error is float rounding.
+#define WEIGHT_STEPS 1024
+
+static double quadratic(double x)
+{
+  return 3.0 - 2.0*x + 0.75*x*x;
+}
+
+// The Keys weights should sum to one (so constants are reproduced),
+// and interpolate any quadratic exactly.
+int cubic_weights_test(void)
+{
+  int ii, kk, failures = 0;
+
+  printf("Cubic convolution weights\n");
+  for (ii=0; ii<=WEIGHT_STEPS; ii++) {
+    double t = (double) ii / WEIGHT_STEPS;
+    const float *w = cubic_convolution_weights(t);
+    double sum = 0.0, value = 0.0;
+    for (kk=0; kk<4; kk++) {
+      sum += w[kk];
+      value += w[kk] * quadratic(kk - 1);
+    }
+    if (fabs(sum - 1.0) > 1e-6) {
+      printf("  weights at %g sum to %.9f\n", t, sum);
+      failures++;
+    }
+    if (fabs(value - quadratic(t)) > 1e-5) {
+      printf("  quadratic at %g is %.9f, expected %.9f\n",
+             t, value, quadratic(t));
+      failures++;
+    }
+  }
+
+  // At whole pixels the kernel must return the pixel itself.
+  const float *w0 = cubic_convolution_weights(0.0);
+  if (w0[0] != 0.0 || w0[1] != 1.0 || w0[2] != 0.0 || w0[3] != 0.0) {
+    printf("  weights at 0 are not 0 1 0 0\n");
+    failures++;
+  }
+
+  return failures;
+}
+
+// Bicubic sampling of a FloatImage holding a quadratic surface should
+// give back the surface itself away from the edges, including where
+// the 4 x 4 neighbourhood spans a tile edge.
+int float_bicubic_quadratic_test(void)
+{
+  const int size = 600;
+  FloatImage *image;
+  int ii, kk, failures = 0;
+
+  printf("Bicubic sampling of a quadratic surface\n");
+  // Small enough that the image is split into tiles.
+  float_image_set_default_cache_size(1048576);
+  image = float_image_new(size, size);
+  for (ii=0; ii<size; ii++)
+    for (kk=0; kk<size; kk++)
+      float_image_set_pixel(image, kk, ii,
+                            quadratic(kk/100.0) + quadratic(ii/100.0));
+
+  srand(4242);
+  for (ii=0; ii<20000; ii++) {
+    float x = 2.0 + (size - 5.0) * rand() / RAND_MAX;
+    float y = 2.0 + (size - 5.0) * rand() / RAND_MAX;
+    // Sample positions are rounded to the nearest table phase.
+    double xr = floor(x) + floor((x - floor(x))*WEIGHT_STEPS + 0.5)/WEIGHT_STEPS;
+    double yr = floor(y) + floor((y - floor(y))*WEIGHT_STEPS + 0.5)/WEIGHT_STEPS;
+    double expected = quadratic(xr/100.0) + quadratic(yr/100.0);
+    double value = float_image_sample(image, x, y,
+                                      FLOAT_IMAGE_SAMPLE_METHOD_BICUBIC);
+    if (fabs(value - expected) > 1e-4 * fabs(expected)) {
+      printf("  sample at %g, %g is %.7f, expected %.7f\n",
+             x, y, value, expected);
+      failures++;
+    }
+  }
+
+  float_image_free(image);
+  return failures;
+}
+
+// FloatImage and UInt8Image holding the same byte data should sample
+// alike.  UInt8Image doesn't do bicubic sampling, so the FloatImage
+// bicubic samples are checked against cubic convolution of the
+// UInt8Image pixels instead.
+int float_uint8_sample_test(void)
+{
+  const int size = 300;
+  FloatImage *fimage = float_image_new(size, size);
+  UInt8Image *bimage = uint8_image_new(size, size);
+  int ii, jj, kk, failures = 0;
+
+  printf("FloatImage versus UInt8Image sampling\n");
+  srand(1701);
+  for (ii=0; ii<size; ii++)
+    for (kk=0; kk<size; kk++) {
+      uint8_t value = rand() % 256;
+      uint8_image_set_pixel(bimage, kk, ii, value);
+      float_image_set_pixel(fimage, kk, ii, value);
+    }
+
+  for (ii=0; ii<20000; ii++) {
+    // float_image_sample takes float coordinates.
+    float x = 1.0 + (size - 3.0) * rand() / RAND_MAX;
+    float y = 1.0 + (size - 3.0) * rand() / RAND_MAX;
+    double fv, bv;
+
+    fv = float_image_sample(fimage, x, y,
+                            FLOAT_IMAGE_SAMPLE_METHOD_NEAREST_NEIGHBOR);
+    bv = uint8_image_sample(bimage, x, y,
+                            UINT8_IMAGE_SAMPLE_METHOD_NEAREST_NEIGHBOR);
+    if (fv != bv) {
+      printf("  nearest neighbor at %g, %g: %g versus %g\n", x, y, fv, bv);
+      failures++;
+    }
+
+    fv = float_image_sample(fimage, x, y, FLOAT_IMAGE_SAMPLE_METHOD_BILINEAR);
+    bv = uint8_image_sample(bimage, x, y, UINT8_IMAGE_SAMPLE_METHOD_BILINEAR);
+    if (fabs(fv - bv) > 1e-3) {
+      printf("  bilinear at %g, %g: %g versus %g\n", x, y, fv, bv);
+      failures++;
+    }
+
+    if (x >= 2.0 && y >= 2.0 && x < size - 3 && y < size - 3) {
+      int xb = floor(x), yb = floor(y);
+      const float *wx = cubic_convolution_weights(x - xb);
+      const float *wy = cubic_convolution_weights(y - yb);
+      fv = float_image_sample(fimage, x, y, FLOAT_IMAGE_SAMPLE_METHOD_BICUBIC);
+      bv = 0.0;
+      for (jj=0; jj<4; jj++)
+        for (kk=0; kk<4; kk++)
+          bv += wy[jj] * wx[kk]
+            * uint8_image_get_pixel(bimage, xb - 1 + kk, yb - 1 + jj);
+      if (fabs(fv - bv) > 1e-3) {
+        printf("  bicubic at %g, %g: %g versus %g\n", x, y, fv, bv);
+        failures++;
+      }
+    }
+  }
+
+  float_image_free(fimage);
+  uint8_image_free(bimage);
+  return failures;
+}
+
 int main(int argc, char * argv [])
 {
+  int failures = 0;
 
   /*
   rotation_test(BILINEAR, NO_WEIGHT);
@@ -169,6 +320,11 @@ int main(int argc, char * argv [])
   rotation_test(SINC, KAISER);
   rotation_test(SINC, LANCZOS);
   */
-  
-  return 0;
+
+  failures += cubic_weights_test();
+  failures += float_bicubic_quadratic_test();
+  failures += float_uint8_sample_test();
+  printf("%d failures\n", failures);
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
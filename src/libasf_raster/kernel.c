@@ -15,9 +15,15 @@ INPUT: inbuf          - input image buffer
 
 #include "asf.h"
 #include "asf_raster.h"
+#include "asf_glib.h"
 
 #define SQR(X) ((X)*(X))
 
+// Output lines handed out to a kernel_filter thread at a time.  Each block
+// reads kernel_size-1 lines more than it outputs, so this keeps that
+// overhead small.
+#define LINES_PER_BLOCK 64
+
 int compare_values(const float *valueA, const float *valueB)
 {
   if (*valueA <  *valueB) return -1;
@@ -64,15 +70,86 @@ double calc_std_dev(float *inbuf, int nSamples, int xSample, int kernel_size,
   return standard_deviation;
 }
 
+// The filters that need only the centre pixel and the mean and standard
+// deviation of the window.  kernel() and kernel_filter() both use this, so
+// the formulas live in one place.
+static int is_local_stats_filter(filter_type_t filter_type)
+{
+  return filter_type == AVERAGE || filter_type == EDGE ||
+    filter_type == LEE || filter_type == ENHANCED_LEE ||
+    filter_type == GAMMA_MAP || filter_type == KUAN;
+}
+
+static double local_stats_value(filter_type_t filter_type, double center,
+                                double mean, double standard_deviation,
+                                float damping_factor, int nLooks)
+{
+  double ci, cu, cmax, weight, a, b, d, rf, value = 0.0;
+
+  switch(filter_type)
+    {
+    case AVERAGE:
+      value = mean;
+      break;
+
+    case EDGE:
+      value = center - mean;
+      break;
+
+    case LEE:
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      weight = 1 - SQR(cu)/SQR(ci);
+      value = center*weight + mean*(1-weight);
+      break;
+
+    case ENHANCED_LEE:
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      cmax = sqrt(1+2.0/(double)nLooks);
+      weight = exp(-damping_factor*(ci-cu)/(cmax-ci));
+      rf = center*weight + center*(1-weight);
+      if (ci <= cu) value = mean;
+      else if ((cu < ci) && (ci < cmax)) value = rf;
+      else if (ci >= cmax) value = center;
+      break;
+
+    case GAMMA_MAP:
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      cmax = sqrt(2.0)*cu;
+      a = (1+SQR(cu)) / (SQR(ci)-SQR(cu));
+      b = a - nLooks - 1;
+      d = SQR(mean)*SQR(b) + 4*a*nLooks*mean*center;
+      rf = (b*mean + sqrt(d)) / (2*a);
+      if (ci <= cu) value = mean;
+      else if ((cu < ci) && (ci < cmax)) value = rf;
+      else if (ci >= cmax) value = center;
+      break;
+
+    case KUAN:
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      weight = (1 - SQR(cu)/SQR(ci))/(1 + SQR(cu));
+      value = center*weight + mean*(1-weight);
+      break;
+
+    default:
+      assert(FALSE);
+    }
+
+  return value;
+}
+
 float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples, 
 	     int yLine, int xSample, int kernel_size, float damping_factor, 
 	     int nLooks)
 {
-  double sum = 0.0, mean, standard_deviation, weight, value = 0.0, sigmsq=4;
+  double sum = 0.0, mean, standard_deviation, value = 0.0, sigmsq=4;
   int half = (kernel_size-1)/2;
   int base = xSample-half; //+(nLines-half)*nSamples;
   int total = 0;
-  double ci, cu, cmax, center, a, b, d, rf = 0.0, x, y, m;
+  double ci, cu, cmax, center, a, rf = 0.0, x, y, m;
   float *pix;
   register int i, j;
   
@@ -214,29 +291,13 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
       break;
 
     case LEE:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      weight = 1 - SQR(cu)/SQR(ci);
-      value = center*weight + mean*(1-weight);
-      break;
-
     case ENHANCED_LEE:
       center = inbuf[base + half + half*nSamples];
       mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
       standard_deviation = 
 	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      cmax = sqrt(1+2.0/(double)nLooks);
-      weight = exp(-damping_factor*(ci-cu)/(cmax-ci));
-      rf = center*weight + center*(1-weight);
-      if (ci <= cu) value = mean;
-      else if ((cu < ci) && (ci < cmax)) value = rf;
-      else if (ci >= cmax) value = center;
+      value = local_stats_value(filter_type, center, mean, standard_deviation,
+                                damping_factor, nLooks);
       break;
 
     case FROST:
@@ -247,7 +308,7 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
       a = damping_factor * SQR(ci);
       for (i=yLine-half; i<=yLine+half; i++) {
 	for (j=xSample-half; j<=xSample+half; j++) {
-          m = exp(-a * abs(j-half));
+          m = exp(-a * abs(j-xSample));
           rf += m * inbuf[base];
           sum += m;
           base++;
@@ -292,113 +353,435 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
       break;
 
     case GAMMA_MAP:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      cmax = sqrt(2.0)*cu;
-      a = (1+SQR(cu)) / (SQR(ci)-SQR(cu));
-      b = a - nLooks - 1;
-      d = SQR(mean)*SQR(b) + 4*a*nLooks*mean*center;
-      rf = (b*mean + sqrt(d)) / (2*a);
-      if (ci <= cu) value = mean;
-      else if ((cu < ci) && (ci < cmax)) value = rf;
-      else if (ci >= cmax) value = center;
-      break;
-     
     case KUAN:
       center = inbuf[base + half + half*nSamples];
       mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
       standard_deviation = 
 	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      weight = (1 - SQR(cu)/SQR(ci))/(1 + SQR(cu));
-      value = center*weight + mean*(1-weight);
+      value = local_stats_value(filter_type, center, mean, standard_deviation,
+                                damping_factor, nLooks);
       break;
     }
 
   return value;
 }
 
+// Number of threads kernel_filter uses, see kernel_filter_set_thread_count
+static int kernel_filter_thread_count = 1;
+
+void kernel_filter_set_thread_count(int count)
+{
+  kernel_filter_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+// What the threads of kernel_filter share while filtering a band
+typedef struct {
+  GMutex *lock;          // Guards next_line and lines_done
+  int next_line;         // First line of the next block to hand out
+  int lines_done;
+
+  const char *inFile, *outFile;
+  meta_parameters *inMeta, *outMeta;
+  int band;
+  filter_type_t filter;
+  int kernel_size;
+  float damping;
+  int nLooks;
+  double shift;          // Typical value of the band, see filter_window
+} filter_job;
+
+// A thread's window onto the image.  Input lines go round a ring buffer of
+// kernel_size lines, so each output line reads just one new input line.
+typedef struct {
+  int ns, size, half;
+  float *ring;            // Input line y lives in line y % size
+  float **rows;           // The window's lines in order, centre is rows[half]
+  int next_input;         // Input line the ring wants next, -1 when empty
+
+  // Sums down each column of the window, of values less 'shift'.  The
+  // window sums slide along the line over these.  Taking off a typical
+  // value first keeps the sums of squares from swamping the variance.
+  // Every thread uses the same one, so the rounding doesn't depend on who
+  // filtered which line.
+  double shift;
+  double *col_sum, *col_sum_sq;
+  double *mean, *std_dev;
+
+  double *weights;        // Per pixel weights by distance from the centre
+  float *window;          // Window copy for kernel(), sorted one for MEDIAN
+} filter_window;
+
+static filter_window *filter_window_new(int ns, int size, double shift)
+{
+  filter_window *w = (filter_window *) MALLOC(sizeof(filter_window));
+  w->ns = ns;
+  w->size = size;
+  w->half = (size-1)/2;
+  w->ring = (float *) MALLOC(sizeof(float)*size*ns);
+  w->rows = (float **) MALLOC(sizeof(float *)*size);
+  w->next_input = -1;
+  w->shift = shift;
+  w->col_sum = (double *) MALLOC(sizeof(double)*ns);
+  w->col_sum_sq = (double *) MALLOC(sizeof(double)*ns);
+  w->mean = (double *) MALLOC(sizeof(double)*ns);
+  w->std_dev = (double *) MALLOC(sizeof(double)*ns);
+  w->weights = (double *) MALLOC(sizeof(double)*(w->half+1));
+  w->window = (float *) MALLOC(sizeof(float)*size*ns);
+  return w;
+}
+
+static void filter_window_free(filter_window *w)
+{
+  FREE(w->ring);
+  FREE(w->rows);
+  FREE(w->col_sum);
+  FREE(w->col_sum_sq);
+  FREE(w->mean);
+  FREE(w->std_dev);
+  FREE(w->weights);
+  FREE(w->window);
+  FREE(w);
+}
+
+// Bring the window to input lines line-half .. line+half.  Moving down a
+// line reads one line, anything else refills the ring.
+static void filter_window_move_to(filter_window *w, FILE *fp,
+                                  meta_parameters *meta, int band, int line)
+{
+  int first = line - w->half, ii;
+
+  if (w->next_input != line + w->half) {
+    for (ii=first; ii<line+w->half; ii++)
+      get_band_float_line(fp, meta, band, ii, w->ring + (ii%w->size)*w->ns);
+  }
+  ii = line + w->half;
+  get_band_float_line(fp, meta, band, ii, w->ring + (ii%w->size)*w->ns);
+  w->next_input = ii + 1;
+
+  for (ii=0; ii<w->size; ii++)
+    w->rows[ii] = w->ring + ((first+ii)%w->size)*w->ns;
+}
+
+// Mean and standard deviation of the window around each sample of the
+// line, the same as calc_mean and calc_std_dev give.
+static void filter_window_stats(filter_window *w)
+{
+  int ns = w->ns, half = w->half, n = SQR(w->size), ii, jj;
+
+  for (jj=0; jj<ns; jj++)
+    w->col_sum[jj] = w->col_sum_sq[jj] = 0.0;
+  for (ii=0; ii<w->size; ii++) {
+    const float *row = w->rows[ii];
+    for (jj=0; jj<ns; jj++) {
+      double v = row[jj] - w->shift;
+      w->col_sum[jj] += v;
+      w->col_sum_sq[jj] += v*v;
+    }
+  }
+
+  double sum = 0.0, sum_sq = 0.0;
+  for (jj=half; jj<ns-half; jj++) {
+    double var;
+    // Slide the window sums along by a column, except that every
+    // kernel_size columns they are added up afresh, so the rounding
+    // error can't build up along the line.  So is a window after a NaN
+    // or infinity, which would otherwise spoil the sliding sums.
+    if ((jj-half) % w->size != 0 &&
+        meta_is_valid_double(sum) && meta_is_valid_double(sum_sq)) {
+      sum += w->col_sum[jj+half] - w->col_sum[jj-half-1];
+      sum_sq += w->col_sum_sq[jj+half] - w->col_sum_sq[jj-half-1];
+    }
+    else {
+      int kk;
+      sum = sum_sq = 0.0;
+      for (kk=jj-half; kk<=jj+half; kk++) {
+        sum += w->col_sum[kk];
+        sum_sq += w->col_sum_sq[kk];
+      }
+    }
+    var = (sum_sq - sum*sum/n) / (n-1);
+    w->mean[jj] = w->shift + sum/n;
+    w->std_dev[jj] = sqrt(var > 0 ? var : 0);
+  }
+}
+
+// Takes 'out' out of the sorted window and puts 'in' in its place,
+// keeping it sorted.  Only the values between the two move.
+static void sorted_window_replace(float *sorted, int n, float out, float in)
+{
+  int lo = 0, hi = n, pos;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (sorted[mid] < out)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  pos = lo;
+  if (pos >= n || sorted[pos] != out) {
+    // Only NaNs upset the ordering, look for the very value
+    for (pos=0; pos<n; pos++)
+      if (memcmp(&sorted[pos], &out, sizeof(float)) == 0)
+        break;
+    assert(pos < n);
+  }
+
+  while (pos+1 < n && sorted[pos+1] < in) {
+    sorted[pos] = sorted[pos+1];
+    pos++;
+  }
+  while (pos > 0 && sorted[pos-1] > in) {
+    sorted[pos] = sorted[pos-1];
+    pos--;
+  }
+  sorted[pos] = in;
+}
+
+// Slides a sorted copy of the window along the line, so each sample
+// takes kernel_size replacements rather than a sort.  Picks the same
+// element of the sorted window that kernel() does.
+static void median_line(filter_window *w, float *outbuf)
+{
+  int ns = w->ns, size = w->size, half = w->half, n = SQR(size);
+  int pick = n/2 + 1 < n ? n/2 + 1 : n-1;
+  float *sorted = w->window;
+  int ii, jj;
+
+  for (ii=0; ii<size; ii++)
+    for (jj=0; jj<size; jj++)
+      sorted[ii*size + jj] = w->rows[ii][jj];
+  qsort(sorted, n, sizeof(float), (void*)compare_values);
+  outbuf[half] = sorted[pick];
+
+  for (jj=half+1; jj<ns-half; jj++) {
+    for (ii=0; ii<size; ii++)
+      sorted_window_replace(sorted, n, w->rows[ii][jj-half-1],
+                            w->rows[ii][jj+half]);
+    outbuf[jj] = sorted[pick];
+  }
+}
+
+// Filter one line, whose window is loaded.  Samples closer than half a
+// kernel to the edge are set to zero, as before.
+static void filter_line(filter_job *job, filter_window *w, int line,
+                        float *outbuf)
+{
+  int ns = w->ns, size = w->size, half = w->half, n = SQR(size);
+  double *weights = w->weights;
+  int ii, jj, kk;
+
+  for (jj=0; jj<ns; jj++)
+    outbuf[jj] = 0.0;
+  if (ns-half <= half)
+    return;
+
+  if (is_local_stats_filter(job->filter)) {
+    filter_window_stats(w);
+    for (jj=half; jj<ns-half; jj++)
+      outbuf[jj] = local_stats_value(job->filter, w->rows[half][jj],
+                                     w->mean[jj], w->std_dev[jj],
+                                     job->damping, job->nLooks);
+  }
+  else if (job->filter == GAUSSIAN) {
+    // Weights exp(-(di^2 + dj^2) / (2 sigma)), with sigma the window's
+    // standard deviation as in kernel(): a row and a column factor, each
+    // from a table of half+1 weights.
+    filter_window_stats(w);
+    for (jj=half; jj<ns-half; jj++) {
+      double sum = w->mean[jj]*n, value = 0.0;
+      for (kk=0; kk<=half; kk++)
+        weights[kk] = exp(-SQR(kk) / (2*w->std_dev[jj]));
+      for (ii=0; ii<size; ii++) {
+        const float *row = w->rows[ii] + jj;
+        double row_value = weights[0]*row[0];
+        for (kk=1; kk<=half; kk++)
+          row_value += weights[kk]*(row[-kk] + row[kk]);
+        value += weights[abs(ii-half)]*row_value;
+      }
+      outbuf[jj] = value / sum;
+    }
+  }
+  else if (job->filter == FROST) {
+    // Weights exp(-a |dj|) are the same down each column, so they apply
+    // to the column sums.
+    filter_window_stats(w);
+    for (jj=half; jj<ns-half; jj++) {
+      double ci = w->std_dev[jj] / w->mean[jj];
+      double a = job->damping * SQR(ci);
+      double rf, sum;
+      for (kk=0; kk<=half; kk++)
+        weights[kk] = exp(-a*kk);
+      rf = weights[0]*(w->col_sum[jj] + size*w->shift);
+      sum = weights[0];
+      for (kk=1; kk<=half; kk++) {
+        rf += weights[kk]*(w->col_sum[jj-kk] + w->col_sum[jj+kk] +
+                           2*size*w->shift);
+        sum += 2*weights[kk];
+      }
+      outbuf[jj] = rf / (size*sum);
+    }
+  }
+  else if (job->filter == MEDIAN) {
+    median_line(w, outbuf);
+  }
+  else {
+    // The small fixed kernels, and ENHANCED_FROST, which squares its
+    // input in place, work on a fresh copy of the window.
+    for (ii=0; ii<size; ii++)
+      memcpy(w->window + ii*ns, w->rows[ii], sizeof(float)*ns);
+    for (jj=half; jj<ns-half; jj++)
+      outbuf[jj] = kernel(job->filter, w->window, size, ns, line, jj,
+                          size, job->damping, job->nLooks);
+  }
+}
+
+// Takes blocks of output lines until there are none left.  Each thread
+// has its own input and output files and its own window.
+static gpointer filter_worker(gpointer data)
+{
+  filter_job *job = (filter_job *) data;
+  int nl = job->inMeta->general->line_count;
+  int ns = job->inMeta->general->sample_count;
+  int half = (job->kernel_size-1)/2;
+  FILE *fpIn = fopenImage(job->inFile, "rb");
+  FILE *fpOut = fopenImage(job->outFile, "r+b");
+  filter_window *w = filter_window_new(ns, job->kernel_size, job->shift);
+  float *outbuf = (float *) MALLOC(sizeof(float)*ns);
+  int ii, jj;
+
+  for (;;) {
+    int first, last;
+
+    g_mutex_lock(job->lock);
+    first = job->next_line;
+    job->next_line += LINES_PER_BLOCK;
+    g_mutex_unlock(job->lock);
+
+    if (first >= nl)
+      break;
+    last = first + LINES_PER_BLOCK < nl ? first + LINES_PER_BLOCK : nl;
+
+    for (ii=first; ii<last; ii++) {
+      // Lines closer than half a kernel to the top or bottom are zero
+      if (ii < half || ii >= nl-half) {
+        for (jj=0; jj<ns; jj++)
+          outbuf[jj] = 0.0;
+      }
+      else {
+        filter_window_move_to(w, fpIn, job->inMeta, job->band, ii);
+        filter_line(job, w, ii, outbuf);
+      }
+      put_band_float_line(fpOut, job->outMeta, job->band, ii, outbuf);
+    }
+
+    g_mutex_lock(job->lock);
+    job->lines_done += last - first;
+    asfLineMeter(job->lines_done-1, nl);
+    g_mutex_unlock(job->lock);
+  }
+
+  filter_window_free(w);
+  FREE(outbuf);
+  FCLOSE(fpIn);
+  FCLOSE(fpOut);
+  return NULL;
+}
+
+// Any typical value of the band will do for the window shift.  The mean
+// of the valid values of the middle line is handy.
+static double band_shift(filter_job *job)
+{
+  int nl = job->inMeta->general->line_count;
+  int ns = job->inMeta->general->sample_count;
+  float *line = (float *) MALLOC(sizeof(float)*ns);
+  FILE *fp = fopenImage(job->inFile, "rb");
+  double sum = 0.0;
+  int count = 0, jj;
+
+  get_band_float_line(fp, job->inMeta, job->band, nl/2, line);
+  for (jj=0; jj<ns; jj++) {
+    if (meta_is_valid_double(line[jj])) {
+      sum += line[jj];
+      count++;
+    }
+  }
+
+  FCLOSE(fp);
+  FREE(line);
+  return count > 0 ? sum/count : 0.0;
+}
+
+// Runs filter_worker on kernel_filter_thread_count threads, or just in
+// this one.  The lines come out the same either way.
+static void filter_band(filter_job *job)
+{
+  int nl = job->inMeta->general->line_count;
+  int thread_count = kernel_filter_thread_count;
+  int max_threads = (nl + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+  int tt;
+
+  if (thread_count > max_threads)
+    thread_count = max_threads;
+
+  job->shift = band_shift(job);
+
+  asf_thread_init();
+  job->lock = asf_mutex_new();
+  job->next_line = 0;
+  job->lines_done = 0;
+
+  if (thread_count <= 1) {
+    filter_worker(job);
+  }
+  else {
+    GThread **threads = (GThread **) MALLOC(sizeof(GThread *) * thread_count);
+    for (tt=0; tt<thread_count; ++tt) {
+      threads[tt] = asf_thread_new("kernel_filter", filter_worker, job);
+      if (threads[tt] == NULL)
+        asfPrintError("Failed to create kernel_filter thread\n");
+    }
+    for (tt=0; tt<thread_count; ++tt)
+      g_thread_join(threads[tt]);
+    FREE(threads);
+  }
+
+  asf_mutex_free(job->lock);
+}
+
 void kernel_filter(char *inFile, char *outFile, filter_type_t filter, 
 		   int kernel_size, float damping, int nLooks)
 {
-  int ii, jj, kk;
+  int kk;
   char **band_names=NULL;
+  filter_job job;
 
   // Create metadata
   meta_parameters *inMeta = meta_read(inFile);
   meta_parameters *outMeta = meta_read(inFile);
   outMeta->general->data_type = REAL32;
-  
-  int inLines = inMeta->general->line_count;
-  int inSamples = inMeta->general->sample_count;
-  int half = (kernel_size - 1) / 2;
-  int numLines = kernel_size;
-  
-  // Open output files
-  FILE *fpIn = fopenImage(inFile,"rb");
-  FILE *fpOut = fopenImage(outFile,"wb");
-    
-  // Allocate memory for input and output file
-  float *inbuf= (float*) MALLOC (kernel_size*inSamples*sizeof(float));
-  float *outbuf = (float*) MALLOC (inSamples*sizeof(float));
+
+  // the threads each write their own lines of the output file
+  FCLOSE(fopenImage(outFile,"wb"));
+
+  job.inFile = inFile;
+  job.outFile = outFile;
+  job.inMeta = inMeta;
+  job.outMeta = outMeta;
+  job.filter = filter;
+  job.kernel_size = kernel_size;
+  job.damping = damping;
+  job.nLooks = nLooks;
 
   // Go through all bands
   int band_count = inMeta->general->band_count;
   band_names = extract_band_names(inMeta->general->bands, band_count);
   for (kk=0; kk<band_count; kk++) {
-  
     asfPrintStatus("\nFiltering %s ...\n", band_names[kk]);
-
-    // Set upper margin of image to input pixel values
-    for (ii=0; ii<half; ii++) {
-      for (jj=0; jj<inSamples; jj++) outbuf[jj] = 0.0;
-      put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
-      asfLineMeter(ii, inLines);
-    }
-  
-    int startLine;
-    
-    // Filtering the 'regular' lines
-    for (ii=half; ii<inLines-half; ii++) {
-      
-      // Read next set of lines for kernel
-      startLine = ii - half;
-      if (startLine<0) startLine = 0;
-      if (inLines < (kernel_size+startLine)) numLines = inLines - startLine;
-      get_band_float_lines(fpIn, inMeta, kk, startLine, numLines, inbuf); 
-      
-      // Calculate the usual output line
-      for (jj=0; jj<half; jj++) outbuf[jj] = 0.0;
-      for (jj=half; jj<inSamples-half; jj++) {
-	outbuf[jj] = kernel(filter, inbuf, numLines, inSamples, ii, jj,
-			    kernel_size, damping, nLooks);
-      }
-      for (jj=inSamples-half; jj<inSamples; jj++) outbuf[jj] = 0.0;
-      
-      // Write line to disk
-      put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
-      asfLineMeter(ii, inLines);
-    }
-    
-    // Set lower margin of image to input pixel values
-    for (ii=inLines-half; ii<inLines; ii++) {
-      for (jj=0; jj<inSamples; jj++) outbuf[jj] = 0.0;
-      put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
-      asfLineMeter(ii, inLines);
-    }  
+    job.band = kk;
+    filter_band(&job);
   }
 
-  // Clean up
-  FREE(inbuf);
-  FREE(outbuf);
-  FCLOSE(fpOut);
-  FCLOSE(fpIn);
-  
   // Write metadata
   meta_write(outMeta, outFile);
   meta_free(inMeta);
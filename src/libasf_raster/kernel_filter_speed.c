@@ -0,0 +1,186 @@
+// Test program useful for checking kernel_filter against kernel().
+//
+// Writes an image of random data, then for each filter type filters it
+// once with kernel() a pixel at a time, the way kernel_filter used to,
+// once with kernel_filter in one thread and once with kernel_filter in
+// several threads.  Checks that kernel_filter agrees with kernel() to
+// within a small tolerance (the running window sums round differently),
+// and that the threaded output is identical to the single thread output.
+// Reports megapixels per second for each.
+//
+// Usage: kernel_filter_speed [kernel_size [threads [samples [lines]]]]
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "asf.h"
+#include "asf_meta.h"
+#include "asf_raster.h"
+
+#define IN_FILE "kernel_filter_speed_in"
+#define OUT_FILE "kernel_filter_speed_out"
+
+static const char *filter_names[] = {
+  "", "AVERAGE", "GAUSSIAN", "LAPLACE1", "LAPLACE2", "LAPLACE3", "SOBEL",
+  "SOBEL_X", "SOBEL_Y", "PREWITT", "PREWITT_X", "PREWITT_Y", "EDGE",
+  "MEDIAN", "LEE", "ENHANCED_LEE", "FROST", "ENHANCED_FROST", "GAMMA_MAP",
+  "KUAN"
+};
+
+// Wall clock time, since the threads share the work.
+static double seconds(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double megapixels_per_second(double pixels, double seconds)
+{
+  return seconds > 0 ? pixels / seconds / 1e6 : 0;
+}
+
+// Per pixel filtering with kernel(), as kernel_filter used to do it.
+static void filter_with_kernel(filter_type_t filter, const float *image,
+                               int nl, int ns, int size, float *out)
+{
+  int half = (size-1)/2, ii, jj;
+  float *inbuf = (float *) MALLOC(sizeof(float)*size*ns);
+
+  for (ii=0; ii<nl*ns; ii++)
+    out[ii] = 0.0;
+  for (ii=half; ii<nl-half; ii++) {
+    memcpy(inbuf, image + (ii-half)*ns, sizeof(float)*size*ns);
+    for (jj=half; jj<ns-half; jj++)
+      out[ii*ns + jj] = kernel(filter, inbuf, size, ns, ii, jj, size,
+                               1.0, 1);
+  }
+
+  FREE(inbuf);
+}
+
+static void filter_with_kernel_filter(filter_type_t filter, int size,
+                                      int threads, int nl, int ns,
+                                      float *out)
+{
+  meta_parameters *meta;
+  FILE *fp;
+  int ii;
+
+  kernel_filter_set_thread_count(threads);
+  kernel_filter(IN_FILE, OUT_FILE, filter, size, 1.0, 1);
+
+  meta = meta_read(OUT_FILE);
+  fp = fopenImage(OUT_FILE, "rb");
+  for (ii=0; ii<nl; ii++)
+    get_float_line(fp, meta, ii, out + ii*ns);
+  FCLOSE(fp);
+  meta_free(meta);
+}
+
+// NaNs (which ENHANCED_FROST can give) count as equal to each other.
+static int close_enough(float a, float b)
+{
+  if (isnan(a) || isnan(b))
+    return isnan(a) && isnan(b);
+  return fabs(a - b) <= 1e-3 * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+int main(int argc, char **argv)
+{
+  int size = argc > 1 ? atoi(argv[1]) : 7;
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  int ns = argc > 3 ? atoi(argv[3]) : 2000;
+  int nl = argc > 4 ? atoi(argv[4]) : 500;
+  meta_parameters *meta;
+  float *image, *ref, *single, *multi;
+  int filter, ii, mismatches = 0, thread_differences = 0;
+  FILE *fp;
+
+  // kernel() needs at least two pixels for a standard deviation.
+  assert(size >= 3 && size % 2 == 1 && threads > 0);
+  assert(ns > size && nl > size);
+
+  image = (float *) MALLOC(sizeof(float)*nl*ns);
+  ref = (float *) MALLOC(sizeof(float)*nl*ns);
+  single = (float *) MALLOC(sizeof(float)*nl*ns);
+  multi = (float *) MALLOC(sizeof(float)*nl*ns);
+
+  // Speckle-like positive data, so the local statistics filters have
+  // something sensible to work on.
+  srand(2718);
+  for (ii=0; ii<nl*ns; ii++)
+    image[ii] = 1.0 + 100.0 * rand() / RAND_MAX;
+
+  meta = raw_init();
+  meta->general->data_type = REAL32;
+  meta->general->line_count = nl;
+  meta->general->sample_count = ns;
+  meta->general->band_count = 1;
+  strcpy(meta->general->bands, "01");
+  meta_write(meta, IN_FILE);
+  fp = fopenImage(IN_FILE, "wb");
+  for (ii=0; ii<nl; ii++)
+    put_float_line(fp, meta, ii, image + ii*ns);
+  FCLOSE(fp);
+
+  printf("%d x %d kernel, %d samples, %d lines, %d threads\n",
+         size, size, ns, nl, threads);
+  printf("%-16s %12s %12s %12s %10s\n", "", "kernel()",
+         "1 thread", "threads", "mismatches");
+
+  for (filter=AVERAGE; filter<=KUAN; filter++) {
+    double start, ref_time, single_time, multi_time;
+    int filter_mismatches = 0;
+
+    // The fixed kernels are 3 x 3 whatever the kernel size.
+    if (filter >= LAPLACE1 && filter <= EDGE && size != 3)
+      continue;
+
+    start = seconds();
+    filter_with_kernel(filter, image, nl, ns, size, ref);
+    ref_time = seconds() - start;
+
+    start = seconds();
+    filter_with_kernel_filter(filter, size, 1, nl, ns, single);
+    single_time = seconds() - start;
+
+    start = seconds();
+    filter_with_kernel_filter(filter, size, threads, nl, ns, multi);
+    multi_time = seconds() - start;
+
+    for (ii=0; ii<nl*ns; ii++) {
+      if (!close_enough(single[ii], ref[ii]))
+        filter_mismatches++;
+      if (memcmp(&single[ii], &multi[ii], sizeof(float)) != 0)
+        thread_differences++;
+    }
+    mismatches += filter_mismatches;
+
+    printf("%-16s %12.1f %12.1f %12.1f %10d\n", filter_names[filter],
+           megapixels_per_second((double)nl*ns, ref_time),
+           megapixels_per_second((double)nl*ns, single_time),
+           megapixels_per_second((double)nl*ns, multi_time),
+           filter_mismatches);
+  }
+
+  printf("pixels differing from kernel(): %d\n", mismatches);
+  printf("pixels differing between thread counts: %d\n", thread_differences);
+
+  meta_free(meta);
+  FREE(image);
+  FREE(ref);
+  FREE(single);
+  FREE(multi);
+  remove(IN_FILE ".img");
+  remove(IN_FILE ".meta");
+  remove(OUT_FILE ".img");
+  remove(OUT_FILE ".meta");
+
+  return mismatches == 0 && thread_differences == 0
+    ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,11 +2,18 @@
 #include "asf_meta.h"
 #include "asf_raster.h"
 #include "expression.h"
+#include "asf_glib.h"
 #include <ctype.h>
 
 #define VERSION 2.0
 #define MAXIMGS 20
 
+// Pixels evaluated at a time by a compiled expression
+#define EXPRESSION_BLOCK 1024
+
+// Output lines handed out to a raster_calc thread at a time
+#define LINES_PER_BLOCK 64
+
 char *expression2cookie(const char *expr, int nvars)
 {
   token **outputStack = (token **) MALLOC(200*sizeof(token));
@@ -232,22 +239,342 @@ token *nextToken(void)
   return t;
 }
 
+// Compiled expressions.
+//
+// expression_compile turns the postfix cookie into a short program that
+// works on blocks of EXPRESSION_BLOCK pixels: the input bands used are
+// converted to double once per block, and each operator is then one loop
+// over the block instead of a function call per pixel.  Operands that are
+// the same for every pixel of a line (constants and y) stay scalars, and
+// operators on two constants are done once, at compile time.  The stack
+// is simulated exactly the way evaluate() runs it, including the two
+// zeros at the bottom that make a leading '-' a negation, so the results
+// match evaluate() bit for bit.
+
+typedef enum {
+  opAdd,opSub,opMul,opDiv,opMod,opPow
+} opCode;
+
+// A block of values in the workspace when reg >= 0, otherwise a scalar:
+// the line number when is_y is set, the constant val when it isn't.
+typedef struct {
+  int reg;
+  int is_y;
+  double val;
+} operand;
+
+typedef struct {
+  opCode op;
+  int dest;
+  operand a, b;
+} instruction;
+
+struct expression_program {
+  int nloads;         // Bands converted into registers 0..nloads-1
+  int load_var[26];   // Which band goes in each of those registers
+  int x_reg;          // Register holding x, -1 if x isn't used
+  int nregs;
+  int ninstructions;
+  instruction *code;
+  operand result;
+};
+
+static opCode op_code(char op)
+{
+  switch (op) {
+    case '+': return opAdd;
+    case '-': return opSub;
+    case '*': return opMul;
+    case '/': return opDiv;
+    case '%': return opMod;
+    default:  return opPow;
+  }
+}
+
+static operand scalar_operand(double val)
+{
+  operand o;
+  o.reg = -1;
+  o.is_y = FALSE;
+  o.val = val;
+  return o;
+}
+
+expression_program *expression_compile(const char *expr, int nvars)
+{
+  token **cookie = (token **) expression2cookie(expr, nvars);
+  token **tok;
+  expression_program *prog;
+  operand *stack;
+  int var_reg[26];
+  int ii, ntokens = 0, sp, stack_base, depth = 0;
+
+  if (NULL == cookie)
+    return NULL;
+  for (tok = cookie; *tok; tok++)
+    ntokens++;
+
+  prog = (expression_program *) MALLOC(sizeof(expression_program));
+  prog->code = (instruction *) MALLOC(sizeof(instruction)*(ntokens+1));
+  prog->ninstructions = 0;
+  prog->nloads = 0;
+  prog->x_reg = -1;
+
+  // Registers for the bands and x come first, then one per stack slot.
+  for (ii=0; ii<26; ii++)
+    var_reg[ii] = -1;
+  for (tok = cookie; *tok; tok++) {
+    int index = (*tok)->index;
+    if ((*tok)->type != tokVariable || index == 'y'-'a')
+      continue;
+    if (index == 'x'-'a')
+      prog->x_reg = 0;
+    else if (var_reg[index] < 0) {
+      var_reg[index] = prog->nloads;
+      prog->load_var[prog->nloads++] = index;
+    }
+  }
+  if (prog->x_reg >= 0)
+    prog->x_reg = prog->nloads;
+  stack_base = prog->nloads + (prog->x_reg >= 0 ? 1 : 0);
+
+  stack = (operand *) MALLOC(sizeof(operand)*(ntokens+2));
+  stack[0] = stack[1] = scalar_operand(0.0);
+  sp = 2;
+  for (tok = cookie; *tok; tok++) {
+    token *t = *tok;
+    if (t->type == tokConstant)
+      stack[sp++] = scalar_operand(t->val);
+    else if (t->type == tokVariable) {
+      operand o = scalar_operand(0.0);
+      if (t->index == 'y'-'a')
+        o.is_y = TRUE;
+      else if (t->index == 'x'-'a')
+        o.reg = prog->x_reg;
+      else
+        o.reg = var_reg[t->index];
+      stack[sp++] = o;
+    }
+    else {
+      operand b = sp > 0 ? stack[--sp] : scalar_operand(0.0);
+      operand a = sp > 0 ? stack[--sp] : scalar_operand(0.0);
+      if (a.reg < 0 && !a.is_y && b.reg < 0 && !b.is_y)
+        stack[sp++] = scalar_operand(t->eval(t, NULL, a.val, b.val));
+      else {
+        instruction *in = &prog->code[prog->ninstructions++];
+        in->op = op_code(t->op);
+        in->dest = stack_base + sp;
+        in->a = a;
+        in->b = b;
+        // Squaring is common, and a*a is exactly what pow gives for it
+        if (in->op == opPow && b.reg < 0 && !b.is_y && b.val == 2.0) {
+          in->op = opMul;
+          in->b = a;
+        }
+        stack[sp] = scalar_operand(0.0);
+        stack[sp++].reg = in->dest;
+        if (sp > depth)
+          depth = sp;
+      }
+    }
+  }
+  prog->result = stack[sp-1];
+  prog->nregs = stack_base + depth;
+
+  for (tok = cookie; *tok; tok++)
+    FREE(*tok);
+  FREE(cookie);
+  FREE(stack);
+  return prog;
+}
+
+void expression_program_free(expression_program *prog)
+{
+  if (prog) {
+    FREE(prog->code);
+    FREE(prog);
+  }
+}
+
+// Scratch space for expression_evaluate_line, one per thread.
+double *expression_workspace_new(const expression_program *prog)
+{
+  int nregs = prog->nregs > 0 ? prog->nregs : 1;
+  return (double *) MALLOC(sizeof(double)*nregs*EXPRESSION_BLOCK);
+}
+
+// One loop over the block for each combination of block and scalar
+// operands, with 'a' and 'b' standing for the operand values.
+#define BLOCK_LOOP(expr) do { \
+    if (av && bv) \
+      for (i=0; i<n; i++) { double a = av[i], b = bv[i]; d[i] = (expr); } \
+    else if (av) \
+      for (i=0; i<n; i++) { double a = av[i], b = bs; d[i] = (expr); } \
+    else if (bv) \
+      for (i=0; i<n; i++) { double a = as, b = bv[i]; d[i] = (expr); } \
+    else { \
+      double a = as, b = bs, v = (expr); \
+      for (i=0; i<n; i++) d[i] = v; \
+    } \
+  } while (0)
+
+static void evaluate_block(const expression_program *prog,
+                           const float *const *variables, int x0, int y,
+                           int n, float *out, double *work)
+{
+  int i, jj;
+
+  for (jj=0; jj<prog->nloads; jj++) {
+    double *d = work + jj*EXPRESSION_BLOCK;
+    const float *v = variables[prog->load_var[jj]] + x0;
+    for (i=0; i<n; i++)
+      d[i] = v[i];
+  }
+  if (prog->x_reg >= 0) {
+    double *d = work + prog->x_reg*EXPRESSION_BLOCK;
+    for (i=0; i<n; i++)
+      d[i] = x0 + i;
+  }
+
+  for (jj=0; jj<prog->ninstructions; jj++) {
+    const instruction *in = &prog->code[jj];
+    double *d = work + in->dest*EXPRESSION_BLOCK;
+    const double *av = in->a.reg >= 0 ? work + in->a.reg*EXPRESSION_BLOCK
+                                      : NULL;
+    const double *bv = in->b.reg >= 0 ? work + in->b.reg*EXPRESSION_BLOCK
+                                      : NULL;
+    double as = in->a.is_y ? y : in->a.val;
+    double bs = in->b.is_y ? y : in->b.val;
+    switch (in->op) {
+      case opAdd: BLOCK_LOOP(a+b); break;
+      case opSub: BLOCK_LOOP(a-b); break;
+      case opMul: BLOCK_LOOP(a*b); break;
+      case opDiv: BLOCK_LOOP(b == 0 ? a : a/b); break;
+      case opMod: BLOCK_LOOP(modOp(NULL,NULL,a,b)); break;
+      case opPow: BLOCK_LOOP(pow(a,b)); break;
+    }
+  }
+
+  if (prog->result.reg >= 0) {
+    const double *r = work + prog->result.reg*EXPRESSION_BLOCK;
+    for (i=0; i<n; i++)
+      out[i] = r[i];
+  }
+  else {
+    float v = prog->result.is_y ? y : prog->result.val;
+    for (i=0; i<n; i++)
+      out[i] = v;
+  }
+}
+
+// Evaluate the expression for samples 0..ns-1 of line y, where
+// variables[ii] is the line of band ii.
+void expression_evaluate_line(const expression_program *prog,
+                              const float *const *variables, int y, int ns,
+                              float *out, double *work)
+{
+  int x0;
+  for (x0=0; x0<ns; x0+=EXPRESSION_BLOCK) {
+    int n = ns - x0 < EXPRESSION_BLOCK ? ns - x0 : EXPRESSION_BLOCK;
+    evaluate_block(prog, variables, x0, y, n, out + x0, work);
+  }
+}
+
+// Number of threads raster_calc uses, see raster_calc_set_thread_count
+static int raster_calc_thread_count = 1;
+
+void raster_calc_set_thread_count(int count)
+{
+  raster_calc_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+// What the threads of raster_calc share
+typedef struct {
+  GMutex *lock;          // Guards next_line and lines_done
+  int next_line;         // First line of the next block to hand out
+  int lines_done;
+
+  const expression_program *prog;
+  const char *outFile;
+  char **inFiles;
+  int input_count;
+  meta_parameters **metas, *outMeta;
+} calc_job;
+
+// Takes blocks of output lines until there are none left.  Each thread
+// has its own input and output files and line buffers.
+static gpointer calc_worker(gpointer data)
+{
+  calc_job *job = (calc_job *) data;
+  int nl = job->outMeta->general->line_count;
+  int ns = job->outMeta->general->sample_count;
+  float *inBuf[MAXIMGS], *outBuf;
+  FILE *fpIn[MAXIMGS], *fpOut;
+  double *work;
+  int ii, yy;
+
+  for (ii=0; ii<job->input_count; ii++) {
+    fpIn[ii] = fopenImage(job->inFiles[ii], "rb");
+    inBuf[ii] = (float *)
+      MALLOC(sizeof(float)*job->metas[ii]->general->sample_count);
+  }
+  fpOut = fopenImage(job->outFile, "r+b");
+  outBuf = (float *) MALLOC(sizeof(float)*ns);
+  work = expression_workspace_new(job->prog);
+
+  for (;;) {
+    int first, last;
+
+    g_mutex_lock(job->lock);
+    first = job->next_line;
+    job->next_line += LINES_PER_BLOCK;
+    g_mutex_unlock(job->lock);
+
+    if (first >= nl)
+      break;
+    last = first + LINES_PER_BLOCK < nl ? first + LINES_PER_BLOCK : nl;
+
+    for (yy=first; yy<last; yy++) {
+      for (ii=0; ii<job->input_count; ii++)
+        get_float_line(fpIn[ii], job->metas[ii], yy, inBuf[ii]);
+      expression_evaluate_line(job->prog, (const float *const *) inBuf,
+                               yy, ns, outBuf, work);
+      put_float_line(fpOut, job->outMeta, yy, outBuf);
+    }
+
+    g_mutex_lock(job->lock);
+    job->lines_done += last - first;
+    asfLineMeter(job->lines_done-1, nl);
+    g_mutex_unlock(job->lock);
+  }
+
+  for (ii=0; ii<job->input_count; ii++) {
+    FREE(inBuf[ii]);
+    FCLOSE(fpIn[ii]);
+  }
+  FREE(work);
+  FREE(outBuf);
+  FCLOSE(fpOut);
+  return NULL;
+}
+
 int raster_calc(char *outFile, char *expression, int input_count, 
 		char **inFiles)
 {
-  int ii, xx, yy;
+  int ii, tt, thread_count, max_threads;
   meta_parameters *inMeta, *outMeta;
   meta_parameters *metas[MAXIMGS];
-  char *cookie;
-  float *inBuf[MAXIMGS], *outBuf;
-  FILE *fpIn[MAXIMGS], *fpOut;
+  expression_program *prog;
+  calc_job job;
+
+  if (input_count > MAXIMGS)
+    asfPrintError("raster_calc takes at most %d input images\n", MAXIMGS);
 
   inMeta = meta_read(inFiles[0]);
   int ns = inMeta->general->sample_count;
   int nl = inMeta->general->line_count;
   for (ii=0; ii<input_count; ii++) {
     meta_parameters *tmpMeta = meta_read(inFiles[ii]);
-    fpIn[ii] = fopenImage(inFiles[ii], "rb");
     // Make sure each image is at least as big as the first image.
     if (ii != 0) {
       if (tmpMeta->general->line_count < inMeta->general->line_count)
@@ -255,45 +582,57 @@ int raster_calc(char *outFile, char *expression, int input_count,
       if (tmpMeta->general->sample_count < inMeta->general->sample_count)
         ns = tmpMeta->general->sample_count;
     }
-    inBuf[ii] = (float*) MALLOC( sizeof(float)*tmpMeta->general->sample_count);
     metas[ii] = tmpMeta;
   }
-  fpOut = fopenImage(outFile, "wb");
   outMeta = meta_copy(inMeta);
   outMeta->general->line_count = nl;
   outMeta->general->sample_count = ns;
   meta_write(outMeta, outFile);
 
-  outBuf = (float *) MALLOC(sizeof(float)*outMeta->general->sample_count);
-  cookie = expression2cookie(expression, input_count);
-  if (NULL == cookie)
+  prog = expression_compile(expression, input_count);
+  if (NULL == prog)
     exit(EXIT_FAILURE);
-  for (yy=0; yy<outMeta->general->line_count; yy++) {
-    double variables[26];
 
-    variables['y'-'a'] = yy;
+  // the threads each write their own lines of the output file
+  FCLOSE(fopenImage(outFile, "wb"));
 
-    for (ii=0; ii<input_count; ii++)
-      get_float_line(fpIn[ii], metas[ii], yy, inBuf[ii]);
+  job.prog = prog;
+  job.outFile = outFile;
+  job.inFiles = inFiles;
+  job.input_count = input_count;
+  job.metas = metas;
+  job.outMeta = outMeta;
 
-    for (xx=0; xx<outMeta->general->sample_count; xx++) {
-      variables['x'-'a'] = xx;
-      for (ii=0; ii<input_count; ii++)
-        variables[ii] = inBuf[ii][xx];
-      outBuf[xx] = evaluate(cookie,variables);
-    }
-    put_float_line(fpOut, outMeta, yy, outBuf);
-    asfLineMeter(yy, outMeta->general->line_count);
-  }
+  asf_thread_init();
+  job.lock = asf_mutex_new();
+  job.next_line = 0;
+  job.lines_done = 0;
 
-  for (ii=0; ii<input_count; ++ii) { 
-    FREE(inBuf[ii]);
-    meta_free(metas[ii]); 
-    FCLOSE(fpIn[ii]);
+  thread_count = raster_calc_thread_count;
+  max_threads = (nl + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+  if (thread_count > max_threads)
+    thread_count = max_threads;
+
+  if (thread_count <= 1) {
+    calc_worker(&job);
+  }
+  else {
+    GThread **threads = (GThread **) MALLOC(sizeof(GThread *)*thread_count);
+    for (tt=0; tt<thread_count; tt++) {
+      threads[tt] = asf_thread_new("raster_calc", calc_worker, &job);
+      if (threads[tt] == NULL)
+        asfPrintError("Failed to create raster_calc thread\n");
+    }
+    for (tt=0; tt<thread_count; tt++)
+      g_thread_join(threads[tt]);
+    FREE(threads);
   }
 
-  FREE(outBuf);
+  asf_mutex_free(job.lock);
+  expression_program_free(prog);
+  for (ii=0; ii<input_count; ++ii)
+    meta_free(metas[ii]);
+  meta_free(inMeta);
   meta_free(outMeta);
-  FCLOSE(fpOut);
   return (0);
 }
@@ -0,0 +1,119 @@
+// Test program useful for checking the speed of raster_calc expression
+// evaluation.
+//
+// Evaluates a few expressions over lines of random data, for some number
+// of bands, once with evaluate() a pixel at a time the way raster_calc
+// used to, and once a line at a time with a compiled expression.  Checks
+// that the results are identical and reports megapixels per second for
+// each.
+//
+// Usage: raster_calc_speed [bands [samples [lines]]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "asf.h"
+#include "expression.h"
+
+#define MAXBANDS 20
+
+static double seconds_since(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double megapixels_per_second(double pixels, double seconds)
+{
+  return seconds > 0 ? pixels / seconds / 1e6 : 0;
+}
+
+// The sum of all the bands, then an expression using every operator,
+// then one that refers to x and y.
+static void make_expressions(int bands, char exprs[3][256])
+{
+  int ii;
+  strcpy(exprs[0], "a");
+  for (ii=1; ii<bands; ii++)
+    sprintf(exprs[0] + strlen(exprs[0]), "+%c", 'a' + ii);
+  if (bands > 1)
+    sprintf(exprs[1], "(a-b)/(a+b)*100%%7+a^2-(2*3)");
+  else
+    sprintf(exprs[1], "-a/(a+1)*100%%7+a^2-(2*3)");
+  sprintf(exprs[2], "a*x+y/2-(x%%10)");
+}
+
+int main(int argc, char **argv)
+{
+  int bands = argc > 1 ? atoi(argv[1]) : 4;
+  int ns = argc > 2 ? atoi(argv[2]) : 5000;
+  int nl = argc > 3 ? atoi(argv[3]) : 200;
+  float *lines[MAXBANDS], *old_out, *new_out;
+  char exprs[3][256];
+  int ee, ii, xx, yy, mismatches = 0;
+
+  assert(bands > 0 && bands <= MAXBANDS && ns > 0 && nl > 0);
+  for (ii=0; ii<bands; ii++)
+    lines[ii] = (float *) MALLOC(sizeof(float)*ns);
+  old_out = (float *) MALLOC(sizeof(float)*ns);
+  new_out = (float *) MALLOC(sizeof(float)*ns);
+  make_expressions(bands, exprs);
+
+  srand(10101);
+  printf("%d bands, %d samples, %d lines\n", bands, ns, nl);
+  printf("%-40s %12s %12s\n", "", "old Mpix/s", "new Mpix/s");
+
+  for (ee=0; ee<3; ee++) {
+    char *cookie = expression2cookie(exprs[ee], bands);
+    expression_program *prog = expression_compile(exprs[ee], bands);
+    double *work, old_time = 0, new_time = 0;
+    clock_t start;
+
+    assert(cookie && prog);
+    work = expression_workspace_new(prog);
+
+    for (yy=0; yy<nl; yy++) {
+      double variables[26];
+
+      for (ii=0; ii<bands; ii++)
+        for (xx=0; xx<ns; xx++)
+          lines[ii][xx] = 100.0 * rand() / RAND_MAX - 10.0;
+
+      start = clock();
+      variables['y'-'a'] = yy;
+      for (xx=0; xx<ns; xx++) {
+        variables['x'-'a'] = xx;
+        for (ii=0; ii<bands; ii++)
+          variables[ii] = lines[ii][xx];
+        old_out[xx] = evaluate(cookie, variables);
+      }
+      old_time += seconds_since(start);
+
+      start = clock();
+      expression_evaluate_line(prog, (const float *const *) lines, yy, ns,
+                               new_out, work);
+      new_time += seconds_since(start);
+
+      for (xx=0; xx<ns; xx++)
+        if (memcmp(&old_out[xx], &new_out[xx], sizeof(float)) != 0)
+          mismatches++;
+    }
+
+    printf("%-40.40s %12.1f %12.1f\n", exprs[ee],
+           megapixels_per_second((double)ns*nl, old_time),
+           megapixels_per_second((double)ns*nl, new_time));
+
+    FREE(work);
+    expression_program_free(prog);
+  }
+
+  printf("mismatched pixels: %d\n", mismatches);
+
+  FREE(new_out);
+  FREE(old_out);
+  for (ii=0; ii<bands; ii++)
+    FREE(lines[ii]);
+
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,156 @@
+// Test program useful for checking the speed of float_image region
+// copies.
+//
+// Fills a size by size image (20000 x 20000 by default) a band of rows
+// at a time with float_image_set_region, then extracts chips and full
+// width row bands with the old per-pixel loop and with
+// float_image_get_region, checks that they agree, and reports the
+// throughput of each in MB/s.
+//
+// Usage: region_speed [size [chip_size [cache_megabytes]]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "asf.h"
+#include "float_image.h"
+
+// Value we store at each pixel, so extracted regions can be checked.
+static float
+pixel_value (size_t x, size_t y)
+{
+  return (float) ((x * 31 + y * 17) % 65521);
+}
+
+// The way float_image_get_region used to work: a get_pixel call (and
+// two ldiv calls) for every pixel.
+static void
+old_get_region (FloatImage *self, ssize_t x, ssize_t y, ssize_t size_x,
+                ssize_t size_y, float *buffer)
+{
+  ssize_t ii, jj;
+  for ( ii = 0 ; ii < size_y ; ii++ ) {
+    for ( jj = 0 ; jj < size_x ; jj++ ) {
+      buffer[ii * size_x + jj] = float_image_get_pixel (self, x + jj, y + ii);
+    }
+  }
+}
+
+static double
+seconds_since (clock_t start)
+{
+  return (double) (clock () - start) / CLOCKS_PER_SEC;
+}
+
+static double
+megabytes_per_second (size_t pixels, double seconds)
+{
+  return seconds > 0 ? pixels * sizeof (float) / seconds / 1048576.0 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t size = argc > 1 ? (size_t) atol (argv[1]) : 20000;
+  size_t chip_size = argc > 2 ? (size_t) atol (argv[2]) : 512;
+  size_t cache_megabytes = argc > 3 ? (size_t) atol (argv[3]) : 0;
+  const size_t band_rows = 64;
+  const int chip_count = 200;
+
+  assert (size >= chip_size && chip_size > 0);
+
+  if ( cache_megabytes > 0 ) {
+    float_image_set_default_cache_size (cache_megabytes * 1048576);
+  }
+
+  printf ("%lu x %lu image, %lu x %lu chips, %lu MB cache\n",
+          (unsigned long) size, (unsigned long) size,
+          (unsigned long) chip_size, (unsigned long) chip_size,
+          (unsigned long) (float_image_get_default_cache_size () / 1048576));
+
+  FloatImage *image = float_image_new (size, size);
+
+  // Fill the image a band of rows at a time.
+  float *band = g_new (float, size * band_rows);
+  clock_t start = clock ();
+  size_t ii, jj;
+  for ( ii = 0 ; ii < size ; ii += band_rows ) {
+    size_t rows = MIN (band_rows, size - ii);
+    size_t kk;
+    for ( kk = 0 ; kk < rows ; kk++ ) {
+      for ( jj = 0 ; jj < size ; jj++ ) {
+        band[kk * size + jj] = pixel_value (jj, ii + kk);
+      }
+    }
+    float_image_set_region (image, 0, ii, size, rows, band);
+  }
+  printf ("set_region fill:       %10.1f MB/s\n",
+          megabytes_per_second (size * size, seconds_since (start)));
+
+  // Chips at the same pseudorandom positions for both methods.
+  size_t *chip_x = g_new (size_t, chip_count);
+  size_t *chip_y = g_new (size_t, chip_count);
+  srand (42);
+  int cc;
+  for ( cc = 0 ; cc < chip_count ; cc++ ) {
+    chip_x[cc] = (size_t) rand () % (size - chip_size + 1);
+    chip_y[cc] = (size_t) rand () % (size - chip_size + 1);
+  }
+
+  float *old_chip = g_new (float, chip_size * chip_size);
+  float *new_chip = g_new (float, chip_size * chip_size);
+  double old_seconds = 0.0, new_seconds = 0.0;
+  for ( cc = 0 ; cc < chip_count ; cc++ ) {
+    start = clock ();
+    old_get_region (image, chip_x[cc], chip_y[cc], chip_size, chip_size,
+                    old_chip);
+    old_seconds += seconds_since (start);
+    start = clock ();
+    float_image_get_region (image, chip_x[cc], chip_y[cc], chip_size,
+                            chip_size, new_chip);
+    new_seconds += seconds_since (start);
+    for ( ii = 0 ; ii < chip_size * chip_size ; ii++ ) {
+      assert (old_chip[ii] == new_chip[ii]);
+    }
+    assert (new_chip[0] == pixel_value (chip_x[cc], chip_y[cc]));
+  }
+  size_t chip_pixels = chip_count * chip_size * chip_size;
+  printf ("chips, old get_region: %10.1f MB/s\n",
+          megabytes_per_second (chip_pixels, old_seconds));
+  printf ("chips, new get_region: %10.1f MB/s\n",
+          megabytes_per_second (chip_pixels, new_seconds));
+
+  // Full width bands of rows from top to bottom, as export does.
+  float *old_band = g_new (float, size * band_rows);
+  old_seconds = new_seconds = 0.0;
+  for ( ii = 0 ; ii < size ; ii += band_rows ) {
+    size_t rows = MIN (band_rows, size - ii);
+    start = clock ();
+    old_get_region (image, 0, ii, size, rows, old_band);
+    old_seconds += seconds_since (start);
+    start = clock ();
+    float_image_get_region (image, 0, ii, size, rows, band);
+    new_seconds += seconds_since (start);
+    for ( jj = 0 ; jj < size * rows ; jj++ ) {
+      assert (old_band[jj] == band[jj]);
+    }
+  }
+  printf ("rows, old get_region:  %10.1f MB/s\n",
+          megabytes_per_second (size * size, old_seconds));
+  printf ("rows, new get_region:  %10.1f MB/s\n",
+          megabytes_per_second (size * size, new_seconds));
+
+  g_free (old_band);
+  g_free (band);
+  g_free (new_chip);
+  g_free (old_chip);
+  g_free (chip_y);
+  g_free (chip_x);
+  float_image_free (image);
+
+  return EXIT_SUCCESS;
+}
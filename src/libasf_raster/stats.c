@@ -1,5 +1,6 @@
 #include <math.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include "asf.h"
 #include "asf_endian.h"
 #include "asf_nan.h"
@@ -302,92 +303,335 @@ calc_stats_from_file(const char *inFile, char *band, double mask,
                                   &valid, histogram);
 }
 
-void
-calc_stats_from_file_ext(const char *inFile, char *band, double mask,
-                         double *min, double *max, double *mean,
-                         double *stdDev, double *percentValid, 
-                         gsl_histogram **histogram)
+/* Streaming statistics.  The values are added a line at a time: each
+   line's mean and sum of squared differences from it are found in two
+   passes over the line (while it is still in the cache), and then merged
+   into the running totals.  Accumulators for different parts of an image
+   can be merged the same way, so statistics need only one pass over the
+   data. */
+void stats_accumulator_init(stats_accumulator_t *acc)
 {
-    int ii,jj;
+    acc->count = 0;
+    acc->total = 0;
+    acc->min = 0.0;
+    acc->max = 0.0;
+    acc->mean = 0.0;
+    acc->m2 = 0.0;
+}
 
-    *min = 999999;
-    *max = -999999;
-    *mean = 0.0;
-    *percentValid = 0.0;
+void stats_accumulator_merge(stats_accumulator_t *acc,
+                             const stats_accumulator_t *other)
+{
+    long long count = acc->count + other->count;
+
+    acc->total += other->total;
+    if (other->count == 0)
+        return;
+    if (acc->count == 0) {
+        long long total = acc->total;
+        *acc = *other;
+        acc->total = total;
+        return;
+    }
 
-    meta_parameters *meta = meta_read(inFile);
-    int band_number;
-    if (!band || strlen(band) == 0 || strcmp(band, "???") == 0 ||
-        meta->general->band_count == 1) {
-      band_number = 0;
+    double delta = other->mean - acc->mean;
+    acc->m2 += other->m2 +
+        delta * delta * ((double)acc->count * other->count / count);
+    acc->mean += delta * other->count / count;
+    acc->count = count;
+    if (other->min < acc->min) acc->min = other->min;
+    if (other->max > acc->max) acc->max = other->max;
+}
+
+/* Adds n values, skipping invalid ones and the mask value (pass NAN for
+   no mask). */
+void stats_accumulator_add(stats_accumulator_t *acc, const float *data,
+                           int n, double mask)
+{
+    stats_accumulator_t line;
+    double sum = 0.0;
+    int ii;
+
+    stats_accumulator_init(&line);
+    line.total = n;
+    for (ii=0; ii<n; ++ii) {
+        if (meta_is_valid_double(data[ii]) &&
+            (ISNAN(mask) || !FLOAT_EQUIVALENT(data[ii], mask)))
+        {
+            if (line.count == 0 || data[ii] < line.min) line.min = data[ii];
+            if (line.count == 0 || data[ii] > line.max) line.max = data[ii];
+            sum += data[ii];
+            ++line.count;
+        }
     }
-    else {
-      band_number = get_band_number(meta->general->bands,
-                                    meta->general->band_count, band);
+    if (line.count > 0) {
+        line.mean = sum / line.count;
+        for (ii=0; ii<n; ++ii) {
+            if (meta_is_valid_double(data[ii]) &&
+                (ISNAN(mask) || !FLOAT_EQUIVALENT(data[ii], mask)))
+                line.m2 += (data[ii] - line.mean) * (data[ii] - line.mean);
+        }
     }
+    stats_accumulator_merge(acc, &line);
+}
 
-    long offset = meta->general->line_count * band_number;
-    float *data = MALLOC(sizeof(float) * meta->general->sample_count);
+double stats_accumulator_std_deviation(const stats_accumulator_t *acc)
+{
+    return acc->count > 1 ? sqrt(acc->m2 / (acc->count - 1)) : 0.0;
+}
 
-    // pass 1 -- calculate mean, min & max
-    FILE *fp = FOPEN(inFile, "rb");
-    long long pixel_count=0;
-    asfPrintStatus("\nCalculating min, max, and mean...\n");
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
+static int band_number_from_name(meta_parameters *meta, char *band)
+{
+    if (!band || strlen(band) == 0 || strcmp(band, "???") == 0 ||
+        meta->general->band_count == 1)
+        return 0;
+    return get_band_number(meta->general->bands, meta->general->band_count,
+                           band);
+}
 
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-          if (meta_is_valid_double(data[jj])) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                if (data[jj] < *min) *min = data[jj];
-                if (data[jj] > *max) *max = data[jj];
-                *mean += data[jj];
-                ++pixel_count;
-            }
-          }
-        }
-    }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
+static int same_mask(double mask1, double mask2)
+{
+    int none1 = ISNAN(mask1) || !meta_is_valid_double(mask1);
+    int none2 = ISNAN(mask2) || !meta_is_valid_double(mask2);
+    if (none1 || none2)
+        return none1 && none2;
+    return FLOAT_EQUIVALENT(mask1, mask2);
+}
 
-    *mean /= pixel_count;
-    long total_count = meta->general->line_count*meta->general->sample_count;
-    *percentValid = (double)pixel_count*100.0/total_count;
+/* Identifies the data file well enough to tell whether statistics cached
+   in the metadata were taken from it: its size, modification time and
+   inode.  Tools often copy their input's metadata, statistics and all, to
+   their output, and the key keeps the output from using them. */
+static void data_file_key(const char *inFile, char *key, size_t size)
+{
+    struct stat st;
 
-    // Guard against weird data
-    if(!(*min<*max)) *max = *min + 1;
+    if (stat(inFile, &st) == 0)
+        snprintf(key, size, "size%lld_time%lld_inode%lld",
+                 (long long)st.st_size, (long long)st.st_mtime,
+                 (long long)st.st_ino);
+    else
+        snprintf(key, size, "%s", MAGIC_UNSET_STRING);
+}
 
-    // Initialize the histogram.
-    const int num_bins = 256;
-    gsl_histogram *hist = gsl_histogram_alloc (num_bins);
-    gsl_histogram_set_ranges_uniform (hist, *min, *max);
-    *stdDev = 0.0;
+/* Statistics that were cached in the metadata for this band, computed
+   from this data file with the same mask. */
+static int have_cached_stats(meta_parameters *meta, int band, double mask,
+                             const char *key)
+{
+    meta_stats *s;
+
+    if (!meta->stats || band < 0 || band >= meta->stats->band_count ||
+        strcmp(key, MAGIC_UNSET_STRING) == 0)
+        return FALSE;
+    s = &meta->stats->band_stats[band];
+    return meta_is_valid_double(s->min) && meta_is_valid_double(s->max) &&
+        meta_is_valid_double(s->mean) &&
+        meta_is_valid_double(s->std_deviation) && same_mask(s->mask, mask) &&
+        strcmp(s->data_key, key) == 0;
+}
 
-    // pass 2 -- update histogram, calculate standard deviation
-    fp = FOPEN(inFile, "rb");
-    asfPrintStatus("\nCalculating standard deviation and histogram...\n");
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
+/* TRUE if the statistics in meta for the given band were taken from the
+   data file inFile (as it is now) with the given mask, so they can be
+   used instead of reading the image.  Metadata copied from another image
+   may carry that image's statistics, which this rejects. */
+int have_cached_band_stats(const char *inFile, meta_parameters *meta,
+                           int band, double mask)
+{
+    char key[64];
 
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-          if (meta_is_valid_double(data[jj])) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                *stdDev += (data[jj] - *mean) * (data[jj] - *mean);
-                gsl_histogram_increment (hist, data[jj]);
+    data_file_key(inFile, key, sizeof key);
+    return have_cached_stats(meta, band, mask, key);
+}
+
+/* Writes the statistics into the image's metadata file, if there is one
+   that can be written to, so the next tool that needs them doesn't have
+   to read the image again. */
+static void cache_stats(const char *inFile, meta_parameters *meta)
+{
+    char *metaFile = appendExt(inFile, ".meta");
+    FILE *fp = fopen(metaFile, "r+");
+
+    if (fp) {
+        int save_dump_envi_header = dump_envi_header;
+        fclose(fp);
+        asfPrintStatus("Saving the statistics in %s\n", metaFile);
+        dump_envi_header = FALSE;
+        meta_write(meta, inFile);
+        dump_envi_header = save_dump_envi_header;
+    }
+    FREE(metaFile);
+}
+
+/* Finds the statistics of band_count bands of an image.  Statistics
+   cached in the metadata are used as they are; the others are computed
+   for all bands in a single pass over the image (and then cached).  If
+   histograms is not NULL, a 256 bin histogram over each band's range is
+   made too, in one more pass. */
+static void band_stats_from_file(const char *inFile, int band_count,
+                                 char **bands, double mask, meta_stats *stats,
+                                 gsl_histogram **histograms)
+{
+    meta_parameters *meta = meta_read(inFile);
+    int line_count = meta->general->line_count;
+    int sample_count = meta->general->sample_count;
+    int *band_numbers = MALLOC(sizeof(int) * band_count);
+    int *todo = MALLOC(sizeof(int) * band_count);
+    stats_accumulator_t *acc = MALLOC(sizeof(stats_accumulator_t) * band_count);
+    float *data = MALLOC(sizeof(float) * sample_count);
+    int ii, kk, n_todo = 0;
+    char key[64];
+    FILE *fp;
+
+    data_file_key(inFile, key, sizeof key);
+    for (kk=0; kk<band_count; ++kk) {
+        band_numbers[kk] = band_number_from_name(meta, bands[kk]);
+        if (band_numbers[kk] < 0)
+            asfPrintError("Band '%s' not found in %s\n", bands[kk], inFile);
+        stats_accumulator_init(&acc[kk]);
+        todo[kk] = !have_cached_stats(meta, band_numbers[kk], mask, key);
+        if (todo[kk])
+            ++n_todo;
+        else
+            stats[kk] = meta->stats->band_stats[band_numbers[kk]];
+    }
+
+    if (n_todo > 0) {
+        fp = FOPEN(inFile, "rb");
+        asfPrintStatus("\nCalculating min, max, mean and standard deviation"
+                       "...\n");
+        for (ii=0; ii<line_count; ++ii) {
+            asfPercentMeter(((double)ii/(double)line_count));
+            for (kk=0; kk<band_count; ++kk) {
+                if (!todo[kk])
+                    continue;
+                get_float_line(fp, meta, ii + line_count*band_numbers[kk],
+                               data);
+                stats_accumulator_add(&acc[kk], data, sample_count, mask);
             }
-          }
         }
+        asfPercentMeter(1.0);
+        FCLOSE(fp);
+
+        if (!meta->stats || meta->stats->band_count < meta->general->band_count)
+        {
+            meta_statistics *old = meta->stats;
+            meta->stats = meta_statistics_init(meta->general->band_count);
+            if (old) {
+                for (kk=0; kk<old->band_count; ++kk)
+                    meta->stats->band_stats[kk] = old->band_stats[kk];
+                FREE(old);
+            }
+        }
+        for (kk=0; kk<band_count; ++kk) {
+            meta_stats *s;
+            if (!todo[kk])
+                continue;
+            s = &meta->stats->band_stats[band_numbers[kk]];
+            if (bands[kk] && strlen(bands[kk]) > 0 &&
+                strcmp(bands[kk], "???") != 0)
+            {
+                strncpy(s->band_id, bands[kk], sizeof(s->band_id)-1);
+                s->band_id[sizeof(s->band_id)-1] = '\0';
+            }
+            s->min = acc[kk].count > 0 ? acc[kk].min : 0.0;
+            s->max = acc[kk].count > 0 ? acc[kk].max : 0.0;
+            s->mean = acc[kk].mean;
+            s->std_deviation = stats_accumulator_std_deviation(&acc[kk]);
+            s->rmse = acc[kk].count > 0 ? sqrt(acc[kk].m2/acc[kk].count) : 0.0;
+            s->percent_valid = acc[kk].total > 0 ?
+                (double)acc[kk].count*100.0/acc[kk].total : 0.0;
+            s->mask = ISNAN(mask) ? MAGIC_UNSET_DOUBLE : mask;
+            strcpy(s->data_key, key);
+            stats[kk] = *s;
+        }
+        cache_stats(inFile, meta);
+    }
+
+    if (histograms) {
+        // Initialize the histograms.
+        const int num_bins = 256;
+        for (kk=0; kk<band_count; ++kk) {
+            double min = stats[kk].min, max = stats[kk].max;
+            // Guard against weird data
+            if (!(min < max)) max = min + 1;
+            histograms[kk] = gsl_histogram_alloc (num_bins);
+            gsl_histogram_set_ranges_uniform (histograms[kk], min, max);
+        }
+
+        fp = FOPEN(inFile, "rb");
+        asfPrintStatus("\nCalculating histogram...\n");
+        for (ii=0; ii<line_count; ++ii) {
+            asfPercentMeter(((double)ii/(double)line_count));
+            for (kk=0; kk<band_count; ++kk) {
+                int jj;
+                get_float_line(fp, meta, ii + line_count*band_numbers[kk],
+                               data);
+                for (jj=0; jj<sample_count; ++jj) {
+                    if (meta_is_valid_double(data[jj]) &&
+                        (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)))
+                        gsl_histogram_increment (histograms[kk], data[jj]);
+                }
+            }
+        }
+        asfPercentMeter(1.0);
+        FCLOSE(fp);
     }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
-    *stdDev = sqrt(*stdDev/(pixel_count - 1));
 
     FREE(data);
+    FREE(acc);
+    FREE(todo);
+    FREE(band_numbers);
     meta_free(meta);
+}
 
-    *histogram = hist;
+/* Statistics of several bands of an image, for scaling them (see
+   band_stats_from_file).  The histograms are only made if asked for,
+   otherwise they are set to NULL. */
+void
+calc_band_stats_from_file(const char *inFile, int band_count, char **bands,
+                          double mask, int histogram, channel_stats_t *stats)
+{
+    meta_stats *s = MALLOC(sizeof(meta_stats) * band_count);
+    gsl_histogram **hists =
+        histogram ? MALLOC(sizeof(gsl_histogram *) * band_count) : NULL;
+    int kk;
+
+    band_stats_from_file(inFile, band_count, bands, mask, s, hists);
+    for (kk=0; kk<band_count; ++kk) {
+        stats[kk].min = s[kk].min;
+        stats[kk].max = s[kk].max;
+        stats[kk].mean = s[kk].mean;
+        stats[kk].standard_deviation = s[kk].std_deviation;
+        stats[kk].hist = hists ? hists[kk] : NULL;
+        stats[kk].hist_pdf = NULL;
+
+        // Guard against weird data
+        if(!(stats[kk].min<stats[kk].max))
+            stats[kk].max = stats[kk].min + 1;
+    }
+
+    if (hists) FREE(hists);
+    FREE(s);
+}
+
+void
+calc_stats_from_file_ext(const char *inFile, char *band, double mask,
+                         double *min, double *max, double *mean,
+                         double *stdDev, double *percentValid,
+                         gsl_histogram **histogram)
+{
+    meta_stats s;
+
+    band_stats_from_file(inFile, 1, &band, mask, &s, histogram);
+    *min = s.min;
+    *max = s.max;
+    *mean = s.mean;
+    *stdDev = s.std_deviation;
+    *percentValid = s.percent_valid;
+
+    // Guard against weird data
+    if(!(*min<*max)) *max = *min + 1;
 }
 
 void
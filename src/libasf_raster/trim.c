@@ -151,6 +151,44 @@ int trim(char *infile, char *outfile,
   return 0;
 }
 
+/* Like trim(), but for an image in memory: returns a new sizeX by sizeY
+   image holding the part of image with its upper left corner at startX,
+   startY.  As with trim(), parts of the new image that fall outside of
+   image are filled with zeros. */
+FloatImage *trim_float_image(FloatImage *image, long long startX,
+                             long long startY, long long sizeX,
+                             long long sizeY)
+{
+  const long long inMaxX = image->size_x;
+  const long long inMaxY = image->size_y;
+
+  if (sizeX < 0) sizeX = inMaxX - startX;
+  if (sizeY < 0) sizeY = inMaxY - startY;
+
+  FloatImage *out = float_image_new_with_value(sizeX, sizeY, 0.0);
+
+  /* The part of the output image that overlaps the input image. */
+  long long firstX = MAXI(0,-startX), lastX = MINI(sizeX,inMaxX-startX);
+  long long firstY = MAXI(0,-startY), lastY = MINI(sizeY,inMaxY-startY);
+  if (firstX >= lastX || firstY >= lastY)
+    return out;
+
+  /* Copy it across a band of lines at a time. */
+  const long long band = 64;
+  long long width = lastX - firstX;
+  float *buffer = MALLOC(sizeof(float)*width*band);
+  long long y;
+  for (y=firstY; y<lastY; y+=band) {
+    long long lines = MINI(band, lastY-y);
+    float_image_get_region(image, firstX+startX, y+startY, width, lines,
+                           buffer);
+    float_image_set_region(out, firstX, y, width, lines, buffer);
+  }
+  FREE(buffer);
+
+  return out;
+}
+
 void trim_zeros(char *infile, char *outfile, int * startX, int * endX)
 {
   meta_parameters *metaIn;
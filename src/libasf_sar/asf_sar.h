@@ -165,6 +165,7 @@ void cpx2debug(const char *inFile, const char *outFile);
 void cpx2freeman_durden(const char *inFile, const char *outFile, int tc_flag);
 
 void make_entropy_alpha_boundary(const char *fname, int size);
+void polarimetry_set_thread_count(int count);
 
 
 /* farcorr.c */
@@ -175,6 +176,9 @@ void faraday_correct(const char *inFile, const char *outFile, double threshold,
 // calibrate.c
 int asf_calibrate(const char *inFile, const char *outFile, 
 		  radiometry_t radiometry, int wh_scaleFlag);
+int asf_calibrate_ext(const char *inFile, const char *outFile,
+		      radiometry_t radiometry, int wh_scaleFlag,
+		      int azimuth_looks, int range_looks);
 int asf_logscale(const char *inFile, const char *outFile);
 
 // calc_number_looks.c
@@ -4,8 +4,95 @@
 #include "asf.h"
 #include <assert.h>
 
+// Calibration goes through a plan (see cal_plan_new in asf_meta), which
+// keeps the gain and offset of every sample instead of calling get_cal_dn
+// (and meta_incid) for every pixel.
+
+// Output lines calibrated per read/write
+#define CAL_BLOCK_LINES 64
+
+// Calibrates one input line to (linear) power and adds it into the
+// range_looks times shorter output line acc.
+static void calibrate_line_into(const cal_plan_t *plan, int line,
+				const float *in, float *power,
+				int range_looks, int out_samples, float *acc)
+{
+  int jj, kk;
+
+  cal_plan_apply(plan, line, in, power);
+
+  if (range_looks == 1)
+    for (jj=0; jj<out_samples; jj++)
+      acc[jj] += power[jj];
+  else
+    for (jj=0; jj<out_samples; jj++) {
+      const float *p = power + jj*range_looks;
+      float sum = 0.0;
+      for (kk=0; kk<range_looks; kk++)
+	sum += p[kk];
+      acc[jj] += sum;
+    }
+}
+
+// Reads, calibrates and multilooks n_out output lines of a band, starting
+// at output line out_line. The result is the averaged linear power.
+static void calibrate_lines(FILE *fpIn, meta_parameters *metaIn, int band,
+			    const cal_plan_t *plan, int out_line, int n_out,
+			    int azimuth_looks, int range_looks,
+			    int out_samples, float *bufIn, float *power,
+			    float *out)
+{
+  int ns = plan->sample_count;
+  int ii, jj, kk;
+  float scale = 1.0/(azimuth_looks*range_looks);
+
+  get_band_float_lines(fpIn, metaIn, band, out_line*azimuth_looks,
+		       n_out*azimuth_looks, bufIn);
+  for (ii=0; ii<n_out; ii++) {
+    float *acc = out + ii*out_samples;
+    for (jj=0; jj<out_samples; jj++)
+      acc[jj] = 0.0;
+    for (kk=0; kk<azimuth_looks; kk++) {
+      int line = ii*azimuth_looks + kk;
+      calibrate_line_into(plan, out_line*azimuth_looks + line,
+			  bufIn + line*ns, power, range_looks, out_samples,
+			  acc);
+    }
+    if (azimuth_looks*range_looks > 1)
+      for (jj=0; jj<out_samples; jj++)
+	acc[jj] *= scale;
+  }
+}
+
+// Phase is not calibrated, and multilooking just picks the first pixel
+// of each look window.
+static void phase_lines(FILE *fpIn, meta_parameters *metaIn, int band,
+			int out_line, int n_out, int azimuth_looks,
+			int range_looks, int out_samples, float *bufIn,
+			float *out)
+{
+  int ns = metaIn->general->sample_count;
+  int ii, jj;
+
+  get_band_float_lines(fpIn, metaIn, band, out_line*azimuth_looks,
+		       n_out*azimuth_looks, bufIn);
+  for (ii=0; ii<n_out; ii++) {
+    const float *in = bufIn + ii*azimuth_looks*ns;
+    for (jj=0; jj<out_samples; jj++)
+      out[ii*out_samples + jj] = in[jj*range_looks];
+  }
+}
+
 int asf_calibrate(const char *inFile, const char *outFile, 
 		  radiometry_t outRadiometry, int wh_scaleFlag)
+{
+  return asf_calibrate_ext(inFile, outFile, outRadiometry, wh_scaleFlag,
+			   1, 1);
+}
+
+int asf_calibrate_ext(const char *inFile, const char *outFile,
+		      radiometry_t outRadiometry, int wh_scaleFlag,
+		      int azimuth_looks, int range_looks)
 {
   meta_parameters *metaIn = meta_read(inFile);
   meta_parameters *metaOut = meta_read(inFile);
@@ -30,6 +117,14 @@ int asf_calibrate(const char *inFile, const char *outFile,
     asfPrintError("Can't apply calibration factors to map projected images\n"
                   "(Amplitude or Power only)\n");
 
+  if (azimuth_looks < 1 || range_looks < 1)
+    asfPrintError("Invalid number of looks (%d x %d)!\n",
+		  azimuth_looks, range_looks);
+  if (azimuth_looks > metaIn->general->line_count ||
+      range_looks > metaIn->general->sample_count)
+    asfPrintError("More looks (%d x %d) than the image has lines and "
+		  "samples!\n", azimuth_looks, range_looks);
+
   radiometry_t inRadiometry = metaIn->general->radiometry;
   asfPrintStatus("Calibrating %s image to %s image\n\n", 
 		 radiometry2str(inRadiometry), radiometry2str(outRadiometry));
@@ -53,6 +148,11 @@ int asf_calibrate(const char *inFile, const char *outFile,
       strcmp_case(metaIn->general->sensor, "RSAT-1") == 0)
     asfPrintWarning("The noise floor removal is not applied to the data!\n");
 
+  // The calibration plans are set up with the input geometry, but need
+  // the output radiometry
+  meta_parameters *calMeta = meta_copy(metaIn);
+  calMeta->general->radiometry = outRadiometry;
+
   metaOut->general->radiometry = outRadiometry;
   int dbFlag = FALSE;
   if (outRadiometry >= r_SIGMA && outRadiometry <= r_GAMMA)
@@ -72,47 +172,75 @@ int asf_calibrate(const char *inFile, const char *outFile,
   if (wh_scaleFlag)
     metaOut->general->data_type = ASF_BYTE;
 
+  int band_count = metaIn->general->band_count;
+  int sample_count = metaIn->general->sample_count;
+
+  // Multilooking is done on the calibrated power, before any conversion
+  // into dB
+  if (azimuth_looks > 1 || range_looks > 1) {
+    asfPrintStatus("Multilooking %d x %d (azimuth x range)\n\n",
+		   azimuth_looks, range_looks);
+    metaOut->general->line_count /= azimuth_looks;
+    metaOut->general->sample_count /= range_looks;
+    metaOut->general->line_scaling *= azimuth_looks;
+    metaOut->general->sample_scaling *= range_looks;
+    metaOut->general->y_pixel_size *= azimuth_looks;
+    metaOut->general->x_pixel_size *= range_looks;
+    if (metaOut->sar) {
+      metaOut->sar->azimuth_time_per_pixel *= azimuth_looks;
+      metaOut->sar->range_time_per_pixel *= range_looks;
+      if (metaOut->sar->azimuth_look_count > 0 &&
+          metaOut->sar->azimuth_look_count != MAGIC_UNSET_INT)
+        metaOut->sar->azimuth_look_count *= azimuth_looks;
+      if (metaOut->sar->range_look_count > 0 &&
+          metaOut->sar->range_look_count != MAGIC_UNSET_INT)
+        metaOut->sar->range_look_count *= range_looks;
+      metaOut->sar->multilook = 1;
+    }
+  }
+  int out_samples = metaOut->general->sample_count;
+  int out_lines = metaOut->general->line_count;
+
   char *input = appendExt(inFile, ".img");
   char *output = appendExt(outFile, ".img");
   FILE *fpIn = FOPEN(input, "rb");
   FILE *fpOut = FOPEN(output, "wb");
 
   int dualpol = strncmp_case(metaIn->general->mode, "FBD", 3) == 0 ? 1 : 0;
-  int band_count = metaIn->general->band_count;
-  int sample_count = metaIn->general->sample_count;
-  int line_count = metaIn->general->line_count;
   char **bands = 
     extract_band_names(metaIn->general->bands, band_count);
 
-  float *bufIn = (float *) MALLOC(sizeof(float)*sample_count);
-  float *bufOut = (float *) MALLOC(sizeof(float)*sample_count);
-  float *bufIn2 = NULL, *bufOut2 = NULL, *bufOut3 = NULL;
+  int block = CAL_BLOCK_LINES;
+  float *bufIn =
+    (float *) MALLOC(sizeof(float)*sample_count*block*azimuth_looks);
+  float *bufOut = (float *) MALLOC(sizeof(float)*out_samples*block);
+  float *power = (float *) MALLOC(sizeof(float)*sample_count);
+  float *bufOut2 = NULL, *bufOut3 = NULL;
   if (dualpol && wh_scaleFlag) {
-    bufIn2 = (float *) MALLOC(sizeof(float)*sample_count);
-    bufOut2 = (float *) MALLOC(sizeof(float)*sample_count);
-    bufOut3 = (float *) MALLOC(sizeof(float)*sample_count);
+    bufOut2 = (float *) MALLOC(sizeof(float)*out_samples*block);
+    bufOut3 = (float *) MALLOC(sizeof(float)*out_samples*block);
     metaOut->general->band_count = 3;
     sprintf(metaOut->general->bands, "%s,%s,%s-%s", 
 	    bands[0], bands[1], bands[0], bands[1]);
   }
 
-  int ii, jj, kk;
+  int ii, jj, kk, n;
+  int pixels;
   float cal_dn, cal_dn2;
-  double incid;
   if (dualpol && wh_scaleFlag) {
     metaOut->general->image_data_type = RGB_STACK;
-    for (ii=0; ii<line_count; ii++) {
-      get_band_float_line(fpIn, metaIn, 0, ii, bufIn);
-      get_band_float_line(fpIn, metaIn, 1, ii, bufIn2);
-      for (jj=0; jj<sample_count; jj++) {
-	// Taking the remapping of other radiometries out for the moment
-	//if (inRadiometry >= r_SIGMA && inRadiometry <= r_BETA_DB)
-	//bufIn[jj] = cal2amp(metaIn, incid, jj, bands[kk], bufIn[jj]);
-	incid = meta_incid(metaIn, ii, jj);
-	cal_dn = 
-	  get_cal_dn(metaOut, incid, jj, bufIn[jj], bands[0], dbFlag);
-	cal_dn2 = 
-	  get_cal_dn(metaOut, incid, jj, bufIn2[jj], bands[1], dbFlag);
+    cal_plan_t *plan = cal_plan_new(calMeta, bands[0], FALSE);
+    cal_plan_t *plan2 = cal_plan_new(calMeta, bands[1], FALSE);
+    for (ii=0; ii<out_lines; ii+=block) {
+      n = MIN(block, out_lines - ii);
+      pixels = n*out_samples;
+      calibrate_lines(fpIn, metaIn, 0, plan, ii, n, azimuth_looks,
+		      range_looks, out_samples, bufIn, power, bufOut);
+      calibrate_lines(fpIn, metaIn, 1, plan2, ii, n, azimuth_looks,
+		      range_looks, out_samples, bufIn, power, bufOut2);
+      for (jj=0; jj<pixels; jj++) {
+	cal_dn = 10.0 * log10(bufOut[jj]);
+	cal_dn2 = 10.0 * log10(bufOut2[jj]);
 	if (FLOAT_EQUIVALENT(cal_dn, metaIn->general->no_data) ||
 	    cal_dn == cal_dn2) {
 	  bufOut[jj] = 0;
@@ -125,39 +253,43 @@ int asf_calibrate(const char *inFile, const char *outFile,
 	  bufOut3[jj] = bufOut[jj] - bufOut2[jj];
 	}
       }
-      put_band_float_line(fpOut, metaOut, 0, ii, bufOut);
-      put_band_float_line(fpOut, metaOut, 1, ii, bufOut2);
-      put_band_float_line(fpOut, metaOut, 2, ii, bufOut3);
-      asfLineMeter(ii, line_count);
+      put_band_float_lines(fpOut, metaOut, 0, ii, n, bufOut);
+      put_band_float_lines(fpOut, metaOut, 1, ii, n, bufOut2);
+      put_band_float_lines(fpOut, metaOut, 2, ii, n, bufOut3);
+      asfLineMeter(ii + n - 1, out_lines);
     }
+    cal_plan_free(plan);
+    cal_plan_free(plan2);
   }
   else {
     for (kk=0; kk<band_count; kk++) {
-      for (ii=0; ii<line_count; ii++) {
-	get_band_float_line(fpIn, metaIn, kk, ii, bufIn);
-	for (jj=0; jj<sample_count; jj++) {
-	  // Taking the remapping of other radiometries out for the moment
-	  //if (inRadiometry >= r_SIGMA && inRadiometry <= r_BETA_DB)
-	  //bufIn[jj] = cal2amp(metaIn, incid, jj, bands[kk], bufIn[jj]);
-	  if (strstr(bands[kk], "PHASE") == NULL) {
-	    incid = meta_incid(metaIn, ii, jj);
-	    cal_dn =
-	      get_cal_dn(metaOut, incid, jj, bufIn[jj], bands[kk], dbFlag);
-	    if (wh_scaleFlag) {
-	      if (FLOAT_EQUIVALENT(cal_dn, metaIn->general->no_data))
+      int phase = strstr(bands[kk], "PHASE") != NULL;
+      cal_plan_t *plan = phase ? NULL : cal_plan_new(calMeta, bands[kk], FALSE);
+      for (ii=0; ii<out_lines; ii+=block) {
+	n = MIN(block, out_lines - ii);
+	pixels = n*out_samples;
+	if (phase) { // PHASE band, do nothing
+	  phase_lines(fpIn, metaIn, kk, ii, n, azimuth_looks, range_looks,
+		      out_samples, bufIn, bufOut);
+	}
+	else {
+	  calibrate_lines(fpIn, metaIn, kk, plan, ii, n, azimuth_looks,
+			  range_looks, out_samples, bufIn, power, bufOut);
+	  if (dbFlag)
+	    for (jj=0; jj<pixels; jj++)
+	      bufOut[jj] = 10.0 * log10(bufOut[jj]);
+	  if (wh_scaleFlag)
+	    for (jj=0; jj<pixels; jj++) {
+	      if (FLOAT_EQUIVALENT(bufOut[jj], metaIn->general->no_data))
 		bufOut[jj] = 0;
 	      else
-		bufOut[jj] = (cal_dn + 31) / 0.15 + 1.5;
+		bufOut[jj] = (bufOut[jj] + 31) / 0.15 + 1.5;
 	    }
-	    else
-	      bufOut[jj] = cal_dn;
-	  }
-	  else // PHASE band, do nothing
-	    bufOut[jj] = bufIn[jj];
 	}
-	put_band_float_line(fpOut, metaOut, kk, ii, bufOut);
-	asfLineMeter(ii, line_count);
+	put_band_float_lines(fpOut, metaOut, kk, ii, n, bufOut);
+	asfLineMeter(ii + n - 1, out_lines);
       }
+      cal_plan_free(plan);
       char *radiometry = radiometry2str(outRadiometry);
       if (kk==0)
 	sprintf(metaOut->general->bands, "%s-%s", 
@@ -173,10 +305,11 @@ int asf_calibrate(const char *inFile, const char *outFile,
   meta_write(metaOut, outFile);
   meta_free(metaIn);
   meta_free(metaOut);
+  meta_free(calMeta);
   FREE(bufIn);
   FREE(bufOut);
-  if (dualpol) {
-    FREE(bufIn2);
+  FREE(power);
+  if (dualpol && wh_scaleFlag) {
     FREE(bufOut2);
     FREE(bufOut3);
   }
@@ -0,0 +1,269 @@
+// Test program useful for checking hermitian3_eigen() against GSL.
+//
+// Decomposes random Hermitian matrices with hermitian3_eigen() and with
+// gsl_eigen_hermv, sorted the same way, and checks that the eigenvalues
+// agree and that the eigenvectors agree up to a phase.  Then tries the
+// matrices the closed form has the most trouble with: zero, multiples of
+// the identity, and ones with repeated or nearly repeated eigenvalues,
+// where the eigenvectors aren't unique and only A v = lambda v and
+// orthonormality are checked.
+//
+// Usage: hermitian3_eigen_test [random_matrices]
+
+// hermitian3_eigen() is static
+#include "polarimetry.c"
+
+#include <gsl/gsl_eigen.h>
+
+#define TOL 1e-9
+
+static int failures = 0;
+
+static double uniform(void)
+{
+  return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+// Largest absolute element of A, for scaling the tolerances
+static double matrix_scale(complexDouble A[3][3])
+{
+  double s = 1.0;
+  int i, j;
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      if (sqrt(cd_amp_sqr(A[i][j])) > s)
+        s = sqrt(cd_amp_sqr(A[i][j]));
+  return s;
+}
+
+static void fail(const char *what, const char *name, double err)
+{
+  printf("%s: %s off by %g\n", name, what, err);
+  failures++;
+}
+
+// A v = lambda v for each column, and the columns are orthonormal
+static void check_decomposition(complexDouble A[3][3], double *eval,
+                                complexDouble evec[3][3], const char *name)
+{
+  double scale = matrix_scale(A);
+  int i, j, k;
+
+  for (k=0; k<3; ++k) {
+    double err = 0;
+    for (i=0; i<3; ++i) {
+      complexDouble Av = cd_new(0, 0);
+      for (j=0; j<3; ++j)
+        Av = cd_add(Av, cd_mul(A[i][j], evec[j][k]));
+      Av = cd_add(Av, cd_scale(evec[i][k], -eval[k]));
+      err += cd_amp_sqr(Av);
+    }
+    if (sqrt(err) > TOL*scale)
+      fail("A v - lambda v", name, sqrt(err));
+  }
+
+  for (j=0; j<3; ++j) {
+    for (k=0; k<3; ++k) {
+      complexDouble dot = cd_new(0, 0);
+      for (i=0; i<3; ++i)
+        dot = cd_add(dot, cd_mul(cd_conj(evec[i][j]), evec[i][k]));
+      dot = cd_add(dot, cd_new(j == k ? -1 : 0, 0));
+      if (sqrt(cd_amp_sqr(dot)) > TOL)
+        fail("orthonormality", name, sqrt(cd_amp_sqr(dot)));
+    }
+  }
+
+  for (k=0; k<2; ++k)
+    if (fabs(eval[k]) < fabs(eval[k+1]))
+      fail("eigenvalue order", name, fabs(eval[k+1]) - fabs(eval[k]));
+}
+
+// The decomposition gsl_eigen_hermv gives, sorted as polarimetry.c used
+// to sort it
+static void gsl_decomposition(complexDouble A[3][3], double *eval,
+                              complexDouble evec[3][3])
+{
+  gsl_matrix_complex *m = gsl_matrix_complex_alloc(3, 3);
+  gsl_matrix_complex *v = gsl_matrix_complex_alloc(3, 3);
+  gsl_vector *e = gsl_vector_alloc(3);
+  gsl_eigen_hermv_workspace *ws = gsl_eigen_hermv_alloc(3);
+  int i, j;
+
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      gsl_matrix_complex_set(m, i, j,
+                             gsl_complex_rect(A[i][j].real, A[i][j].imag));
+  gsl_eigen_hermv(m, e, v, ws);
+  gsl_eigen_hermv_sort(e, v, GSL_EIGEN_SORT_ABS_DESC);
+
+  for (j=0; j<3; ++j) {
+    eval[j] = gsl_vector_get(e, j);
+    for (i=0; i<3; ++i) {
+      gsl_complex z = gsl_matrix_complex_get(v, i, j);
+      evec[i][j] = cd_new(GSL_REAL(z), GSL_IMAG(z));
+    }
+  }
+
+  gsl_eigen_hermv_free(ws);
+  gsl_vector_free(e);
+  gsl_matrix_complex_free(v);
+  gsl_matrix_complex_free(m);
+}
+
+// Compare with GSL.  The eigenvectors are only compared when the
+// eigenvalues are well separated, otherwise they aren't unique.
+static void check_against_gsl(complexDouble A[3][3], const char *name)
+{
+  double eval[3], gsl_eval[3], scale = matrix_scale(A);
+  complexDouble evec[3][3], gsl_evec[3][3];
+  int i, k;
+
+  hermitian3_eigen(A, eval, evec);
+  gsl_decomposition(A, gsl_eval, gsl_evec);
+  check_decomposition(A, eval, evec, name);
+
+  for (k=0; k<3; ++k)
+    if (fabs(eval[k] - gsl_eval[k]) > TOL*scale)
+      fail("eigenvalue", name, fabs(eval[k] - gsl_eval[k]));
+
+  for (k=0; k<3; ++k) {
+    double gap = 1e300;
+    int j;
+    for (j=0; j<3; ++j)
+      if (j != k && fabs(eval[j] - eval[k]) < gap)
+        gap = fabs(eval[j] - eval[k]);
+    if (gap < 1e-3*scale)
+      continue;
+
+    // |<v, v_gsl>| is 1 if they differ only by a phase
+    complexDouble dot = cd_new(0, 0);
+    for (i=0; i<3; ++i)
+      dot = cd_add(dot, cd_mul(cd_conj(evec[i][k]), gsl_evec[i][k]));
+    double err = fabs(sqrt(cd_amp_sqr(dot)) - 1.0);
+    if (err > 1e-6)
+      fail("eigenvector", name, err);
+  }
+}
+
+static void random_hermitian(complexDouble A[3][3], double size)
+{
+  int i, j;
+  for (i=0; i<3; ++i) {
+    A[i][i] = cd_new(size*uniform(), 0);
+    for (j=i+1; j<3; ++j) {
+      A[i][j] = cd_new(size*uniform(), size*uniform());
+      A[j][i] = cd_conj(A[i][j]);
+    }
+  }
+}
+
+// A random orthonormal basis, by Gram-Schmidt on random vectors
+static void random_unitary(complexDouble U[3][3])
+{
+  int i, j, k;
+  for (k=0; k<3; ++k) {
+    for (;;) {
+      double n = 0;
+      for (i=0; i<3; ++i)
+        U[i][k] = cd_new(uniform(), uniform());
+      for (j=0; j<k; ++j) {
+        complexDouble dot = cd_new(0, 0);
+        for (i=0; i<3; ++i)
+          dot = cd_add(dot, cd_mul(cd_conj(U[i][j]), U[i][k]));
+        for (i=0; i<3; ++i)
+          U[i][k] = cd_add(U[i][k], cd_scale(cd_mul(dot, U[i][j]), -1));
+      }
+      for (i=0; i<3; ++i)
+        n += cd_amp_sqr(U[i][k]);
+      if (n > 1e-6) {
+        for (i=0; i<3; ++i)
+          U[i][k] = cd_scale(U[i][k], 1.0/sqrt(n));
+        break;
+      }
+    }
+  }
+}
+
+// U diag(l0, l1, l2) U^H, for a random unitary U
+static void with_eigenvalues(complexDouble A[3][3], double l0, double l1,
+                             double l2)
+{
+  complexDouble U[3][3];
+  double l[3] = { l0, l1, l2 };
+  int i, j, k;
+
+  random_unitary(U);
+  for (i=0; i<3; ++i) {
+    for (j=0; j<3; ++j) {
+      A[i][j] = cd_new(0, 0);
+      for (k=0; k<3; ++k)
+        A[i][j] = cd_add(A[i][j],
+                         cd_scale(cd_mul(U[i][k], cd_conj(U[j][k])), l[k]));
+    }
+  }
+  // exactly Hermitian, as the coherency matrices are
+  for (i=0; i<3; ++i) {
+    A[i][i].imag = 0;
+    for (j=i+1; j<3; ++j)
+      A[j][i] = cd_conj(A[i][j]);
+  }
+}
+
+static void diagonal(complexDouble A[3][3], double a, double b, double c)
+{
+  int i, j;
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      A[i][j] = cd_new(0, 0);
+  A[0][0].real = a;
+  A[1][1].real = b;
+  A[2][2].real = c;
+}
+
+int main(int argc, char **argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  complexDouble A[3][3];
+  char name[64];
+  int n;
+
+  srand(31415);
+
+  for (n=0; n<count; ++n) {
+    sprintf(name, "random matrix %d", n);
+    // coherency matrices range over many orders of magnitude
+    random_hermitian(A, pow(10.0, 6.0*uniform()));
+    check_against_gsl(A, name);
+  }
+
+  diagonal(A, 0, 0, 0);
+  check_against_gsl(A, "zero");
+  diagonal(A, 2.5, 2.5, 2.5);
+  check_against_gsl(A, "multiple of the identity");
+  diagonal(A, 3, 1, 1);
+  check_against_gsl(A, "diagonal, repeated smallest");
+  diagonal(A, 3, 3, 1);
+  check_against_gsl(A, "diagonal, repeated largest");
+  diagonal(A, 1, -1, 0.5);
+  check_against_gsl(A, "diagonal, equal magnitudes");
+  diagonal(A, 0, 4, 0);
+  check_against_gsl(A, "diagonal, rank one");
+
+  for (n=0; n<1000; ++n) {
+    double l = 10.0*uniform(), m = 10.0*uniform();
+    sprintf(name, "repeated eigenvalues %d", n);
+    with_eigenvalues(A, l, l, m);
+    check_against_gsl(A, name);
+    with_eigenvalues(A, m, l, l);
+    check_against_gsl(A, name);
+    with_eigenvalues(A, l, l*(1+1e-9), m);
+    check_against_gsl(A, name);
+    with_eigenvalues(A, l, l, l);
+    check_against_gsl(A, name);
+    with_eigenvalues(A, l, 0, 0);
+    check_against_gsl(A, name);
+  }
+
+  printf("hermitian3_eigen: %d failures\n", failures);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
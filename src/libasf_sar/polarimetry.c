@@ -4,10 +4,8 @@
 #include "asf_nan.h"
 #include "asf_complex.h"
 #include <assert.h>
+#include "asf_glib.h"
 #include <gsl/gsl_math.h>
-#include <gsl/gsl_complex.h>
-#include <gsl/gsl_complex_math.h>
-#include <gsl/gsl_eigen.h>
 
 #define EPS 1.E-15
 
@@ -395,7 +393,7 @@ static void polarimetric_image_rows_load_next_row(PolarimetricImageRows *self,
 
 
   int row = self->current_row + (self->nrows-1)/2;
-  if (row < self->meta->general->line_count) {
+  if (row >= 0 && row < self->meta->general->line_count) {
     // amplitude, we only store the current row
     if (self->current_row >= 0 && self->amp_band >= 0)
       get_band_float_line(fin, self->meta, self->amp_band,
@@ -510,7 +508,7 @@ static void polarimetric_image_rows_load_next_row(PolarimetricImageRows *self,
     calculate_coherence_for_row(self, last);
   }
   else {
-    // window has scrolled off top of image -- fill with zeros
+    // window has scrolled off the image -- fill with zeros
     for (k=0; k<self->meta->general->sample_count; ++k) {
       if (self->meta->general->image_data_type == POLARIMETRIC_S2_MATRIX ||
           self->meta->general->image_data_type == POLARIMETRIC_IMAGE)
@@ -806,6 +804,31 @@ static double log3(double v)
 int hist_vals[HIST_SIZE][HIST_SIZE][HIST_SIZE];
 int class_map[HIST_SIZE][HIST_SIZE*2];
 
+// Histogram bins counted by one thread but not yet added to hist_vals.
+// A private copy of hist_vals per thread would be far too big, so the
+// threads keep a list of bins instead, and add them in a block at a time.
+typedef struct {
+  int *bins;             // Offsets into hist_vals
+  int count;
+} hist_batch;
+
+static void hist_batch_add(hist_batch *batch, int entropy_index,
+                           int alpha_index, int anisotropy_index)
+{
+  batch->bins[batch->count++] =
+    (entropy_index*HIST_SIZE + alpha_index)*HIST_SIZE + anisotropy_index;
+}
+
+// Add the batch to hist_vals and empty it.  Only one thread at a time.
+static void hist_batch_flush(hist_batch *batch)
+{
+  int *hist = &hist_vals[0][0][0];
+  int ii;
+  for (ii=0; ii<batch->count; ++ii)
+    hist[batch->bins[ii]]++;
+  batch->count = 0;
+}
+
 #define ENTROPY_ALPHA 0
 #define ALPHA_ANISOTROPY 1
 #define ANISOTROPY_ENTROPY 2
@@ -1028,10 +1051,289 @@ static double calc_alpha_real(double e)
   return alpha;
 }
 
-static double calc_alpha(gsl_complex z)
+// Complex arithmetic in double precision, for hermitian3_eigen()
+static inline complexDouble cd_new(double re, double im)
+{
+  complexDouble c;
+  c.real = re;
+  c.imag = im;
+  return c;
+}
+
+static inline complexDouble cd_add(complexDouble a, complexDouble b)
+{
+  return cd_new(a.real + b.real, a.imag + b.imag);
+}
+
+static inline complexDouble cd_sub(complexDouble a, complexDouble b)
+{
+  return cd_new(a.real - b.real, a.imag - b.imag);
+}
+
+static inline complexDouble cd_mul(complexDouble a, complexDouble b)
+{
+  return cd_new(a.real*b.real - a.imag*b.imag, a.real*b.imag + a.imag*b.real);
+}
+
+static inline complexDouble cd_conj(complexDouble a)
+{
+  return cd_new(a.real, -a.imag);
+}
+
+static inline complexDouble cd_scale(complexDouble a, double f)
 {
-  // alpha: acos(e[0]), e=eigenvector of coherence matrix
-  return calc_alpha_real(GSL_REAL(z));
+  return cd_new(a.real*f, a.imag*f);
+}
+
+static inline double cd_amp_sqr(complexDouble a)
+{
+  return a.real*a.real + a.imag*a.imag;
+}
+
+// a x b, with no conjugation -- the result is orthogonal to the rows
+// a and b in the sense that sum(a[i]*c[i]) == sum(b[i]*c[i]) == 0
+static void cd_cross3(const complexDouble *a, const complexDouble *b,
+                      complexDouble *c)
+{
+  c[0] = cd_sub(cd_mul(a[1], b[2]), cd_mul(a[2], b[1]));
+  c[1] = cd_sub(cd_mul(a[2], b[0]), cd_mul(a[0], b[2]));
+  c[2] = cd_sub(cd_mul(a[0], b[1]), cd_mul(a[1], b[0]));
+}
+
+static double cd_norm3_sqr(const complexDouble *v)
+{
+  return cd_amp_sqr(v[0]) + cd_amp_sqr(v[1]) + cd_amp_sqr(v[2]);
+}
+
+// sum(conj(a[i]) * (A b)[i])
+static complexDouble cd_quad3(const complexDouble *a, complexDouble A[3][3],
+                              const complexDouble *b)
+{
+  complexDouble r = cd_new(0, 0);
+  int i, j;
+  for (i=0; i<3; ++i) {
+    complexDouble Ab = cd_new(0, 0);
+    for (j=0; j<3; ++j)
+      Ab = cd_add(Ab, cd_mul(A[i][j], b[j]));
+    r = cd_add(r, cd_mul(cd_conj(a[i]), Ab));
+  }
+  return r;
+}
+
+// Unit vector in the null space of A - lambda*I, from the largest of the
+// cross products of its rows.  Returns FALSE if A - lambda*I is zero.
+static int null_vector3(complexDouble A[3][3], double lambda,
+                        complexDouble *v)
+{
+  complexDouble M[3][3], c[3];
+  double best = 0, n;
+  int i, j;
+
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      M[i][j] = i==j ? cd_new(A[i][j].real - lambda, A[i][j].imag) : A[i][j];
+
+  cd_cross3(M[0], M[1], c);
+  if ((n = cd_norm3_sqr(c)) > best) { best = n; v[0]=c[0]; v[1]=c[1]; v[2]=c[2]; }
+  cd_cross3(M[0], M[2], c);
+  if ((n = cd_norm3_sqr(c)) > best) { best = n; v[0]=c[0]; v[1]=c[1]; v[2]=c[2]; }
+  cd_cross3(M[1], M[2], c);
+  if ((n = cd_norm3_sqr(c)) > best) { best = n; v[0]=c[0]; v[1]=c[1]; v[2]=c[2]; }
+
+  if (!(best > 0))
+    return FALSE;
+  for (i=0; i<3; ++i)
+    v[i] = cd_scale(v[i], 1.0/sqrt(best));
+  return TRUE;
+}
+
+// Eigenvalues and eigenvectors of the 3x3 Hermitian matrix A, worked out
+// in closed form instead of iteratively as gsl_eigen_hermv does -- this
+// is called for every pixel of the image.
+//
+// The eigenvalues are the roots of the characteristic polynomial, found
+// with the trigonometric solution of the cubic.  The eigenvector of the
+// eigenvalue furthest from the other two comes from the cross products of
+// the rows of A - lambda*I, and the other two from the 2x2 problem left in
+// the plane orthogonal to it, so repeated eigenvalues are handled too.
+//
+// As after gsl_eigen_hermv_sort(..., GSL_EIGEN_SORT_ABS_DESC), eval is
+// sorted by decreasing magnitude, and column k of evec is the unit
+// eigenvector of eval[k].  Like gsl_eigen_hermv's, each eigenvector's
+// first element is real (and here non-negative).
+static void hermitian3_eigen(complexDouble A[3][3], double *eval,
+                             complexDouble evec[3][3])
+{
+  double a = A[0][0].real, b = A[1][1].real, c = A[2][2].real;
+  complexDouble d = A[0][1], e = A[0][2], f = A[1][2];
+  double off = cd_amp_sqr(d) + cd_amp_sqr(e) + cd_amp_sqr(f);
+  double q = (a + b + c) / 3.0;
+  double p2 = (a-q)*(a-q) + (b-q)*(b-q) + (c-q)*(c-q) + 2.0*off;
+  double lambda[3];
+  complexDouble v[3][3];  // v[k] is the eigenvector of lambda[k]
+  int i, k;
+
+  if (p2 > 0) {
+    // (A - qI)/p has eigenvalues 2cos(phi + 2*pi*k/3), where
+    // cos(3*phi) = det((A - qI)/p)/2
+    double p = sqrt(p2/6.0);
+    double aq = a-q, bq = b-q, cq = c-q;
+    double det = aq*bq*cq + 2.0*cd_mul(cd_mul(d, f), cd_conj(e)).real
+      - aq*cd_amp_sqr(f) - bq*cd_amp_sqr(e) - cq*cd_amp_sqr(d);
+    double r = det / (2.0*p*p*p);
+    if (r < -1) r = -1;
+    if (r > 1) r = 1;
+    double phi = acos(r) / 3.0;
+    lambda[0] = q + 2.0*p*cos(phi);
+    lambda[2] = q + 2.0*p*cos(phi + 2.0*M_PI/3.0);
+    lambda[1] = 3.0*q - lambda[0] - lambda[2];
+  }
+  else {
+    lambda[0] = lambda[1] = lambda[2] = q;
+  }
+
+  // lambda[0] >= lambda[1] >= lambda[2]; start with whichever end is
+  // better separated, the cubic gives that one accurately
+  int iso = lambda[0]-lambda[1] >= lambda[1]-lambda[2] ? 0 : 2;
+  int ka = iso == 0 ? 1 : 0;
+  int kb = iso == 2 ? 1 : 2;
+
+  if (!null_vector3(A, lambda[iso], v[iso])) {
+    // A is a multiple of the identity
+    for (k=0; k<3; ++k)
+      for (i=0; i<3; ++i)
+        v[k][i] = cd_new(i==k, 0);
+  }
+  else {
+    // u and w: an orthonormal basis of the plane orthogonal to v[iso]
+    complexDouble u[3], w[3], *vi = v[iso];
+    if (cd_amp_sqr(vi[0]) > cd_amp_sqr(vi[1])) {
+      double n = 1.0/sqrt(cd_amp_sqr(vi[0]) + cd_amp_sqr(vi[2]));
+      u[0] = cd_scale(cd_conj(vi[2]), -n);
+      u[1] = cd_new(0, 0);
+      u[2] = cd_scale(cd_conj(vi[0]), n);
+    }
+    else {
+      double n = 1.0/sqrt(cd_amp_sqr(vi[1]) + cd_amp_sqr(vi[2]));
+      u[0] = cd_new(0, 0);
+      u[1] = cd_scale(cd_conj(vi[2]), n);
+      u[2] = cd_scale(cd_conj(vi[1]), -n);
+    }
+    cd_cross3(vi, u, w);
+    for (i=0; i<3; ++i)
+      w[i] = cd_conj(w[i]);
+
+    // A restricted to that plane is [ b00 b01 ; conj(b01) b11 ].  Its
+    // eigenvalues are the other two, and come out more accurately from
+    // this than from the cubic when they are close together.
+    double b00 = cd_quad3(u, A, u).real;
+    double b11 = cd_quad3(w, A, w).real;
+    complexDouble b01 = cd_quad3(u, A, w);
+    double mid = (b00 + b11) / 2.0;
+    double rad = sqrt((b00 - b11)*(b00 - b11)/4.0 + cd_amp_sqr(b01));
+    lambda[ka] = mid + rad;
+    lambda[kb] = mid - rad;
+
+    // eigenvector of lambda[ka] in the plane
+    complexDouble x0 = b01, x1 = cd_new(lambda[ka] - b00, 0);
+    complexDouble y0 = cd_new(b11 - lambda[ka], 0), y1 = cd_scale(cd_conj(b01), -1);
+    if (cd_amp_sqr(y0) + cd_amp_sqr(y1) > cd_amp_sqr(x0) + cd_amp_sqr(x1)) {
+      x0 = y0;
+      x1 = y1;
+    }
+    double n = cd_amp_sqr(x0) + cd_amp_sqr(x1);
+    if (n > 0) {
+      n = 1.0/sqrt(n);
+      x0 = cd_scale(x0, n);
+      x1 = cd_scale(x1, n);
+    }
+    else {
+      // repeated eigenvalue, any vector in the plane will do
+      x0 = cd_new(1, 0);
+      x1 = cd_new(0, 0);
+    }
+    for (i=0; i<3; ++i)
+      v[ka][i] = cd_add(cd_mul(x0, u[i]), cd_mul(x1, w[i]));
+
+    // and the last one is orthogonal to both
+    cd_cross3(vi, v[ka], v[kb]);
+    for (i=0; i<3; ++i)
+      v[kb][i] = cd_conj(v[kb][i]);
+  }
+
+  // make the first elements real
+  for (k=0; k<3; ++k) {
+    double m = sqrt(cd_amp_sqr(v[k][0]));
+    if (m > 0) {
+      complexDouble ph = cd_scale(cd_conj(v[k][0]), 1.0/m);
+      for (i=0; i<3; ++i)
+        v[k][i] = cd_mul(v[k][i], ph);
+      v[k][0].imag = 0;
+    }
+  }
+
+  // sort by decreasing magnitude
+  int order[3] = {0, 1, 2};
+  for (i=0; i<2; ++i)
+    for (k=i+1; k<3; ++k)
+      if (fabs(lambda[order[k]]) > fabs(lambda[order[i]])) {
+        int tmp = order[i];
+        order[i] = order[k];
+        order[k] = tmp;
+      }
+  for (k=0; k<3; ++k) {
+    eval[k] = lambda[order[k]];
+    for (i=0; i<3; ++i)
+      evec[i][k] = v[order[k]][i];
+  }
+}
+
+// Entropy, anisotropy and mean alpha (in degrees) of a coherency matrix
+static void calc_entropy_anisotropy_alpha(complexDouble T[3][3],
+                                          double *entropy, double *anisotropy,
+                                          double *alpha)
+{
+  double eval[3];
+  complexDouble evec[3][3];
+
+  hermitian3_eigen(T, eval, evec);
+
+  double e1 = eval[0];
+  double e2 = eval[1];
+  double e3 = eval[2];
+
+  double eT = e1+e2+e3;
+
+  double P1 = e1/eT;
+  double P2 = e2/eT;
+  double P3 = e3/eT;
+
+  double P1l3 = log3(P1);
+  double P2l3 = log3(P2);
+  double P3l3 = log3(P3);
+
+  // If a Pn value is small enough, the log value will be NaN.
+  // In this case, the value of -Pn*log3(Pn) is supposed to be
+  // zero - we have to force it.
+  *entropy =
+    (meta_is_valid_double(P1l3) ? -P1*P1l3 : 0) +
+    (meta_is_valid_double(P2l3) ? -P2*P2l3 : 0) +
+    (meta_is_valid_double(P3l3) ? -P3*P3l3 : 0);
+
+  if (e2+e3 != 0)
+    *anisotropy = (e2-e3)/(e2+e3);
+  else
+    *anisotropy = 0;
+
+  // calculate the "mean alpha" (mean scattering angle)
+  // this is the polar angle when expressing each eigenvector
+  // in spherical coordinates.  the mean alpha is weighted by
+  // the eigenvector (so weight by P1-3)
+  double alpha1 = calc_alpha_real(evec[0][0].real);
+  double alpha2 = calc_alpha_real(evec[0][1].real);
+  double alpha3 = calc_alpha_real(evec[0][2].real);
+
+  *alpha = R2D*(P1*alpha1 + P2*alpha2 + P3*alpha3);
 }
 
 static void add_boundary(int wide)
@@ -1207,10 +1509,8 @@ do_coherence_bands(int entropy_band, int anisotropy_band, int alpha_band,
                    int class_band,
                    PolarimetricImageRows *img_rows,
                    int line, int l, int multi, int chunk_size,
-                   gsl_matrix_complex *T, gsl_vector *eval,
-                   gsl_matrix_complex *evec, gsl_eigen_hermv_workspace *ws,
                    meta_parameters *outMeta, FILE *fout,
-                   float *buf, classifier_t *classifier)
+                   float *buf, classifier_t *classifier, hist_batch *hist)
 {
   if (entropy_band >= 0 || anisotropy_band >= 0 || alpha_band >= 0 || 
       class_band >= 0)
@@ -1233,54 +1533,43 @@ do_coherence_bands(int entropy_band, int anisotropy_band, int alpha_band,
     // coherence -- do ensemble averaging for each element
     int j;
     for (j=0; j<ns; ++j) {
-      int ii,jj,m;
-      for (ii=0; ii<3; ++ii) {
-        for (jj=0; jj<3; ++jj) {
-          gsl_complex c = gsl_complex_rect(0,0);
-          int k,n=0;
-          for (m=0; m<chunk_size; ++m) {
-            for (k=j-hw;k<=j+hw;++k) {
-              if (k>=0 && k<ns && m+line>l && m+line<onl-l) {
-                ++n;
-                complexFloat f =
-                  img_rows->coh_lines[m][k]->coeff[ii][jj];
-                c = gsl_complex_add_real(c, f.real);
-                c = gsl_complex_add_imag(c, f.imag);
+      complexDouble T[3][3];
+      int ii,jj,k,m,n=0;
+      for (ii=0; ii<3; ++ii)
+        for (jj=ii; jj<3; ++jj)
+          T[ii][jj] = cd_new(0,0);
+      for (m=0; m<chunk_size; ++m) {
+        if (m+line>l && m+line<onl-l) {
+          for (k=j-hw;k<=j+hw;++k) {
+            if (k>=0 && k<ns) {
+              complexFloat **coeff = img_rows->coh_lines[m][k]->coeff;
+              ++n;
+              for (ii=0; ii<3; ++ii) {
+                for (jj=ii; jj<3; ++jj) {
+                  T[ii][jj].real += coeff[ii][jj].real;
+                  T[ii][jj].imag += coeff[ii][jj].imag;
+                }
               }
             }
           }
-          if (n>1) {
-            gsl_complex_div_real(c, (float)n);
-          }
-          gsl_matrix_complex_set(T,ii,jj,c);
         }
       }
-      
-      gsl_eigen_hermv(T, eval, evec, ws);
-      gsl_eigen_hermv_sort(eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-      
-      double e1 = gsl_vector_get(eval, 0);
-      double e2 = gsl_vector_get(eval, 1);
-      double e3 = gsl_vector_get(eval, 2);
-      
-      double eT = e1+e2+e3;
-      
-      double P1 = e1/eT;
-      double P2 = e2/eT;
-      double P3 = e3/eT;
-      
-      double P1l3 = log3(P1);
-      double P2l3 = log3(P2);
-      double P3l3 = log3(P3);
-      
-      // If a Pn value is small enough, the log value will be NaN.
-      // In this case, the value of -Pn*log3(Pn) is supposed to be
-      // zero - we have to force it.
-      entropy[j] =
-        (meta_is_valid_double(P1l3) ? -P1*P1l3 : 0) +
-        (meta_is_valid_double(P2l3) ? -P2*P2l3 : 0) +
-        (meta_is_valid_double(P3l3) ? -P3*P3l3 : 0);
-      
+      // the matrices are Hermitian, so only the upper triangle was summed
+      for (ii=0; ii<3; ++ii) {
+        for (jj=ii; jj<3; ++jj) {
+          if (n>1)
+            T[ii][jj] = cd_scale(T[ii][jj], 1.0/n);
+          T[jj][ii] = cd_conj(T[ii][jj]);
+        }
+        T[ii][ii].imag = 0;
+      }
+
+      double H, A, a;
+      calc_entropy_anisotropy_alpha(T, &H, &A, &a);
+      entropy[j] = H;
+      anisotropy[j] = A;
+      alpha[j] = a;
+
       // mathematically, entropy is limited to be between 0 and 1.
       // however it sometimes is just a bit out of that range due
       // to numerical anomalies
@@ -1291,11 +1580,6 @@ do_coherence_bands(int entropy_band, int anisotropy_band, int alpha_band,
       else if (entropy[j] > 1)
         entropy[j] = 1.0;
       
-      if (e2+e3 != 0)
-        anisotropy[j] = (e2-e3)/(e2+e3);
-      else
-        anisotropy[j] = 0;
-      
       // as for entropy, anisotropy is limited to be between 0 and 1.
       // guard against numerical anomalies (usually this is due to
       // one really big eigenvalue)
@@ -1306,15 +1590,6 @@ do_coherence_bands(int entropy_band, int anisotropy_band, int alpha_band,
       else if (anisotropy[j] > 1)
         anisotropy[j] = 1.0;
       
-      // calculate the "mean alpha" (mean scattering angle)
-      // this is the polar angle when expressing each eigenvector
-      // in spherical coordinates.  the mean alpha is weighted by
-      // the eigenvector (so weight by P1-3)
-      double alpha1 = calc_alpha(gsl_matrix_complex_get(evec, 0, 0));
-      double alpha2 = calc_alpha(gsl_matrix_complex_get(evec, 0, 1));
-      double alpha3 = calc_alpha(gsl_matrix_complex_get(evec, 0, 2));
-      
-      alpha[j] = R2D*(P1*alpha1 + P2*alpha2 + P3*alpha3);
       if (!meta_is_valid_double(alpha[j]))
         alpha[j] = 0.0;
     }
@@ -1349,7 +1624,9 @@ do_coherence_bands(int entropy_band, int anisotropy_band, int alpha_band,
       //       entropy_index, alpha_index,
       //      ea_hist[entropy_index][alpha_index]+1);
       int anisotropy_index = anisotropy[j]*(float)HIST_SIZE;
-      hist_vals[entropy_index][alpha_index][anisotropy_index] += 1;
+      if (anisotropy_index>HIST_SIZE-1) anisotropy_index=HIST_SIZE-1;
+
+      hist_batch_add(hist, entropy_index, alpha_index, anisotropy_index);
     }
 
     free(entropy);
@@ -1736,6 +2013,216 @@ static void do_class_map(classifier_t *classifier, int class_band, int wide,
   }
 }
 
+// Number of threads polarimetric_decomp uses, see
+// polarimetry_set_thread_count
+static int polarimetry_thread_count = 1;
+
+void polarimetry_set_thread_count(int count)
+{
+  polarimetry_thread_count = count > 0 ? count : asf_processor_count();
+}
+
+// Output lines handed out to a thread at a time.  Each block needs
+// chunk_size-1 rows more than it outputs to be read in, so this keeps
+// that overhead small.
+#define LINES_PER_BLOCK 128
+
+// What the threads of polarimetric_decomp share
+typedef struct {
+  GMutex *lock;          // Guards next_line, lines_done and hist_vals
+  int next_line;         // First line of the next block to hand out
+  int lines_done;
+
+  const char *in_img_name, *out_img_name;
+  meta_parameters *inMeta, *outMeta;
+  int chunk_size, multi, onl;
+  int amplitude_band;
+  int pauli_1_band, pauli_2_band, pauli_3_band;
+  int entropy_band, anisotropy_band, alpha_band;
+  int sinclair_1_band, sinclair_2_band, sinclair_3_band;
+  int freeman_1_band, freeman_2_band, freeman_3_band;
+  int class_band;
+  classifier_t *classifier;
+} decomp_job;
+
+// Load the rows needed for output line 'line' into the window.
+//
+// When not multilooking, for chunk_size=5 and line 0 the window is:
+//   *lines[0] = ALL ZEROS
+//   *lines[1] = ALL ZEROS
+//   *lines[2] = line 0 of the image
+//   *lines[3] = line 1 of the image
+//   *lines[4] = line 2 of the image
+// and polarimetric_image_rows_load_next_row slides it down a row for the
+// next line:
+//   *lines[0] = ALL ZEROS
+//   *lines[1] = line 0 of the image
+//   *lines[2] = line 1 of the image
+//   *lines[3] = line 2 of the image
+//   *lines[4] = line 3 of the image
+// we don't actually move the data from line n to line n-1, we just move
+// the pointers.
+//
+// When multilooking, the window is the look_count rows that are combined
+// to produce a single output line.
+static void polarimetric_image_rows_start_at(PolarimetricImageRows *self,
+                                             FILE *fin, int line, int multi)
+{
+  if (multi) {
+    self->current_row = line * self->nrows;
+    polarimetric_image_rows_load_new_rows(self, fin);
+  }
+  else {
+    int k;
+    self->current_row = line - self->nrows;
+    for (k=0; k<self->nrows; ++k)
+      polarimetric_image_rows_load_next_row(self, fin);
+    assert(self->current_row == line);
+  }
+}
+
+// Output line i of the decomposition, from the rows in the window.  Its
+// population histogram bins go into hist.
+static void decompose_line(decomp_job *job, PolarimetricImageRows *img_rows,
+                           int i, FILE *fout, float *buf, hist_batch *hist)
+{
+  // Indicates which line in the various *lines arrays contains
+  // what corresponds to line i in the output. since the line pointers
+  // slide, this never changes.
+  const int l = (job->chunk_size-1)/2;
+  int multi = job->multi, chunk_size = job->chunk_size;
+  meta_parameters *outMeta = job->outMeta;
+
+  // normal amplitude band (usually, this is added to allow terrcorr)
+  if (job->amplitude_band >= 0)
+    put_band_float_line(fout, outMeta, job->amplitude_band, i,
+                        img_rows->amp);
+
+  // if requested, generate sinlair output
+  do_sinclair_bands(job->sinclair_1_band, job->sinclair_2_band,
+                    job->sinclair_3_band,
+                    img_rows, i, l, multi, chunk_size, outMeta, fout, buf);
+
+  // calculate the pauli output (magnitude of already-calculated
+  // complex pauli basis elements), and save the requested pauli
+  // bands in the output
+  do_pauli_bands(job->pauli_1_band, job->pauli_2_band, job->pauli_3_band,
+                 img_rows, i, l, multi, chunk_size, outMeta, fout, buf);
+
+  // Freeman-Durden
+  do_freeman(job->freeman_1_band, job->freeman_2_band, job->freeman_3_band,
+             img_rows, i, l, multi, chunk_size, outMeta, fout);
+
+  // do any polarimetry that uses the coherence matrix
+  do_coherence_bands(job->entropy_band, job->anisotropy_band,
+                     job->alpha_band, job->class_band,
+                     img_rows, i, l, multi, chunk_size,
+                     outMeta, fout, buf, job->classifier, hist);
+}
+
+// Takes blocks of output lines until there are none left.  Each thread
+// has its own window of rows and its own input and output files, and
+// adds its block's histogram counts to hist_vals along with its progress.
+static gpointer decomp_worker(gpointer data)
+{
+  decomp_job *job = (decomp_job *) data;
+  int ns = job->inMeta->general->sample_count;
+  hist_batch hist;
+
+  FILE *fin = fopenImage(job->in_img_name, "rb");
+  FILE *fout = fopenImage(job->out_img_name, "r+b");
+  if (!fin || !fout)
+    asfPrintError("Cannot open %s or %s\n", job->in_img_name,
+                  job->out_img_name);
+
+  // this struct will hold the current row being processed, and
+  // chunk_size/2 rows before & after
+  PolarimetricImageRows *img_rows =
+      polarimetric_image_rows_new(job->inMeta, job->chunk_size, job->multi);
+  polarimetric_image_rows_get_bands(img_rows);
+
+  float *buf = MALLOC(sizeof(float)*ns);
+  hist.bins = MALLOC(sizeof(int)*job->outMeta->general->sample_count*
+                     LINES_PER_BLOCK);
+  hist.count = 0;
+
+  for (;;)
+  {
+    int first, last, i;
+
+    g_mutex_lock(job->lock);
+    first = job->next_line;
+    job->next_line += LINES_PER_BLOCK;
+    g_mutex_unlock(job->lock);
+
+    if (first >= job->onl)
+      break;
+    last = MIN(first + LINES_PER_BLOCK, job->onl);
+
+    polarimetric_image_rows_start_at(img_rows, fin, first, job->multi);
+    for (i=first; i<last; ++i) {
+      decompose_line(job, img_rows, i, fout, buf, &hist);
+
+      // load the next row, if there are still more to go
+      if (i<last-1) {
+        if (job->multi) {
+          polarimetric_image_rows_load_new_rows(img_rows, fin);
+        }
+        else {
+          polarimetric_image_rows_load_next_row(img_rows, fin);
+          assert(img_rows->current_row == i+1);
+        }
+      }
+    }
+
+    g_mutex_lock(job->lock);
+    hist_batch_flush(&hist);
+    job->lines_done += last - first;
+    asfLineMeter(job->lines_done-1, job->onl);
+    g_mutex_unlock(job->lock);
+  }
+
+  polarimetric_image_rows_free(img_rows);
+  FREE(hist.bins);
+  FREE(buf);
+  FCLOSE(fin);
+  FCLOSE(fout);
+  return NULL;
+}
+
+// Runs decomp_worker on polarimetry_thread_count threads, or just in this
+// one.  The lines come out the same either way.
+static void decompose_lines(decomp_job *job)
+{
+  int thread_count = polarimetry_thread_count;
+  int max_threads = (job->onl + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+  int tt;
+
+  if (thread_count > max_threads)
+    thread_count = max_threads;
+
+  asf_thread_init();
+  job->lock = asf_mutex_new();
+  job->next_line = 0;
+  job->lines_done = 0;
+
+  if (thread_count <= 1) {
+    decomp_worker(job);
+  }
+  else {
+    GThread **threads = (GThread **) MALLOC(sizeof(GThread *) * thread_count);
+    for (tt=0; tt<thread_count; ++tt) {
+      threads[tt] = asf_thread_new("polarimetry", decomp_worker, job);
+      if (threads[tt] == NULL)
+        asfPrintError("Failed to create polarimetry thread\n");
+    }
+    for (tt=0; tt<thread_count; ++tt)
+      g_thread_join(threads[tt]);
+    FREE(threads);
+  }
+
+  asf_mutex_free(job->lock);
+}
 void polarimetric_decomp(const char *inFile, const char *outFile,
                          int amplitude_band,
                          int pauli_1_band,
@@ -1786,59 +2273,17 @@ void polarimetric_decomp(const char *inFile, const char *outFile,
 
   // aliases
   int nl = inMeta->general->line_count;
-  int ns = inMeta->general->sample_count;
-
-  FILE *fin = fopenImage(in_img_name, "rb");
-  FILE *fout = fopenImage(out_img_name, "wb");
 
-  // this struct will hold the current row being processed, and
-  // chunk_size/2 rows before & after
+  // make sure all bands we need are there before starting
   PolarimetricImageRows *img_rows =
       polarimetric_image_rows_new(inMeta, chunk_size, multi);
-
-  // make sure all bands we need are there, and find their numbers
-  // and offsets
   int ok = polarimetric_image_rows_get_bands(img_rows);
+  polarimetric_image_rows_free(img_rows);
 
   if (!ok)
       asfPrintError("Not all required bands found-- "
                     "is this SLC quad-pol data?\n");
 
-  float *buf = MALLOC(sizeof(float)*ns);
-
-  // at the start, we want to load the buffers as follows: (for chunk_size=5)
-  //   *lines[0] = ALL ZEROS
-  //   *lines[1] = ALL ZEROS
-  //   *lines[2] = line 0 of the image
-  //   *lines[3] = line 1 of the image
-  //   *lines[4] = line 2 of the image
-  // next time through the loop:
-  //   *lines[0] = ALL ZEROS
-  //   *lines[1] = line 0 of the image
-  //   *lines[2] = line 1 of the image
-  //   *lines[3] = line 2 of the image
-  //   *lines[4] = line 3 of the image
-  // we don't actually move the data from line n to line n-1, we just move
-  // the pointers.  initially, the pointers will match the buffer (as set
-  // in the loop directly above), but the second time through the pointers
-  // slide down one row (line 3 is loaded into the beginning of the buffer,
-  // but line pointer 4 points at the beginning).
-
-  if (multi) {
-    // multilook case:
-    // preload rows --> load look_count rows, these will all be combined
-    // to produce a single output line
-    polarimetric_image_rows_load_new_rows(img_rows, fin);
-  }
-  else {
-    // non-multilook case:
-    // preload rows --> center of window will be row 0.
-    // the next (chunk_size+1)/2 rows are also loaded, and ready to go.
-    for (i=0; i<(chunk_size+1)/2; ++i)
-      polarimetric_image_rows_load_next_row(img_rows, fin);    
-    assert(img_rows->current_row == 0);
-  }
-
   // output metadata differs from input only in the number
   // of bands, and the band names
   char *out_meta_name = appendExt(outFile, ".meta");
@@ -1935,59 +2380,33 @@ void polarimetric_decomp(const char *inFile, const char *outFile,
   //-----------------------------------------------------------------------
   // done setting up metadata, now write the data
 
-  // gsl infrastructure for calculating eigen- vals & vecs for the
-  // coherence matrix
-  gsl_matrix_complex *T = gsl_matrix_complex_alloc(3,3);
-  gsl_vector *eval = gsl_vector_alloc(3);
-  gsl_matrix_complex *evec = gsl_matrix_complex_alloc(3,3);
-  gsl_eigen_hermv_workspace *ws = gsl_eigen_hermv_alloc(3);
-
-  // now loop through the lines of the output image
-  for (i=0; i<onl; ++i) {
-
-      // Indicates which line in the various *lines arrays contains
-      // what corresponds to line i in the output. since the line pointers
-      // slide, this never changes.
-      const int l = (chunk_size-1)/2;
-
-      // normal amplitude band (usually, this is added to allow terrcorr)
-      if (amplitude_band >= 0)
-        put_band_float_line(fout, outMeta, amplitude_band, i, img_rows->amp);
-
-      // if requested, generate sinlair output
-      do_sinclair_bands(sinclair_1_band, sinclair_2_band, sinclair_3_band,
-                        img_rows, i, l, multi, chunk_size, outMeta, fout, buf);
-
-      // calculate the pauli output (magnitude of already-calculated
-      // complex pauli basis elements), and save the requested pauli
-      // bands in the output
-      do_pauli_bands(pauli_1_band, pauli_2_band, pauli_3_band,
-                     img_rows, i, l, multi, chunk_size, outMeta, fout, buf);
-
-
-      // Freeman-Durden
-      do_freeman(freeman_1_band, freeman_2_band, freeman_3_band,
-                 img_rows, i, l, multi, chunk_size, outMeta, fout);
-
-      // do any polarimetry that uses the coherence matrix
-      do_coherence_bands(entropy_band, anisotropy_band, alpha_band, class_band,
-                         img_rows, i, l, multi, chunk_size, T, eval, evec, ws,
-                         outMeta, fout, buf, classifier);
-                         
-
-      // load the next row, if there are still more to go
-      if (i<onl-1) {
-          if (multi) {
-              polarimetric_image_rows_load_new_rows(img_rows, fin);
-          }
-          else {
-              polarimetric_image_rows_load_next_row(img_rows, fin);
-              assert(img_rows->current_row == i+1);
-          }
-      }
-
-      asfLineMeter(i,onl);
-  }
+  // the threads each write their own lines of the output file
+  FCLOSE(fopenImage(out_img_name, "wb"));
+
+  decomp_job job;
+  job.in_img_name = in_img_name;
+  job.out_img_name = out_img_name;
+  job.inMeta = inMeta;
+  job.outMeta = outMeta;
+  job.chunk_size = chunk_size;
+  job.multi = multi;
+  job.onl = onl;
+  job.amplitude_band = amplitude_band;
+  job.pauli_1_band = pauli_1_band;
+  job.pauli_2_band = pauli_2_band;
+  job.pauli_3_band = pauli_3_band;
+  job.entropy_band = entropy_band;
+  job.anisotropy_band = anisotropy_band;
+  job.alpha_band = alpha_band;
+  job.sinclair_1_band = sinclair_1_band;
+  job.sinclair_2_band = sinclair_2_band;
+  job.sinclair_3_band = sinclair_3_band;
+  job.freeman_1_band = freeman_1_band;
+  job.freeman_2_band = freeman_2_band;
+  job.freeman_3_band = freeman_3_band;
+  job.class_band = class_band;
+  job.classifier = classifier;
+  decompose_lines(&job);
 
   if (entropy_band >= 0 || anisotropy_band >= 0 || alpha_band >= 0 || 
       class_band >= 0)
@@ -2014,18 +2433,6 @@ void polarimetric_decomp(const char *inFile, const char *outFile,
     do_class_map(classifier, class_band, wide, outFile);
   }
 
-  gsl_vector_free(eval);
-  gsl_eigen_hermv_free(ws);
-  gsl_matrix_complex_free(evec);
-  gsl_matrix_complex_free(T);
-
-  polarimetric_image_rows_free(img_rows);
-
-  fclose(fin);
-  fclose(fout);
-
-  free(buf);
-
   free(out_img_name);
   free(in_img_name);
   free(meta_name);
@@ -2126,62 +2533,25 @@ void cpx2freeman_durden(const char *inFile, const char *outFile, int tc_flag)
                         NULL,-1);
 }
 
-static gsl_matrix *make_diag3(double e00, double e11, double e22)
+static void make_diag3(double e00, double e11, double e22,
+                       complexDouble T[3][3])
 {
-  gsl_matrix *mat = gsl_matrix_calloc(3, 3);
-  gsl_matrix_set(mat, 0, 0, e00);
-  gsl_matrix_set(mat, 1, 1, e11);
-  gsl_matrix_set(mat, 2, 2, e22);
-  return mat;
+  int i, j;
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      T[i][j] = cd_new(0, 0);
+  T[0][0].real = e00;
+  T[1][1].real = e11;
+  T[2][2].real = e22;
 }
 
-static void calc_entropy_alpha(gsl_matrix *mat, double *entropy, double *alpha)
+static void calc_entropy_alpha(complexDouble T[3][3], double *entropy,
+                               double *alpha)
 {
-  gsl_vector *eval = gsl_vector_alloc(3);
-  gsl_matrix *evec = gsl_matrix_alloc(3,3);
-
-  gsl_eigen_symmv_workspace *w = gsl_eigen_symmv_alloc(3);
-  gsl_eigen_symmv(mat, eval, evec, w);
-  gsl_eigen_symmv_free(w);
-
-  gsl_eigen_symmv_sort(eval, evec, GSL_EIGEN_SORT_ABS_ASC);
-
-  double e1 = gsl_vector_get(eval, 0);
-  double e2 = gsl_vector_get(eval, 1);
-  double e3 = gsl_vector_get(eval, 2);
-
-  double eT = e1+e2+e3;
-
-  double P1 = e1/eT;
-  double P2 = e2/eT;
-  double P3 = e3/eT;
-
-  double P1l3 = log3(P1);
-  double P2l3 = log3(P2);
-  double P3l3 = log3(P3);
-
-  // If a Pn value is small enough, the log value will be NaN.
-  // In this case, the value of -Pn*log3(Pn) is supposed to be
-  // zero - we have to force it.
-  *entropy =
-    (meta_is_valid_double(P1l3) ? -P1*P1l3 : 0) +
-    (meta_is_valid_double(P2l3) ? -P2*P2l3 : 0) +
-    (meta_is_valid_double(P3l3) ? -P3*P3l3 : 0);
-
-  // calculate the "mean alpha" (mean scattering angle)
-  // this is the polar angle when expressing each eigenvector
-  // in spherical coordinates.  the mean alpha is weighted by
-  // the eigenvector (so weight by P1-3)
-  double alpha1 = calc_alpha_real(gsl_matrix_get(evec, 0, 0));
-  double alpha2 = calc_alpha_real(gsl_matrix_get(evec, 0, 1));
-  double alpha3 = calc_alpha_real(gsl_matrix_get(evec, 0, 2));
-
-  *alpha = R2D*(P1*alpha1 + P2*alpha2 + P3*alpha3);
+  double anisotropy;
+  calc_entropy_anisotropy_alpha(T, entropy, &anisotropy, alpha);
   if (!meta_is_valid_double(*alpha))
     *alpha = 0.0;
-
-  gsl_vector_free(eval);
-  gsl_matrix_free(evec);
 }
 
 void make_entropy_alpha_boundary(const char *fname, int size)
@@ -2210,6 +2580,7 @@ void make_entropy_alpha_boundary(const char *fname, int size)
  
   int i;
   double entropy, alpha;
+  complexDouble T[3][3];
 
   // Generate the top curve by finding the eigenvalues of
   // the matrix:
@@ -2220,10 +2591,9 @@ void make_entropy_alpha_boundary(const char *fname, int size)
 
   for (i=0; i<numtop; ++i) {
     double m = (double)i / (double)(numtop-1);
-    gsl_matrix *mat = make_diag3(1, m, m);
-    calc_entropy_alpha(mat, &entropy, &alpha);
+    make_diag3(1, m, m, T);
+    calc_entropy_alpha(T, &entropy, &alpha);
     fprintf(fp,"%f,%f\n",entropy,alpha);
-    gsl_matrix_free(mat);
     asfPercentMeter((double)i/size);
   }
 
@@ -2237,10 +2607,9 @@ void make_entropy_alpha_boundary(const char *fname, int size)
 
   for (i=0; i<numbot1; ++i) {
     double m = (double)i / (double)(numbot1-1);
-    gsl_matrix *mat = make_diag3(1, 1, m);
-    calc_entropy_alpha(mat, &entropy, &alpha);
+    make_diag3(1, 1, m, T);
+    calc_entropy_alpha(T, &entropy, &alpha);
     fprintf(fp,"%f,%f\n",entropy,alpha);
-    gsl_matrix_free(mat);
     asfPercentMeter((double)(i+numtop)/size);
   }
 
@@ -2254,10 +2623,9 @@ void make_entropy_alpha_boundary(const char *fname, int size)
 
   for (i=0; i<numbot2; ++i) {
     double m = (double)i / (double)(numbot2-1);
-    gsl_matrix *mat = make_diag3(m, 1, 1);
-    calc_entropy_alpha(mat, &entropy, &alpha);
+    make_diag3(m, 1, 1, T);
+    calc_entropy_alpha(T, &entropy, &alpha);
     fprintf(fp,"%f,%f\n",entropy,alpha);    
-    gsl_matrix_free(mat);
     asfPercentMeter((double)(i+numtop+numbot1)/size);
   }
 
@@ -12,6 +12,7 @@
 #include <assert.h>
 
 #include <asf.h>
+#include <asf_glib.h>
 #include <asf_endian.h>
 #include <asf_meta.h>
 #include <asf_raster.h>
@@ -96,42 +97,73 @@ static void clean(const char *file)
     }
 }
 
+// Read the first band of an image into memory, as fftMatch() would see
+// it (i.e. without the radiometry conversion that
+// float_image_new_from_metadata() does).
+static FloatImage *read_float_image(char *file)
+{
+  meta_parameters *meta = meta_read(file);
+  int nl = meta->general->line_count;
+  int ns = meta->general->sample_count;
+  FloatImage *image = float_image_new(ns, nl);
+  float *buf = MALLOC(sizeof(float)*ns);
+  FILE *fp = fopenImage(file, "rb");
+  int ii;
+
+  for (ii=0; ii<nl; ii++) {
+    get_float_line(fp, meta, ii, buf);
+    float_image_set_region(image, 0, ii, ns, 1, buf);
+  }
+
+  FCLOSE(fp);
+  FREE(buf);
+  meta_free(meta);
+
+  return image;
+}
+
 static void
-fftMatchQ(char *file1, char *file2, float *dx, float *dy, float *cert,
-          int use_grid_matching)
+fftMatchQ(FloatImage *image1, FloatImage *image2, float *dx, float *dy,
+          float *cert)
 {
   int qf_saved = quietflag;
   //quietflag = 1;
   quietflag = 0;
 
-  if (use_grid_matching) {
-    char match_file[256];
-    strcpy(match_file,"fft_match.txt");
-    fftMatch_gridded(file1, file2, match_file, dx, dy, cert, -1, -1, -1);
-  }
-  else {
-    fftMatch(file1, file2, NULL, dx, dy, cert);
-    asfPrintStatus("Regular matching: dx=%6.3f, dy=%6.3f\n", *dx, *dy);
-
-    // We don't do this for the grid matching, as that already does
-    // forward & backward matching on each grid section
-
-    if (!meta_is_valid_double(*dx) || !meta_is_valid_double(*dy) || cert==0) {
-      // bad match the first way, sometimes we can get a good match by
-      // reversing the order (chips are taken from the other file)
-      // in this case, any valid offsets will need to be flipped
-      fftMatch(file2, file1, NULL, dx, dy, cert);
-
-      if (meta_is_valid_double(*dx))
-          *dx = -(*dx);
-      if (meta_is_valid_double(*dy))
-          *dy = -(*dy);
-    }
+  fftMatch_image(image1, image2, dx, dy, cert);
+  asfPrintStatus("Regular matching: dx=%6.3f, dy=%6.3f\n", *dx, *dy);
+
+  if (!meta_is_valid_double(*dx) || !meta_is_valid_double(*dy) || cert==0) {
+    // bad match the first way, sometimes we can get a good match by
+    // reversing the order (chips are taken from the other image)
+    // in this case, any valid offsets will need to be flipped
+    fftMatch_image(image2, image1, dx, dy, cert);
+
+    if (meta_is_valid_double(*dx))
+        *dx = -(*dx);
+    if (meta_is_valid_double(*dy))
+        *dy = -(*dy);
   }
 
   quietflag = qf_saved;
 }
 
+// The grid matching variant of fftMatchQ, which still works from files.
+// We don't do the reverse match for the grid matching, as that already
+// does forward & backward matching on each grid section.
+static void
+fftMatchQ_gridded(char *file1, char *file2, float *dx, float *dy, float *cert)
+{
+  int qf_saved = quietflag;
+  quietflag = 0;
+
+  char match_file[256];
+  strcpy(match_file,"fft_match.txt");
+  fftMatch_gridded(file1, file2, match_file, dx, dy, cert, -1, -1, -1);
+
+  quietflag = qf_saved;
+}
+
 static int mini(int a, int b)
 {
   return a < b ? a : b;
@@ -149,31 +181,93 @@ static void update_meta_offsets(const char *filename, double t_offset,
     meta_free(meta);
 }
 
+// Cut out the same region of both images (with trim()'s conventions)
+// and match the two chips.
+static void
+match_chips(FloatImage *image1, FloatImage *image2,
+            long long startX, long long startY, long long sizeX,
+            long long sizeY, float *dx, float *dy, float *cert)
+{
+  FloatImage *chip1 = trim_float_image(image1, startX, startY, sizeX, sizeY);
+  FloatImage *chip2 = trim_float_image(image2, startX, startY, sizeX, sizeY);
+
+  fftMatchQ(chip1, chip2, dx, dy, cert);
+
+  float_image_free(chip2);
+  float_image_free(chip1);
+}
+
+// Copy the size by size chip with top left corner (startX, startY) out
+// of image, padding with zeros where it runs off the image, as trim()
+// would.
+static void
+get_chip(FloatImage *image, int startX, int startY, int size, float *chip)
+{
+  int x0 = startX > 0 ? startX : 0;
+  int y0 = startY > 0 ? startY : 0;
+  int x1 = mini(startX + size, image->size_x);
+  int y1 = mini(startY + size, image->size_y);
+  int ii;
+
+  memset(chip, 0, sizeof(float)*size*size);
+  if (x1 <= x0)
+    return;
+  for (ii=y0; ii<y1; ii++)
+    float_image_get_region(image, x0, ii, x1-x0, 1,
+                           chip + (ii-startY)*size + (x0-startX));
+}
+
+// One of the corner matches done by fftMatch_atCorners.
+typedef struct {
+  fft_match_plan_t *plan;
+  float *sar_chip, *dem_chip;
+  int size;
+  float dx, dy, cert;
+} corner_match_t;
+
+// Thread function: match one pair of corner chips the way fftMatchQ()
+// does, including the reversed match when the first one fails.
+static gpointer
+corner_match_thread(gpointer data)
+{
+  corner_match_t *cm = (corner_match_t *) data;
+
+  fftMatch_chips(cm->plan, cm->sar_chip, cm->size, cm->dem_chip, cm->size,
+                 &cm->dx, &cm->dy, &cm->cert);
+
+  if (!meta_is_valid_double(cm->dx) || !meta_is_valid_double(cm->dy)) {
+    fftMatch_chips(cm->plan, cm->dem_chip, cm->size, cm->sar_chip, cm->size,
+                   &cm->dx, &cm->dy, &cm->cert);
+    if (meta_is_valid_double(cm->dx))
+      cm->dx = -(cm->dx);
+    if (meta_is_valid_double(cm->dy))
+      cm->dy = -(cm->dy);
+  }
+
+  return NULL;
+}
+
+// Match a chip of size by size pixels at each corner of the sar and
+// (simulated sar) dem images.  The chips are cut out in memory and the
+// four corners are matched at the same time, each in its own thread
+// with its own fft plan.
 static void
-fftMatch_atCorners(char *output_dir, char *sar, char *dem, const int size)
+fftMatch_atCorners(FloatImage *sar, FloatImage *dem, const int size)
 {
+  static const char *corner_names[4] = { "UR", "UL", "LR", "LL" };
+  corner_match_t corners[4];
+  GThread *threads[4];
   float dx_ur, dy_ur;
   float dx_ul, dy_ul;
   float dx_lr, dy_lr;
   float dx_ll, dy_ll;
-  float cert;
   double rsf, asf;
+  int ii;
 
-  char *chopped_sar, *chopped_dem;
   int nl, ns;
-  meta_parameters *meta_sar, *meta_dem;
-  long long lsz = (long long)size;
-
-  meta_sar = meta_read(sar);
-  meta_dem = meta_read(dem);
-
-  chopped_sar = getOutName(output_dir, sar, "_chip");
-  chopped_dem = getOutName(output_dir, dem, "_chip");
 
-  nl = mini(meta_sar->general->line_count, meta_dem->general->line_count);
-  ns = mini(meta_sar->general->sample_count, meta_dem->general->sample_count);
-
-  meta_free(meta_dem);
+  nl = mini(sar->size_y, dem->size_y);
+  ns = mini(sar->size_x, dem->size_x);
 
   // Require the image be 4x the chip size in each direction, otherwise
   // the corner matching isn't really that meaningful
@@ -182,52 +276,57 @@ fftMatch_atCorners(char *output_dir, char *sar, char *dem, const int size)
   //  return;
   //}
 
-  trim(sar, chopped_sar, (long long)0, (long long)0, lsz, lsz);
-  trim(dem, chopped_dem, (long long)0, (long long)0, lsz, lsz);
-
-  fftMatchQ(chopped_sar, chopped_dem, &dx_ur, &dy_ur, &cert, FALSE);
-  asfPrintStatus("UR: %14.10f %14.10f %14.10f\n", dx_ur, dy_ur, cert);
-
-  trim(sar, chopped_sar, (long long)(ns-size), (long long)0, lsz, lsz);
-  trim(dem, chopped_dem, (long long)(ns-size), (long long)0, lsz, lsz);
-
-  fftMatchQ(chopped_sar, chopped_dem, &dx_ul, &dy_ul, &cert, FALSE);
-  asfPrintStatus("UL: %14.10f %14.10f %14.10f\n", dx_ul, dy_ul, cert);
-
-  trim(sar, chopped_sar, (long long)0, (long long)(nl-size), lsz, lsz);
-  trim(dem, chopped_dem, (long long)0, (long long)(nl-size), lsz, lsz);
+  int start_x[4] = { 0, ns-size, 0, ns-size };
+  int start_y[4] = { 0, 0, nl-size, nl-size };
+
+  // The plans have to be set up before the threads are started.
+  asf_thread_init();
+  for (ii=0; ii<4; ii++) {
+    corner_match_t *cm = &corners[ii];
+    cm->size = size;
+    cm->sar_chip = MALLOC(sizeof(float)*size*size);
+    cm->dem_chip = MALLOC(sizeof(float)*size*size);
+    get_chip(sar, start_x[ii], start_y[ii], size, cm->sar_chip);
+    get_chip(dem, start_x[ii], start_y[ii], size, cm->dem_chip);
+    cm->plan = fft_match_plan_new(size, size);
+  }
 
-  fftMatchQ(chopped_sar, chopped_dem, &dx_lr, &dy_lr, &cert, FALSE);
-  asfPrintStatus("LR: %14.10f %14.10f %14.10f\n", dx_lr, dy_lr, cert);
+  for (ii=0; ii<4; ii++) {
+    threads[ii] = asf_thread_new("fftMatch_atCorners", corner_match_thread,
+                                 &corners[ii]);
+    if (threads[ii] == NULL)
+      corner_match_thread(&corners[ii]);
+  }
 
-  trim(sar, chopped_sar, (long long)(ns-size), (long long)(nl-size),
-       lsz, lsz);
-  trim(dem, chopped_dem, (long long)(ns-size), (long long)(nl-size),
-       lsz, lsz);
+  for (ii=0; ii<4; ii++) {
+    corner_match_t *cm = &corners[ii];
+    if (threads[ii])
+      g_thread_join(threads[ii]);
+    asfPrintStatus("%s: %14.10f %14.10f %14.10f\n", corner_names[ii],
+                   cm->dx, cm->dy, cm->cert);
+    fft_match_plan_free(cm->plan);
+    FREE(cm->dem_chip);
+    FREE(cm->sar_chip);
+  }
 
-  fftMatchQ(chopped_sar, chopped_dem, &dx_ll, &dy_ll, &cert, FALSE);
-  asfPrintStatus("LL: %14.10f %14.10f %14.10f\n", dx_ll, dy_ll, cert);
+  dx_ur = corners[0].dx; dy_ur = corners[0].dy;
+  dx_ul = corners[1].dx; dy_ul = corners[1].dy;
+  dx_lr = corners[2].dx; dy_lr = corners[2].dy;
+  dx_ll = corners[3].dx; dy_ll = corners[3].dy;
 
   asfPrintStatus("Range shift: %14.10f top\n", (double)(dx_ul-dx_ur));
   asfPrintStatus("             %14.10f bottom\n", (double)(dx_ll-dx_lr));
   asfPrintStatus("   Az shift: %14.10f left\n", (double)(dy_ul-dy_ll));
   asfPrintStatus("             %14.10f right\n\n", (double)(dy_ur-dy_lr));
 
-  nl = meta_sar->general->line_count;
-  ns = meta_sar->general->sample_count;
+  nl = sar->size_y;
+  ns = sar->size_x;
 
   rsf = 1 - (fabs((double)(dx_ul-dx_ur)) + fabs((double)(dx_ll-dx_lr)))/ns/2;
   asf = 1 - (fabs((double)(dy_ul-dy_ll)) + fabs((double)(dy_ur-dy_lr)))/nl/2;
 
   asfPrintStatus("Suggested scale factors: %14.10f range\n", rsf);
   asfPrintStatus("                         %14.10f azimuth\n\n", asf);
-
-  meta_free(meta_sar);
-
-  clean(chopped_sar);
-  clean(chopped_dem);
-  free(chopped_sar);
-  free(chopped_dem);
 }
 
 int asf_terrcorr(char *sarFile, char *demFile, char *userMaskFile,
@@ -659,6 +758,11 @@ int match_dem(meta_parameters *metaSAR,
 {
   char *demClipped = NULL, *demSlant = NULL;
   char *demSimSar = NULL;
+  // The slant range SAR image, simulated SAR image and simulated SAR
+  // image trimmed to the size of the SAR image, held in memory while
+  // matching so they needn't be written out and reread for each match.
+  FloatImage *srImage = NULL, *simSarImage = NULL, *trimSimSarImage = NULL;
+  int need_images = userMaskFile || matching_level != MATCHING_NONE;
   int num_attempts = 0;
   const int max_attempts = 10; // # of times we re-try co-registration
   const float required_match = 2.5;
@@ -743,14 +847,29 @@ int match_dem(meta_parameters *metaSAR,
     reskew_dem_rad(srFile, demClipped, demSlant, demGround, demSimSar,
                    userMaskClipped, metaSAR->general->radiometry,add_speckle);
 
-    // Resize the simulated sar image to match the slant range SAR image.
-    asfPrintStatus("Resizing simulated sar image...\n");
-    trim(demSimSar, demTrimSimSar, 0, 0, metaSAR->general->sample_count,
-     demHeight);
-
-    if (!add_speckle)
+    if (!add_speckle) {
+      trim(demSimSar, demTrimSimSar, 0, 0, metaSAR->general->sample_count,
+           demHeight);
       asfPrintError("User specified no speckle -- quitting.\n"
                     "Simulated SAR image is %s.img\n", demTrimSimSar);
+    }
+
+    // Resize the simulated sar image to match the slant range SAR image.
+    // This is done in memory, the trimmed image is written out once the
+    // offsets are known.
+    if (need_images) {
+      asfPrintStatus("Resizing simulated sar image...\n");
+      if (!srImage)
+        srImage = read_float_image(srFile);
+      if (simSarImage) {
+        float_image_free(simSarImage);
+        float_image_free(trimSimSarImage);
+      }
+      simSarImage = read_float_image(demSimSar);
+      trimSimSarImage = trim_float_image(simSarImage, 0, 0,
+                                         metaSAR->general->sample_count,
+                                         demHeight);
+    }
 
     if (matching_level != 0)
       asfPrintStatus("Determining image offsets...\n");
@@ -827,17 +946,8 @@ int match_dem(meta_parameters *metaSAR,
 
               good_pct_list[ii_chosen] = 0; // prevent future selection
 
-              char *demTrimSimSar_ffft = getOutName(output_dir, demFile,
-                                                    "_sim_sar_trim_for_fft");
-              char *srTrimSimSar = getOutName(output_dir, srFile,
-                                              "_src_trim_for_fft");
-
-              //asfPrintStatus("Creating trimmed regions:\n %s->%s\n %s->%s\n",
-              //               demTrimSimSar, demTrimSimSar_ffft,
-              //               srFile, srTrimSimSar);
-              trim(demTrimSimSar, demTrimSimSar_ffft,xtl,ytl,xbr-xtl,ybr-ytl);
-              trim(srFile, srTrimSimSar, xtl, ytl, xbr-xtl, ybr-ytl);
-              fftMatchQ(srTrimSimSar, demTrimSimSar_ffft, &dx, &dy, &cert, FALSE);
+              match_chips(srImage, trimSimSarImage, xtl, ytl, xbr-xtl,
+                          ybr-ytl, &dx, &dy, &cert);
 
               if (cert < cert_cutoff) {
                   asfPrintStatus("Match: %.2f%% certainty. (%f,%f)\n"
@@ -846,12 +956,6 @@ int match_dem(meta_parameters *metaSAR,
                                  100*cert, dx, dy, 100*cert_cutoff);
               }
 
-              clean(demTrimSimSar_ffft);
-              clean(srTrimSimSar);
-
-              FREE(demTrimSimSar_ffft);
-              FREE(srTrimSimSar);
-
           } while (!(cert > cert_cutoff)); // guard against NANs
       }
 
@@ -881,12 +985,19 @@ int match_dem(meta_parameters *metaSAR,
       // This is the normal case -- no user mask, regular matching
       // Match the real and simulated SAR image to determine the offset.
       int use_grid_matching = matching_level == MATCHING_GRID;
-      fftMatchQ(srFile, demTrimSimSar, &dx, &dy, &cert, use_grid_matching);
-
-      // Now that we've generated the grid, we are done, user must use
-      // fit_warp and remap
-      if (use_grid_matching)
+      if (use_grid_matching) {
+        // Grid matching works from files.  Now that we've generated the
+        // grid, we are done, user must use fit_warp and remap
+        trim(demSimSar, demTrimSimSar, 0, 0, metaSAR->general->sample_count,
+             demHeight);
+        fftMatchQ_gridded(srFile, demTrimSimSar, &dx, &dy, &cert);
+        float_image_free(trimSimSarImage);
+        float_image_free(simSarImage);
+        float_image_free(srImage);
         return 0;
+      }
+
+      fftMatchQ(srImage, trimSimSarImage, &dx, &dy, &cert);
 
       asfPrintStatus("Correlation (cert=%5.2f%%): dx=%f, dy=%f.\n",
              100*cert, dx, dy);
@@ -966,7 +1077,7 @@ int match_dem(meta_parameters *metaSAR,
       int chipsz = 256;
       asfPrintStatus("Doing corner fftMatching... (using %dx%d chips)\n",
              chipsz, chipsz);
-      fftMatch_atCorners(output_dir, srFile, demTrimSimSar, chipsz);
+      fftMatch_atCorners(srImage, trimSimSarImage, chipsz);
     }
 
     // Apply the offset to the simulated sar image.
@@ -979,7 +1090,11 @@ int match_dem(meta_parameters *metaSAR,
       float dx2, dy2;
 
       asfPrintStatus("Verifying offsets are now close to zero...\n");
-      fftMatchQ(srFile, demTrimSimSar, &dx2, &dy2, &cert, FALSE);
+      FloatImage *shiftedSimSarImage =
+        trim_float_image(simSarImage, idx, idy,
+                         metaSAR->general->sample_count, demHeight);
+      fftMatchQ(srImage, shiftedSimSarImage, &dx2, &dy2, &cert);
+      float_image_free(shiftedSimSarImage);
 
       asfPrintStatus("Correlation after shift (cert=%5.2f%%): "
                      "dx=%f, dy=%f.\n",
@@ -1006,6 +1121,9 @@ int match_dem(meta_parameters *metaSAR,
           clean(demClipped);   FREE(demClipped);
           clean(demSimSar);    FREE(demSimSar);
           clean(demSlant);     FREE(demSlant);
+          float_image_free(trimSimSarImage);
+          float_image_free(simSarImage);
+          float_image_free(srImage);
 	 
           // restore original shifts
           metaSAR->sar->time_shift = saved_time_shift;
@@ -1061,6 +1179,20 @@ int match_dem(meta_parameters *metaSAR,
       }
     }
   }
+  else {
+    // No offsets to apply, just resize the simulated sar image to match
+    // the slant range SAR image.
+    asfPrintStatus("Resizing simulated sar image...\n");
+    trim(demSimSar, demTrimSimSar, 0, 0, metaSAR->general->sample_count,
+         demHeight);
+  }
+
+  if (trimSimSarImage) {
+    float_image_free(trimSimSarImage);
+    float_image_free(simSarImage);
+  }
+  if (srImage)
+    float_image_free(srImage);
 
   if (do_trim_slant_range_dem)
   {
@@ -90,7 +90,8 @@ void usage(char *name)
 {
  printf("\n"
 	"USAGE:\n"
-	"   %s [-log <file>] <out.ext> \"exp\" <inA.ext> [<inB.ext> [...]]\n",
+	"   %s [-log <file>] [-threads <count>]\n"
+	"      <out.ext> \"exp\" <inA.ext> [<inB.ext> [...]]\n",
 	name);
  printf("\n"
 	"REQUIRED ARGUMENTS:\n"
@@ -101,7 +102,11 @@ void usage(char *name)
 	"OPTIONAL ARGUMENTS:\n"
 	"   [<inB.ext>]      Optional second input image with extension.\n"
 	"   [...]            Optional additional images with extension.\n"
-	"   [-log <file>]    Option to have output written to a log file.\n");
+	"   [-log <file>]    Option to have output written to a log file.\n"
+	"   [-threads <count>]\n"
+	"                    Number of threads to use.  The default is 1, 0 uses\n"
+	"                    one thread per processor.  The output is the same\n"
+	"                    for any number of threads.\n");
  printf("\n"
 	"DESCRIPTION:\n"
 	"   Creates an output ASF tools format image based upon the\n"
@@ -132,6 +137,10 @@ int main(int argc,char **argv)
       fLog = FOPEN(logFile,"a");
       logflag=TRUE;
     }
+    else if (strmatch(key,"-threads")) {
+      CHECK_ARG(1); /*one integer argument: thread count */
+      raster_calc_set_thread_count(atoi(GET_ARG(1)));
+    }
   }
 
   outFile = argv[currArg++];